@@ -36,6 +36,7 @@
 #include "util/u_pack_color.h"
 #include "sp_clear.h"
 #include "sp_context.h"
+#include "sp_query.h"
 #include "sp_surface.h"
 #include "sp_state.h"
 #include "sp_tile_cache.h"
@@ -56,6 +57,8 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers, const float *rgba,
    if (softpipe->no_rast)
       return;
 
+   sp_timer_begin(softpipe);
+
 #if 0
    softpipe_update_derived(softpipe); /* not needed?? */
 #endif
@@ -86,4 +89,6 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers, const float *rgba,
       pipe->surface_fill(pipe, ps, 0, 0, ps->width, ps->height, cv);
 #endif
       }
+
+   sp_timer_end(softpipe);
 }
@@ -37,9 +37,11 @@
 #include "sp_clear.h"
 #include "sp_context.h"
 #include "sp_flush.h"
+#include "sp_gen_mipmap.h"
 #include "sp_prim_setup.h"
 #include "sp_prim_vbuf.h"
 #include "sp_state.h"
+#include "sp_stats.h"
 #include "sp_surface.h"
 #include "sp_tile_cache.h"
 #include "sp_texture.h"
@@ -105,6 +107,8 @@ static void softpipe_destroy( struct pipe_context *pipe )
       softpipe->quad[i].output->destroy( softpipe->quad[i].output );
    }
 
+   sp_destroy_stats( softpipe );
+
    for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++)
       sp_destroy_tile_cache(softpipe->cbuf_cache[i]);
    sp_destroy_tile_cache(softpipe->zsbuf_cache);
@@ -281,6 +285,8 @@ softpipe_create( struct pipe_screen *screen )
                          (struct tgsi_sampler **)
                             softpipe->tgsi.vert_samplers_list);
 
+   sp_init_stats(softpipe);
+
    softpipe->setup = sp_draw_render_stage(softpipe);
    if (!softpipe->setup)
       goto fail;
@@ -307,6 +313,7 @@ softpipe_create( struct pipe_screen *screen )
 #endif
 
    sp_init_surface_functions(softpipe);
+   sp_init_gen_mipmap_functions(softpipe);
 
    return &softpipe->pipe;
 
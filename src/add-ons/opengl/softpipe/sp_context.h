@@ -36,6 +36,7 @@
 #include "draw/draw_vertex.h"
 
 #include "sp_quad_pipe.h"
+#include "sp_stats.h"
 #include "sp_tex_sample.h"
 
 
@@ -94,6 +95,17 @@ struct softpipe_context {
    uint64_t occlusion_count;
    unsigned active_query_count;
 
+   /** Pipeline statistics and stage timing */
+   struct sp_stats stats;
+
+   /** Time spent rendering, for time elapsed queries, see sp_query.h */
+   struct {
+      uint64_t elapsed;     /**< usecs, while a query is active */
+      uint64_t start;       /**< start of the outermost timed call, or 0 */
+      unsigned depth;       /**< nesting of timed calls */
+      unsigned active_query_count;
+   } timer;
+
    /** Mapped vertex buffers */
    ubyte *mapped_vbuffer[PIPE_MAX_ATTRIBS];
    
@@ -129,6 +141,9 @@ struct softpipe_context {
       struct quad_stage *output;
 
       struct quad_stage *first; /**< points to one of the above stages */
+
+      /** Timing wrappers for the above, with SP_STATS */
+      struct quad_stage *timed[SP_STAGE_COUNT];
    } quad[SP_NUM_QUAD_THREADS];
 
    /** TGSI exec things */
@@ -38,6 +38,7 @@
 #include "util/u_prim.h"
 
 #include "sp_context.h"
+#include "sp_query.h"
 #include "sp_state.h"
 
 #include "draw/draw_context.h"
@@ -113,6 +114,8 @@ softpipe_draw_range_elements(struct pipe_context *pipe,
    struct draw_context *draw = sp->draw;
    unsigned i;
 
+   sp_timer_begin(sp);
+
    sp->reduced_api_prim = u_reduced_prim(mode);
 
    if (sp->dirty)
@@ -168,6 +171,8 @@ softpipe_draw_range_elements(struct pipe_context *pipe,
    softpipe_unmap_constant_buffers(sp);
 
    sp->dirty_render_cache = TRUE;
+
+   sp_timer_end(sp);
    
    return TRUE;
 }
@@ -34,8 +34,10 @@
 #include "draw/draw_context.h"
 #include "sp_flush.h"
 #include "sp_context.h"
+#include "sp_query.h"
 #include "sp_surface.h"
 #include "sp_state.h"
+#include "sp_stats.h"
 #include "sp_tile_cache.h"
 #include "sp_winsys.h"
 
@@ -48,6 +50,8 @@ softpipe_flush( struct pipe_context *pipe,
    struct softpipe_context *softpipe = softpipe_context(pipe);
    uint i;
 
+   sp_timer_begin(softpipe);
+
    draw_flush(softpipe->draw);
 
    if (flags & PIPE_FLUSH_TEXTURE_CACHE) {
@@ -87,7 +91,11 @@ softpipe_flush( struct pipe_context *pipe,
       ++frame_no;
    }
 #endif
+
+   sp_timer_end(softpipe);
    
+   sp_stats_flush(softpipe);
+
    if (fence)
       *fence = NULL;
 }
@@ -0,0 +1,338 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * Mipmap generation for softpipe.
+ *
+ * Rendering each level through the quad pipeline (util/u_gen_mipmap.c)
+ * or going through the generic _mesa_generate_mipmap() code is slow on a
+ * software rasterizer.  For textures with 8-bit unorm channels, which is
+ * what nearly all applications use, each level is instead computed
+ * directly with a 2x2 box filter.  Every byte of a texel is a channel
+ * of its own, so one kernel covers all such formats regardless of the
+ * channel order.  Large levels are split across several threads.
+ */
+
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_format.h"
+#include "pipe/p_thread.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_sse.h"
+#include "util/u_time.h"
+
+#include "sp_context.h"
+#include "sp_flush.h"
+#include "sp_gen_mipmap.h"
+#include "sp_query.h"
+#include "sp_texture.h"
+
+
+/** Max number of threads working on one level */
+#define SP_MIPMAP_MAX_THREADS 8
+
+/** Don't bother with threads for less destination rows than this */
+#define SP_MIPMAP_ROWS_PER_THREAD 64
+
+
+/**
+ * A range of destination rows to compute.
+ */
+struct sp_mipmap_job
+{
+   const ubyte *src;
+   unsigned src_stride, src_width, src_height;
+
+   ubyte *dst;
+   unsigned dst_stride, dst_width;
+
+   unsigned cpp;
+   unsigned y0, y1;
+
+   uint64_t usecs;   /**< time spent, when run by a worker thread */
+};
+
+
+/**
+ * Is the format made of 8-bit unsigned normalized channels only?
+ */
+static boolean
+is_unorm8_format(enum pipe_format format)
+{
+   uint i;
+
+   if (pf_layout(format) != PIPE_FORMAT_LAYOUT_RGBAZS ||
+       pf_type(format) != PIPE_FORMAT_TYPE_UNORM ||
+       pf_is_depth_or_stencil(format))
+      return FALSE;
+
+   for (i = 0; i < 4; i++) {
+      uint size = pf_size_xyzw(format, i) << pf_exp2(format);
+      if (size != 0 && size != 8)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Reduce one row.  row0 and row1 are the two source rows, which are the
+ * same row when the source is one texel high.
+ */
+static void
+reduce_row(const ubyte *row0, const ubyte *row1,
+           unsigned src_width, ubyte *dst, unsigned dst_width,
+           unsigned cpp)
+{
+   unsigned x = 0, c;
+
+#if defined(PIPE_ARCH_SSE)
+   if (src_width > 1) {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i two = _mm_set1_epi16(2);
+      const __m128i lo_byte = _mm_set1_epi16(0xff);
+
+      if (cpp == 4) {
+         /* 4 destination texels from 8 source texels per iteration */
+         for (; x + 4 <= dst_width && 2 * x + 8 <= src_width; x += 4) {
+            const __m128i a0 = _mm_loadu_si128((const __m128i *) (row0 + 8 * x));
+            const __m128i a1 = _mm_loadu_si128((const __m128i *) (row0 + 8 * x + 16));
+            const __m128i b0 = _mm_loadu_si128((const __m128i *) (row1 + 8 * x));
+            const __m128i b1 = _mm_loadu_si128((const __m128i *) (row1 + 8 * x + 16));
+            /* sum the rows, 16 bits per channel */
+            __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                       _mm_unpacklo_epi8(b0, zero));
+            __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                       _mm_unpackhi_epi8(b0, zero));
+            __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                                       _mm_unpacklo_epi8(b1, zero));
+            __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                                       _mm_unpackhi_epi8(b1, zero));
+            /* each register now holds two texel columns, sum them */
+            s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+            s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+            s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+            s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+            s0 = _mm_unpacklo_epi64(s0, s1);
+            s2 = _mm_unpacklo_epi64(s2, s3);
+            /* round and divide by 4 */
+            s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+            s2 = _mm_srli_epi16(_mm_add_epi16(s2, two), 2);
+            _mm_storeu_si128((__m128i *) (dst + 4 * x),
+                             _mm_packus_epi16(s0, s2));
+         }
+      }
+      else if (cpp == 1) {
+         /* 16 destination texels from 32 source texels per iteration */
+         for (; x + 16 <= dst_width && 2 * x + 32 <= src_width; x += 16) {
+            const __m128i a0 = _mm_loadu_si128((const __m128i *) (row0 + 2 * x));
+            const __m128i a1 = _mm_loadu_si128((const __m128i *) (row0 + 2 * x + 16));
+            const __m128i b0 = _mm_loadu_si128((const __m128i *) (row1 + 2 * x));
+            const __m128i b1 = _mm_loadu_si128((const __m128i *) (row1 + 2 * x + 16));
+            /* add horizontal pairs: even bytes + odd bytes, 16 bits each */
+            __m128i s0 = _mm_add_epi16(_mm_and_si128(a0, lo_byte),
+                                       _mm_srli_epi16(a0, 8));
+            __m128i s1 = _mm_add_epi16(_mm_and_si128(a1, lo_byte),
+                                       _mm_srli_epi16(a1, 8));
+            s0 = _mm_add_epi16(s0, _mm_and_si128(b0, lo_byte));
+            s0 = _mm_add_epi16(s0, _mm_srli_epi16(b0, 8));
+            s1 = _mm_add_epi16(s1, _mm_and_si128(b1, lo_byte));
+            s1 = _mm_add_epi16(s1, _mm_srli_epi16(b1, 8));
+            s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+            s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+            _mm_storeu_si128((__m128i *) (dst + x),
+                             _mm_packus_epi16(s0, s1));
+         }
+      }
+   }
+#endif
+
+   /* remaining texels, and NPOT/1-wide edges */
+   for (; x < dst_width; x++) {
+      const unsigned x0 = MIN2(2 * x, src_width - 1) * cpp;
+      const unsigned x1 = MIN2(2 * x + 1, src_width - 1) * cpp;
+      for (c = 0; c < cpp; c++) {
+         dst[x * cpp + c] = (ubyte) ((row0[x0 + c] + row0[x1 + c] +
+                                      row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+      }
+   }
+}
+
+
+static void
+reduce_rows(const struct sp_mipmap_job *job)
+{
+   unsigned y;
+
+   for (y = job->y0; y < job->y1; y++) {
+      const unsigned y0 = MIN2(2 * y, job->src_height - 1);
+      const unsigned y1 = MIN2(2 * y + 1, job->src_height - 1);
+
+      reduce_row(job->src + y0 * job->src_stride,
+                 job->src + y1 * job->src_stride,
+                 job->src_width,
+                 job->dst + y * job->dst_stride,
+                 job->dst_width,
+                 job->cpp);
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE(reduce_rows_thread, param)
+{
+   struct sp_mipmap_job *job = (struct sp_mipmap_job *) param;
+   const uint64_t start = util_time_micros();
+
+   reduce_rows(job);
+   job->usecs = util_time_micros() - start;
+   return NULL;
+}
+
+
+static unsigned
+num_threads(unsigned rows)
+{
+   static long max_threads = -1;
+   unsigned n;
+
+   if (max_threads < 0) {
+      long ncpu;
+
+      cpu_detect_initialize();
+      ncpu = cpu_detect_get_caps()->nrcpu;
+      max_threads = debug_get_num_option("SP_MIPMAP_THREADS", MAX2(ncpu, 1));
+      max_threads = CLAMP(max_threads, 1, SP_MIPMAP_MAX_THREADS);
+   }
+
+   n = rows / SP_MIPMAP_ROWS_PER_THREAD;
+   return CLAMP(n, 1, (unsigned) max_threads);
+}
+
+
+/**
+ * Compute a whole level, splitting the rows across threads.
+ * \return  the time the worker threads ran while the calling thread
+ *          was not running, for time elapsed queries
+ */
+static uint64_t
+reduce_level(struct sp_mipmap_job *level)
+{
+   const unsigned rows = level->y1 - level->y0;
+   const unsigned n = num_threads(rows);
+   struct sp_mipmap_job jobs[SP_MIPMAP_MAX_THREADS];
+   pipe_thread threads[SP_MIPMAP_MAX_THREADS];
+   uint64_t worker_usecs = 0, wait_usecs = 0;
+   unsigned i;
+
+   for (i = 0; i < n; i++) {
+      jobs[i] = *level;
+      jobs[i].y0 = level->y0 + rows * i / n;
+      jobs[i].y1 = level->y0 + rows * (i + 1) / n;
+      jobs[i].usecs = 0;
+   }
+
+#if defined(PIPE_THREAD_HAVE_CONDVAR)
+   /* The calling thread does the first slice itself */
+   for (i = 1; i < n; i++)
+      threads[i] = pipe_thread_create(reduce_rows_thread, &jobs[i]);
+
+   reduce_rows(&jobs[0]);
+
+   for (i = 1; i < n; i++) {
+      if (threads[i]) {
+         const uint64_t start = util_time_micros();
+         pipe_thread_wait(threads[i]);
+         wait_usecs += util_time_micros() - start;
+         worker_usecs += jobs[i].usecs;
+      }
+      else
+         reduce_rows(&jobs[i]);
+   }
+#else
+   for (i = 0; i < n; i++)
+      reduce_rows(&jobs[i]);
+   (void) threads;
+#endif
+
+   return worker_usecs > wait_usecs ? worker_usecs - wait_usecs : 0;
+}
+
+
+static boolean
+softpipe_generate_mipmap(struct pipe_context *pipe,
+                         struct pipe_texture *pt,
+                         unsigned face,
+                         unsigned baseLevel, unsigned lastLevel)
+{
+   struct pipe_screen *screen = pipe->screen;
+   unsigned level;
+
+   if (pt->target == PIPE_TEXTURE_3D ||
+       pt->block.width != 1 || pt->block.height != 1 ||
+       !is_unorm8_format(pt->format))
+      return FALSE;
+
+   sp_timer_begin(softpipe_context(pipe));
+
+   /* Get any rendering to the texture out of the tile caches. */
+   if (pipe->is_texture_referenced(pipe, pt, face, baseLevel))
+      softpipe_flush(pipe, PIPE_FLUSH_RENDER_CACHE, NULL);
+
+   for (level = baseLevel + 1; level <= lastLevel; level++) {
+      struct pipe_transfer *srcTrans, *dstTrans;
+      struct sp_mipmap_job job;
+
+      srcTrans = screen->get_tex_transfer(screen, pt, face, level - 1, 0,
+                                          PIPE_TRANSFER_READ, 0, 0,
+                                          pt->width[level - 1],
+                                          pt->height[level - 1]);
+      dstTrans = screen->get_tex_transfer(screen, pt, face, level, 0,
+                                          PIPE_TRANSFER_WRITE, 0, 0,
+                                          pt->width[level],
+                                          pt->height[level]);
+
+      job.src = screen->transfer_map(screen, srcTrans);
+      job.dst = screen->transfer_map(screen, dstTrans);
+
+      if (job.src && job.dst) {
+         job.src_stride = srcTrans->stride;
+         job.src_width = pt->width[level - 1];
+         job.src_height = pt->height[level - 1];
+         job.dst_stride = dstTrans->stride;
+         job.dst_width = pt->width[level];
+         job.cpp = pt->block.size;
+         job.y0 = 0;
+         job.y1 = pt->height[level];
+
+         sp_timer_add(softpipe_context(pipe), reduce_level(&job));
+      }
+
+      if (job.src)
+         screen->transfer_unmap(screen, srcTrans);
+      if (job.dst)
+         screen->transfer_unmap(screen, dstTrans);
+
+      screen->tex_transfer_destroy(srcTrans);
+      screen->tex_transfer_destroy(dstTrans);
+   }
+
+   /* Texture tile caches must not keep the old contents. */
+   softpipe_texture(pt)->modified = TRUE;
+
+   sp_timer_end(softpipe_context(pipe));
+
+   return TRUE;
+}
+
+
+void
+sp_init_gen_mipmap_functions(struct softpipe_context *sp)
+{
+   sp->pipe.generate_mipmap = softpipe_generate_mipmap;
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef SP_GEN_MIPMAP_H
+#define SP_GEN_MIPMAP_H
+
+
+struct softpipe_context;
+
+
+extern void
+sp_init_gen_mipmap_functions(struct softpipe_context *sp);
+
+
+#endif /* SP_GEN_MIPMAP_H */
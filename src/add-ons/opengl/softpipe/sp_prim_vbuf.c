@@ -41,6 +41,7 @@
 #include "sp_prim_vbuf.h"
 #include "sp_prim_setup.h"
 #include "sp_setup.h"
+#include "sp_stats.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
 #include "util/u_memory.h"
@@ -542,6 +543,33 @@ sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
 
 
+/**
+ * Timed versions of the draw functions, with SP_STATS.
+ */
+static void
+sp_vbuf_draw_timed(struct vbuf_render *vbr, const ushort *indices, uint nr)
+{
+   struct sp_stats *stats = &softpipe_vbuf_render(vbr)->softpipe->stats;
+   uint64_t start, saved;
+
+   sp_stats_begin(stats, &start, &saved);
+   sp_vbuf_draw(vbr, indices, nr);
+   sp_stats_end(stats, SP_STAGE_SETUP, start, saved);
+}
+
+
+static void
+sp_vbuf_draw_arrays_timed(struct vbuf_render *vbr, uint start, uint nr)
+{
+   struct sp_stats *stats = &softpipe_vbuf_render(vbr)->softpipe->stats;
+   uint64_t t0, saved;
+
+   sp_stats_begin(stats, &t0, &saved);
+   sp_vbuf_draw_arrays(vbr, start, nr);
+   sp_stats_end(stats, SP_STAGE_SETUP, t0, saved);
+}
+
+
 static void
 sp_vbuf_destroy(struct vbuf_render *vbr)
 {
@@ -575,6 +603,11 @@ sp_init_vbuf(struct softpipe_context *sp)
    sp->vbuf_render->base.release_vertices = sp_vbuf_release_vertices;
    sp->vbuf_render->base.destroy = sp_vbuf_destroy;
 
+   if (sp->stats.timing) {
+      sp->vbuf_render->base.draw = sp_vbuf_draw_timed;
+      sp->vbuf_render->base.draw_arrays = sp_vbuf_draw_arrays_timed;
+   }
+
    sp->vbuf_render->softpipe = sp;
 
    sp->vbuf = draw_vbuf_stage(sp->draw, &sp->vbuf_render->base);
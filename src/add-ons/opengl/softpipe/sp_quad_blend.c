@@ -233,6 +233,8 @@ blend_quad(struct quad_stage *qs, struct quad_header *quad)
    struct softpipe_context *softpipe = qs->softpipe;
    uint cbuf;
 
+   softpipe->stats.blend_ops++;
+
    if (softpipe->blend->logicop_enable) {
       logicop_quad(qs, quad);
       return;
@@ -262,6 +262,10 @@ depth_test_quad(struct quad_stage *qs, struct quad_header *quad)
 
    if (quad->inout.mask)
       qs->next->run(qs->next, quad);
+   else if (qs->softpipe->stats.early_depth_test)
+      qs->softpipe->stats.quads_early_z_killed++;
+   else
+      qs->softpipe->stats.quads_depth_killed++;
 }
 
 
@@ -83,6 +83,7 @@ shade_quad(struct quad_stage *qs, struct quad_header *quad)
 
    /* run shader */
    quad->inout.mask &= softpipe->fs->run( softpipe->fs, machine, quad );
+   softpipe->stats.quads_shaded++;
 
    /* store outputs */
    z_written = FALSE;
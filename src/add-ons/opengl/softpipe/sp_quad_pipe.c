@@ -28,6 +28,7 @@
 
 #include "sp_context.h"
 #include "sp_state.h"
+#include "sp_stats.h"
 #include "pipe/p_shader_tokens.h"
 
 static void
@@ -67,6 +68,8 @@ sp_build_quad_pipeline(struct softpipe_context *sp)
                !sp->fs->info.uses_kill &&
                !sp->fs->info.writes_z;
 
+   sp->stats.early_depth_test = early_depth_test;
+
    /* build up the pipeline in reverse order... */
    for (i = 0; i < SP_NUM_QUAD_THREADS; i++) {
       sp->quad[i].first = sp->quad[i].output;
@@ -114,5 +117,7 @@ sp_build_quad_pipeline(struct softpipe_context *sp)
       }
 #endif
    }
+
+   sp_stats_wrap_quad_pipeline(sp);
 }
 
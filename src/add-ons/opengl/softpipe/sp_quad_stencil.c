@@ -209,6 +209,7 @@ stencil_test_quad(struct quad_stage *qs, struct quad_header *quad)
       = sp_get_cached_tile(softpipe, softpipe->zsbuf_cache, quad->input.x0, quad->input.y0);
    uint j;
    uint face = quad->input.facing;
+   boolean stencil_killed;
 
    if (!softpipe->depth_stencil->stencil[1].enabled) {
       /* single-sided stencil test, use front (face=0) state */
@@ -260,6 +261,7 @@ stencil_test_quad(struct quad_stage *qs, struct quad_header *quad)
       passMask = do_stencil_test(stencilVals, func, ref, valMask);
       failMask = quad->inout.mask & ~passMask;
       quad->inout.mask &= passMask;
+      stencil_killed = !quad->inout.mask;
 
       if (failOp != PIPE_STENCIL_OP_KEEP) {
          apply_stencil_op(stencilVals, failMask, failOp, ref, wrtMask);
@@ -324,6 +326,12 @@ stencil_test_quad(struct quad_stage *qs, struct quad_header *quad)
 
    if (quad->inout.mask)
       qs->next->run(qs->next, quad);
+   else if (stencil_killed)
+      qs->softpipe->stats.quads_stencil_killed++;
+   else if (qs->softpipe->stats.early_depth_test)
+      qs->softpipe->stats.quads_early_z_killed++;
+   else
+      qs->softpipe->stats.quads_depth_killed++;
 }
 
 
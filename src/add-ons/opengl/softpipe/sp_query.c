@@ -35,10 +35,14 @@
 #include "sp_context.h"
 #include "sp_query.h"
 #include "sp_state.h"
+#include "sp_stats.h"
 
 struct softpipe_query {
+   unsigned type;
    uint64_t start;
    uint64_t end;
+   struct pipe_query_data_pipeline_statistics stats_start;
+   struct pipe_query_data_pipeline_statistics stats_end;
 };
 
 
@@ -51,8 +55,16 @@ static struct pipe_query *
 softpipe_create_query(struct pipe_context *pipe, 
 		      unsigned type)
 {
-   assert(type == PIPE_QUERY_OCCLUSION_COUNTER);
-   return (struct pipe_query *)CALLOC_STRUCT( softpipe_query );
+   struct softpipe_query *sq;
+
+   assert(type == PIPE_QUERY_OCCLUSION_COUNTER ||
+          type == PIPE_QUERY_PIPELINE_STATISTICS ||
+          type == PIPE_QUERY_TIME_ELAPSED);
+
+   sq = CALLOC_STRUCT( softpipe_query );
+   if (sq)
+      sq->type = type;
+   return (struct pipe_query *)sq;
 }
 
 
@@ -68,6 +80,21 @@ softpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct softpipe_context *softpipe = softpipe_context( pipe );
    struct softpipe_query *sq = softpipe_query(q);
+
+   if (sq->type == PIPE_QUERY_PIPELINE_STATISTICS) {
+      /* don't count what is still queued in draw */
+      draw_flush(softpipe->draw);
+      sp_get_pipeline_statistics(softpipe, &sq->stats_start);
+      return;
+   }
+
+   if (sq->type == PIPE_QUERY_TIME_ELAPSED) {
+      /* work queued before the query doesn't count */
+      draw_flush(softpipe->draw);
+      sq->start = softpipe->timer.elapsed;
+      softpipe->timer.active_query_count++;
+      return;
+   }
    
    sq->start = softpipe->occlusion_count;
    softpipe->active_query_count++;
@@ -81,6 +108,22 @@ softpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct softpipe_context *softpipe = softpipe_context( pipe );
    struct softpipe_query *sq = softpipe_query(q);
 
+   if (sq->type == PIPE_QUERY_PIPELINE_STATISTICS) {
+      draw_flush(softpipe->draw);
+      sp_get_pipeline_statistics(softpipe, &sq->stats_end);
+      return;
+   }
+
+   if (sq->type == PIPE_QUERY_TIME_ELAPSED) {
+      /* but work queued within the query does */
+      sp_timer_begin(softpipe);
+      draw_flush(softpipe->draw);
+      sp_timer_end(softpipe);
+      softpipe->timer.active_query_count--;
+      sq->end = softpipe->timer.elapsed;
+      return;
+   }
+
    softpipe->active_query_count--;
    sq->end = softpipe->occlusion_count;
    softpipe->dirty |= SP_NEW_QUERY;
@@ -91,10 +134,44 @@ static boolean
 softpipe_get_query_result(struct pipe_context *pipe, 
 			  struct pipe_query *q,
 			  boolean wait,
-			  uint64_t *result )
+			  union pipe_query_result *result )
 {
    struct softpipe_query *sq = softpipe_query(q);
-   *result = sq->end - sq->start;
+
+   if (sq->type == PIPE_QUERY_PIPELINE_STATISTICS) {
+      struct pipe_query_data_pipeline_statistics *stats =
+         &result->pipeline_statistics;
+
+      stats->vertices_fetched = sq->stats_end.vertices_fetched -
+                                sq->stats_start.vertices_fetched;
+      stats->vs_invocations = sq->stats_end.vs_invocations -
+                              sq->stats_start.vs_invocations;
+      stats->primitives_clipped = sq->stats_end.primitives_clipped -
+                                  sq->stats_start.primitives_clipped;
+      stats->primitives_culled = sq->stats_end.primitives_culled -
+                                 sq->stats_start.primitives_culled;
+      stats->triangles_setup = sq->stats_end.triangles_setup -
+                               sq->stats_start.triangles_setup;
+      stats->quads_shaded = sq->stats_end.quads_shaded -
+                            sq->stats_start.quads_shaded;
+      stats->quads_early_z_killed = sq->stats_end.quads_early_z_killed -
+                                    sq->stats_start.quads_early_z_killed;
+      stats->quads_depth_killed = sq->stats_end.quads_depth_killed -
+                                  sq->stats_start.quads_depth_killed;
+      stats->quads_stencil_killed = sq->stats_end.quads_stencil_killed -
+                                    sq->stats_start.quads_stencil_killed;
+      stats->blend_ops = sq->stats_end.blend_ops -
+                         sq->stats_start.blend_ops;
+      return TRUE;
+   }
+
+   if (sq->type == PIPE_QUERY_TIME_ELAPSED) {
+      /* nanoseconds */
+      result->u64 = (sq->end - sq->start) * 1000;
+      return TRUE;
+   }
+
+   result->u64 = sq->end - sq->start;
    return TRUE;
 }
 
@@ -32,8 +32,46 @@
 #ifndef SP_QUERY_H
 #define SP_QUERY_H
 
-struct softpipe_context;
+#include "util/u_time.h"
+
+#include "sp_context.h"
+
 extern void softpipe_init_query_funcs(struct softpipe_context * );
 
 
+/**
+ * Time elapsed queries measure the time spent in the pipe_context calls
+ * which do the rendering: draw, clear, flush and mipmap generation.
+ * Those bracket their work with sp_timer_begin/end, which may nest.
+ * Nothing is measured unless a query is active.
+ */
+static INLINE void
+sp_timer_begin(struct softpipe_context *sp)
+{
+   if (sp->timer.depth++ == 0 && sp->timer.active_query_count)
+      sp->timer.start = util_time_micros();
+}
+
+
+static INLINE void
+sp_timer_end(struct softpipe_context *sp)
+{
+   if (--sp->timer.depth == 0 && sp->timer.start) {
+      sp->timer.elapsed += util_time_micros() - sp->timer.start;
+      sp->timer.start = 0;
+   }
+}
+
+
+/**
+ * Add time spent by worker threads.
+ */
+static INLINE void
+sp_timer_add(struct softpipe_context *sp, uint64_t usecs)
+{
+   if (sp->timer.active_query_count)
+      sp->timer.elapsed += usecs;
+}
+
+
 #endif /* SP_QUERY_H */
@@ -75,6 +75,10 @@ softpipe_get_param(struct pipe_screen *screen, int param)
       return PIPE_MAX_COLOR_BUFS;
    case PIPE_CAP_OCCLUSION_QUERY:
       return 1;
+   case PIPE_CAP_TIMER_QUERY:
+      return 1;
+   case PIPE_CAP_SHARED_STATE_OBJECTS:
+      return 1;
    case PIPE_CAP_TEXTURE_MIRROR_CLAMP:
       return 1;
    case PIPE_CAP_TEXTURE_MIRROR_REPEAT:
@@ -147,8 +151,20 @@ softpipe_is_format_supported( struct pipe_screen *screen,
 static void
 softpipe_destroy_screen( struct pipe_screen *screen )
 {
+   struct softpipe_screen *sp_screen = softpipe_screen(screen);
    struct pipe_winsys *winsys = screen->winsys;
 
+   if (debug_get_bool_option("SP_TEXTURE_STATS", FALSE)) {
+      debug_printf("softpipe: texture memory peak %lu bytes, "
+                   "%lu bytes still allocated\n",
+                   sp_screen->texture_bytes_peak, sp_screen->texture_bytes);
+      debug_printf("softpipe: %u images allocated, %u shared, "
+                   "%u copied on write\n",
+                   sp_screen->texture_images,
+                   sp_screen->texture_images_shared,
+                   sp_screen->texture_images_copied);
+   }
+
    if(winsys->destroy)
       winsys->destroy(winsys);
 
@@ -43,6 +43,14 @@ struct softpipe_screen {
     * this.
     */
    unsigned timestamp;          
+
+   /* Texture image memory statistics, see SP_TEXTURE_STATS.
+    */
+   unsigned long texture_bytes;
+   unsigned long texture_bytes_peak;
+   unsigned texture_images;        /**< images actually allocated */
+   unsigned texture_images_shared; /**< images shared by surface_copy */
+   unsigned texture_images_copied; /**< shared images copied on write */
 };
 
 
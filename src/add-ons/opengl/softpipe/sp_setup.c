@@ -951,8 +951,12 @@ void setup_tri( struct setup_context *setup,
    setup->numFragsWritten = 0;
 #endif
 
-   if (cull_tri( setup, det ))
+   if (cull_tri( setup, det )) {
+      setup->softpipe->stats.triangles_culled++;
       return;
+   }
+
+   setup->softpipe->stats.triangles_setup++;
 
    if (!setup_sort_vertices( setup, det, v0, v1, v2 ))
       return;
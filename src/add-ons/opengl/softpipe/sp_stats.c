@@ -0,0 +1,358 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * Softpipe pipeline statistics and per-stage timing.
+ *
+ * Stage times are exclusive: a quad stage calls the next stage from its
+ * run function, so the time of the stages further down the pipeline is
+ * subtracted (see sp_stats_begin/end).  The setup stage is the vbuf
+ * draw call, which does triangle setup and scan conversion and runs the
+ * quad pipeline for every quad it generates.
+ *
+ * The draw module times its middle ends including everything the vbuf
+ * backend does while they run, so the time reported for draw is the
+ * middle end time minus the softpipe stage time.
+ */
+
+
+#include "pipe/p_defines.h"
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+
+#include "sp_context.h"
+#include "sp_quad.h"
+#include "sp_stats.h"
+
+
+static const char *stage_names[SP_STAGE_COUNT] = {
+   "setup",
+   "polygon_stipple",
+   "earlyz",
+   "shade",
+   "alpha_test",
+   "stencil_test",
+   "depth_test",
+   "occlusion",
+   "coverage",
+   "blend",
+   "colormask",
+   "output"
+};
+
+static const char *middle_names[DRAW_MIDDLE_COUNT] = {
+   "fetch_emit",
+   "fetch_shade_emit",
+   "general"
+};
+
+
+/**
+ * Quad stage which times another one.
+ */
+struct timed_stage
+{
+   struct quad_stage base;
+   struct quad_stage *stage;
+   enum sp_stats_stage id;
+};
+
+
+static INLINE struct timed_stage *
+timed_stage(struct quad_stage *qs)
+{
+   return (struct timed_stage *) qs;
+}
+
+
+static void
+timed_run(struct quad_stage *qs, struct quad_header *quad)
+{
+   struct timed_stage *ts = timed_stage(qs);
+   struct sp_stats *stats = &qs->softpipe->stats;
+   uint64_t start, saved;
+
+   sp_stats_begin(stats, &start, &saved);
+   ts->stage->run(ts->stage, quad);
+   sp_stats_end(stats, ts->id, start, saved);
+}
+
+
+static void
+timed_begin(struct quad_stage *qs)
+{
+   struct timed_stage *ts = timed_stage(qs);
+
+   ts->stage->begin(ts->stage);
+}
+
+
+static void
+timed_destroy(struct quad_stage *qs)
+{
+   FREE(qs);
+}
+
+
+/**
+ * The quad stages of one thread, indexed by enum sp_stats_stage.
+ */
+static void
+get_quad_stages(struct softpipe_context *sp, uint i,
+                struct quad_stage *stages[SP_STAGE_COUNT])
+{
+   stages[SP_STAGE_SETUP] = NULL;
+   stages[SP_STAGE_POLYGON_STIPPLE] = sp->quad[i].polygon_stipple;
+   stages[SP_STAGE_EARLYZ] = sp->quad[i].earlyz;
+   stages[SP_STAGE_SHADE] = sp->quad[i].shade;
+   stages[SP_STAGE_ALPHA_TEST] = sp->quad[i].alpha_test;
+   stages[SP_STAGE_STENCIL_TEST] = sp->quad[i].stencil_test;
+   stages[SP_STAGE_DEPTH_TEST] = sp->quad[i].depth_test;
+   stages[SP_STAGE_OCCLUSION] = sp->quad[i].occlusion;
+   stages[SP_STAGE_COVERAGE] = sp->quad[i].coverage;
+   stages[SP_STAGE_BLEND] = sp->quad[i].blend;
+   stages[SP_STAGE_COLORMASK] = sp->quad[i].colormask;
+   stages[SP_STAGE_OUTPUT] = sp->quad[i].output;
+}
+
+
+/**
+ * Current values of the counters, for PIPELINE_STATISTICS queries.
+ */
+void
+sp_get_pipeline_statistics(struct softpipe_context *sp,
+                           struct pipe_query_data_pipeline_statistics *counters)
+{
+   const struct draw_statistics *ds = draw_get_statistics(sp->draw);
+
+   counters->vertices_fetched = ds->vertices_fetched;
+   counters->vs_invocations = ds->vs_invocations;
+   counters->primitives_clipped = ds->primitives_clipped;
+   counters->primitives_culled = ds->primitives_culled +
+                                 sp->stats.triangles_culled;
+   counters->triangles_setup = sp->stats.triangles_setup;
+   counters->quads_shaded = sp->stats.quads_shaded;
+   counters->quads_early_z_killed = sp->stats.quads_early_z_killed;
+   counters->quads_depth_killed = sp->stats.quads_depth_killed;
+   counters->quads_stencil_killed = sp->stats.quads_stencil_killed;
+   counters->blend_ops = sp->stats.blend_ops;
+}
+
+
+/**
+ * Start a new dump interval.
+ */
+static void
+reset_timing(struct softpipe_context *sp)
+{
+   struct sp_stats *stats = &sp->stats;
+   const struct draw_statistics *ds = draw_get_statistics(sp->draw);
+   uint i;
+
+   for (i = 0; i < SP_STAGE_COUNT; i++) {
+      stats->ticks[i] = 0;
+      stats->calls[i] = 0;
+   }
+
+   for (i = 0; i < DRAW_MIDDLE_COUNT; i++) {
+      stats->start_draw_ticks[i] = ds->middle_ticks[i];
+      stats->start_draw_runs[i] = ds->middle_runs[i];
+   }
+
+   sp_get_pipeline_statistics(sp, &stats->start_counters);
+
+   stats->start_usecs = util_time_micros();
+   stats->start_ticks = util_time_ticks();
+}
+
+
+static void
+dump_timing(struct softpipe_context *sp, uint64_t usecs, uint64_t ticks)
+{
+   const struct sp_stats *stats = &sp->stats;
+   const struct draw_statistics *ds = draw_get_statistics(sp->draw);
+   struct pipe_query_data_pipeline_statistics counters;
+   const double ms_per_tick = ticks ? (double) usecs / ticks / 1000.0 : 0.0;
+   const double total_ms = usecs / 1000.0;
+   uint64_t sp_ticks = 0, draw_ticks = 0;
+   uint i;
+
+   debug_printf("softpipe: %.0f ms\n", total_ms);
+
+   for (i = 0; i < DRAW_MIDDLE_COUNT; i++) {
+      const uint64_t runs = ds->middle_runs[i] - stats->start_draw_runs[i];
+      const uint64_t t = ds->middle_ticks[i] - stats->start_draw_ticks[i];
+
+      draw_ticks += t;
+      if (runs)
+         debug_printf("softpipe:   draw %-16s %10llu runs %10.3f ms\n",
+                      middle_names[i], (unsigned long long) runs,
+                      t * ms_per_tick);
+   }
+
+   for (i = 0; i < SP_STAGE_COUNT; i++) {
+      sp_ticks += stats->ticks[i];
+      if (stats->calls[i])
+         debug_printf("softpipe:   %-21s %10llu calls %9.3f ms %5.1f%%\n",
+                      stage_names[i], (unsigned long long) stats->calls[i],
+                      stats->ticks[i] * ms_per_tick,
+                      100.0 * stats->ticks[i] * ms_per_tick / total_ms);
+   }
+
+   if (draw_ticks > sp_ticks)
+      debug_printf("softpipe:   %-21s %16s %9.3f ms %5.1f%%\n",
+                   "draw (exclusive)", "",
+                   (draw_ticks - sp_ticks) * ms_per_tick,
+                   100.0 * (draw_ticks - sp_ticks) * ms_per_tick / total_ms);
+
+   sp_get_pipeline_statistics(sp, &counters);
+   debug_printf("softpipe:   %llu vertices fetched, %llu shaded, "
+                "%llu prims clipped, %llu culled\n",
+                (unsigned long long) (counters.vertices_fetched -
+                                      stats->start_counters.vertices_fetched),
+                (unsigned long long) (counters.vs_invocations -
+                                      stats->start_counters.vs_invocations),
+                (unsigned long long) (counters.primitives_clipped -
+                                      stats->start_counters.primitives_clipped),
+                (unsigned long long) (counters.primitives_culled -
+                                      stats->start_counters.primitives_culled));
+   debug_printf("softpipe:   %llu tris set up, %llu quads shaded, "
+                "%llu early z killed, %llu depth killed, "
+                "%llu stencil killed, %llu blended\n",
+                (unsigned long long) (counters.triangles_setup -
+                                      stats->start_counters.triangles_setup),
+                (unsigned long long) (counters.quads_shaded -
+                                      stats->start_counters.quads_shaded),
+                (unsigned long long) (counters.quads_early_z_killed -
+                                      stats->start_counters.quads_early_z_killed),
+                (unsigned long long) (counters.quads_depth_killed -
+                                      stats->start_counters.quads_depth_killed),
+                (unsigned long long) (counters.quads_stencil_killed -
+                                      stats->start_counters.quads_stencil_killed),
+                (unsigned long long) (counters.blend_ops -
+                                      stats->start_counters.blend_ops));
+}
+
+
+/**
+ * Must be called after the quad stages and the draw module are created,
+ * and before the vbuf backend is set up.
+ */
+void
+sp_init_stats(struct softpipe_context *sp)
+{
+   struct sp_stats *stats = &sp->stats;
+   long interval;
+   uint i, j;
+
+   interval = debug_get_num_option("SP_STATS", 0);
+   if (interval <= 0)
+      return;
+
+   for (i = 0; i < SP_NUM_QUAD_THREADS; i++) {
+      struct quad_stage *stages[SP_STAGE_COUNT];
+
+      get_quad_stages(sp, i, stages);
+
+      for (j = 0; j < SP_STAGE_COUNT; j++) {
+         struct timed_stage *ts;
+
+         if (!stages[j])
+            continue;
+
+         ts = CALLOC_STRUCT(timed_stage);
+         if (!ts)
+            return;
+
+         ts->base.softpipe = sp;
+         ts->base.begin = timed_begin;
+         ts->base.run = timed_run;
+         ts->base.destroy = timed_destroy;
+         ts->stage = stages[j];
+         ts->id = (enum sp_stats_stage) j;
+
+         sp->quad[i].timed[j] = &ts->base;
+      }
+   }
+
+   stats->timing = TRUE;
+   stats->interval = (unsigned) interval * 1000;
+
+   draw_enable_timing(sp->draw, TRUE);
+
+   reset_timing(sp);
+}
+
+
+void
+sp_destroy_stats(struct softpipe_context *sp)
+{
+   uint i, j;
+
+   for (i = 0; i < SP_NUM_QUAD_THREADS; i++) {
+      for (j = 0; j < SP_STAGE_COUNT; j++) {
+         if (sp->quad[i].timed[j])
+            sp->quad[i].timed[j]->destroy(sp->quad[i].timed[j]);
+      }
+   }
+}
+
+
+/**
+ * Put the timing stages into the quad pipeline which
+ * sp_build_quad_pipeline() just built.
+ */
+void
+sp_stats_wrap_quad_pipeline(struct softpipe_context *sp)
+{
+   uint i, j;
+
+   if (!sp->stats.timing)
+      return;
+
+   for (i = 0; i < SP_NUM_QUAD_THREADS; i++) {
+      struct quad_stage *stages[SP_STAGE_COUNT];
+      struct quad_stage **link = &sp->quad[i].first;
+
+      get_quad_stages(sp, i, stages);
+
+      /* Every stage was linked fresh, so no link points to a timing
+       * stage yet.
+       */
+      while (*link) {
+         struct quad_stage *stage = *link;
+
+         for (j = 0; j < SP_STAGE_COUNT; j++) {
+            if (stages[j] == stage && sp->quad[i].timed[j]) {
+               *link = sp->quad[i].timed[j];
+               break;
+            }
+         }
+
+         link = &stage->next;
+      }
+   }
+}
+
+
+/**
+ * Called on every flush, prints the timing every SP_STATS milliseconds.
+ */
+void
+sp_stats_flush(struct softpipe_context *sp)
+{
+   struct sp_stats *stats = &sp->stats;
+   uint64_t usecs;
+
+   if (!stats->timing)
+      return;
+
+   usecs = util_time_micros() - stats->start_usecs;
+   if (usecs < stats->interval)
+      return;
+
+   dump_timing(sp, usecs, util_time_ticks() - stats->start_ticks);
+   reset_timing(sp);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * @file
+ * Softpipe pipeline statistics and per-stage timing.
+ *
+ * The counters are always kept, they back PIPE_QUERY_PIPELINE_STATISTICS.
+ * Timing is only done when SP_STATS is set to a dump interval in
+ * milliseconds: every quad stage is then wrapped by a stage which times
+ * it, and the totals are printed every interval from softpipe_flush().
+ */
+
+#ifndef SP_STATS_H
+#define SP_STATS_H
+
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_state.h"
+#include "draw/draw_context.h"
+#include "util/u_time.h"
+
+
+struct softpipe_context;
+
+
+/** Timed stages, for sp_stats::ticks */
+enum sp_stats_stage
+{
+   SP_STAGE_SETUP,     /**< vbuf draw calls, triangle setup and scan */
+   SP_STAGE_POLYGON_STIPPLE,
+   SP_STAGE_EARLYZ,
+   SP_STAGE_SHADE,
+   SP_STAGE_ALPHA_TEST,
+   SP_STAGE_STENCIL_TEST,
+   SP_STAGE_DEPTH_TEST,
+   SP_STAGE_OCCLUSION,
+   SP_STAGE_COVERAGE,
+   SP_STAGE_BLEND,
+   SP_STAGE_COLORMASK,
+   SP_STAGE_OUTPUT,
+   SP_STAGE_COUNT
+};
+
+
+struct sp_stats
+{
+   /* Counters, never reset */
+   uint64_t triangles_setup;
+   uint64_t triangles_culled;    /**< by setup, not by draw */
+   uint64_t quads_shaded;
+   uint64_t quads_early_z_killed;
+   uint64_t quads_depth_killed;
+   uint64_t quads_stencil_killed;
+   uint64_t blend_ops;
+
+   /** Is early depth test in the current quad pipeline? */
+   boolean early_depth_test;
+
+   /* Timing, only with SP_STATS */
+   boolean timing;
+   unsigned interval;            /**< dump interval, usecs */
+
+   uint64_t ticks[SP_STAGE_COUNT];   /**< exclusive */
+   uint64_t calls[SP_STAGE_COUNT];
+   uint64_t nested;              /**< ticks of the stages run so far */
+
+   /* Values at the start of the current dump interval */
+   uint64_t start_ticks;
+   uint64_t start_usecs;
+   uint64_t start_draw_ticks[DRAW_MIDDLE_COUNT];
+   uint64_t start_draw_runs[DRAW_MIDDLE_COUNT];
+   struct pipe_query_data_pipeline_statistics start_counters;
+};
+
+
+/**
+ * Start timing a stage.  Stages may nest, the time of the inner stages
+ * is excluded from the outer ones.
+ */
+static INLINE void
+sp_stats_begin(struct sp_stats *stats, uint64_t *start, uint64_t *saved)
+{
+   *saved = stats->nested;
+   stats->nested = 0;
+   *start = util_time_ticks();
+}
+
+
+static INLINE void
+sp_stats_end(struct sp_stats *stats, enum sp_stats_stage stage,
+             uint64_t start, uint64_t saved)
+{
+   const uint64_t dt = util_time_ticks() - start;
+
+   stats->ticks[stage] += dt - stats->nested;
+   stats->calls[stage]++;
+   stats->nested = saved + dt;
+}
+
+
+void sp_init_stats(struct softpipe_context *sp);
+
+void sp_destroy_stats(struct softpipe_context *sp);
+
+void sp_stats_wrap_quad_pipeline(struct softpipe_context *sp);
+
+void sp_stats_flush(struct softpipe_context *sp);
+
+void
+sp_get_pipeline_statistics(struct softpipe_context *sp,
+                           struct pipe_query_data_pipeline_statistics *counters);
+
+
+#endif /* SP_STATS_H */
@@ -28,6 +28,7 @@
 #include "util/u_rect.h"
 #include "sp_context.h"
 #include "sp_surface.h"
+#include "sp_texture.h"
 
 
 static void
@@ -36,6 +37,23 @@ sp_surface_copy(struct pipe_context *pipe,
                 struct pipe_surface *src, unsigned srcx, unsigned srcy,
                 unsigned width, unsigned height)
 {
+   /* Copying a whole image between two textures, as done when the state
+    * tracker pulls the images of a texture object into a new mipmap tree,
+    * just shares the image storage.
+    */
+   if (dest->texture && src->texture &&
+       destx == 0 && desty == 0 && srcx == 0 && srcy == 0 &&
+       width == dest->width && height == dest->height &&
+       width == src->width && height == src->height &&
+       dest->face == src->face &&
+       dest->texture->depth[dest->level] == 1 &&
+       src->texture->depth[src->level] == 1 &&
+       softpipe_texture_share_image(pipe->screen,
+                                    dest->texture, dest->level,
+                                    src->texture, src->level,
+                                    dest->face))
+      return;
+
    util_surface_copy(pipe, FALSE,
                      dest, destx, desty,
                      src, srcx, srcy,
@@ -54,7 +54,9 @@ static unsigned minify( unsigned d )
 }
 
 
-/* Conventional allocation path for non-display textures:
+/* Conventional allocation path for non-display textures.  Only the
+ * layout is computed here, the storage of each image is allocated by
+ * softpipe_texture_image_buffer() when the image is first mapped.
  */
 static boolean
 softpipe_texture_layout(struct pipe_screen *screen,
@@ -66,8 +68,6 @@ softpipe_texture_layout(struct pipe_screen *screen,
    unsigned height = pt->height[0];
    unsigned depth = pt->depth[0];
 
-   unsigned buffer_size = 0;
-
    for (level = 0; level <= pt->last_level; level++) {
       pt->width[level] = width;
       pt->height[level] = height;
@@ -76,24 +76,158 @@ softpipe_texture_layout(struct pipe_screen *screen,
       pt->nblocksy[level] = pf_get_nblocksy(&pt->block, height);  
       spt->stride[level] = pt->nblocksx[level]*pt->block.size;
 
-      spt->level_offset[level] = buffer_size;
+      spt->level_offset[level] = 0;
 
-      buffer_size += (pt->nblocksy[level] *
-                      ((pt->target == PIPE_TEXTURE_CUBE) ? 6 : depth) *
-                      spt->stride[level]);
+      spt->image_size[level] = (pt->nblocksy[level] *
+                                ((pt->target == PIPE_TEXTURE_3D) ? depth : 1) *
+                                spt->stride[level]);
 
       width  = minify(width);
       height = minify(height);
       depth = minify(depth);
    }
 
-   spt->buffer = screen->buffer_create(screen, 32,
-                                       PIPE_BUFFER_USAGE_PIXEL,
-                                       buffer_size);
+   return TRUE;
+}
+
 
-   return spt->buffer != NULL;
+static void
+softpipe_texture_release_image(struct pipe_screen *screen,
+                               struct softpipe_texture *spt,
+                               unsigned face, unsigned level)
+{
+   struct softpipe_screen *sp_screen = softpipe_screen(screen);
+   struct pipe_buffer **buf = &spt->image_buffer[level][face];
+
+   if (!*buf)
+      return;
+
+   if (p_atomic_read(&(*buf)->reference.count) == 1) {
+      sp_screen->texture_bytes -= (*buf)->size;
+      sp_screen->texture_images--;
+   }
+
+   pipe_buffer_reference(buf, NULL);
+   spt->image_shared[level][face] = FALSE;
 }
 
+
+/**
+ * Return the buffer holding the given image, allocating it on first use.
+ * When the image is about to be written and its buffer may still be
+ * shared with another texture, the contents are copied first.
+ */
+static struct pipe_buffer *
+softpipe_texture_image_buffer(struct pipe_screen *screen,
+                              struct softpipe_texture *spt,
+                              unsigned face, unsigned level,
+                              boolean write)
+{
+   struct softpipe_screen *sp_screen = softpipe_screen(screen);
+   struct pipe_buffer **buf;
+
+   if (spt->buffer)
+      return spt->buffer;
+
+   buf = &spt->image_buffer[level][face];
+
+   if (!*buf) {
+      *buf = screen->buffer_create(screen, 32,
+                                   PIPE_BUFFER_USAGE_PIXEL,
+                                   spt->image_size[level]);
+      if (!*buf)
+         return NULL;
+
+      sp_screen->texture_bytes += (*buf)->size;
+      sp_screen->texture_bytes_peak = MAX2(sp_screen->texture_bytes_peak,
+                                           sp_screen->texture_bytes);
+      sp_screen->texture_images++;
+   }
+   else if (write && spt->image_shared[level][face]) {
+      if (p_atomic_read(&(*buf)->reference.count) > 1) {
+         struct pipe_buffer *copy;
+         const void *src;
+         void *dst;
+
+         copy = screen->buffer_create(screen, 32,
+                                      PIPE_BUFFER_USAGE_PIXEL,
+                                      (*buf)->size);
+         if (!copy)
+            return NULL;
+
+         src = pipe_buffer_map(screen, *buf, PIPE_BUFFER_USAGE_CPU_READ);
+         dst = pipe_buffer_map(screen, copy, PIPE_BUFFER_USAGE_CPU_WRITE);
+         if (src && dst)
+            memcpy(dst, src, copy->size);
+         if (dst)
+            pipe_buffer_unmap(screen, copy);
+         if (src)
+            pipe_buffer_unmap(screen, *buf);
+
+         pipe_buffer_reference(buf, NULL);
+         *buf = copy;
+
+         sp_screen->texture_bytes += copy->size;
+         sp_screen->texture_bytes_peak = MAX2(sp_screen->texture_bytes_peak,
+                                              sp_screen->texture_bytes);
+         sp_screen->texture_images++;
+         sp_screen->texture_images_copied++;
+
+         /* Cached views into the old buffer are now stale. */
+         spt->modified = TRUE;
+      }
+
+      spt->image_shared[level][face] = FALSE;
+   }
+
+   return *buf;
+}
+
+
+/**
+ * Make a level/face of dst share the storage of a level/face of src
+ * instead of copying it.  The image is copied on the first write to
+ * either texture.
+ * \return TRUE if the image is now shared, FALSE if it must be copied.
+ */
+boolean
+softpipe_texture_share_image(struct pipe_screen *screen,
+                             struct pipe_texture *dst, unsigned dst_level,
+                             struct pipe_texture *src, unsigned src_level,
+                             unsigned face)
+{
+   struct softpipe_texture *dst_spt = softpipe_texture(dst);
+   struct softpipe_texture *src_spt = softpipe_texture(src);
+   unsigned dst_face = dst->target == PIPE_TEXTURE_CUBE ? face : 0;
+   unsigned src_face = src->target == PIPE_TEXTURE_CUBE ? face : 0;
+
+   if (dst_spt->buffer || src_spt->buffer ||
+       dst == src ||
+       dst->format != src->format ||
+       dst->width[dst_level] != src->width[src_level] ||
+       dst->height[dst_level] != src->height[src_level] ||
+       dst->depth[dst_level] != src->depth[src_level] ||
+       dst_spt->stride[dst_level] != src_spt->stride[src_level] ||
+       dst_spt->image_size[dst_level] != src_spt->image_size[src_level])
+      return FALSE;
+
+   softpipe_texture_release_image(screen, dst_spt, dst_face, dst_level);
+
+   /* An image which was never materialized stays that way. */
+   if (src_spt->image_buffer[src_level][src_face]) {
+      pipe_buffer_reference(&dst_spt->image_buffer[dst_level][dst_face],
+                            src_spt->image_buffer[src_level][src_face]);
+      dst_spt->image_shared[dst_level][dst_face] = TRUE;
+      src_spt->image_shared[src_level][src_face] = TRUE;
+      softpipe_screen(screen)->texture_images_shared++;
+   }
+
+   dst_spt->modified = TRUE;
+
+   return TRUE;
+}
+
+
 static boolean
 softpipe_displaytarget_layout(struct pipe_screen *screen,
                               struct softpipe_texture * spt)
@@ -184,6 +318,11 @@ static void
 softpipe_texture_destroy(struct pipe_texture *pt)
 {
    struct softpipe_texture *spt = softpipe_texture(pt);
+   unsigned level, face;
+
+   for (level = 0; level <= pt->last_level; level++)
+      for (face = 0; face < 6; face++)
+         softpipe_texture_release_image(pt->screen, spt, face, level);
 
    pipe_buffer_reference(&spt->buffer, NULL);
    FREE(spt);
@@ -235,7 +374,8 @@ softpipe_get_tex_surface(struct pipe_screen *screen,
       ps->zslice = zslice;
 
       if (pt->target == PIPE_TEXTURE_CUBE) {
-         ps->offset += face * pt->nblocksy[level] * spt->stride[level];
+         if (spt->buffer)
+            ps->offset += face * pt->nblocksy[level] * spt->stride[level];
       }
       else if (pt->target == PIPE_TEXTURE_3D) {
          ps->offset += zslice * pt->nblocksy[level] * spt->stride[level];
@@ -296,7 +436,8 @@ softpipe_get_tex_transfer(struct pipe_screen *screen,
       spt->offset = sptex->level_offset[level];
 
       if (texture->target == PIPE_TEXTURE_CUBE) {
-         spt->offset += face * pt->nblocksy * pt->stride;
+         if (sptex->buffer)
+            spt->offset += face * pt->nblocksy * pt->stride;
       }
       else if (texture->target == PIPE_TEXTURE_3D) {
          spt->offset += zslice * pt->nblocksy * pt->stride;
@@ -319,6 +460,7 @@ softpipe_tex_transfer_destroy(struct pipe_transfer *transfer)
     * where it would happen.  For softpipe, nothing to do.
     */
    assert (transfer->texture);
+   assert (!softpipe_transfer(transfer)->buffer);
    pipe_texture_reference(&transfer->texture, NULL);
    FREE(transfer);
 }
@@ -330,6 +472,8 @@ softpipe_transfer_map( struct pipe_screen *screen,
 {
    ubyte *map, *xfer_map;
    struct softpipe_texture *spt;
+   struct pipe_buffer *buffer;
+   unsigned face;
    unsigned flags = 0;
 
    assert(transfer->texture);
@@ -343,10 +487,18 @@ softpipe_transfer_map( struct pipe_screen *screen,
       flags |= PIPE_BUFFER_USAGE_CPU_READ;
    }
 
-   map = pipe_buffer_map(screen, spt->buffer, flags);
+   face = transfer->texture->target == PIPE_TEXTURE_CUBE ? transfer->face : 0;
+   buffer = softpipe_texture_image_buffer(screen, spt, face, transfer->level,
+                                          transfer->usage != PIPE_TRANSFER_READ);
+   if (buffer == NULL)
+      return NULL;
+
+   map = pipe_buffer_map(screen, buffer, flags);
    if (map == NULL)
       return NULL;
 
+   pipe_buffer_reference(&softpipe_transfer(transfer)->buffer, buffer);
+
    /* May want to different things here depending on read/write nature
     * of the map:
     */
@@ -370,12 +522,13 @@ static void
 softpipe_transfer_unmap(struct pipe_screen *screen,
                        struct pipe_transfer *transfer)
 {
-   struct softpipe_texture *spt;
+   struct softpipe_transfer *spt = softpipe_transfer(transfer);
 
    assert(transfer->texture);
-   spt = softpipe_texture(transfer->texture);
+   assert(spt->buffer);
 
    pipe_buffer_unmap( screen, spt->buffer );
+   pipe_buffer_reference(&spt->buffer, NULL);
 }
 
 
@@ -44,10 +44,21 @@ struct softpipe_texture
    unsigned long level_offset[PIPE_MAX_TEXTURE_LEVELS];
    unsigned stride[PIPE_MAX_TEXTURE_LEVELS];
 
-   /* The data is held here:
+   /* Size of one face (or of all the slices of a 3D level) of each level.
+    */
+   unsigned image_size[PIPE_MAX_TEXTURE_LEVELS];
+
+   /* The data of display targets and blanketed textures is held here:
     */
    struct pipe_buffer *buffer;
 
+   /* Other textures get one buffer per level and face, allocated the
+    * first time that image is mapped.  Images may be shared with another
+    * texture by surface_copy, in which case they are copied on write.
+    */
+   struct pipe_buffer *image_buffer[PIPE_MAX_TEXTURE_LEVELS][6];
+   boolean image_shared[PIPE_MAX_TEXTURE_LEVELS][6];
+
    boolean modified;
 };
 
@@ -56,6 +67,9 @@ struct softpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** The buffer mapped by transfer_map, kept until transfer_unmap */
+   struct pipe_buffer *buffer;
 };
 
 
@@ -76,6 +90,12 @@ softpipe_transfer(struct pipe_transfer *pt)
 extern void
 softpipe_init_texture_funcs( struct softpipe_context *softpipe );
 
+extern boolean
+softpipe_texture_share_image(struct pipe_screen *screen,
+                             struct pipe_texture *dst, unsigned dst_level,
+                             struct pipe_texture *src, unsigned src_level,
+                             unsigned face);
+
 extern void
 softpipe_init_screen_texture_funcs(struct pipe_screen *screen);
 
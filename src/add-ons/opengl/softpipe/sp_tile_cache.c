@@ -536,6 +536,16 @@ sp_get_cached_tile_tex(struct softpipe_context *sp,
             tile->x = -1;
          }
          spt->modified = FALSE;
+
+         /* the image storage may have been replaced too */
+         if (tc->tex_trans) {
+            if (tc->tex_trans_map) {
+               screen->transfer_unmap(screen, tc->tex_trans);
+               tc->tex_trans_map = NULL;
+            }
+            screen->tex_transfer_destroy(tc->tex_trans);
+            tc->tex_trans = NULL;
+         }
       }
    }
 
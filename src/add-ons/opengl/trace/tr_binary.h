@@ -0,0 +1,69 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * @file
+ * Binary trace format.
+ *
+ * A binary trace starts with the magic TR_BIN_MAGIC and a version byte,
+ * followed by records which all start with a one byte tag.
+ *
+ * Unsigned integers are LEB128 varints, signed integers are zig-zag
+ * encoded varints and floats are little endian IEEE doubles.
+ *
+ * Class, method, argument, member, struct and enum names are interned:
+ * a TR_BIN_NAME record gives the id of a name before its first use and
+ * later records only carry the id.
+ *
+ * String and byte array contents are stored as blobs, which are
+ * deduplicated by size and content hash.  A TR_BIN_BLOB record defines
+ * a blob before its first use, so uploading the same data again only
+ * costs the blob id.
+ *
+ * Name and blob definitions may appear between any two records and are
+ * not part of the call structure.
+ */
+
+#ifndef TR_BINARY_H
+#define TR_BINARY_H
+
+
+#define TR_BIN_MAGIC "GTRB"
+#define TR_BIN_MAGIC_SIZE 4
+#define TR_BIN_VERSION 1
+
+
+enum tr_bin_tag
+{
+   /* Definitions */
+   TR_BIN_NAME = 1,        /**< id, length, characters */
+   TR_BIN_BLOB,            /**< id, size, bytes */
+
+   /* Calls */
+   TR_BIN_CALL_BEGIN,      /**< call number, class id, method id */
+   TR_BIN_CALL_END,
+   TR_BIN_ARG,             /**< name id, value */
+   TR_BIN_RET,             /**< value */
+
+   /* Values */
+   TR_BIN_NULL,
+   TR_BIN_FALSE,
+   TR_BIN_TRUE,
+   TR_BIN_INT,             /**< zig-zag varint */
+   TR_BIN_UINT,            /**< varint */
+   TR_BIN_FLOAT,           /**< double */
+   TR_BIN_PTR,             /**< varint */
+   TR_BIN_ENUM,            /**< name id, value varint */
+   TR_BIN_STRING,          /**< blob id */
+   TR_BIN_BYTES,           /**< blob id */
+   TR_BIN_ARRAY_BEGIN,     /**< values */
+   TR_BIN_ARRAY_END,
+   TR_BIN_STRUCT_BEGIN,    /**< name id, members */
+   TR_BIN_STRUCT_END,
+   TR_BIN_MEMBER           /**< name id, value */
+};
+
+
+#endif /* TR_BINARY_H */
@@ -374,7 +374,7 @@ static INLINE boolean
 trace_context_get_query_result(struct pipe_context *_pipe,
                                struct pipe_query *query,
                                boolean wait,
-                               uint64_t *presult)
+                               union pipe_query_result *presult)
 {
    struct trace_context *tr_ctx = trace_context(_pipe);
    struct pipe_context *pipe = tr_ctx->pipe;
@@ -386,7 +386,7 @@ trace_context_get_query_result(struct pipe_context *_pipe,
    trace_dump_arg(ptr, pipe);
 
    _result = pipe->get_query_result(pipe, query, wait, presult);;
-   result = *presult;
+   result = presult->u64;
 
    trace_dump_arg(uint, result);
    trace_dump_ret(bool, _result);
@@ -1084,6 +1084,7 @@ trace_context_surface_fill(struct pipe_context *_pipe,
    trace_dump_arg(uint, dsty);
    trace_dump_arg(uint, width);
    trace_dump_arg(uint, height);
+   trace_dump_arg(uint, value);
 
    pipe->surface_fill(pipe, dst, dstx, dsty, width, height, value);;
 
@@ -1155,6 +1156,34 @@ trace_context_destroy(struct pipe_context *_pipe)
    FREE(tr_ctx);
 }
 
+static boolean
+trace_context_generate_mipmap(struct pipe_context *_pipe,
+                              struct pipe_texture *_texture,
+                              unsigned face,
+                              unsigned baseLevel, unsigned lastLevel)
+{
+   struct trace_context *tr_ctx = trace_context(_pipe);
+   struct trace_texture *tr_tex = trace_texture(_texture);
+   struct pipe_context *pipe = tr_ctx->pipe;
+   struct pipe_texture *texture = tr_tex->texture;
+   boolean result;
+
+   trace_dump_call_begin("pipe_context", "generate_mipmap");
+   trace_dump_arg(ptr, pipe);
+   trace_dump_arg(ptr, texture);
+   trace_dump_arg(uint, face);
+   trace_dump_arg(uint, baseLevel);
+   trace_dump_arg(uint, lastLevel);
+
+   result = pipe->generate_mipmap(pipe, texture, face, baseLevel, lastLevel);
+
+   trace_dump_ret(bool, result);
+   trace_dump_call_end();
+
+   return result;
+}
+
+
 static unsigned int
 trace_is_texture_referenced( struct pipe_context *_pipe,
 			    struct pipe_texture *_texture,
@@ -1279,6 +1308,8 @@ trace_context_create(struct pipe_screen *_screen,
    tr_ctx->base.set_vertex_elements = trace_context_set_vertex_elements;
    tr_ctx->base.surface_copy = trace_context_surface_copy;
    tr_ctx->base.surface_fill = trace_context_surface_fill;
+   tr_ctx->base.generate_mipmap = pipe->generate_mipmap ?
+                                  trace_context_generate_mipmap : NULL;
    tr_ctx->base.clear = trace_context_clear;
    tr_ctx->base.flush = trace_context_flush;
    tr_ctx->base.is_texture_referenced = trace_is_texture_referenced;
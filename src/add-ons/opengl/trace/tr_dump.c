@@ -30,10 +30,15 @@
  * @file
  * Trace dumping functions.
  *
- * For now we just use standard XML for dumping the trace calls, as this is
- * simple to write, parse, and visually inspect, but the actual representation
- * is abstracted out of this file, so that we can switch to a binary
- * representation if/when it becomes justified.
+ * By default the trace calls are dumped as standard XML, as this is simple to
+ * write, parse, and visually inspect.  Setting GALLIUM_TRACE_FORMAT=binary
+ * selects the much more compact encoding described in tr_binary.h instead,
+ * which is what tr_replay reads.
+ *
+ * The output is handed to a background thread which writes it to the file,
+ * unless GALLIUM_TRACE_SYNC is set, in which case every call is written and
+ * flushed before returning, so that nothing is lost if the application
+ * crashes.
  *
  * @author Jose Fonseca <jrfonseca@tungstengraphics.com>
  */
@@ -47,10 +52,14 @@
 #include "pipe/p_compiler.h"
 #include "pipe/p_thread.h"
 #include "util/u_debug.h"
+#include "util/u_hash.h"
+#include "util/u_hash_table.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_string.h"
 #include "util/u_stream.h"
 
+#include "tr_binary.h"
 #include "tr_dump.h"
 #include "tr_screen.h"
 #include "tr_texture.h"
@@ -63,13 +72,245 @@ static pipe_mutex call_mutex;
 static long unsigned call_no = 0;
 static boolean dumping = FALSE;
 static boolean initialized = FALSE;
+static boolean binary = FALSE;
+static boolean async = FALSE;
+
+
+/*
+ * Asynchronous output.
+ *
+ * The dump is accumulated in chunks which are queued for a writer thread.
+ * At most TRACE_MAX_CHUNKS are allocated, after which the application
+ * waits for the writer to catch up.
+ */
+
+#define TRACE_CHUNK_SIZE (256 * 1024)
+#define TRACE_MAX_CHUNKS 16
+
+#if defined(PIPE_THREAD_HAVE_CONDVAR)
+
+struct trace_chunk
+{
+   struct trace_chunk *next;
+   size_t used;
+   char data[TRACE_CHUNK_SIZE];
+};
+
+static struct trace_chunk *chunk = NULL;  /**< chunk being filled */
+static struct trace_chunk *queue_head = NULL;
+static struct trace_chunk *queue_tail = NULL;
+static struct trace_chunk *free_chunks = NULL;
+static unsigned num_chunks = 0;
+static unsigned num_pending = 0;  /**< queued or being written */
+static boolean writer_quit = FALSE;
+static pipe_thread writer_thread;
+static pipe_mutex queue_mutex;
+static pipe_condvar queue_cond;
+
+
+static PIPE_THREAD_ROUTINE(trace_dump_writer, param)
+{
+   struct trace_chunk *c;
+
+   pipe_mutex_lock(queue_mutex);
+   for (;;) {
+      while (!queue_head && !writer_quit)
+         pipe_condvar_wait(queue_cond, queue_mutex);
+
+      c = queue_head;
+      if (!c)
+         break;
+
+      queue_head = c->next;
+      if (!queue_head)
+         queue_tail = NULL;
+      pipe_mutex_unlock(queue_mutex);
+
+      util_stream_write(stream, c->data, c->used);
+
+      pipe_mutex_lock(queue_mutex);
+      c->next = free_chunks;
+      free_chunks = c;
+      --num_pending;
+      pipe_condvar_broadcast(queue_cond);
+   }
+   pipe_mutex_unlock(queue_mutex);
+
+   return NULL;
+}
+
+
+static void
+trace_dump_queue_chunk(void)
+{
+   pipe_mutex_lock(queue_mutex);
+   chunk->next = NULL;
+   if (queue_tail)
+      queue_tail->next = chunk;
+   else
+      queue_head = chunk;
+   queue_tail = chunk;
+   ++num_pending;
+   pipe_condvar_broadcast(queue_cond);
+   pipe_mutex_unlock(queue_mutex);
+
+   chunk = NULL;
+}
+
+
+/**
+ * Wait until everything queued has been written.
+ */
+static void
+trace_dump_drain(void)
+{
+   pipe_mutex_lock(queue_mutex);
+   while (num_pending)
+      pipe_condvar_wait(queue_cond, queue_mutex);
+   pipe_mutex_unlock(queue_mutex);
+}
+
+
+static struct trace_chunk *
+trace_dump_get_chunk(void)
+{
+   struct trace_chunk *c = NULL;
+
+   pipe_mutex_lock(queue_mutex);
+   while (!free_chunks && num_chunks >= TRACE_MAX_CHUNKS)
+      pipe_condvar_wait(queue_cond, queue_mutex);
+   if (free_chunks) {
+      c = free_chunks;
+      free_chunks = c->next;
+   }
+   else {
+      c = MALLOC_STRUCT(trace_chunk);
+      if (c)
+         ++num_chunks;
+   }
+   pipe_mutex_unlock(queue_mutex);
+
+   if (c)
+      c->used = 0;
+
+   return c;
+}
+
+
+static void
+trace_dump_write_async(const char *buf, size_t size)
+{
+   while (size) {
+      size_t n;
+
+      if (!chunk) {
+         chunk = trace_dump_get_chunk();
+         if (!chunk) {
+            /* out of memory, write it ourselves but keep the order */
+            trace_dump_drain();
+            util_stream_write(stream, buf, size);
+            return;
+         }
+      }
+
+      n = MIN2(size, TRACE_CHUNK_SIZE - chunk->used);
+      memcpy(chunk->data + chunk->used, buf, n);
+      chunk->used += n;
+      buf += n;
+      size -= n;
+
+      if (chunk->used == TRACE_CHUNK_SIZE)
+         trace_dump_queue_chunk();
+   }
+}
+
+
+static boolean
+trace_dump_writer_start(void)
+{
+   pipe_mutex_init(queue_mutex);
+   pipe_condvar_init(queue_cond);
+   writer_quit = FALSE;
+
+   writer_thread = pipe_thread_create(trace_dump_writer, NULL);
+   if (!writer_thread) {
+      pipe_condvar_destroy(queue_cond);
+      pipe_mutex_destroy(queue_mutex);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Write out whatever is left and stop the writer thread.
+ */
+static void
+trace_dump_writer_finish(void)
+{
+   struct trace_chunk *c;
+
+   if (chunk) {
+      if (chunk->used) {
+         trace_dump_queue_chunk();
+      }
+      else {
+         FREE(chunk);
+         chunk = NULL;
+         --num_chunks;
+      }
+   }
+
+   pipe_mutex_lock(queue_mutex);
+   writer_quit = TRUE;
+   pipe_condvar_broadcast(queue_cond);
+   pipe_mutex_unlock(queue_mutex);
+
+   pipe_thread_wait(writer_thread);
+
+   while (free_chunks) {
+      c = free_chunks;
+      free_chunks = c->next;
+      FREE(c);
+   }
+   num_chunks = 0;
+
+   pipe_condvar_destroy(queue_cond);
+   pipe_mutex_destroy(queue_mutex);
+}
+
+#else /* !PIPE_THREAD_HAVE_CONDVAR */
+
+static INLINE void
+trace_dump_write_async(const char *buf, size_t size)
+{
+   util_stream_write(stream, buf, size);
+}
+
+static INLINE boolean
+trace_dump_writer_start(void)
+{
+   return FALSE;
+}
+
+static INLINE void
+trace_dump_writer_finish(void)
+{
+}
+
+#endif /* !PIPE_THREAD_HAVE_CONDVAR */
 
 
 static INLINE void
 trace_dump_write(const char *buf, size_t size)
 {
-   if(stream)
-      util_stream_write(stream, buf, size);
+   if(stream) {
+      if(async)
+         trace_dump_write_async(buf, size);
+      else
+         util_stream_write(stream, buf, size);
+   }
 }
 
 
@@ -215,11 +456,253 @@ trace_dump_tag_end(const char *name)
    trace_dump_writes(">");
 }
 
+
+/*
+ * Binary encoding, see tr_binary.h.
+ */
+
+/**
+ * Identifies a blob by its contents.  The contents themselves aren't
+ * kept, that would hold every texture and buffer ever traced in memory;
+ * two checksums and the size make a false match negligible.
+ */
+struct trace_blob_key
+{
+   uint32_t size;
+   uint32_t crc32;
+   uint64_t fnv;
+};
+
+/** Forget the blobs seen so far once there are this many */
+#define TRACE_BIN_MAX_BLOBS 65536
+
+static struct hash_table *names = NULL;   /**< name -> id + 1 */
+static struct hash_table *blobs = NULL;   /**< trace_blob_key -> id + 1 */
+static unsigned num_names = 0;
+static unsigned num_blobs = 0;
+static unsigned num_blob_keys = 0;
+
+
+static INLINE void
+trace_bin_tag(enum tr_bin_tag tag)
+{
+   char c = (char) tag;
+   trace_dump_write(&c, 1);
+}
+
+
+static void
+trace_bin_uint(uint64_t value)
+{
+   char buf[10];
+   unsigned n = 0;
+
+   do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      if (value)
+         byte |= 0x80;
+      buf[n++] = (char) byte;
+   } while (value);
+
+   trace_dump_write(buf, n);
+}
+
+
+static INLINE void
+trace_bin_int(int64_t value)
+{
+   trace_bin_uint(((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+
+static void
+trace_bin_double(double value)
+{
+   union { double f; uint64_t u; } x;
+   char buf[8];
+   unsigned i;
+
+   x.f = value;
+   for (i = 0; i < 8; ++i)
+      buf[i] = (char) (x.u >> (8 * i));
+
+   trace_dump_write(buf, 8);
+}
+
+
+static unsigned
+trace_bin_name_hash(void *key)
+{
+   return util_hash_crc32(key, strlen((const char *) key));
+}
+
+
+static int
+trace_bin_name_compare(void *key1, void *key2)
+{
+   return strcmp((const char *) key1, (const char *) key2);
+}
+
+
+static unsigned
+trace_bin_blob_hash(void *key)
+{
+   const struct trace_blob_key *blob = (const struct trace_blob_key *) key;
+   return blob->crc32 ^ blob->size;
+}
+
+
+static int
+trace_bin_blob_compare(void *key1, void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct trace_blob_key));
+}
+
+
+static enum pipe_error
+trace_bin_free_key(void *key, void *value, void *data)
+{
+   FREE(key);
+   return PIPE_OK;
+}
+
+
+/**
+ * Return the id of a name, defining it first if it is new.
+ */
+static unsigned
+trace_bin_name(const char *name)
+{
+   size_t len = strlen(name);
+   void *value;
+   char *key;
+
+   value = hash_table_get(names, (void *) name);
+   if (value)
+      return (unsigned) (uintptr_t) value - 1;
+
+   key = MALLOC(len + 1);
+   if (key) {
+      memcpy(key, name, len + 1);
+      if (hash_table_set(names, key,
+                         (void *) (uintptr_t) (num_names + 1)) != PIPE_OK)
+         FREE(key);
+   }
+
+   trace_bin_tag(TR_BIN_NAME);
+   trace_bin_uint(num_names);
+   trace_bin_uint(len);
+   trace_dump_write(name, len);
+
+   return num_names++;
+}
+
+
+static uint64_t
+trace_bin_fnv1a(const uint8_t *data, size_t size)
+{
+   uint64_t hash = 14695981039346656037ULL;
+
+   while (size--) {
+      hash ^= *data++;
+      hash *= 1099511628211ULL;
+   }
+
+   return hash;
+}
+
+
+/**
+ * Return the id of a blob, defining it first if no blob with the same
+ * contents was seen yet.
+ */
+static unsigned
+trace_bin_blob(const void *data, size_t size)
+{
+   struct trace_blob_key key, *new_key;
+   void *value;
+
+   key.size = (uint32_t) size;
+   key.crc32 = util_hash_crc32(data, size);
+   key.fnv = trace_bin_fnv1a((const uint8_t *) data, size);
+
+   value = hash_table_get(blobs, &key);
+   if (value)
+      return (unsigned) (uintptr_t) value - 1;
+
+   /* Blobs are written again after this, but the table stays bounded */
+   if (num_blob_keys == TRACE_BIN_MAX_BLOBS) {
+      hash_table_foreach(blobs, trace_bin_free_key, NULL);
+      hash_table_clear(blobs);
+      num_blob_keys = 0;
+   }
+
+   new_key = MALLOC_STRUCT(trace_blob_key);
+   if (new_key) {
+      *new_key = key;
+      if (hash_table_set(blobs, new_key,
+                         (void *) (uintptr_t) (num_blobs + 1)) != PIPE_OK)
+         FREE(new_key);
+      else
+         num_blob_keys++;
+   }
+
+   trace_bin_tag(TR_BIN_BLOB);
+   trace_bin_uint(num_blobs);
+   trace_bin_uint(size);
+   trace_dump_write(data, size);
+
+   return num_blobs++;
+}
+
+
+static boolean
+trace_bin_begin(void)
+{
+   names = hash_table_create(trace_bin_name_hash, trace_bin_name_compare);
+   blobs = hash_table_create(trace_bin_blob_hash, trace_bin_blob_compare);
+   if (!names || !blobs)
+      return FALSE;
+
+   num_names = 0;
+   num_blobs = 0;
+   num_blob_keys = 0;
+
+   trace_dump_write(TR_BIN_MAGIC, TR_BIN_MAGIC_SIZE);
+   trace_bin_uint(TR_BIN_VERSION);
+
+   return TRUE;
+}
+
+
+static void
+trace_bin_end(void)
+{
+   if (names) {
+      hash_table_foreach(names, trace_bin_free_key, NULL);
+      hash_table_destroy(names);
+      names = NULL;
+   }
+   if (blobs) {
+      hash_table_foreach(blobs, trace_bin_free_key, NULL);
+      hash_table_destroy(blobs);
+      blobs = NULL;
+   }
+}
+
+
 static void
 trace_dump_trace_close(void)
 {
    if(stream) {
-      trace_dump_writes("</trace>\n");
+      if(binary)
+         trace_bin_end();
+      else
+         trace_dump_writes("</trace>\n");
+      if(async)
+         trace_dump_writer_finish();
+      async = FALSE;
       util_stream_close(stream);
       stream = NULL;
       refcount = 0;
@@ -250,13 +733,33 @@ boolean trace_dump_trace_begin()
 
    if(!stream) {
 
+      const char *format = debug_get_option("GALLIUM_TRACE_FORMAT", "xml");
+
       stream = util_stream_create(filename, 0);
       if(!stream)
          return FALSE;
 
-      trace_dump_writes("<?xml version='1.0' encoding='UTF-8'?>\n");
-      trace_dump_writes("<?xml-stylesheet type='text/xsl' href='trace.xsl'?>\n");
-      trace_dump_writes("<trace version='0.1'>\n");
+      binary = strcmp(format, "binary") == 0;
+
+      if(!debug_get_bool_option("GALLIUM_TRACE_SYNC", FALSE))
+         async = trace_dump_writer_start();
+
+      if(binary) {
+         if(!trace_bin_begin()) {
+            trace_bin_end();
+            if(async)
+               trace_dump_writer_finish();
+            async = FALSE;
+            util_stream_close(stream);
+            stream = NULL;
+            return FALSE;
+         }
+      }
+      else {
+         trace_dump_writes("<?xml version='1.0' encoding='UTF-8'?>\n");
+         trace_dump_writes("<?xml-stylesheet type='text/xsl' href='trace.xsl'?>\n");
+         trace_dump_writes("<trace version='0.1'>\n");
+      }
 
 #if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_SOLARIS)
       /* Linux applications rarely cleanup GL / Gallium resources so catch
@@ -348,6 +851,17 @@ void trace_dump_call_begin_locked(const char *klass, const char *method)
       return;
 
    ++call_no;
+
+   if (binary) {
+      unsigned klass_id = trace_bin_name(klass);
+      unsigned method_id = trace_bin_name(method);
+      trace_bin_tag(TR_BIN_CALL_BEGIN);
+      trace_bin_uint(call_no);
+      trace_bin_uint(klass_id);
+      trace_bin_uint(method_id);
+      return;
+   }
+
    trace_dump_indent(1);
    trace_dump_writes("<call no=\'");
    trace_dump_writef("%lu", call_no);
@@ -364,10 +878,17 @@ void trace_dump_call_end_locked(void)
    if (!dumping)
       return;
 
-   trace_dump_indent(1);
-   trace_dump_tag_end("call");
-   trace_dump_newline();
-   util_stream_flush(stream);
+   if (binary) {
+      trace_bin_tag(TR_BIN_CALL_END);
+   }
+   else {
+      trace_dump_indent(1);
+      trace_dump_tag_end("call");
+      trace_dump_newline();
+   }
+
+   if (!async)
+      util_stream_flush(stream);
 }
 
 void trace_dump_call_begin(const char *klass, const char *method)
@@ -387,6 +908,13 @@ void trace_dump_arg_begin(const char *name)
    if (!dumping)
       return;
 
+   if (binary) {
+      unsigned id = trace_bin_name(name);
+      trace_bin_tag(TR_BIN_ARG);
+      trace_bin_uint(id);
+      return;
+   }
+
    trace_dump_indent(2);
    trace_dump_tag_begin1("arg", "name", name);
 }
@@ -396,6 +924,9 @@ void trace_dump_arg_end(void)
    if (!dumping)
       return;
 
+   if (binary)
+      return;
+
    trace_dump_tag_end("arg");
    trace_dump_newline();
 }
@@ -405,6 +936,11 @@ void trace_dump_ret_begin(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_RET);
+      return;
+   }
+
    trace_dump_indent(2);
    trace_dump_tag_begin("ret");
 }
@@ -414,6 +950,9 @@ void trace_dump_ret_end(void)
    if (!dumping)
       return;
 
+   if (binary)
+      return;
+
    trace_dump_tag_end("ret");
    trace_dump_newline();
 }
@@ -423,6 +962,11 @@ void trace_dump_bool(int value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(value ? TR_BIN_TRUE : TR_BIN_FALSE);
+      return;
+   }
+
    trace_dump_writef("<bool>%c</bool>", value ? '1' : '0');
 }
 
@@ -431,6 +975,12 @@ void trace_dump_int(long long int value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_INT);
+      trace_bin_int(value);
+      return;
+   }
+
    trace_dump_writef("<int>%lli</int>", value);
 }
 
@@ -439,6 +989,12 @@ void trace_dump_uint(long long unsigned value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_UINT);
+      trace_bin_uint(value);
+      return;
+   }
+
    trace_dump_writef("<uint>%llu</uint>", value);
 }
 
@@ -447,6 +1003,12 @@ void trace_dump_float(double value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_FLOAT);
+      trace_bin_double(value);
+      return;
+   }
+
    trace_dump_writef("<float>%g</float>", value);
 }
 
@@ -460,6 +1022,13 @@ void trace_dump_bytes(const void *data,
    if (!dumping)
       return;
 
+   if (binary) {
+      unsigned id = trace_bin_blob(data, size);
+      trace_bin_tag(TR_BIN_BYTES);
+      trace_bin_uint(id);
+      return;
+   }
+
    trace_dump_writes("<bytes>");
    for(i = 0; i < size; ++i) {
       uint8_t byte = *p++;
@@ -476,18 +1045,33 @@ void trace_dump_string(const char *str)
    if (!dumping)
       return;
 
+   if (binary) {
+      unsigned id = trace_bin_blob(str, strlen(str));
+      trace_bin_tag(TR_BIN_STRING);
+      trace_bin_uint(id);
+      return;
+   }
+
    trace_dump_writes("<string>");
    trace_dump_escape(str);
    trace_dump_writes("</string>");
 }
 
-void trace_dump_enum(const char *value)
+void trace_dump_enum(const char *name, long long unsigned value)
 {
    if (!dumping)
       return;
 
+   if (binary) {
+      unsigned id = trace_bin_name(name);
+      trace_bin_tag(TR_BIN_ENUM);
+      trace_bin_uint(id);
+      trace_bin_uint(value);
+      return;
+   }
+
    trace_dump_writes("<enum>");
-   trace_dump_escape(value);
+   trace_dump_escape(name);
    trace_dump_writes("</enum>");
 }
 
@@ -496,6 +1080,11 @@ void trace_dump_array_begin(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_ARRAY_BEGIN);
+      return;
+   }
+
    trace_dump_writes("<array>");
 }
 
@@ -504,6 +1093,11 @@ void trace_dump_array_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_ARRAY_END);
+      return;
+   }
+
    trace_dump_writes("</array>");
 }
 
@@ -512,6 +1106,9 @@ void trace_dump_elem_begin(void)
    if (!dumping)
       return;
 
+   if (binary)
+      return;
+
    trace_dump_writes("<elem>");
 }
 
@@ -520,6 +1117,9 @@ void trace_dump_elem_end(void)
    if (!dumping)
       return;
 
+   if (binary)
+      return;
+
    trace_dump_writes("</elem>");
 }
 
@@ -528,6 +1128,13 @@ void trace_dump_struct_begin(const char *name)
    if (!dumping)
       return;
 
+   if (binary) {
+      unsigned id = trace_bin_name(name);
+      trace_bin_tag(TR_BIN_STRUCT_BEGIN);
+      trace_bin_uint(id);
+      return;
+   }
+
    trace_dump_writef("<struct name='%s'>", name);
 }
 
@@ -536,6 +1143,11 @@ void trace_dump_struct_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_STRUCT_END);
+      return;
+   }
+
    trace_dump_writes("</struct>");
 }
 
@@ -544,6 +1156,13 @@ void trace_dump_member_begin(const char *name)
    if (!dumping)
       return;
 
+   if (binary) {
+      unsigned id = trace_bin_name(name);
+      trace_bin_tag(TR_BIN_MEMBER);
+      trace_bin_uint(id);
+      return;
+   }
+
    trace_dump_writef("<member name='%s'>", name);
 }
 
@@ -552,6 +1171,9 @@ void trace_dump_member_end(void)
    if (!dumping)
       return;
 
+   if (binary)
+      return;
+
    trace_dump_writes("</member>");
 }
 
@@ -560,6 +1182,11 @@ void trace_dump_null(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_tag(TR_BIN_NULL);
+      return;
+   }
+
    trace_dump_writes("<null/>");
 }
 
@@ -568,7 +1195,11 @@ void trace_dump_ptr(const void *value)
    if (!dumping)
       return;
 
-   if(value)
+   if(value && binary) {
+      trace_bin_tag(TR_BIN_PTR);
+      trace_bin_uint((uintptr_t)value);
+   }
+   else if(value)
       trace_dump_writef("<ptr>0x%08lx</ptr>", (unsigned long)(uintptr_t)value);
    else
       trace_dump_null();
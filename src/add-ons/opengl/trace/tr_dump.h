@@ -93,7 +93,7 @@ void trace_dump_uint(long long unsigned value);
 void trace_dump_float(double value);
 void trace_dump_bytes(const void *data, long unsigned size);
 void trace_dump_string(const char *str);
-void trace_dump_enum(const char *value);
+void trace_dump_enum(const char *name, long long unsigned value);
 void trace_dump_array_begin(void);
 void trace_dump_array_end(void);
 void trace_dump_elem_begin(void);
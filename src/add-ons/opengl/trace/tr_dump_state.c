@@ -36,7 +36,7 @@
 
 void trace_dump_format(enum pipe_format format)
 {
-   trace_dump_enum(pf_name(format) );
+   trace_dump_enum(pf_name(format), format);
 }
 
 
@@ -0,0 +1,2152 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * @file
+ * Replay binary traces against softpipe.
+ *
+ * Reads a trace written with GALLIUM_TRACE_FORMAT=binary (see tr_binary.h)
+ * and executes every pipe_screen and pipe_context call again on a
+ * softpipe screen.  Objects are tracked by the pointer values recorded in
+ * the trace, so the replay does not depend on where anything ends up in
+ * memory.
+ *
+ * Usage: gallium_replay [-t] [-c] [-v] trace
+ *
+ *   -t  time every replayed call and print a per-method summary
+ *   -c  print a checksum of every presented surface, for regression tests
+ *   -v  print every call as it is replayed
+ *
+ * Calls which only query the driver (get_param, is_format_supported,
+ * fence calls, ...) are skipped.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_inlines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "pipe/internal/p_winsys_screen.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_hash.h"
+#include "util/u_hash_table.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "util/u_time.h"
+
+#include "sp_winsys.h"
+
+#include "tr_binary.h"
+
+
+#define REPLAY_MAX_TOKENS 4096
+
+/** Number of values per arena chunk */
+#define REPLAY_ARENA_CHUNK 256
+
+
+/*
+ * Malloc based winsys.
+ */
+
+struct replay_buffer
+{
+   struct pipe_buffer base;
+   void *data;
+   boolean user;
+};
+
+
+static void
+replay_winsys_destroy(struct pipe_winsys *ws)
+{
+   FREE(ws);
+}
+
+
+static const char *
+replay_winsys_get_name(struct pipe_winsys *ws)
+{
+   return "replay";
+}
+
+
+static void
+replay_winsys_flush_frontbuffer(struct pipe_winsys *ws,
+                                struct pipe_surface *surf,
+                                void *context_private)
+{
+}
+
+
+static struct pipe_buffer *
+replay_winsys_buffer_create(struct pipe_winsys *ws, unsigned alignment,
+                            unsigned usage, unsigned size)
+{
+   struct replay_buffer *buf = CALLOC_STRUCT(replay_buffer);
+   if (!buf)
+      return NULL;
+
+   pipe_reference_init(&buf->base.reference, 1);
+   buf->base.alignment = alignment;
+   buf->base.usage = usage;
+   buf->base.size = size;
+   buf->data = align_malloc(size, MAX2(alignment, 16));
+   if (!buf->data) {
+      FREE(buf);
+      return NULL;
+   }
+
+   return &buf->base;
+}
+
+
+static struct pipe_buffer *
+replay_winsys_user_buffer_create(struct pipe_winsys *ws, void *ptr,
+                                 unsigned bytes)
+{
+   struct replay_buffer *buf = CALLOC_STRUCT(replay_buffer);
+   if (!buf)
+      return NULL;
+
+   pipe_reference_init(&buf->base.reference, 1);
+   buf->base.size = bytes;
+   buf->data = ptr;
+   buf->user = TRUE;
+
+   return &buf->base;
+}
+
+
+static struct pipe_buffer *
+replay_winsys_surface_buffer_create(struct pipe_winsys *ws,
+                                    unsigned width, unsigned height,
+                                    enum pipe_format format,
+                                    unsigned usage, unsigned *stride)
+{
+   const unsigned alignment = 64;
+   struct pipe_format_block block;
+   unsigned nblocksx, nblocksy;
+
+   pf_get_block(format, &block);
+   nblocksx = pf_get_nblocksx(&block, width);
+   nblocksy = pf_get_nblocksy(&block, height);
+   *stride = align(nblocksx * block.size, alignment);
+
+   return ws->buffer_create(ws, alignment, usage, *stride * nblocksy);
+}
+
+
+static void *
+replay_winsys_buffer_map(struct pipe_winsys *ws, struct pipe_buffer *buf,
+                         unsigned usage)
+{
+   return ((struct replay_buffer *) buf)->data;
+}
+
+
+static void
+replay_winsys_buffer_unmap(struct pipe_winsys *ws, struct pipe_buffer *buf)
+{
+}
+
+
+static void
+replay_winsys_buffer_destroy(struct pipe_buffer *buf)
+{
+   struct replay_buffer *rbuf = (struct replay_buffer *) buf;
+
+   if (!rbuf->user)
+      align_free(rbuf->data);
+   FREE(rbuf);
+}
+
+
+static void
+replay_winsys_fence_reference(struct pipe_winsys *ws,
+                              struct pipe_fence_handle **ptr,
+                              struct pipe_fence_handle *fence)
+{
+}
+
+
+static int
+replay_winsys_fence_signalled(struct pipe_winsys *ws,
+                              struct pipe_fence_handle *fence,
+                              unsigned flag)
+{
+   return 0;
+}
+
+
+static int
+replay_winsys_fence_finish(struct pipe_winsys *ws,
+                           struct pipe_fence_handle *fence,
+                           unsigned flag)
+{
+   return 0;
+}
+
+
+static struct pipe_winsys *
+replay_winsys_create(void)
+{
+   struct pipe_winsys *ws = CALLOC_STRUCT(pipe_winsys);
+   if (!ws)
+      return NULL;
+
+   ws->destroy = replay_winsys_destroy;
+   ws->get_name = replay_winsys_get_name;
+   ws->flush_frontbuffer = replay_winsys_flush_frontbuffer;
+   ws->buffer_create = replay_winsys_buffer_create;
+   ws->user_buffer_create = replay_winsys_user_buffer_create;
+   ws->surface_buffer_create = replay_winsys_surface_buffer_create;
+   ws->buffer_map = replay_winsys_buffer_map;
+   ws->buffer_unmap = replay_winsys_buffer_unmap;
+   ws->buffer_destroy = replay_winsys_buffer_destroy;
+   ws->fence_reference = replay_winsys_fence_reference;
+   ws->fence_signalled = replay_winsys_fence_signalled;
+   ws->fence_finish = replay_winsys_fence_finish;
+
+   return ws;
+}
+
+
+/*
+ * Trace decoding.
+ */
+
+/**
+ * A decoded value.  Arguments and struct members carry their name, array
+ * elements and struct members are linked through next.
+ */
+struct replay_value
+{
+   enum tr_bin_tag type;
+   const char *name;
+   union {
+      int64_t i;
+      uint64_t u;
+      double f;
+      struct {
+         const void *data;
+         size_t size;
+      } blob;
+   } u;
+   struct replay_value *children;
+   struct replay_value *next;
+   unsigned num_children;
+};
+
+
+/**
+ * Values are allocated from chunks which are reused for every call.
+ */
+struct replay_arena_chunk
+{
+   struct replay_value values[REPLAY_ARENA_CHUNK];
+   struct replay_arena_chunk *next;
+};
+
+
+struct replay_blob
+{
+   void *data;
+   size_t size;
+};
+
+
+struct replay_call
+{
+   uint64_t no;
+   unsigned klass;
+   unsigned method;
+   struct replay_value *args;
+   struct replay_value *ret;
+};
+
+
+struct replay_state;
+
+typedef void (*replay_func)(struct replay_state *r,
+                            const struct replay_call *call);
+
+
+/**
+ * Statistics of one replayed method.
+ */
+struct replay_method_stats
+{
+   unsigned count;
+   int64_t usecs;
+};
+
+
+struct replay_method
+{
+   const char *klass;
+   const char *method;
+   replay_func func;
+};
+
+
+/**
+ * Resolved method of an interned method name.
+ */
+struct replay_method_cache
+{
+   unsigned klass;
+   const struct replay_method *method;
+};
+
+
+enum replay_object_type
+{
+   REPLAY_OBJECT_OTHER,
+   REPLAY_OBJECT_BUFFER,
+   REPLAY_OBJECT_TEXTURE,
+   REPLAY_OBJECT_SURFACE,
+   REPLAY_OBJECT_TRANSFER,
+   REPLAY_OBJECT_CONTEXT
+};
+
+
+struct replay_object
+{
+   enum replay_object_type type;
+   void *object;
+};
+
+
+struct replay_state
+{
+   FILE *file;
+
+   char **names;
+   unsigned num_names;
+   unsigned max_names;
+
+   struct replay_blob *blobs;
+   unsigned num_blobs;
+
+   struct replay_arena_chunk *arena;
+   struct replay_arena_chunk *arena_chunk;
+   unsigned arena_used;
+
+   struct replay_method_cache *methods;
+
+   /** trace pointer -> struct replay_object */
+   struct hash_table *objects;
+
+   struct pipe_winsys *winsys;
+   struct pipe_screen *screen;
+
+   struct tgsi_token tokens[REPLAY_MAX_TOKENS];
+
+   boolean timing;
+   boolean checksum;
+   boolean verbose;
+
+   unsigned frames;
+   struct replay_method_stats *stats;
+};
+
+
+static void
+replay_error(struct replay_state *r, const char *msg)
+{
+   fprintf(stderr, "gallium_replay: %s at offset %ld\n",
+           msg, ftell(r->file));
+   exit(1);
+}
+
+
+static uint64_t
+read_uint(struct replay_state *r)
+{
+   uint64_t value = 0;
+   unsigned shift = 0;
+   int c;
+
+   do {
+      c = getc(r->file);
+      if (c == EOF)
+         replay_error(r, "unexpected end of file");
+      value |= (uint64_t) (c & 0x7f) << shift;
+      shift += 7;
+   } while (c & 0x80);
+
+   return value;
+}
+
+
+static int64_t
+read_int(struct replay_state *r)
+{
+   uint64_t value = read_uint(r);
+   return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+
+static double
+read_double(struct replay_state *r)
+{
+   uint8_t bytes[8];
+   uint64_t bits = 0;
+   double value;
+   int i;
+
+   if (fread(bytes, 1, 8, r->file) != 8)
+      replay_error(r, "unexpected end of file");
+
+   for (i = 7; i >= 0; i--)
+      bits = (bits << 8) | bytes[i];
+
+   memcpy(&value, &bits, sizeof value);
+   return value;
+}
+
+
+/**
+ * Read bytes into a new NUL-terminated allocation.
+ */
+static void *
+read_data(struct replay_state *r, size_t size)
+{
+   char *data = MALLOC(size + 1);
+   if (!data)
+      replay_error(r, "out of memory");
+
+   if (size && fread(data, 1, size, r->file) != size)
+      replay_error(r, "unexpected end of file");
+   data[size] = 0;
+
+   return data;
+}
+
+
+static void
+read_name_definition(struct replay_state *r)
+{
+   unsigned id = (unsigned) read_uint(r);
+   size_t len = (size_t) read_uint(r);
+
+   if (id >= r->max_names) {
+      unsigned max = MAX2(id + 1, r->max_names * 2);
+      r->names = REALLOC(r->names, r->max_names * sizeof *r->names,
+                         max * sizeof *r->names);
+      r->methods = REALLOC(r->methods, r->max_names * sizeof *r->methods,
+                           max * sizeof *r->methods);
+      if (!r->names || !r->methods)
+         replay_error(r, "out of memory");
+      memset(r->names + r->max_names, 0,
+             (max - r->max_names) * sizeof *r->names);
+      memset(r->methods + r->max_names, 0,
+             (max - r->max_names) * sizeof *r->methods);
+      r->max_names = max;
+   }
+
+   FREE(r->names[id]);
+   r->names[id] = read_data(r, len);
+   r->num_names = MAX2(r->num_names, id + 1);
+}
+
+
+static void
+read_blob_definition(struct replay_state *r)
+{
+   unsigned id = (unsigned) read_uint(r);
+   size_t size = (size_t) read_uint(r);
+
+   /* Blobs are numbered consecutively */
+   if (id != r->num_blobs)
+      replay_error(r, "bad blob id");
+
+   r->blobs = REALLOC(r->blobs, r->num_blobs * sizeof *r->blobs,
+                      (r->num_blobs + 1) * sizeof *r->blobs);
+   if (!r->blobs)
+      replay_error(r, "out of memory");
+
+   r->blobs[id].data = read_data(r, size);
+   r->blobs[id].size = size;
+   r->num_blobs++;
+}
+
+
+/**
+ * Return the next structural tag, consuming name and blob definitions.
+ * Returns 0 at the end of the file.
+ */
+static int
+read_tag(struct replay_state *r)
+{
+   for (;;) {
+      int tag = getc(r->file);
+      switch (tag) {
+      case EOF:
+         return 0;
+      case TR_BIN_NAME:
+         read_name_definition(r);
+         break;
+      case TR_BIN_BLOB:
+         read_blob_definition(r);
+         break;
+      default:
+         return tag;
+      }
+   }
+}
+
+
+static const char *
+read_name(struct replay_state *r)
+{
+   unsigned id = (unsigned) read_uint(r);
+   if (id >= r->num_names || !r->names[id])
+      replay_error(r, "undefined name");
+   return r->names[id];
+}
+
+
+static const struct replay_blob *
+read_blob(struct replay_state *r)
+{
+   unsigned id = (unsigned) read_uint(r);
+   if (id >= r->num_blobs)
+      replay_error(r, "undefined blob");
+   return &r->blobs[id];
+}
+
+
+static struct replay_value *
+alloc_value(struct replay_state *r)
+{
+   struct replay_value *value;
+
+   if (r->arena_used == REPLAY_ARENA_CHUNK) {
+      if (!r->arena_chunk->next) {
+         r->arena_chunk->next = CALLOC_STRUCT(replay_arena_chunk);
+         if (!r->arena_chunk->next)
+            replay_error(r, "out of memory");
+      }
+      r->arena_chunk = r->arena_chunk->next;
+      r->arena_used = 0;
+   }
+
+   value = &r->arena_chunk->values[r->arena_used++];
+   memset(value, 0, sizeof *value);
+   return value;
+}
+
+
+static void
+reset_arena(struct replay_state *r)
+{
+   r->arena_chunk = r->arena;
+   r->arena_used = 0;
+}
+
+
+static struct replay_value *
+read_value(struct replay_state *r, int tag, const char *name)
+{
+   struct replay_value *value = alloc_value(r);
+   struct replay_value **tail = &value->children;
+   const struct replay_blob *blob;
+
+   value->type = tag;
+   value->name = name;
+
+   switch (tag) {
+   case TR_BIN_NULL:
+   case TR_BIN_FALSE:
+   case TR_BIN_TRUE:
+      break;
+   case TR_BIN_INT:
+      value->u.i = read_int(r);
+      break;
+   case TR_BIN_UINT:
+   case TR_BIN_PTR:
+      value->u.u = read_uint(r);
+      break;
+   case TR_BIN_FLOAT:
+      value->u.f = read_double(r);
+      break;
+   case TR_BIN_ENUM:
+      read_name(r);
+      value->u.u = read_uint(r);
+      break;
+   case TR_BIN_STRING:
+   case TR_BIN_BYTES:
+      blob = read_blob(r);
+      value->u.blob.data = blob->data;
+      value->u.blob.size = blob->size;
+      break;
+   case TR_BIN_ARRAY_BEGIN:
+      while ((tag = read_tag(r)) != TR_BIN_ARRAY_END) {
+         *tail = read_value(r, tag, NULL);
+         tail = &(*tail)->next;
+         value->num_children++;
+      }
+      break;
+   case TR_BIN_STRUCT_BEGIN:
+      read_name(r);
+      while ((tag = read_tag(r)) != TR_BIN_STRUCT_END) {
+         const char *member;
+         if (tag != TR_BIN_MEMBER)
+            replay_error(r, "expected struct member");
+         member = read_name(r);
+         *tail = read_value(r, read_tag(r), member);
+         tail = &(*tail)->next;
+         value->num_children++;
+      }
+      break;
+   default:
+      replay_error(r, "unexpected tag");
+   }
+
+   return value;
+}
+
+
+/**
+ * Read the next call.  Returns FALSE at the end of the trace.
+ */
+static boolean
+read_call(struct replay_state *r, struct replay_call *call)
+{
+   struct replay_value **tail = &call->args;
+   int tag;
+
+   reset_arena(r);
+
+   tag = read_tag(r);
+   if (!tag)
+      return FALSE;
+   if (tag != TR_BIN_CALL_BEGIN)
+      replay_error(r, "expected call");
+
+   call->no = read_uint(r);
+   call->klass = (unsigned) read_uint(r);
+   call->method = (unsigned) read_uint(r);
+   call->args = NULL;
+   call->ret = NULL;
+
+   if (call->klass >= r->num_names || call->method >= r->num_names)
+      replay_error(r, "undefined name");
+
+   while ((tag = read_tag(r)) != TR_BIN_CALL_END) {
+      if (tag == TR_BIN_ARG) {
+         const char *name = read_name(r);
+         *tail = read_value(r, read_tag(r), name);
+         tail = &(*tail)->next;
+      }
+      else if (tag == TR_BIN_RET) {
+         call->ret = read_value(r, read_tag(r), NULL);
+      }
+      else {
+         replay_error(r, "unexpected tag in call");
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ * Value access.
+ */
+
+static const struct replay_value *
+find_value(const struct replay_value *list, const char *name)
+{
+   for (; list; list = list->next) {
+      if (list->name && !strcmp(list->name, name))
+         return list;
+   }
+   return NULL;
+}
+
+
+static const struct replay_value *
+get_arg(const struct replay_call *call, const char *name)
+{
+   return find_value(call->args, name);
+}
+
+
+static const struct replay_value *
+get_member(const struct replay_value *value, const char *name)
+{
+   return value ? find_value(value->children, name) : NULL;
+}
+
+
+static const struct replay_value *
+get_elem(const struct replay_value *value, unsigned index)
+{
+   const struct replay_value *elem = value ? value->children : NULL;
+
+   while (elem && index--)
+      elem = elem->next;
+   return elem;
+}
+
+
+static uint64_t
+value_uint(const struct replay_value *value)
+{
+   if (!value)
+      return 0;
+
+   switch (value->type) {
+   case TR_BIN_TRUE:
+      return 1;
+   case TR_BIN_INT:
+      return (uint64_t) value->u.i;
+   case TR_BIN_UINT:
+   case TR_BIN_PTR:
+   case TR_BIN_ENUM:
+      return value->u.u;
+   case TR_BIN_FLOAT:
+      return (uint64_t) value->u.f;
+   default:
+      return 0;
+   }
+}
+
+
+static float
+value_float(const struct replay_value *value)
+{
+   if (!value)
+      return 0.0f;
+
+   switch (value->type) {
+   case TR_BIN_FLOAT:
+      return (float) value->u.f;
+   case TR_BIN_INT:
+      return (float) value->u.i;
+   default:
+      return (float) value_uint(value);
+   }
+}
+
+
+#define ARG_UINT(_call, _name) ((unsigned) value_uint(get_arg(_call, _name)))
+#define MEMBER_UINT(_value, _name) ((unsigned) value_uint(get_member(_value, _name)))
+#define MEMBER_FLOAT(_value, _name) value_float(get_member(_value, _name))
+
+
+/*
+ * Object tracking.
+ */
+
+static unsigned
+replay_object_hash(void *key)
+{
+   uintptr_t ptr = (uintptr_t) key;
+   return (unsigned) (ptr ^ (ptr >> 7) ^ (ptr >> 17));
+}
+
+
+static int
+replay_object_compare(void *key1, void *key2)
+{
+   return key1 != key2;
+}
+
+
+static void *
+lookup_object(struct replay_state *r, const struct replay_value *value)
+{
+   struct replay_object *obj;
+
+   if (!value || value->type != TR_BIN_PTR || !value->u.u)
+      return NULL;
+
+   obj = hash_table_get(r->objects, (void *) (uintptr_t) value->u.u);
+   return obj ? obj->object : NULL;
+}
+
+
+static void
+add_object(struct replay_state *r, const struct replay_value *value,
+           enum replay_object_type type, void *object)
+{
+   void *key;
+   struct replay_object *obj;
+
+   if (!value || value->type != TR_BIN_PTR || !value->u.u || !object)
+      return;
+
+   key = (void *) (uintptr_t) value->u.u;
+
+   /* The traced driver may have reused the address of a destroyed object */
+   obj = hash_table_get(r->objects, key);
+   if (!obj) {
+      obj = CALLOC_STRUCT(replay_object);
+      if (!obj || hash_table_set(r->objects, key, obj) != PIPE_OK)
+         replay_error(r, "out of memory");
+   }
+
+   obj->type = type;
+   obj->object = object;
+}
+
+
+/**
+ * Forget about an object, returning what it mapped to.
+ */
+static void *
+remove_object(struct replay_state *r, const struct replay_value *value)
+{
+   void *key, *object;
+   struct replay_object *obj;
+
+   if (!value || value->type != TR_BIN_PTR || !value->u.u)
+      return NULL;
+
+   key = (void *) (uintptr_t) value->u.u;
+   obj = hash_table_get(r->objects, key);
+   if (!obj)
+      return NULL;
+
+   object = obj->object;
+   hash_table_remove(r->objects, key);
+   FREE(obj);
+   return object;
+}
+
+
+static struct pipe_context *
+get_pipe(struct replay_state *r, const struct replay_call *call)
+{
+   return (struct pipe_context *) lookup_object(r, get_arg(call, "pipe"));
+}
+
+
+/*
+ * State decoding.
+ */
+
+static void
+decode_texture_template(const struct replay_value *value,
+                        struct pipe_texture *templat)
+{
+   const struct replay_value *block = get_member(value, "block");
+
+   memset(templat, 0, sizeof *templat);
+   templat->target = MEMBER_UINT(value, "target");
+   templat->format = MEMBER_UINT(value, "format");
+   templat->width[0] = (unsigned) value_uint(get_elem(get_member(value, "width"), 0));
+   templat->height[0] = (unsigned) value_uint(get_elem(get_member(value, "height"), 0));
+   templat->depth[0] = (unsigned) value_uint(get_elem(get_member(value, "depth"), 0));
+   templat->block.size = MEMBER_UINT(block, "size");
+   templat->block.width = MEMBER_UINT(block, "width");
+   templat->block.height = MEMBER_UINT(block, "height");
+   templat->last_level = MEMBER_UINT(value, "last_level");
+   templat->tex_usage = MEMBER_UINT(value, "tex_usage");
+}
+
+
+static void
+decode_float_array(const struct replay_value *value, float *array,
+                   unsigned size)
+{
+   const struct replay_value *elem = value ? value->children : NULL;
+   unsigned i;
+
+   for (i = 0; i < size; i++) {
+      array[i] = value_float(elem);
+      if (elem)
+         elem = elem->next;
+   }
+}
+
+
+static void
+decode_rasterizer_state(const struct replay_value *value,
+                        struct pipe_rasterizer_state *state)
+{
+   const struct replay_value *elem;
+   unsigned i;
+
+   memset(state, 0, sizeof *state);
+   state->flatshade = MEMBER_UINT(value, "flatshade");
+   state->light_twoside = MEMBER_UINT(value, "light_twoside");
+   state->front_winding = MEMBER_UINT(value, "front_winding");
+   state->cull_mode = MEMBER_UINT(value, "cull_mode");
+   state->fill_cw = MEMBER_UINT(value, "fill_cw");
+   state->fill_ccw = MEMBER_UINT(value, "fill_ccw");
+   state->offset_cw = MEMBER_UINT(value, "offset_cw");
+   state->offset_ccw = MEMBER_UINT(value, "offset_ccw");
+   state->scissor = MEMBER_UINT(value, "scissor");
+   state->poly_smooth = MEMBER_UINT(value, "poly_smooth");
+   state->poly_stipple_enable = MEMBER_UINT(value, "poly_stipple_enable");
+   state->point_smooth = MEMBER_UINT(value, "point_smooth");
+   state->point_sprite = MEMBER_UINT(value, "point_sprite");
+   state->point_size_per_vertex = MEMBER_UINT(value, "point_size_per_vertex");
+   state->multisample = MEMBER_UINT(value, "multisample");
+   state->line_smooth = MEMBER_UINT(value, "line_smooth");
+   state->line_stipple_enable = MEMBER_UINT(value, "line_stipple_enable");
+   state->line_stipple_factor = MEMBER_UINT(value, "line_stipple_factor");
+   state->line_stipple_pattern = MEMBER_UINT(value, "line_stipple_pattern");
+   state->line_last_pixel = MEMBER_UINT(value, "line_last_pixel");
+   state->bypass_vs_clip_and_viewport =
+      MEMBER_UINT(value, "bypass_vs_clip_and_viewport");
+   state->flatshade_first = MEMBER_UINT(value, "flatshade_first");
+   state->gl_rasterization_rules = MEMBER_UINT(value, "gl_rasterization_rules");
+   state->line_width = MEMBER_FLOAT(value, "line_width");
+   state->point_size = MEMBER_FLOAT(value, "point_size");
+   state->point_size_min = MEMBER_FLOAT(value, "point_size_min");
+   state->point_size_max = MEMBER_FLOAT(value, "point_size_max");
+   state->offset_units = MEMBER_FLOAT(value, "offset_units");
+   state->offset_scale = MEMBER_FLOAT(value, "offset_scale");
+
+   elem = get_elem(get_member(value, "sprite_coord_mode"), 0);
+   for (i = 0; i < Elements(state->sprite_coord_mode) && elem; i++) {
+      state->sprite_coord_mode[i] = (unsigned) value_uint(elem);
+      elem = elem->next;
+   }
+}
+
+
+static void
+decode_depth_stencil_alpha_state(const struct replay_value *value,
+                                 struct pipe_depth_stencil_alpha_state *state)
+{
+   const struct replay_value *depth = get_member(value, "depth");
+   const struct replay_value *alpha = get_member(value, "alpha");
+   const struct replay_value *stencil;
+   unsigned i;
+
+   memset(state, 0, sizeof *state);
+   state->depth.enabled = MEMBER_UINT(depth, "enabled");
+   state->depth.writemask = MEMBER_UINT(depth, "writemask");
+   state->depth.func = MEMBER_UINT(depth, "func");
+
+   stencil = get_elem(get_member(value, "stencil"), 0);
+   for (i = 0; i < 2 && stencil; i++) {
+      state->stencil[i].enabled = MEMBER_UINT(stencil, "enabled");
+      state->stencil[i].func = MEMBER_UINT(stencil, "func");
+      state->stencil[i].fail_op = MEMBER_UINT(stencil, "fail_op");
+      state->stencil[i].zpass_op = MEMBER_UINT(stencil, "zpass_op");
+      state->stencil[i].zfail_op = MEMBER_UINT(stencil, "zfail_op");
+      state->stencil[i].ref_value = MEMBER_UINT(stencil, "ref_value");
+      state->stencil[i].valuemask = MEMBER_UINT(stencil, "valuemask");
+      state->stencil[i].writemask = MEMBER_UINT(stencil, "writemask");
+      stencil = stencil->next;
+   }
+
+   state->alpha.enabled = MEMBER_UINT(alpha, "enabled");
+   state->alpha.func = MEMBER_UINT(alpha, "func");
+   state->alpha.ref_value = MEMBER_FLOAT(alpha, "ref_value");
+}
+
+
+static void
+decode_blend_state(const struct replay_value *value,
+                   struct pipe_blend_state *state)
+{
+   memset(state, 0, sizeof *state);
+   state->blend_enable = MEMBER_UINT(value, "blend_enable");
+   state->rgb_func = MEMBER_UINT(value, "rgb_func");
+   state->rgb_src_factor = MEMBER_UINT(value, "rgb_src_factor");
+   state->rgb_dst_factor = MEMBER_UINT(value, "rgb_dst_factor");
+   state->alpha_func = MEMBER_UINT(value, "alpha_func");
+   state->alpha_src_factor = MEMBER_UINT(value, "alpha_src_factor");
+   state->alpha_dst_factor = MEMBER_UINT(value, "alpha_dst_factor");
+   state->logicop_enable = MEMBER_UINT(value, "logicop_enable");
+   state->logicop_func = MEMBER_UINT(value, "logicop_func");
+   state->colormask = MEMBER_UINT(value, "colormask");
+   state->dither = MEMBER_UINT(value, "dither");
+}
+
+
+static void
+decode_sampler_state(const struct replay_value *value,
+                     struct pipe_sampler_state *state)
+{
+   memset(state, 0, sizeof *state);
+   state->wrap_s = MEMBER_UINT(value, "wrap_s");
+   state->wrap_t = MEMBER_UINT(value, "wrap_t");
+   state->wrap_r = MEMBER_UINT(value, "wrap_r");
+   state->min_img_filter = MEMBER_UINT(value, "min_img_filter");
+   state->min_mip_filter = MEMBER_UINT(value, "min_mip_filter");
+   state->mag_img_filter = MEMBER_UINT(value, "mag_img_filter");
+   state->compare_mode = MEMBER_UINT(value, "compare_mode");
+   state->compare_func = MEMBER_UINT(value, "compare_func");
+   state->normalized_coords = MEMBER_UINT(value, "normalized_coords");
+   state->prefilter = MEMBER_UINT(value, "prefilter");
+   state->shadow_ambient = MEMBER_FLOAT(value, "shadow_ambient");
+   state->lod_bias = MEMBER_FLOAT(value, "lod_bias");
+   state->min_lod = MEMBER_FLOAT(value, "min_lod");
+   state->max_lod = MEMBER_FLOAT(value, "max_lod");
+   decode_float_array(get_member(value, "border_color"),
+                      state->border_color, 4);
+   state->max_anisotropy = MEMBER_FLOAT(value, "max_anisotropy");
+}
+
+
+/**
+ * Translate the TGSI text of a shader state back into tokens.
+ */
+static boolean
+decode_shader_state(struct replay_state *r, const struct replay_value *value,
+                    struct pipe_shader_state *state)
+{
+   const struct replay_value *tokens = get_member(value, "tokens");
+
+   if (!tokens || tokens->type != TR_BIN_STRING ||
+       !tgsi_text_translate(tokens->u.blob.data, r->tokens,
+                            REPLAY_MAX_TOKENS)) {
+      fprintf(stderr, "gallium_replay: failed to translate shader\n");
+      return FALSE;
+   }
+
+   state->tokens = r->tokens;
+   return TRUE;
+}
+
+
+/*
+ * Screen calls.
+ */
+
+static void
+replay_screen_create(struct replay_state *r, const struct replay_call *call)
+{
+   add_object(r, call->ret, REPLAY_OBJECT_OTHER, r->screen);
+}
+
+
+static void
+replay_texture_create(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_texture templat;
+   struct pipe_texture *texture;
+
+   decode_texture_template(get_arg(call, "templat"), &templat);
+   texture = r->screen->texture_create(r->screen, &templat);
+   add_object(r, call->ret, REPLAY_OBJECT_TEXTURE, texture);
+}
+
+
+static void
+replay_texture_blanket(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_texture templat;
+   struct pipe_texture *texture;
+   struct pipe_buffer *buffer;
+   unsigned pitch = ARG_UINT(call, "pitch");
+
+   decode_texture_template(get_arg(call, "templat"), &templat);
+   buffer = lookup_object(r, get_arg(call, "buffer"));
+   if (!buffer)
+      return;
+
+   texture = r->screen->texture_blanket(r->screen, &templat, &pitch, buffer);
+   add_object(r, call->ret, REPLAY_OBJECT_TEXTURE, texture);
+}
+
+
+static void
+replay_texture_destroy(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_texture *texture = remove_object(r, get_arg(call, "texture"));
+   pipe_texture_reference(&texture, NULL);
+}
+
+
+static void
+replay_get_tex_surface(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_texture *texture = lookup_object(r, get_arg(call, "texture"));
+   struct pipe_surface *surface;
+
+   if (!texture)
+      return;
+
+   surface = r->screen->get_tex_surface(r->screen, texture,
+                                        ARG_UINT(call, "face"),
+                                        ARG_UINT(call, "level"),
+                                        ARG_UINT(call, "zslice"),
+                                        ARG_UINT(call, "usage"));
+   add_object(r, call->ret, REPLAY_OBJECT_SURFACE, surface);
+}
+
+
+static void
+replay_tex_surface_destroy(struct replay_state *r,
+                           const struct replay_call *call)
+{
+   struct pipe_surface *surface = remove_object(r, get_arg(call, "surface"));
+   pipe_surface_reference(&surface, NULL);
+}
+
+
+static void
+replay_get_tex_transfer(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_texture *texture = lookup_object(r, get_arg(call, "texture"));
+   struct pipe_transfer *transfer;
+
+   if (!texture)
+      return;
+
+   transfer = r->screen->get_tex_transfer(r->screen, texture,
+                                          ARG_UINT(call, "face"),
+                                          ARG_UINT(call, "level"),
+                                          ARG_UINT(call, "zslice"),
+                                          ARG_UINT(call, "usage"),
+                                          ARG_UINT(call, "x"),
+                                          ARG_UINT(call, "y"),
+                                          ARG_UINT(call, "w"),
+                                          ARG_UINT(call, "h"));
+   add_object(r, call->ret, REPLAY_OBJECT_TRANSFER, transfer);
+}
+
+
+static void
+replay_tex_transfer_destroy(struct replay_state *r,
+                            const struct replay_call *call)
+{
+   struct pipe_transfer *transfer = remove_object(r, get_arg(call, "transfer"));
+   if (transfer)
+      r->screen->tex_transfer_destroy(transfer);
+}
+
+
+static void
+replay_transfer_write(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_transfer *transfer = lookup_object(r, get_arg(call, "transfer"));
+   const struct replay_value *data = get_arg(call, "data");
+   unsigned src_stride = ARG_UINT(call, "stride");
+   const ubyte *src;
+   ubyte *map;
+   unsigned y, rows, row_size;
+
+   if (!transfer || !data || data->type != TR_BIN_BYTES)
+      return;
+
+   map = r->screen->transfer_map(r->screen, transfer);
+   if (!map)
+      return;
+
+   /* Our layout may differ from the traced driver's */
+   src = data->u.blob.data;
+   row_size = MIN2(src_stride, transfer->stride);
+   rows = src_stride ? MIN2(transfer->nblocksy,
+                            data->u.blob.size / src_stride) : 0;
+   for (y = 0; y < rows; y++)
+      memcpy(map + y * transfer->stride, src + y * src_stride, row_size);
+
+   r->screen->transfer_unmap(r->screen, transfer);
+}
+
+
+static void
+replay_surface_buffer_create(struct replay_state *r,
+                             const struct replay_call *call)
+{
+   struct pipe_buffer *buffer;
+   unsigned stride;
+
+   buffer = r->screen->surface_buffer_create(r->screen,
+                                             ARG_UINT(call, "width"),
+                                             ARG_UINT(call, "height"),
+                                             ARG_UINT(call, "format"),
+                                             ARG_UINT(call, "usage"),
+                                             &stride);
+   add_object(r, call->ret, REPLAY_OBJECT_BUFFER, buffer);
+}
+
+
+static void
+replay_buffer_create(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_buffer *buffer;
+
+   buffer = pipe_buffer_create(r->screen,
+                               ARG_UINT(call, "alignment"),
+                               ARG_UINT(call, "usage"),
+                               ARG_UINT(call, "size"));
+   add_object(r, call->ret, REPLAY_OBJECT_BUFFER, buffer);
+}
+
+
+/**
+ * User buffers become regular buffers; the blob is only valid until the
+ * trace is closed and the application may have changed the memory since.
+ */
+static void
+replay_user_buffer_create(struct replay_state *r,
+                          const struct replay_call *call)
+{
+   const struct replay_value *data = get_arg(call, "data");
+   unsigned size = ARG_UINT(call, "size");
+   struct pipe_buffer *buffer;
+
+   buffer = pipe_buffer_create(r->screen, 16, PIPE_BUFFER_USAGE_VERTEX |
+                               PIPE_BUFFER_USAGE_INDEX |
+                               PIPE_BUFFER_USAGE_CONSTANT, size);
+   if (buffer && data && data->type == TR_BIN_BYTES)
+      pipe_buffer_write(r->screen, buffer, 0,
+                        MIN2(size, data->u.blob.size), data->u.blob.data);
+   add_object(r, call->ret, REPLAY_OBJECT_BUFFER, buffer);
+}
+
+
+static void
+replay_buffer_write(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_buffer *buffer = lookup_object(r, get_arg(call, "buffer"));
+   const struct replay_value *data = get_arg(call, "data");
+   unsigned offset = ARG_UINT(call, "offset");
+   unsigned size = ARG_UINT(call, "size");
+
+   if (!buffer || !data || data->type != TR_BIN_BYTES)
+      return;
+
+   size = MIN2(size, data->u.blob.size);
+   if (offset > buffer->size)
+      return;
+   size = MIN2(size, buffer->size - offset);
+
+   pipe_buffer_write(r->screen, buffer, offset, size, data->u.blob.data);
+}
+
+
+static void
+replay_buffer_destroy(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_buffer *buffer = remove_object(r, get_arg(call, "buffer"));
+   pipe_buffer_reference(&buffer, NULL);
+}
+
+
+/**
+ * Checksum the presented surface.
+ */
+static void
+replay_flush_frontbuffer(struct replay_state *r,
+                         const struct replay_call *call)
+{
+   struct pipe_surface *surface = lookup_object(r, get_arg(call, "surface"));
+   struct pipe_transfer *transfer;
+   const ubyte *map;
+   ubyte *pixels;
+   unsigned y, row_size;
+
+   r->frames++;
+
+   if (!r->checksum || !surface)
+      return;
+
+   transfer = r->screen->get_tex_transfer(r->screen, surface->texture,
+                                          surface->face, surface->level,
+                                          surface->zslice, PIPE_TRANSFER_READ,
+                                          0, 0, surface->width,
+                                          surface->height);
+   if (!transfer)
+      return;
+
+   map = r->screen->transfer_map(r->screen, transfer);
+   row_size = transfer->nblocksx * transfer->block.size;
+   pixels = MALLOC(row_size * transfer->nblocksy);
+   if (map && pixels) {
+      /* Only hash the pixels, not the padding */
+      for (y = 0; y < transfer->nblocksy; y++)
+         memcpy(pixels + y * row_size, map + y * transfer->stride, row_size);
+
+      printf("frame %u: call %llu, %ux%u, crc32 %08x\n", r->frames,
+             (unsigned long long) call->no, surface->width, surface->height,
+             util_hash_crc32(pixels, row_size * transfer->nblocksy));
+   }
+
+   FREE(pixels);
+   if (map)
+      r->screen->transfer_unmap(r->screen, transfer);
+   r->screen->tex_transfer_destroy(transfer);
+}
+
+
+/*
+ * Context calls.
+ */
+
+static void
+replay_context_create(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = softpipe_create(r->screen);
+   if (!pipe)
+      replay_error(r, "failed to create context");
+   add_object(r, call->ret, REPLAY_OBJECT_CONTEXT, pipe);
+}
+
+
+static void
+replay_context_destroy(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = remove_object(r, get_arg(call, "pipe"));
+   if (pipe)
+      pipe->destroy(pipe);
+}
+
+
+static void
+replay_draw_arrays(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   if (!pipe)
+      return;
+
+   pipe->draw_arrays(pipe, ARG_UINT(call, "mode"), ARG_UINT(call, "start"),
+                     ARG_UINT(call, "count"));
+}
+
+
+static void
+replay_draw_elements(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_buffer *index = lookup_object(r, get_arg(call, "indexBuffer"));
+   if (!pipe || !index)
+      return;
+
+   pipe->draw_elements(pipe, index, ARG_UINT(call, "indexSize"),
+                       ARG_UINT(call, "mode"), ARG_UINT(call, "start"),
+                       ARG_UINT(call, "count"));
+}
+
+
+static void
+replay_draw_range_elements(struct replay_state *r,
+                           const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_buffer *index = lookup_object(r, get_arg(call, "indexBuffer"));
+   if (!pipe || !index)
+      return;
+
+   pipe->draw_range_elements(pipe, index, ARG_UINT(call, "indexSize"),
+                             ARG_UINT(call, "minIndex"),
+                             ARG_UINT(call, "maxIndex"),
+                             ARG_UINT(call, "mode"), ARG_UINT(call, "start"),
+                             ARG_UINT(call, "count"));
+}
+
+
+static void
+replay_create_query(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   if (!pipe)
+      return;
+
+   add_object(r, call->ret, REPLAY_OBJECT_OTHER,
+              pipe->create_query(pipe, ARG_UINT(call, "query_type")));
+}
+
+
+static void
+replay_destroy_query(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_query *query = remove_object(r, get_arg(call, "query"));
+   if (pipe && query)
+      pipe->destroy_query(pipe, query);
+}
+
+
+static void
+replay_begin_query(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_query *query = lookup_object(r, get_arg(call, "query"));
+   if (pipe && query)
+      pipe->begin_query(pipe, query);
+}
+
+
+static void
+replay_end_query(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_query *query = lookup_object(r, get_arg(call, "query"));
+   if (pipe && query)
+      pipe->end_query(pipe, query);
+}
+
+
+static void
+replay_get_query_result(struct replay_state *r,
+                        const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_query *query = lookup_object(r, get_arg(call, "query"));
+   union pipe_query_result result;
+
+   if (pipe && query)
+      pipe->get_query_result(pipe, query, TRUE, &result);
+}
+
+
+/**
+ * Generate the create/bind/delete replay functions of a CSO type.
+ */
+#define REPLAY_CSO(_name, _type, _decode) \
+static void \
+replay_create_##_name##_state(struct replay_state *r, \
+                              const struct replay_call *call) \
+{ \
+   struct pipe_context *pipe = get_pipe(r, call); \
+   struct _type state; \
+   if (!pipe) \
+      return; \
+   _decode(get_arg(call, "state"), &state); \
+   add_object(r, call->ret, REPLAY_OBJECT_OTHER, \
+              pipe->create_##_name##_state(pipe, &state)); \
+} \
+\
+static void \
+replay_bind_##_name##_state(struct replay_state *r, \
+                            const struct replay_call *call) \
+{ \
+   struct pipe_context *pipe = get_pipe(r, call); \
+   if (pipe) \
+      pipe->bind_##_name##_state(pipe, lookup_object(r, get_arg(call, "state"))); \
+} \
+\
+static void \
+replay_delete_##_name##_state(struct replay_state *r, \
+                              const struct replay_call *call) \
+{ \
+   struct pipe_context *pipe = get_pipe(r, call); \
+   void *state = remove_object(r, get_arg(call, "state")); \
+   if (pipe && state) \
+      pipe->delete_##_name##_state(pipe, state); \
+}
+
+REPLAY_CSO(blend, pipe_blend_state, decode_blend_state)
+REPLAY_CSO(rasterizer, pipe_rasterizer_state, decode_rasterizer_state)
+REPLAY_CSO(depth_stencil_alpha, pipe_depth_stencil_alpha_state,
+           decode_depth_stencil_alpha_state)
+
+
+static void
+replay_create_sampler_state(struct replay_state *r,
+                            const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_sampler_state state;
+
+   if (!pipe)
+      return;
+
+   decode_sampler_state(get_arg(call, "state"), &state);
+   add_object(r, call->ret, REPLAY_OBJECT_OTHER,
+              pipe->create_sampler_state(pipe, &state));
+}
+
+
+static void
+replay_bind_sampler_states(struct replay_state *r,
+                           const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *elem = get_elem(get_arg(call, "states"), 0);
+   void *states[PIPE_MAX_SAMPLERS];
+   unsigned i, num = MIN2(ARG_UINT(call, "num_states"), PIPE_MAX_SAMPLERS);
+
+   if (!pipe)
+      return;
+
+   for (i = 0; i < num; i++) {
+      states[i] = lookup_object(r, elem);
+      if (elem)
+         elem = elem->next;
+   }
+
+   pipe->bind_sampler_states(pipe, num, states);
+}
+
+
+static void
+replay_delete_sampler_state(struct replay_state *r,
+                            const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   void *state = remove_object(r, get_arg(call, "state"));
+   if (pipe && state)
+      pipe->delete_sampler_state(pipe, state);
+}
+
+
+static void
+replay_create_fs_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_shader_state state;
+
+   if (pipe && decode_shader_state(r, get_arg(call, "state"), &state))
+      add_object(r, call->ret, REPLAY_OBJECT_OTHER,
+                 pipe->create_fs_state(pipe, &state));
+}
+
+
+static void
+replay_bind_fs_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   if (pipe)
+      pipe->bind_fs_state(pipe, lookup_object(r, get_arg(call, "state")));
+}
+
+
+static void
+replay_delete_fs_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   void *state = remove_object(r, get_arg(call, "state"));
+   if (pipe && state)
+      pipe->delete_fs_state(pipe, state);
+}
+
+
+static void
+replay_create_vs_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_shader_state state;
+
+   if (pipe && decode_shader_state(r, get_arg(call, "state"), &state))
+      add_object(r, call->ret, REPLAY_OBJECT_OTHER,
+                 pipe->create_vs_state(pipe, &state));
+}
+
+
+static void
+replay_bind_vs_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   if (pipe)
+      pipe->bind_vs_state(pipe, lookup_object(r, get_arg(call, "state")));
+}
+
+
+static void
+replay_delete_vs_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   void *state = remove_object(r, get_arg(call, "state"));
+   if (pipe && state)
+      pipe->delete_vs_state(pipe, state);
+}
+
+
+static void
+replay_set_blend_color(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_blend_color state;
+
+   if (!pipe)
+      return;
+
+   decode_float_array(get_member(get_arg(call, "state"), "color"),
+                      state.color, 4);
+   pipe->set_blend_color(pipe, &state);
+}
+
+
+static void
+replay_set_clip_state(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *value = get_arg(call, "state");
+   const struct replay_value *plane;
+   struct pipe_clip_state state;
+   unsigned i;
+
+   if (!pipe)
+      return;
+
+   memset(&state, 0, sizeof state);
+   plane = get_elem(get_member(value, "ucp"), 0);
+   for (i = 0; i < PIPE_MAX_CLIP_PLANES && plane; i++) {
+      decode_float_array(plane, state.ucp[i], 4);
+      plane = plane->next;
+   }
+   state.nr = MEMBER_UINT(value, "nr");
+
+   pipe->set_clip_state(pipe, &state);
+}
+
+
+static void
+replay_set_constant_buffer(struct replay_state *r,
+                           const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_constant_buffer buf;
+
+   if (!pipe)
+      return;
+
+   buf.buffer = lookup_object(r, get_member(get_arg(call, "buffer"), "buffer"));
+   pipe->set_constant_buffer(pipe, ARG_UINT(call, "shader"),
+                             ARG_UINT(call, "index"), &buf);
+}
+
+
+static void
+replay_set_framebuffer_state(struct replay_state *r,
+                             const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *value = get_arg(call, "state");
+   const struct replay_value *cbuf;
+   struct pipe_framebuffer_state state;
+   unsigned i;
+
+   if (!pipe)
+      return;
+
+   memset(&state, 0, sizeof state);
+   state.width = MEMBER_UINT(value, "width");
+   state.height = MEMBER_UINT(value, "height");
+   state.nr_cbufs = MIN2(MEMBER_UINT(value, "nr_cbufs"),
+                         PIPE_MAX_COLOR_BUFS);
+
+   cbuf = get_elem(get_member(value, "cbufs"), 0);
+   for (i = 0; i < state.nr_cbufs && cbuf; i++) {
+      state.cbufs[i] = lookup_object(r, cbuf);
+      cbuf = cbuf->next;
+   }
+   state.zsbuf = lookup_object(r, get_member(value, "zsbuf"));
+
+   pipe->set_framebuffer_state(pipe, &state);
+}
+
+
+static void
+replay_set_polygon_stipple(struct replay_state *r,
+                           const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *elem;
+   struct pipe_poly_stipple state;
+   unsigned i;
+
+   if (!pipe)
+      return;
+
+   memset(&state, 0, sizeof state);
+   elem = get_elem(get_member(get_arg(call, "state"), "stipple"), 0);
+   for (i = 0; i < Elements(state.stipple) && elem; i++) {
+      state.stipple[i] = (unsigned) value_uint(elem);
+      elem = elem->next;
+   }
+
+   pipe->set_polygon_stipple(pipe, &state);
+}
+
+
+static void
+replay_set_scissor_state(struct replay_state *r,
+                         const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *value = get_arg(call, "state");
+   struct pipe_scissor_state state;
+
+   if (!pipe)
+      return;
+
+   state.minx = MEMBER_UINT(value, "minx");
+   state.miny = MEMBER_UINT(value, "miny");
+   state.maxx = MEMBER_UINT(value, "maxx");
+   state.maxy = MEMBER_UINT(value, "maxy");
+
+   pipe->set_scissor_state(pipe, &state);
+}
+
+
+static void
+replay_set_viewport_state(struct replay_state *r,
+                          const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *value = get_arg(call, "state");
+   struct pipe_viewport_state state;
+
+   if (!pipe)
+      return;
+
+   decode_float_array(get_member(value, "scale"), state.scale, 4);
+   decode_float_array(get_member(value, "translate"), state.translate, 4);
+
+   pipe->set_viewport_state(pipe, &state);
+}
+
+
+static void
+replay_set_sampler_textures(struct replay_state *r,
+                            const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *elem = get_elem(get_arg(call, "textures"), 0);
+   struct pipe_texture *textures[PIPE_MAX_SAMPLERS];
+   unsigned i, num = MIN2(ARG_UINT(call, "num_textures"), PIPE_MAX_SAMPLERS);
+
+   if (!pipe)
+      return;
+
+   for (i = 0; i < num; i++) {
+      textures[i] = lookup_object(r, elem);
+      if (elem)
+         elem = elem->next;
+   }
+
+   pipe->set_sampler_textures(pipe, num, textures);
+}
+
+
+static void
+replay_set_vertex_buffers(struct replay_state *r,
+                          const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *elem = get_elem(get_arg(call, "buffers"), 0);
+   struct pipe_vertex_buffer buffers[PIPE_MAX_ATTRIBS];
+   unsigned i, num = MIN2(ARG_UINT(call, "num_buffers"), PIPE_MAX_ATTRIBS);
+
+   if (!pipe)
+      return;
+
+   for (i = 0; i < num && elem; i++) {
+      buffers[i].stride = MEMBER_UINT(elem, "stride");
+      buffers[i].max_index = MEMBER_UINT(elem, "max_index");
+      buffers[i].buffer_offset = MEMBER_UINT(elem, "buffer_offset");
+      buffers[i].buffer = lookup_object(r, get_member(elem, "buffer"));
+      elem = elem->next;
+   }
+
+   pipe->set_vertex_buffers(pipe, i, buffers);
+}
+
+
+static void
+replay_set_vertex_elements(struct replay_state *r,
+                           const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   const struct replay_value *elem = get_elem(get_arg(call, "elements"), 0);
+   struct pipe_vertex_element elements[PIPE_MAX_ATTRIBS];
+   unsigned i, num = MIN2(ARG_UINT(call, "num_elements"), PIPE_MAX_ATTRIBS);
+
+   if (!pipe)
+      return;
+
+   for (i = 0; i < num && elem; i++) {
+      elements[i].src_offset = MEMBER_UINT(elem, "src_offset");
+      elements[i].vertex_buffer_index =
+         MEMBER_UINT(elem, "vertex_buffer_index");
+      elements[i].nr_components = MEMBER_UINT(elem, "nr_components");
+      elements[i].src_format = MEMBER_UINT(elem, "src_format");
+      elem = elem->next;
+   }
+
+   pipe->set_vertex_elements(pipe, i, elements);
+}
+
+
+static void
+replay_set_edgeflags(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+
+   /* The flags themselves are not in the trace */
+   if (pipe && pipe->set_edgeflags)
+      pipe->set_edgeflags(pipe, NULL);
+}
+
+
+static void
+replay_surface_copy(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_surface *dest = lookup_object(r, get_arg(call, "dest"));
+   struct pipe_surface *src = lookup_object(r, get_arg(call, "src"));
+
+   if (!pipe || !dest || !src)
+      return;
+
+   pipe->surface_copy(pipe, dest, ARG_UINT(call, "destx"),
+                      ARG_UINT(call, "desty"), src, ARG_UINT(call, "srcx"),
+                      ARG_UINT(call, "srcy"), ARG_UINT(call, "width"),
+                      ARG_UINT(call, "height"));
+}
+
+
+static void
+replay_surface_fill(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_surface *dst = lookup_object(r, get_arg(call, "dst"));
+
+   if (!pipe || !dst)
+      return;
+
+   pipe->surface_fill(pipe, dst, ARG_UINT(call, "dstx"),
+                      ARG_UINT(call, "dsty"), ARG_UINT(call, "width"),
+                      ARG_UINT(call, "height"), ARG_UINT(call, "value"));
+}
+
+
+static void
+replay_clear(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   float rgba[4];
+
+   if (!pipe)
+      return;
+
+   decode_float_array(get_arg(call, "rgba"), rgba, 4);
+   pipe->clear(pipe, ARG_UINT(call, "buffers"), rgba,
+               value_float(get_arg(call, "depth")),
+               ARG_UINT(call, "stencil"));
+}
+
+
+static void
+replay_flush(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   if (pipe)
+      pipe->flush(pipe, ARG_UINT(call, "flags"), NULL);
+}
+
+
+static void
+replay_generate_mipmap(struct replay_state *r, const struct replay_call *call)
+{
+   struct pipe_context *pipe = get_pipe(r, call);
+   struct pipe_texture *texture = lookup_object(r, get_arg(call, "texture"));
+
+   if (pipe && texture && pipe->generate_mipmap)
+      pipe->generate_mipmap(pipe, texture, ARG_UINT(call, "face"),
+                            ARG_UINT(call, "baseLevel"),
+                            ARG_UINT(call, "lastLevel"));
+}
+
+
+static const struct replay_method replay_methods[] = {
+   { "", "pipe_screen_create", replay_screen_create },
+   { "pipe_screen", "flush_frontbuffer", replay_flush_frontbuffer },
+   { "pipe_screen", "texture_create", replay_texture_create },
+   { "pipe_screen", "texture_blanket", replay_texture_blanket },
+   { "pipe_screen", "texture_destroy", replay_texture_destroy },
+   { "pipe_screen", "get_tex_surface", replay_get_tex_surface },
+   { "pipe_screen", "tex_surface_destroy", replay_tex_surface_destroy },
+   { "pipe_screen", "get_tex_transfer", replay_get_tex_transfer },
+   { "pipe_screen", "tex_transfer_destroy", replay_tex_transfer_destroy },
+   { "pipe_screen", "transfer_write", replay_transfer_write },
+   { "pipe_screen", "surface_buffer_create", replay_surface_buffer_create },
+   { "pipe_screen", "buffer_create", replay_buffer_create },
+   { "pipe_screen", "user_buffer_create", replay_user_buffer_create },
+   { "pipe_screen", "buffer_write", replay_buffer_write },
+   { "pipe_winsys", "buffer_write", replay_buffer_write },
+   { "pipe_screen", "buffer_destroy", replay_buffer_destroy },
+
+   { "", "pipe_context_create", replay_context_create },
+   { "pipe_context", "destroy", replay_context_destroy },
+   { "pipe_context", "draw_arrays", replay_draw_arrays },
+   { "pipe_context", "draw_elements", replay_draw_elements },
+   { "pipe_context", "draw_range_elements", replay_draw_range_elements },
+   { "pipe_context", "create_query", replay_create_query },
+   { "pipe_context", "destroy_query", replay_destroy_query },
+   { "pipe_context", "begin_query", replay_begin_query },
+   { "pipe_context", "end_query", replay_end_query },
+   { "pipe_context", "get_query_result", replay_get_query_result },
+   { "pipe_context", "create_blend_state", replay_create_blend_state },
+   { "pipe_context", "bind_blend_state", replay_bind_blend_state },
+   { "pipe_context", "delete_blend_state", replay_delete_blend_state },
+   { "pipe_context", "create_sampler_state", replay_create_sampler_state },
+   { "pipe_context", "bind_sampler_states", replay_bind_sampler_states },
+   { "pipe_context", "delete_sampler_state", replay_delete_sampler_state },
+   { "pipe_context", "create_rasterizer_state", replay_create_rasterizer_state },
+   { "pipe_context", "bind_rasterizer_state", replay_bind_rasterizer_state },
+   { "pipe_context", "delete_rasterizer_state", replay_delete_rasterizer_state },
+   { "pipe_context", "create_depth_stencil_alpha_state",
+     replay_create_depth_stencil_alpha_state },
+   { "pipe_context", "bind_depth_stencil_alpha_state",
+     replay_bind_depth_stencil_alpha_state },
+   { "pipe_context", "delete_depth_stencil_alpha_state",
+     replay_delete_depth_stencil_alpha_state },
+   { "pipe_context", "create_fs_state", replay_create_fs_state },
+   { "pipe_context", "bind_fs_state", replay_bind_fs_state },
+   { "pipe_context", "delete_fs_state", replay_delete_fs_state },
+   { "pipe_context", "create_vs_state", replay_create_vs_state },
+   { "pipe_context", "bind_vs_state", replay_bind_vs_state },
+   { "pipe_context", "delete_vs_state", replay_delete_vs_state },
+   { "pipe_context", "set_blend_color", replay_set_blend_color },
+   { "pipe_context", "set_clip_state", replay_set_clip_state },
+   { "pipe_context", "set_constant_buffer", replay_set_constant_buffer },
+   { "pipe_context", "set_framebuffer_state", replay_set_framebuffer_state },
+   { "pipe_context", "set_polygon_stipple", replay_set_polygon_stipple },
+   { "pipe_context", "set_scissor_state", replay_set_scissor_state },
+   { "pipe_context", "set_viewport_state", replay_set_viewport_state },
+   { "pipe_context", "set_sampler_textures", replay_set_sampler_textures },
+   { "pipe_context", "set_vertex_buffers", replay_set_vertex_buffers },
+   { "pipe_context", "set_vertex_elements", replay_set_vertex_elements },
+   { "pipe_context", "set_edgeflags", replay_set_edgeflags },
+   { "pipe_context", "surface_copy", replay_surface_copy },
+   { "pipe_context", "surface_fill", replay_surface_fill },
+   { "pipe_context", "clear", replay_clear },
+   { "pipe_context", "flush", replay_flush },
+   { "pipe_context", "generate_mipmap", replay_generate_mipmap },
+};
+
+
+static const struct replay_method *
+find_method(struct replay_state *r, const struct replay_call *call)
+{
+   struct replay_method_cache *cache = &r->methods[call->method];
+   unsigned i;
+
+   if (cache->method && cache->klass == call->klass)
+      return cache->method;
+
+   for (i = 0; i < Elements(replay_methods); i++) {
+      if (!strcmp(replay_methods[i].klass, r->names[call->klass]) &&
+          !strcmp(replay_methods[i].method, r->names[call->method])) {
+         cache->klass = call->klass;
+         cache->method = &replay_methods[i];
+         return cache->method;
+      }
+   }
+
+   return NULL;
+}
+
+
+static void
+replay_call(struct replay_state *r, const struct replay_call *call)
+{
+   const struct replay_method *method = find_method(r, call);
+   int64_t start;
+
+   if (r->verbose)
+      printf("%llu %s::%s%s\n", (unsigned long long) call->no,
+             r->names[call->klass], r->names[call->method],
+             method ? "" : " (skipped)");
+
+   if (!method)
+      return;
+
+   if (!r->timing) {
+      method->func(r, call);
+      return;
+   }
+
+   start = util_time_micros();
+   method->func(r, call);
+   r->stats[method - replay_methods].usecs += util_time_micros() - start;
+   r->stats[method - replay_methods].count++;
+}
+
+
+/** Statistics being sorted by print_stats() */
+static const struct replay_method_stats *sort_stats;
+
+
+static int
+compare_stats(const void *a, const void *b)
+{
+   const struct replay_method *ma = *(const struct replay_method **) a;
+   const struct replay_method *mb = *(const struct replay_method **) b;
+   int64_t ua = sort_stats[ma - replay_methods].usecs;
+   int64_t ub = sort_stats[mb - replay_methods].usecs;
+
+   return ua < ub ? 1 : ua > ub ? -1 : 0;
+}
+
+
+static void
+print_stats(struct replay_state *r, int64_t total)
+{
+   const struct replay_method *sorted[Elements(replay_methods)];
+   unsigned i;
+
+   for (i = 0; i < Elements(replay_methods); i++)
+      sorted[i] = &replay_methods[i];
+
+   sort_stats = r->stats;
+   qsort(sorted, Elements(replay_methods), sizeof sorted[0], compare_stats);
+
+   printf("%-40s %10s %12s %10s\n", "call", "count", "total ms", "avg us");
+   for (i = 0; i < Elements(replay_methods); i++) {
+      const struct replay_method_stats *stats =
+         &r->stats[sorted[i] - replay_methods];
+      char name[64];
+
+      if (!stats->count)
+         continue;
+
+      util_snprintf(name, sizeof name, "%s::%s",
+                    sorted[i]->klass, sorted[i]->method);
+      printf("%-40s %10u %12.3f %10.2f\n", name, stats->count,
+             stats->usecs / 1000.0, (double) stats->usecs / stats->count);
+   }
+   printf("total %.3f ms\n", total / 1000.0);
+}
+
+
+static enum pipe_error
+release_object(void *key, void *value, void *data)
+{
+   struct replay_state *r = (struct replay_state *) data;
+   struct replay_object *obj = (struct replay_object *) value;
+   struct pipe_buffer *buffer;
+   struct pipe_texture *texture;
+   struct pipe_surface *surface;
+
+   switch (obj->type) {
+   case REPLAY_OBJECT_BUFFER:
+      buffer = obj->object;
+      pipe_buffer_reference(&buffer, NULL);
+      break;
+   case REPLAY_OBJECT_TEXTURE:
+      texture = obj->object;
+      pipe_texture_reference(&texture, NULL);
+      break;
+   case REPLAY_OBJECT_SURFACE:
+      surface = obj->object;
+      pipe_surface_reference(&surface, NULL);
+      break;
+   case REPLAY_OBJECT_TRANSFER:
+      r->screen->tex_transfer_destroy(obj->object);
+      break;
+   default:
+      break;
+   }
+
+   obj->type = REPLAY_OBJECT_OTHER;
+   return PIPE_OK;
+}
+
+
+static enum pipe_error
+release_context(void *key, void *value, void *data)
+{
+   struct replay_object *obj = (struct replay_object *) value;
+
+   if (obj->type == REPLAY_OBJECT_CONTEXT) {
+      struct pipe_context *pipe = obj->object;
+      pipe->destroy(pipe);
+   }
+
+   FREE(obj);
+   return PIPE_OK;
+}
+
+
+static void
+usage(void)
+{
+   fprintf(stderr, "usage: gallium_replay [-t] [-c] [-v] trace\n");
+   exit(1);
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct replay_state *r;
+   struct replay_call call;
+   const char *filename = NULL;
+   char magic[TR_BIN_MAGIC_SIZE];
+   int64_t start, total;
+   unsigned i, calls = 0;
+
+   r = CALLOC_STRUCT(replay_state);
+   if (!r)
+      return 1;
+
+   for (i = 1; i < (unsigned) argc; i++) {
+      if (!strcmp(argv[i], "-t"))
+         r->timing = TRUE;
+      else if (!strcmp(argv[i], "-c"))
+         r->checksum = TRUE;
+      else if (!strcmp(argv[i], "-v"))
+         r->verbose = TRUE;
+      else if (argv[i][0] == '-' || filename)
+         usage();
+      else
+         filename = argv[i];
+   }
+   if (!filename)
+      usage();
+
+   r->file = fopen(filename, "rb");
+   if (!r->file) {
+      fprintf(stderr, "gallium_replay: cannot open %s\n", filename);
+      return 1;
+   }
+   setvbuf(r->file, NULL, _IOFBF, 256 * 1024);
+
+   if (fread(magic, 1, TR_BIN_MAGIC_SIZE, r->file) != TR_BIN_MAGIC_SIZE ||
+       memcmp(magic, TR_BIN_MAGIC, TR_BIN_MAGIC_SIZE) != 0) {
+      fprintf(stderr, "gallium_replay: %s is not a binary trace\n", filename);
+      return 1;
+   }
+   if (read_uint(r) != TR_BIN_VERSION) {
+      fprintf(stderr, "gallium_replay: unsupported trace version\n");
+      return 1;
+   }
+
+   r->arena = CALLOC_STRUCT(replay_arena_chunk);
+   r->objects = hash_table_create(replay_object_hash, replay_object_compare);
+   r->stats = CALLOC(Elements(replay_methods), sizeof *r->stats);
+   r->winsys = replay_winsys_create();
+   r->screen = r->winsys ? softpipe_create_screen(r->winsys) : NULL;
+   if (!r->arena || !r->objects || !r->stats || !r->screen) {
+      fprintf(stderr, "gallium_replay: initialization failed\n");
+      return 1;
+   }
+
+   start = util_time_micros();
+   while (read_call(r, &call)) {
+      replay_call(r, &call);
+      calls++;
+   }
+   total = util_time_micros() - start;
+
+   if (r->timing)
+      print_stats(r, total);
+   printf("%u calls, %u frames, %.3f s\n", calls, r->frames, total / 1e6);
+
+   hash_table_foreach(r->objects, release_object, r);
+   hash_table_foreach(r->objects, release_context, r);
+   hash_table_destroy(r->objects);
+
+   /* This also destroys the winsys */
+   r->screen->destroy(r->screen);
+
+   fclose(r->file);
+
+   return 0;
+}
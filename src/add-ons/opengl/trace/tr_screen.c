@@ -96,6 +96,10 @@ trace_screen_get_param(struct pipe_screen *_screen,
 
    result = screen->get_param(screen, param);
 
+   /* shaders are wrapped per context */
+   if (param == PIPE_CAP_SHARED_STATE_OBJECTS)
+      result = 0;
+
    trace_dump_ret(int, result);
 
    trace_dump_call_end();
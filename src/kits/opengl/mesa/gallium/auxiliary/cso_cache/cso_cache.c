@@ -49,36 +49,33 @@ struct cso_cache {
    void                 *sanitize_data;
 };
 
-#if 1
+/**
+ * Hash a state struct a word at a time, mixing every word (MurmurHash3
+ * style), as many states differ only in a few bits of a single member.
+ */
 static unsigned hash_key(const void *key, unsigned key_size)
 {
-   unsigned *ikey = (unsigned *)key;
-   unsigned hash = 0, i;
+   const unsigned *ikey = (const unsigned *)key;
+   unsigned hash = key_size, k, i;
 
    assert(key_size % 4 == 0);
 
-   /* I'm sure this can be improved on:
-    */
-   for (i = 0; i < key_size/4; i++)
-      hash ^= ikey[i];
+   for (i = 0; i < key_size/4; i++) {
+      k = ikey[i] * 0xcc9e2d51;
+      k = (k << 15) | (k >> 17);
+      hash ^= k * 0x1b873593;
+      hash = (hash << 13) | (hash >> 19);
+      hash = hash * 5 + 0xe6546b64;
+   }
+
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   hash *= 0xc2b2ae35;
+   hash ^= hash >> 16;
 
    return hash;
 }
-#else
-static unsigned hash_key(const unsigned char *p, int n)
-{
-   unsigned h = 0;
-   unsigned g;
-
-   while (n--) {
-      h = (h << 4) + *p++;
-      if ((g = (h & 0xf0000000)) != 0)
-         h ^= g >> 23;
-      h &= ~g;
-   }
-   return h;
-}
-#endif
 
 unsigned cso_construct_key(void *item, int item_size)
 {
@@ -274,7 +271,7 @@ void *cso_hash_find_data_from_template( struct cso_hash *hash,
 	  */
          return iter_data;
       }
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    return NULL;
 }
@@ -290,7 +287,7 @@ struct cso_hash_iter cso_find_state_template(struct cso_cache *sc,
       void *iter_data = cso_hash_iter_data(iter);
       if (!memcmp(iter_data, templ, size))
          return iter;
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    return iter;
 }
@@ -36,17 +36,73 @@
   */
 
 #include "pipe/p_state.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_thread.h"
 #include "util/u_memory.h"
+#include "util/u_pointer.h"
 #include "tgsi/tgsi_parse.h"
 
 #include "cso_cache/cso_context.h"
 #include "cso_cache/cso_cache.h"
 #include "cso_cache/cso_hash.h"
 
+
+/** Number of recently used states of each type looked at before the cache */
+#define CSO_RECENT_SIZE 4
+
+#define CSO_RECENT_TYPES (CSO_VERTEX_SHADER + 1)
+
+/**
+ * The last few states of a type which were set, most state changes just 
+ * go back and forth between them.  Looking them up needs no hashing.
+ */
+struct cso_recent {
+   void *cso[CSO_RECENT_SIZE];
+   unsigned next;
+};
+
+/**
+ * State objects shared by all cso contexts on one screen, so that
+ * contexts which set the same states and shaders create them only once.
+ * Only used when the driver reports PIPE_CAP_SHARED_STATE_OBJECTS.
+ *
+ * The mutex guards the cache, the shaders and the bound state of every
+ * attached context: a state may only be evicted from the cache when no
+ * context has it bound or saved.
+ */
+struct cso_shared {
+   struct pipe_screen *screen;
+   pipe_mutex mutex;
+
+   struct cso_cache *cache;
+   struct cso_hash *shaders;         /**< fragment shaders, by tokens */
+   struct cso_hash *shader_handles;  /**< the same, by driver handle */
+
+   struct cso_context *contexts;     /**< attached contexts */
+   struct cso_shared *next;
+};
+
+/** Reference counted fragment shader in cso_shared */
+struct cso_shared_shader {
+   struct pipe_shader_state state;
+   void *data;
+   unsigned key;
+   unsigned refcount;
+};
+
+pipe_static_mutex(shared_list_mutex);
+static struct cso_shared *shared_list = NULL;
+
+
 struct cso_context {
    struct pipe_context *pipe;
    struct cso_cache *cache;
 
+   struct cso_shared *shared;
+   struct cso_context *next_shared;
+
+   struct cso_recent recent[CSO_RECENT_TYPES];
+
    struct {
       void *samplers[PIPE_MAX_SAMPLERS];
       unsigned nr_samplers;
@@ -83,11 +139,79 @@ static void
 free_framebuffer_state(struct pipe_framebuffer_state *fb);
 
 
+static INLINE void cso_lock(struct cso_context *ctx)
+{
+   if (ctx->shared)
+      pipe_mutex_lock(ctx->shared->mutex);
+}
+
+static INLINE void cso_unlock(struct cso_context *ctx)
+{
+   if (ctx->shared)
+      pipe_mutex_unlock(ctx->shared->mutex);
+}
+
+
+/**
+ * Is the state bound or saved in the context?
+ */
+static boolean cso_bound(const struct cso_context *ctx,
+                         enum cso_cache_type type, const void *data)
+{
+   unsigned i;
+
+   switch (type) {
+   case CSO_BLEND:
+      return ctx->blend == data || ctx->blend_saved == data;
+   case CSO_DEPTH_STENCIL_ALPHA:
+      return ctx->depth_stencil == data || ctx->depth_stencil_saved == data;
+   case CSO_RASTERIZER:
+      return ctx->rasterizer == data || ctx->rasterizer_saved == data;
+   case CSO_SAMPLER:
+      for (i = 0; i < PIPE_MAX_SAMPLERS; i++) {
+         if (ctx->samplers[i] == data || ctx->samplers_saved[i] == data)
+            return TRUE;
+      }
+      for (i = 0; i < ctx->hw.nr_samplers; i++) {
+         if (ctx->hw.samplers[i] == data)
+            return TRUE;
+      }
+      return FALSE;
+   case CSO_FRAGMENT_SHADER:
+      return ctx->fragment_shader == data ||
+             ctx->fragment_shader_saved == data;
+   case CSO_VERTEX_SHADER:
+      return ctx->vertex_shader == data || ctx->vertex_shader_saved == data;
+   default:
+      assert(0);
+      return TRUE;
+   }
+}
+
+/**
+ * Is the state bound in any context which can see it?
+ */
+static boolean cso_in_use(const struct cso_context *ctx,
+                          enum cso_cache_type type, const void *data)
+{
+   const struct cso_context *other;
+
+   if (!ctx->shared)
+      return cso_bound(ctx, type, data);
+
+   for (other = ctx->shared->contexts; other; other = other->next_shared) {
+      if (cso_bound(other, type, data))
+         return TRUE;
+   }
+   return FALSE;
+}
+
+
 static boolean delete_blend_state(struct cso_context *ctx, void *state)
 {
    struct cso_blend *cso = (struct cso_blend *)state;
 
-   if (ctx->blend == cso->data)
+   if (cso_in_use(ctx, CSO_BLEND, cso->data))
       return FALSE;
 
    if (cso->delete_state)
@@ -100,7 +224,7 @@ static boolean delete_depth_stencil_state(struct cso_context *ctx, void *state)
 {
    struct cso_depth_stencil_alpha *cso = (struct cso_depth_stencil_alpha *)state;
 
-   if (ctx->depth_stencil == cso->data)
+   if (cso_in_use(ctx, CSO_DEPTH_STENCIL_ALPHA, cso->data))
       return FALSE;
 
    if (cso->delete_state)
@@ -113,6 +237,8 @@ static boolean delete_depth_stencil_state(struct cso_context *ctx, void *state)
 static boolean delete_sampler_state(struct cso_context *ctx, void *state)
 {
    struct cso_sampler *cso = (struct cso_sampler *)state;
+   if (cso_in_use(ctx, CSO_SAMPLER, cso->data))
+      return FALSE;
    if (cso->delete_state)
       cso->delete_state(cso->context, cso->data);
    FREE(state);
@@ -123,7 +249,7 @@ static boolean delete_rasterizer_state(struct cso_context *ctx, void *state)
 {
    struct cso_rasterizer *cso = (struct cso_rasterizer *)state;
 
-   if (ctx->rasterizer == cso->data)
+   if (cso_in_use(ctx, CSO_RASTERIZER, cso->data))
       return FALSE;
    if (cso->delete_state)
       cso->delete_state(cso->context, cso->data);
@@ -134,7 +260,7 @@ static boolean delete_rasterizer_state(struct cso_context *ctx, void *state)
 static boolean delete_fs_state(struct cso_context *ctx, void *state)
 {
    struct cso_fragment_shader *cso = (struct cso_fragment_shader *)state;
-   if (ctx->fragment_shader == cso->data)
+   if (cso_in_use(ctx, CSO_FRAGMENT_SHADER, cso->data))
       return FALSE;
    if (cso->delete_state)
       cso->delete_state(cso->context, cso->data);
@@ -145,48 +271,134 @@ static boolean delete_fs_state(struct cso_context *ctx, void *state)
 static boolean delete_vs_state(struct cso_context *ctx, void *state)
 {
    struct cso_vertex_shader *cso = (struct cso_vertex_shader *)state;
-   if (ctx->vertex_shader == cso->data)
-      return TRUE;
+   if (cso_in_use(ctx, CSO_VERTEX_SHADER, cso->data))
+      return FALSE;
    if (cso->delete_state)
       cso->delete_state(cso->context, cso->data);
    FREE(state);
-   return FALSE;
+   return TRUE;
+}
+
+
+/**
+ * Inline memcmp, state structs are a multiple of 4 bytes and mostly differ
+ * in their first words.
+ */
+static INLINE boolean state_equal(const void *a, const void *b, unsigned size)
+{
+   const unsigned *ia = (const unsigned *)a;
+   const unsigned *ib = (const unsigned *)b;
+   unsigned i;
+
+   for (i = 0; i < size/4; i++) {
+      if (ia[i] != ib[i])
+         return FALSE;
+   }
+   return TRUE;
+}
+
+static INLINE void *recent_find(struct cso_recent *recent,
+                                const void *templ, unsigned size)
+{
+   unsigned i;
+
+   /* Every cso struct starts with the state it was created from */
+   for (i = 0; i < CSO_RECENT_SIZE; i++) {
+      if (recent->cso[i] && state_equal(recent->cso[i], templ, size))
+         return recent->cso[i];
+   }
+   return NULL;
+}
+
+static INLINE void recent_add(struct cso_recent *recent, void *cso)
+{
+   recent->cso[recent->next] = cso;
+   recent->next = (recent->next + 1) % CSO_RECENT_SIZE;
+}
+
+static void recent_remove(struct cso_recent *recent, void *cso)
+{
+   unsigned i;
+
+   for (i = 0; i < CSO_RECENT_SIZE; i++) {
+      if (recent->cso[i] == cso)
+         recent->cso[i] = NULL;
+   }
 }
 
 
 static INLINE boolean delete_cso(struct cso_context *ctx,
                                  void *state, enum cso_cache_type type)
 {
+   boolean deleted = FALSE;
+
    switch (type) {
    case CSO_BLEND:
-      return delete_blend_state(ctx, state);
+      deleted = delete_blend_state(ctx, state);
       break;
    case CSO_SAMPLER:
-      return delete_sampler_state(ctx, state);
+      deleted = delete_sampler_state(ctx, state);
       break;
    case CSO_DEPTH_STENCIL_ALPHA:
-      return delete_depth_stencil_state(ctx, state);
+      deleted = delete_depth_stencil_state(ctx, state);
       break;
    case CSO_RASTERIZER:
-      return delete_rasterizer_state(ctx, state);
+      deleted = delete_rasterizer_state(ctx, state);
       break;
    case CSO_FRAGMENT_SHADER:
-      return delete_fs_state(ctx, state);
+      deleted = delete_fs_state(ctx, state);
       break;
    case CSO_VERTEX_SHADER:
-      return delete_vs_state(ctx, state);
+      deleted = delete_vs_state(ctx, state);
       break;
    default:
       assert(0);
       FREE(state);
+      return FALSE;
    }
-   return FALSE;
+
+   if (deleted) {
+      if (ctx->shared) {
+         struct cso_context *other;
+
+         for (other = ctx->shared->contexts; other; other = other->next_shared)
+            recent_remove(&other->recent[type], state);
+      }
+      else
+         recent_remove(&ctx->recent[type], state);
+   }
+   return deleted;
 }
 
-static INLINE void sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
-                                 int max_size, void *user_data)
+
+/**
+ * Find the cso created from the given template, or return NULL and the
+ * hash key to insert a new one with.
+ */
+static void *lookup_cso(struct cso_context *ctx, enum cso_cache_type type,
+                        const void *templ, unsigned size, unsigned *hash_key)
+{
+   struct cso_recent *recent = &ctx->recent[type];
+   struct cso_hash_iter iter;
+   void *cso;
+
+   cso = recent_find(recent, templ, size);
+   if (cso)
+      return cso;
+
+   *hash_key = cso_construct_key((void*)templ, size);
+   iter = cso_find_state_template(ctx->cache, *hash_key, type, (void*)templ);
+   if (cso_hash_iter_is_null(iter))
+      return NULL;
+
+   cso = cso_hash_iter_data(iter);
+   recent_add(recent, cso);
+   return cso;
+}
+
+static void evict_states(struct cso_context *ctx, struct cso_hash *hash,
+                         enum cso_cache_type type, int max_size)
 {
-   struct cso_context *ctx = (struct cso_context *)user_data;
    /* if we're approach the maximum size, remove fourth of the entries
     * otherwise every subsequent call will go through the same */
    int hash_size = cso_hash_size(hash);
@@ -195,7 +407,7 @@ static INLINE void sanitize_hash(struct cso_hash *hash, enum cso_cache_type type
    struct cso_hash_iter iter = cso_hash_first_node(hash);
    if (hash_size > max_size)
       to_remove += hash_size - max_size;
-   while (to_remove) {
+   while (to_remove && !cso_hash_iter_is_null(iter)) {
       /*remove elements until we're good */
       /*fixme: currently we pick the nodes to remove at random*/
       void *cso = cso_hash_iter_data(iter);
@@ -207,13 +419,203 @@ static INLINE void sanitize_hash(struct cso_hash *hash, enum cso_cache_type type
    }
 }
 
+static void sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
+                          int max_size, void *user_data)
+{
+   evict_states((struct cso_context *)user_data, hash, type, max_size);
+}
+
+/**
+ * Evicting from the shared cache only happens on insert, with the mutex
+ * held by an attached context.
+ */
+static void sanitize_shared_hash(struct cso_hash *hash,
+                                 enum cso_cache_type type,
+                                 int max_size, void *user_data)
+{
+   struct cso_shared *shared = (struct cso_shared *)user_data;
+
+   evict_states(shared->contexts, hash, type, max_size);
+}
+
+
+/**
+ * Find or create the shared state of the context's screen, and attach
+ * the context to it.
+ */
+static boolean attach_shared(struct cso_context *ctx)
+{
+   struct pipe_screen *screen = ctx->pipe->screen;
+   struct cso_shared *shared;
+
+   pipe_mutex_lock(shared_list_mutex);
+
+   for (shared = shared_list; shared; shared = shared->next) {
+      if (shared->screen == screen)
+         break;
+   }
+
+   if (!shared) {
+      shared = CALLOC_STRUCT(cso_shared);
+      if (!shared)
+         goto fail;
+
+      shared->cache = cso_cache_create();
+      shared->shaders = cso_hash_create();
+      shared->shader_handles = cso_hash_create();
+      if (!shared->cache || !shared->shaders || !shared->shader_handles) {
+         if (shared->cache)
+            cso_cache_delete(shared->cache);
+         if (shared->shaders)
+            cso_hash_delete(shared->shaders);
+         if (shared->shader_handles)
+            cso_hash_delete(shared->shader_handles);
+         FREE(shared);
+         goto fail;
+      }
+      cso_cache_set_sanitize_callback(shared->cache,
+                                      sanitize_shared_hash,
+                                      shared);
+
+      shared->screen = screen;
+      pipe_mutex_init(shared->mutex);
+
+      shared->next = shared_list;
+      shared_list = shared;
+   }
+
+   pipe_mutex_lock(shared->mutex);
+   ctx->next_shared = shared->contexts;
+   shared->contexts = ctx;
+   ctx->shared = shared;
+   ctx->cache = shared->cache;
+   pipe_mutex_unlock(shared->mutex);
+
+   pipe_mutex_unlock(shared_list_mutex);
+   return TRUE;
+
+fail:
+   pipe_mutex_unlock(shared_list_mutex);
+   return FALSE;
+}
+
+
+struct cso_rehome {
+   struct pipe_context *from;
+   struct pipe_context *to;
+   enum cso_cache_type type;
+};
+
+static void rehome_state(void *state, void *user_data)
+{
+   struct cso_rehome *rehome = (struct cso_rehome *)user_data;
+   struct pipe_context **context;
+
+   switch (rehome->type) {
+   case CSO_BLEND:
+      context = &((struct cso_blend *)state)->context;
+      break;
+   case CSO_SAMPLER:
+      context = &((struct cso_sampler *)state)->context;
+      break;
+   case CSO_DEPTH_STENCIL_ALPHA:
+      context = &((struct cso_depth_stencil_alpha *)state)->context;
+      break;
+   case CSO_RASTERIZER:
+      context = &((struct cso_rasterizer *)state)->context;
+      break;
+   default:
+      assert(0);
+      return;
+   }
+
+   if (*context == rehome->from)
+      *context = rehome->to;
+}
+
+static void delete_shared_shaders(struct cso_shared *shared,
+                                  struct pipe_context *pipe)
+{
+   struct cso_hash_iter iter = cso_hash_first_node(shared->shaders);
+
+   while (!cso_hash_iter_is_null(iter)) {
+      struct cso_shared_shader *shader = cso_hash_iter_data(iter);
+
+      pipe->delete_fs_state(pipe, shader->data);
+      FREE((void *)shader->state.tokens);
+      FREE(shader);
+      iter = cso_hash_iter_next(iter);
+   }
+}
+
+/**
+ * Detach the context from the shared state.  States it created are
+ * handed over to another context, the last context deletes them all.
+ */
+static void detach_shared(struct cso_context *ctx)
+{
+   struct cso_shared *shared = ctx->shared;
+   struct cso_context **link;
+   boolean last;
+
+   pipe_mutex_lock(shared_list_mutex);
+   pipe_mutex_lock(shared->mutex);
+
+   for (link = &shared->contexts; *link != ctx; link = &(*link)->next_shared)
+      ;
+   *link = ctx->next_shared;
+   ctx->next_shared = NULL;
+   ctx->shared = NULL;
+   ctx->cache = NULL;
+
+   last = shared->contexts == NULL;
+   if (!last) {
+      struct cso_rehome rehome;
+
+      rehome.from = ctx->pipe;
+      rehome.to = shared->contexts->pipe;
+      for (rehome.type = CSO_BLEND; rehome.type <= CSO_RASTERIZER;
+           rehome.type++)
+         cso_for_each_state(shared->cache, rehome.type, rehome_state, &rehome);
+   }
+   else {
+      struct cso_shared **prev;
+
+      for (prev = &shared_list; *prev != shared; prev = &(*prev)->next)
+         ;
+      *prev = shared->next;
+   }
+
+   pipe_mutex_unlock(shared->mutex);
+   pipe_mutex_unlock(shared_list_mutex);
+
+   if (last) {
+      /* Nobody else can find it any more */
+      cso_cache_delete(shared->cache);
+      delete_shared_shaders(shared, ctx->pipe);
+      cso_hash_delete(shared->shaders);
+      cso_hash_delete(shared->shader_handles);
+      pipe_mutex_destroy(shared->mutex);
+      FREE(shared);
+   }
+}
+
 
 struct cso_context *cso_create_context( struct pipe_context *pipe )
 {
+   struct pipe_screen *screen = pipe->screen;
    struct cso_context *ctx = CALLOC_STRUCT(cso_context);
    if (ctx == NULL)
       goto out;
 
+   ctx->pipe = pipe;
+
+   if (screen &&
+       screen->get_param(screen, PIPE_CAP_SHARED_STATE_OBJECTS) &&
+       debug_get_bool_option("CSO_SHARED", TRUE) &&
+       attach_shared(ctx))
+      return ctx;
+
    ctx->cache = cso_cache_create();
    if (ctx->cache == NULL)
       goto out;
@@ -221,8 +623,6 @@ struct cso_context *cso_create_context( struct pipe_context *pipe )
                                    sanitize_hash,
                                    ctx);
 
-   ctx->pipe = pipe;
-
    /* Enable for testing: */
    if (0) cso_set_maximum_cache_size( ctx->cache, 4 );
 
@@ -258,10 +658,29 @@ void cso_release_all( struct cso_context *ctx )
    free_framebuffer_state(&ctx->fb);
    free_framebuffer_state(&ctx->fb_saved);
 
+   if (ctx->shared) {
+      /* Let the other contexts evict what this one had bound, the shared
+       * states themselves go when the last context is destroyed.
+       */
+      cso_lock(ctx);
+      ctx->blend = ctx->blend_saved = NULL;
+      ctx->depth_stencil = ctx->depth_stencil_saved = NULL;
+      ctx->rasterizer = ctx->rasterizer_saved = NULL;
+      memset(ctx->samplers, 0, sizeof(ctx->samplers));
+      memset(ctx->samplers_saved, 0, sizeof(ctx->samplers_saved));
+      ctx->nr_samplers = ctx->nr_samplers_saved = 0;
+      ctx->hw.nr_samplers = 0;
+      memset(ctx->recent, 0, sizeof(ctx->recent));
+      cso_unlock(ctx);
+      return;
+   }
+
    if (ctx->cache) {
       cso_cache_delete( ctx->cache );
       ctx->cache = NULL;
    }
+
+   memset(ctx->recent, 0, sizeof(ctx->recent));
 }
 
 
@@ -269,6 +688,8 @@ void cso_destroy_context( struct cso_context *ctx )
 {
    if (ctx) {
       //cso_release_all( ctx );
+      if (ctx->shared)
+         detach_shared(ctx);
       FREE( ctx );
    }
 }
@@ -287,16 +708,21 @@ void cso_destroy_context( struct cso_context *ctx )
 enum pipe_error cso_set_blend(struct cso_context *ctx,
                               const struct pipe_blend_state *templ)
 {
-   unsigned hash_key = cso_construct_key((void*)templ, sizeof(struct pipe_blend_state));
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key, CSO_BLEND,
-                                                       (void*)templ);
+   unsigned hash_key;
+   struct cso_blend *cso;
    void *handle;
 
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_blend *cso = MALLOC(sizeof(struct cso_blend));
-      if (!cso)
+   cso_lock(ctx);
+   cso = lookup_cso(ctx, CSO_BLEND, templ, sizeof(struct pipe_blend_state),
+                    &hash_key);
+   if (!cso) {
+      struct cso_hash_iter iter;
+
+      cso = MALLOC(sizeof(struct cso_blend));
+      if (!cso) {
+         cso_unlock(ctx);
          return PIPE_ERROR_OUT_OF_MEMORY;
+      }
 
       memcpy(&cso->state, templ, sizeof(*templ));
       cso->data = ctx->pipe->create_blend_state(ctx->pipe, &cso->state);
@@ -306,35 +732,40 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
       iter = cso_insert_state(ctx->cache, hash_key, CSO_BLEND, cso);
       if (cso_hash_iter_is_null(iter)) {
          FREE(cso);
+         cso_unlock(ctx);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_blend *)cso_hash_iter_data(iter))->data;
+      recent_add(&ctx->recent[CSO_BLEND], cso);
    }
 
+   handle = cso->data;
+
    if (ctx->blend != handle) {
       ctx->blend = handle;
       ctx->pipe->bind_blend_state(ctx->pipe, handle);
    }
+   cso_unlock(ctx);
    return PIPE_OK;
 }
 
 void cso_save_blend(struct cso_context *ctx)
 {
    assert(!ctx->blend_saved);
+   cso_lock(ctx);
    ctx->blend_saved = ctx->blend;
+   cso_unlock(ctx);
 }
 
 void cso_restore_blend(struct cso_context *ctx)
 {
+   cso_lock(ctx);
    if (ctx->blend != ctx->blend_saved) {
       ctx->blend = ctx->blend_saved;
       ctx->pipe->bind_blend_state(ctx->pipe, ctx->blend_saved);
    }
    ctx->blend_saved = NULL;
+   cso_unlock(ctx);
 }
 
 
@@ -345,16 +776,22 @@ enum pipe_error cso_single_sampler(struct cso_context *ctx,
 {
    void *handle = NULL;
 
+   cso_lock(ctx);
+
    if (templ != NULL) {
-      unsigned hash_key = cso_construct_key((void*)templ, sizeof(struct pipe_sampler_state));
-      struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                          hash_key, CSO_SAMPLER,
-                                                          (void*)templ);
+      unsigned hash_key;
+      struct cso_sampler *cso = lookup_cso(ctx, CSO_SAMPLER, templ,
+                                           sizeof(struct pipe_sampler_state),
+                                           &hash_key);
 
-      if (cso_hash_iter_is_null(iter)) {
-         struct cso_sampler *cso = MALLOC(sizeof(struct cso_sampler));
-         if (!cso)
+      if (!cso) {
+         struct cso_hash_iter iter;
+
+         cso = MALLOC(sizeof(struct cso_sampler));
+         if (!cso) {
+            cso_unlock(ctx);
             return PIPE_ERROR_OUT_OF_MEMORY;
+         }
 
          memcpy(&cso->state, templ, sizeof(*templ));
          cso->data = ctx->pipe->create_sampler_state(ctx->pipe, &cso->state);
@@ -364,17 +801,18 @@ enum pipe_error cso_single_sampler(struct cso_context *ctx,
          iter = cso_insert_state(ctx->cache, hash_key, CSO_SAMPLER, cso);
          if (cso_hash_iter_is_null(iter)) {
             FREE(cso);
+            cso_unlock(ctx);
             return PIPE_ERROR_OUT_OF_MEMORY;
          }
 
-         handle = cso->data;
-      }
-      else {
-         handle = ((struct cso_sampler *)cso_hash_iter_data(iter))->data;
+         recent_add(&ctx->recent[CSO_SAMPLER], cso);
       }
+
+      handle = cso->data;
    }
 
    ctx->samplers[idx] = handle;
+   cso_unlock(ctx);
    return PIPE_OK;
 }
 
@@ -382,6 +820,8 @@ void cso_single_sampler_done( struct cso_context *ctx )
 {
    unsigned i;
 
+   cso_lock(ctx);
+
    /* find highest non-null sampler */
    for (i = PIPE_MAX_SAMPLERS; i > 0; i--) {
       if (ctx->samplers[i - 1] != NULL)
@@ -400,6 +840,8 @@ void cso_single_sampler_done( struct cso_context *ctx )
 
       ctx->pipe->bind_sampler_states(ctx->pipe, ctx->nr_samplers, ctx->samplers);
    }
+
+   cso_unlock(ctx);
 }
 
 /*
@@ -436,14 +878,18 @@ enum pipe_error cso_set_samplers( struct cso_context *ctx,
 
 void cso_save_samplers(struct cso_context *ctx)
 {
+   cso_lock(ctx);
    ctx->nr_samplers_saved = ctx->nr_samplers;
    memcpy(ctx->samplers_saved, ctx->samplers, sizeof(ctx->samplers));
+   cso_unlock(ctx);
 }
 
 void cso_restore_samplers(struct cso_context *ctx)
 {
+   cso_lock(ctx);
    ctx->nr_samplers = ctx->nr_samplers_saved;
    memcpy(ctx->samplers, ctx->samplers_saved, sizeof(ctx->samplers));
+   cso_unlock(ctx);
    cso_single_sampler_done( ctx );
 }
 
@@ -501,18 +947,21 @@ void cso_restore_sampler_textures( struct cso_context *ctx )
 enum pipe_error cso_set_depth_stencil_alpha(struct cso_context *ctx,
                                             const struct pipe_depth_stencil_alpha_state *templ)
 {
-   unsigned hash_key = cso_construct_key((void*)templ,
-                                         sizeof(struct pipe_depth_stencil_alpha_state));
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key, 
-						       CSO_DEPTH_STENCIL_ALPHA,
-                                                       (void*)templ);
+   unsigned hash_key;
+   struct cso_depth_stencil_alpha *cso;
    void *handle;
 
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_depth_stencil_alpha *cso = MALLOC(sizeof(struct cso_depth_stencil_alpha));
-      if (!cso)
+   cso_lock(ctx);
+   cso = lookup_cso(ctx, CSO_DEPTH_STENCIL_ALPHA, templ,
+                    sizeof(struct pipe_depth_stencil_alpha_state), &hash_key);
+   if (!cso) {
+      struct cso_hash_iter iter;
+
+      cso = MALLOC(sizeof(struct cso_depth_stencil_alpha));
+      if (!cso) {
+         cso_unlock(ctx);
          return PIPE_ERROR_OUT_OF_MEMORY;
+      }
 
       memcpy(&cso->state, templ, sizeof(*templ));
       cso->data = ctx->pipe->create_depth_stencil_alpha_state(ctx->pipe, &cso->state);
@@ -522,35 +971,40 @@ enum pipe_error cso_set_depth_stencil_alpha(struct cso_context *ctx,
       iter = cso_insert_state(ctx->cache, hash_key, CSO_DEPTH_STENCIL_ALPHA, cso);
       if (cso_hash_iter_is_null(iter)) {
          FREE(cso);
+         cso_unlock(ctx);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_depth_stencil_alpha *)cso_hash_iter_data(iter))->data;
+      recent_add(&ctx->recent[CSO_DEPTH_STENCIL_ALPHA], cso);
    }
 
+   handle = cso->data;
+
    if (ctx->depth_stencil != handle) {
       ctx->depth_stencil = handle;
       ctx->pipe->bind_depth_stencil_alpha_state(ctx->pipe, handle);
    }
+   cso_unlock(ctx);
    return PIPE_OK;
 }
 
 void cso_save_depth_stencil_alpha(struct cso_context *ctx)
 {
    assert(!ctx->depth_stencil_saved);
+   cso_lock(ctx);
    ctx->depth_stencil_saved = ctx->depth_stencil;
+   cso_unlock(ctx);
 }
 
 void cso_restore_depth_stencil_alpha(struct cso_context *ctx)
 {
+   cso_lock(ctx);
    if (ctx->depth_stencil != ctx->depth_stencil_saved) {
       ctx->depth_stencil = ctx->depth_stencil_saved;
       ctx->pipe->bind_depth_stencil_alpha_state(ctx->pipe, ctx->depth_stencil_saved);
    }
    ctx->depth_stencil_saved = NULL;
+   cso_unlock(ctx);
 }
 
 
@@ -558,17 +1012,21 @@ void cso_restore_depth_stencil_alpha(struct cso_context *ctx)
 enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
                                    const struct pipe_rasterizer_state *templ)
 {
-   unsigned hash_key = cso_construct_key((void*)templ,
-                                         sizeof(struct pipe_rasterizer_state));
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key, CSO_RASTERIZER,
-                                                       (void*)templ);
+   unsigned hash_key;
+   struct cso_rasterizer *cso;
    void *handle = NULL;
 
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_rasterizer *cso = MALLOC(sizeof(struct cso_rasterizer));
-      if (!cso)
+   cso_lock(ctx);
+   cso = lookup_cso(ctx, CSO_RASTERIZER, templ,
+                    sizeof(struct pipe_rasterizer_state), &hash_key);
+   if (!cso) {
+      struct cso_hash_iter iter;
+
+      cso = MALLOC(sizeof(struct cso_rasterizer));
+      if (!cso) {
+         cso_unlock(ctx);
          return PIPE_ERROR_OUT_OF_MEMORY;
+      }
 
       memcpy(&cso->state, templ, sizeof(*templ));
       cso->data = ctx->pipe->create_rasterizer_state(ctx->pipe, &cso->state);
@@ -578,35 +1036,40 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
       iter = cso_insert_state(ctx->cache, hash_key, CSO_RASTERIZER, cso);
       if (cso_hash_iter_is_null(iter)) {
          FREE(cso);
+         cso_unlock(ctx);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_rasterizer *)cso_hash_iter_data(iter))->data;
+      recent_add(&ctx->recent[CSO_RASTERIZER], cso);
    }
 
+   handle = cso->data;
+
    if (ctx->rasterizer != handle) {
       ctx->rasterizer = handle;
       ctx->pipe->bind_rasterizer_state(ctx->pipe, handle);
    }
+   cso_unlock(ctx);
    return PIPE_OK;
 }
 
 void cso_save_rasterizer(struct cso_context *ctx)
 {
    assert(!ctx->rasterizer_saved);
+   cso_lock(ctx);
    ctx->rasterizer_saved = ctx->rasterizer;
+   cso_unlock(ctx);
 }
 
 void cso_restore_rasterizer(struct cso_context *ctx)
 {
+   cso_lock(ctx);
    if (ctx->rasterizer != ctx->rasterizer_saved) {
       ctx->rasterizer = ctx->rasterizer_saved;
       ctx->pipe->bind_rasterizer_state(ctx->pipe, ctx->rasterizer_saved);
    }
    ctx->rasterizer_saved = NULL;
+   cso_unlock(ctx);
 }
 
 
@@ -621,8 +1084,144 @@ enum pipe_error cso_set_fragment_shader_handle(struct cso_context *ctx,
    return PIPE_OK;
 }
 
+static INLINE unsigned handle_key(const void *handle)
+{
+   uintptr_t u = pointer_to_uintptr(handle);
+
+   return (unsigned)(u ^ (u >> 16));
+}
+
+/**
+ * Create a fragment shader.  Contexts sharing state get the same shader
+ * for the same tokens, so it is only compiled once per screen.  Must be
+ * deleted with cso_delete_fragment_shader().
+ */
+void *cso_create_fragment_shader(struct cso_context *ctx,
+                                 const struct pipe_shader_state *templ)
+{
+   struct cso_shared *shared = ctx->shared;
+   unsigned tokens_size, key;
+   struct cso_hash_iter iter;
+   struct cso_shared_shader *shader;
+
+   if (!shared)
+      return ctx->pipe->create_fs_state(ctx->pipe, templ);
+
+   tokens_size = tgsi_num_tokens(templ->tokens) * sizeof(struct tgsi_token);
+   key = cso_construct_key((void *)templ->tokens, tokens_size);
+
+   pipe_mutex_lock(shared->mutex);
+
+   for (iter = cso_hash_find(shared->shaders, key);
+        !cso_hash_iter_is_null(iter);
+        iter = cso_hash_find_next(iter)) {
+      shader = cso_hash_iter_data(iter);
+      if (tgsi_num_tokens(shader->state.tokens) * sizeof(struct tgsi_token) ==
+             tokens_size &&
+          memcmp(shader->state.tokens, templ->tokens, tokens_size) == 0) {
+         shader->refcount++;
+         pipe_mutex_unlock(shared->mutex);
+         return shader->data;
+      }
+   }
+
+   shader = CALLOC_STRUCT(cso_shared_shader);
+   if (!shader)
+      goto fail;
+
+   shader->state.tokens = tgsi_dup_tokens(templ->tokens);
+   if (!shader->state.tokens)
+      goto fail;
+
+   shader->data = ctx->pipe->create_fs_state(ctx->pipe, &shader->state);
+   if (!shader->data)
+      goto fail;
+
+   shader->key = key;
+   shader->refcount = 1;
+
+   iter = cso_hash_insert(shared->shaders, key, shader);
+   if (cso_hash_iter_is_null(iter)) {
+      ctx->pipe->delete_fs_state(ctx->pipe, shader->data);
+      goto fail;
+   }
+   if (cso_hash_iter_is_null(cso_hash_insert(shared->shader_handles,
+                                             handle_key(shader->data),
+                                             shader))) {
+      cso_hash_erase(shared->shaders, iter);
+      ctx->pipe->delete_fs_state(ctx->pipe, shader->data);
+      goto fail;
+   }
+
+   pipe_mutex_unlock(shared->mutex);
+   return shader->data;
+
+fail:
+   if (shader) {
+      FREE((void *)shader->state.tokens);
+      FREE(shader);
+   }
+   pipe_mutex_unlock(shared->mutex);
+   return NULL;
+}
+
+/**
+ * Drop a shared fragment shader reference, unbinding and deleting the
+ * shader with the last one.  Returns FALSE if the handle was not created
+ * by cso_create_fragment_shader().
+ */
+static boolean release_shared_shader(struct cso_context *ctx, void *handle)
+{
+   struct cso_shared *shared = ctx->shared;
+   struct cso_shared_shader *shader = NULL;
+   struct cso_hash_iter iter;
+
+   pipe_mutex_lock(shared->mutex);
+
+   for (iter = cso_hash_find(shared->shader_handles, handle_key(handle));
+        !cso_hash_iter_is_null(iter);
+        iter = cso_hash_find_next(iter)) {
+      shader = cso_hash_iter_data(iter);
+      if (shader->data == handle)
+         break;
+   }
+
+   if (cso_hash_iter_is_null(iter)) {
+      pipe_mutex_unlock(shared->mutex);
+      return FALSE;
+   }
+
+   if (--shader->refcount == 0) {
+      if (handle == ctx->fragment_shader) {
+         /* unbind before deleting */
+         ctx->pipe->bind_fs_state(ctx->pipe, NULL);
+         ctx->fragment_shader = NULL;
+      }
+
+      cso_hash_erase(shared->shader_handles, iter);
+
+      for (iter = cso_hash_find(shared->shaders, shader->key);
+           cso_hash_iter_data(iter) != shader;
+           iter = cso_hash_find_next(iter))
+         ;
+      cso_hash_erase(shared->shaders, iter);
+
+      ctx->pipe->delete_fs_state(ctx->pipe, handle);
+      FREE((void *)shader->state.tokens);
+      FREE(shader);
+   }
+
+   pipe_mutex_unlock(shared->mutex);
+   return TRUE;
+}
+
 void cso_delete_fragment_shader(struct cso_context *ctx, void *handle )
 {
+   /* Programs with the same tokens share the shader, which must stay
+    * bound while another of them may still be using it.
+    */
+   if (ctx->shared && release_shared_shader(ctx, handle))
+      return;
    if (handle == ctx->fragment_shader) {
       /* unbind before deleting */
       ctx->pipe->bind_fs_state(ctx->pipe, NULL);
@@ -101,6 +101,8 @@ void cso_restore_sampler_textures( struct cso_context *cso );
  */
 enum pipe_error cso_set_fragment_shader_handle(struct cso_context *ctx,
                                                void *handle );
+void *cso_create_fragment_shader(struct cso_context *ctx,
+                                 const struct pipe_shader_state *templ);
 void cso_delete_fragment_shader(struct cso_context *ctx, void *handle );
 /*
 enum pipe_error cso_set_fragment_shader( struct cso_context *cso,
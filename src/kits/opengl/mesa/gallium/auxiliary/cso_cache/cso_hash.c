@@ -35,405 +35,307 @@
 
 #include "cso_hash.h"
 
-#define MAX(a, b) ((a > b) ? (a) : (b))
 
 static const int MinNumBits = 4;
 
-static const unsigned char prime_deltas[] = {
-   0,  0,  1,  3,  1,  5,  3,  3,  1,  9,  7,  5,  3,  9, 25,  3,
-   1, 21,  3, 21,  7, 15,  9,  5,  3, 29, 15,  0,  0,  0,  0,  0
-};
 
-static int primeForNumBits(int numBits)
-{
-   return (1 << numBits) + prime_deltas[numBits];
-}
+enum cso_node_state {
+   CSO_NODE_EMPTY = 0,
+   CSO_NODE_USED,
+   CSO_NODE_DELETED
+};
 
 /*
-    Returns the smallest integer n such that
-    primeForNumBits(n) >= hint.
-*/
-static int countBits(int hint)
-{
-   int numBits = 0;
-   int bits = hint;
-
-   while (bits > 1) {
-      bits >>= 1;
-      numBits++;
-   }
-
-   if (numBits >= (int)sizeof(prime_deltas)) {
-      numBits = sizeof(prime_deltas) - 1;
-   } else if (primeForNumBits(numBits) < hint) {
-      ++numBits;
-   }
-   return numBits;
-}
-
+ * The table is open addressed with linear probing.  The keys are kept in
+ * the table next to the values, so probing only compares keys and never
+ * touches the data.  Removed entries leave a DELETED marker until the
+ * next rehash, so that erasing keeps the other entries where they are and
+ * iterators stay valid.
+ */
 struct cso_node {
-   struct cso_node *next;
    unsigned key;
+   unsigned state;
    void *value;
 };
 
-struct cso_hash_data {
-   struct cso_node *fakeNext;
-   struct cso_node **buckets;
+struct cso_hash {
+   struct cso_node *nodes;
    int size;
-   int nodeSize;
-   short userNumBits;
-   short numBits;
-   int numBuckets;
+   int deleted;
+   int numBits;
 };
 
-struct cso_hash {
-   union {
-      struct cso_hash_data *d;
-      struct cso_node      *e;
-   } data;
-};
 
-static void *cso_data_allocate_node(struct cso_hash_data *hash)
+static INLINE unsigned cso_hash_mask(const struct cso_hash *hash)
 {
-   return MALLOC(hash->nodeSize);
+   return (1 << hash->numBits) - 1;
 }
 
-static void cso_free_node(struct cso_node *node)
+/*
+ * Fibonacci hashing, spreads keys whose low bits are poor (e.g. pointers)
+ * over the table.
+ */
+static INLINE unsigned cso_hash_index(const struct cso_hash *hash,
+                                      unsigned key)
 {
-   FREE(node);
+   return (key * 2654435769u) >> (32 - hash->numBits);
 }
 
-static struct cso_node *
-cso_hash_create_node(struct cso_hash *hash,
-                      unsigned akey, void *avalue,
-                      struct cso_node **anextNode)
+static struct cso_node *cso_hash_probe(struct cso_hash *hash,
+                                       unsigned index, unsigned key)
 {
-   struct cso_node *node = cso_data_allocate_node(hash->data.d);
-
-   if (!node)
-      return NULL;
-
-   node->key = akey;
-   node->value = avalue;
-
-   node->next = (struct cso_node*)(*anextNode);
-   *anextNode = node;
-   ++hash->data.d->size;
-   return node;
+   const unsigned mask = cso_hash_mask(hash);
+   struct cso_node *node;
+
+   for (;;) {
+      node = &hash->nodes[index];
+      if (node->state == CSO_NODE_EMPTY)
+         return NULL;
+      if (node->state == CSO_NODE_USED && node->key == key)
+         return node;
+      index = (index + 1) & mask;
+   }
 }
 
-static void cso_data_rehash(struct cso_hash_data *hash, int hint)
+static boolean cso_data_rehash(struct cso_hash *hash, int numBits)
 {
-   if (hint < 0) {
-      hint = countBits(-hint);
-      if (hint < MinNumBits)
-         hint = MinNumBits;
-      hash->userNumBits = (short)hint;
-      while (primeForNumBits(hint) < (hash->size >> 1))
-         ++hint;
-   } else if (hint < MinNumBits) {
-      hint = MinNumBits;
-   }
-
-   if (hash->numBits != hint) {
-      struct cso_node *e = (struct cso_node *)(hash);
-      struct cso_node **oldBuckets = hash->buckets;
-      int oldNumBuckets = hash->numBuckets;
-      int  i = 0;
-
-      hash->numBits = (short)hint;
-      hash->numBuckets = primeForNumBits(hint);
-      hash->buckets = MALLOC(sizeof(struct cso_node*) * hash->numBuckets);
-      for (i = 0; i < hash->numBuckets; ++i)
-         hash->buckets[i] = e;
-
-      for (i = 0; i < oldNumBuckets; ++i) {
-         struct cso_node *firstNode = oldBuckets[i];
-         while (firstNode != e) {
-            unsigned h = firstNode->key;
-            struct cso_node *lastNode = firstNode;
-            struct cso_node *afterLastNode;
-            struct cso_node **beforeFirstNode;
-            
-            while (lastNode->next != e && lastNode->next->key == h)
-               lastNode = lastNode->next;
-
-            afterLastNode = lastNode->next;
-            beforeFirstNode = &hash->buckets[h % hash->numBuckets];
-            while (*beforeFirstNode != e)
-               beforeFirstNode = &(*beforeFirstNode)->next;
-            lastNode->next = *beforeFirstNode;
-            *beforeFirstNode = firstNode;
-            firstNode = afterLastNode;
-         }
+   struct cso_node *oldNodes = hash->nodes;
+   int oldNumNodes = oldNodes ? 1 << hash->numBits : 0;
+   struct cso_node *nodes;
+   unsigned mask;
+   int i;
+
+   nodes = CALLOC(1 << numBits, sizeof(struct cso_node));
+   if (!nodes)
+      return FALSE;
+
+   hash->nodes = nodes;
+   hash->numBits = numBits;
+   hash->deleted = 0;
+   mask = cso_hash_mask(hash);
+
+   for (i = 0; i < oldNumNodes; ++i) {
+      if (oldNodes[i].state == CSO_NODE_USED) {
+         unsigned index = cso_hash_index(hash, oldNodes[i].key);
+         while (nodes[index].state != CSO_NODE_EMPTY)
+            index = (index + 1) & mask;
+         nodes[index] = oldNodes[i];
       }
-      FREE(oldBuckets);
    }
-}
 
-static void cso_data_might_grow(struct cso_hash_data *hash)
-{
-   if (hash->size >= hash->numBuckets)
-      cso_data_rehash(hash, hash->numBits + 1);
+   FREE(oldNodes);
+   return TRUE;
 }
 
-static void cso_data_has_shrunk(struct cso_hash_data *hash)
+static boolean cso_data_might_grow(struct cso_hash *hash)
 {
-   if (hash->size <= (hash->numBuckets >> 3) &&
-       hash->numBits > hash->userNumBits) {
-      int max = MAX(hash->numBits-2, hash->userNumBits);
-      cso_data_rehash(hash,  max);
-   }
+   int numBits = hash->nodes ? hash->numBits : MinNumBits;
+
+   /* Keep at least a quarter of the slots empty, so probe sequences stay
+    * short and always end */
+   if (hash->nodes &&
+       (hash->size + hash->deleted + 1) * 4 <= (3 << hash->numBits))
+      return TRUE;
+
+   while ((hash->size + 1) * 2 > (1 << numBits))
+      ++numBits;
+
+   return cso_data_rehash(hash, numBits);
 }
 
-static struct cso_node *cso_data_first_node(struct cso_hash_data *hash)
+static void cso_data_has_shrunk(struct cso_hash *hash)
 {
-   struct cso_node *e = (struct cso_node *)(hash);
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
-   while (n--) {
-      if (*bucket != e)
-         return *bucket;
-      ++bucket;
-   }
-   return e;
+   if (hash->size <= ((1 << hash->numBits) >> 3) &&
+       hash->numBits > MinNumBits)
+      (void) cso_data_rehash(hash, hash->numBits - 1);
 }
 
-static struct cso_node **cso_hash_find_node(struct cso_hash *hash, unsigned akey)
+static struct cso_node *cso_data_next_node(struct cso_hash *hash,
+                                           struct cso_node *node)
 {
-   struct cso_node **node;
-
-   if (hash->data.d->numBuckets) {
-      node = (struct cso_node **)(&hash->data.d->buckets[akey % hash->data.d->numBuckets]);
-      assert(*node == hash->data.e || (*node)->next);
-      while (*node != hash->data.e && (*node)->key != akey)
-         node = &(*node)->next;
-   } else {
-      node = (struct cso_node **)((const struct cso_node * const *)(&hash->data.e));
+   struct cso_node *end = hash->nodes + (1 << hash->numBits);
+
+   for (++node; node < end; ++node) {
+      if (node->state == CSO_NODE_USED)
+         return node;
    }
-   return node;
+   return NULL;
 }
 
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash,
                                        unsigned key, void *data)
 {
-   cso_data_might_grow(hash->data.d);
-
-   {
-      struct cso_node **nextNode = cso_hash_find_node(hash, key);
-      struct cso_node *node = cso_hash_create_node(hash, key, data, nextNode);
-      if (!node) {
-         struct cso_hash_iter null_iter = {hash, 0};
-         return null_iter;
-      }
+   struct cso_hash_iter iter = {hash, NULL};
+   struct cso_node *node;
+   unsigned mask, index;
 
-      {
-         struct cso_hash_iter iter = {hash, node};
-         return iter;
-      }
-   }
+   if (!cso_data_might_grow(hash))
+      return iter;
+
+   mask = cso_hash_mask(hash);
+   index = cso_hash_index(hash, key);
+   while (hash->nodes[index].state == CSO_NODE_USED)
+      index = (index + 1) & mask;
+
+   node = &hash->nodes[index];
+   if (node->state == CSO_NODE_DELETED)
+      --hash->deleted;
+   node->key = key;
+   node->state = CSO_NODE_USED;
+   node->value = data;
+   ++hash->size;
+
+   iter.node = node;
+   return iter;
 }
 
 struct cso_hash * cso_hash_create(void)
 {
-   struct cso_hash *hash = MALLOC_STRUCT(cso_hash);
+   struct cso_hash *hash = CALLOC_STRUCT(cso_hash);
    if (!hash)
       return NULL;
 
-   hash->data.d = MALLOC_STRUCT(cso_hash_data);
-   if (!hash->data.d) {
-      FREE(hash);
-      return NULL;
-   }
-
-   hash->data.d->fakeNext = 0;
-   hash->data.d->buckets = 0;
-   hash->data.d->size = 0;
-   hash->data.d->nodeSize = sizeof(struct cso_node);
-   hash->data.d->userNumBits = (short)MinNumBits;
-   hash->data.d->numBits = 0;
-   hash->data.d->numBuckets = 0;
-
    return hash;
 }
 
 void cso_hash_delete(struct cso_hash *hash)
 {
-   struct cso_node *e_for_x = (struct cso_node *)(hash->data.d);
-   struct cso_node **bucket = (struct cso_node **)(hash->data.d->buckets);
-   int n = hash->data.d->numBuckets;
-   while (n--) {
-      struct cso_node *cur = *bucket++;
-      while (cur != e_for_x) {
-         struct cso_node *next = cur->next;
-         cso_free_node(cur);
-         cur = next;
-      }
-   }
-   FREE(hash->data.d->buckets);
-   FREE(hash->data.d);
+   FREE(hash->nodes);
    FREE(hash);
 }
 
 struct cso_hash_iter cso_hash_find(struct cso_hash *hash,
                                      unsigned key)
 {
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_hash_iter iter = {hash, *nextNode};
+   struct cso_hash_iter iter = {hash, NULL};
+
+   if (hash->nodes)
+      iter.node = cso_hash_probe(hash, cso_hash_index(hash, key), key);
    return iter;
 }
 
+struct cso_hash_iter cso_hash_find_next(struct cso_hash_iter iter)
+{
+   struct cso_hash *hash = iter.hash;
+   struct cso_hash_iter next = {hash, NULL};
+
+   if (iter.node) {
+      unsigned index = ((iter.node - hash->nodes) + 1) & cso_hash_mask(hash);
+      next.node = cso_hash_probe(hash, index, iter.node->key);
+   }
+   return next;
+}
+
 unsigned cso_hash_iter_key(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->data.e == iter.node)
+   if (!iter.node)
       return 0;
    return iter.node->key;
 }
 
 void * cso_hash_iter_data(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->data.e == iter.node)
+   if (!iter.node)
       return 0;
    return iter.node->value;
 }
 
-static struct cso_node *cso_hash_data_next(struct cso_node *node)
+struct cso_hash_iter cso_hash_iter_next(struct cso_hash_iter iter)
 {
-   union {
-      struct cso_node *next;
-      struct cso_node *e;
-      struct cso_hash_data *d;
-   } a;
-   int start;
-   struct cso_node **bucket;
-   int n;
-
-   a.next = node->next;
-   if (!a.next) {
+   struct cso_hash_iter next = {iter.hash, NULL};
+
+   if (!iter.node) {
       debug_printf("iterating beyond the last element\n");
-      return 0;
-   }
-   if (a.next->next)
-      return a.next;
-
-   start = (node->key % a.d->numBuckets) + 1;
-   bucket = a.d->buckets + start;
-   n = a.d->numBuckets - start;
-   while (n--) {
-      if (*bucket != a.e)
-         return *bucket;
-      ++bucket;
+      return next;
    }
-   return a.e;
-}
-
-
-static struct cso_node *cso_hash_data_prev(struct cso_node *node)
-{
-   union {
-      struct cso_node *e;
-      struct cso_hash_data *d;
-   } a;
-   int start;
-   struct cso_node *sentinel;
-   struct cso_node **bucket;
-
-   a.e = node;
-   while (a.e->next)
-      a.e = a.e->next;
-
-   if (node == a.e)
-      start = a.d->numBuckets - 1;
-   else
-      start = node->key % a.d->numBuckets;
-
-   sentinel = node;
-   bucket = a.d->buckets + start;
-   while (start >= 0) {
-      if (*bucket != sentinel) {
-         struct cso_node *prev = *bucket;
-         while (prev->next != sentinel)
-            prev = prev->next;
-         return prev;
-      }
 
-      sentinel = a.e;
-      --bucket;
-      --start;
-   }
-   debug_printf("iterating backward beyond first element\n");
-   return a.e;
+   next.node = cso_data_next_node(iter.hash, iter.node);
+   return next;
 }
 
-struct cso_hash_iter cso_hash_iter_next(struct cso_hash_iter iter)
+int cso_hash_iter_is_null(struct cso_hash_iter iter)
 {
-   struct cso_hash_iter next = {iter.hash, cso_hash_data_next(iter.node)};
-   return next;
+   return iter.node == NULL;
 }
 
-int cso_hash_iter_is_null(struct cso_hash_iter iter)
+static void cso_data_remove_node(struct cso_hash *hash, struct cso_node *node)
 {
-   if (!iter.node || iter.node == iter.hash->data.e)
-      return 1;
-   return 0;
+   unsigned next = ((node - hash->nodes) + 1) & cso_hash_mask(hash);
+
+   /* No probe sequence goes past an empty slot, so there is no need to
+    * leave a marker in front of one */
+   if (hash->nodes[next].state == CSO_NODE_EMPTY)
+      node->state = CSO_NODE_EMPTY;
+   else {
+      node->state = CSO_NODE_DELETED;
+      ++hash->deleted;
+   }
+   node->value = NULL;
+   --hash->size;
 }
 
 void * cso_hash_take(struct cso_hash *hash,
                       unsigned akey)
 {
-   struct cso_node **node = cso_hash_find_node(hash, akey);
-   if (*node != hash->data.e) {
-      void *t = (*node)->value;
-      struct cso_node *next = (*node)->next;
-      cso_free_node(*node);
-      *node = next;
-      --hash->data.d->size;
-      cso_data_has_shrunk(hash->data.d);
-      return t;
-   }
-   return 0;
+   struct cso_hash_iter iter = cso_hash_find(hash, akey);
+   void *t;
+
+   if (!iter.node)
+      return 0;
+
+   t = iter.node->value;
+   cso_data_remove_node(hash, iter.node);
+   cso_data_has_shrunk(hash);
+   return t;
 }
 
 struct cso_hash_iter cso_hash_iter_prev(struct cso_hash_iter iter)
 {
-   struct cso_hash_iter prev = {iter.hash,
-                                 cso_hash_data_prev(iter.node)};
+   struct cso_hash_iter prev = {iter.hash, NULL};
+   struct cso_node *node = iter.node;
+
+   if (node) {
+      while (node-- > iter.hash->nodes) {
+         if (node->state == CSO_NODE_USED) {
+            prev.node = node;
+            return prev;
+         }
+      }
+   }
+   debug_printf("iterating backward beyond first element\n");
    return prev;
 }
 
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash)
 {
-   struct cso_hash_iter iter = {hash, cso_data_first_node(hash->data.d)};
+   struct cso_hash_iter iter = {hash, NULL};
+
+   if (hash->nodes) {
+      iter.node = hash->nodes;
+      if (iter.node->state != CSO_NODE_USED)
+         iter.node = cso_data_next_node(hash, iter.node);
+   }
    return iter;
 }
 
 int cso_hash_size(struct cso_hash *hash)
 {
-   return hash->data.d->size;
+   return hash->size;
 }
 
 struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter iter)
 {
-   struct cso_hash_iter ret = iter;
-   struct cso_node *node = iter.node;
-   struct cso_node **node_ptr;
+   struct cso_hash_iter ret = {hash, NULL};
 
-   if (node == hash->data.e)
+   if (!iter.node)
       return iter;
 
-   ret = cso_hash_iter_next(ret);
-   node_ptr = (struct cso_node**)(&hash->data.d->buckets[node->key % hash->data.d->numBuckets]);
-   while (*node_ptr != node)
-      node_ptr = &(*node_ptr)->next;
-   *node_ptr = node->next;
-   cso_free_node(node);
-   --hash->data.d->size;
+   ret.node = cso_data_next_node(hash, iter.node);
+   cso_data_remove_node(hash, iter.node);
    return ret;
 }
 
 boolean cso_hash_contains(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **node = cso_hash_find_node(hash, key);
-   return (*node != hash->data.e);
+   return !cso_hash_iter_is_null(cso_hash_find(hash, key));
 }
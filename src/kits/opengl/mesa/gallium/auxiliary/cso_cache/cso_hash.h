@@ -30,13 +30,12 @@
  * Hash table implementation.
  * 
  * This file provides a hash implementation that is capable of dealing
- * with collisions. It stores colliding entries in linked list. All
- * functions operating on the hash return an iterator. The iterator
- * itself points to the collision list. If there wasn't any collision
- * the list will have just one entry, otherwise client code should
- * iterate over the entries to find the exact entry among ones that
- * had the same key (e.g. memcmp could be used on the data to check
- * that)
+ * with collisions: several entries may have the same key. All
+ * functions operating on the hash return an iterator. cso_hash_find()
+ * returns the first entry with the given key and cso_hash_find_next()
+ * the following ones, so client code should go through them to find the
+ * exact entry among the ones that had the same key (e.g. memcmp could be
+ * used on the data to check that)
  * 
  * @author Zack Rusin <zack@tungstengraphics.com>
  */
@@ -69,9 +68,8 @@ int              cso_hash_size(struct cso_hash *hash);
 
 
 /**
- * Adds a data with the given key to the hash. If entry with the given
- * key is already in the hash, this current entry is instered before it
- * in the collision list.
+ * Adds a data with the given key to the hash, even if an entry with the
+ * given key is already in the hash.
  * Function returns iterator pointing to the inserted item in the hash.
  */
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash, unsigned key,
@@ -92,10 +90,16 @@ void  *cso_hash_take(struct cso_hash *hash, unsigned key);
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash);
 
 /**
- * Return an iterator pointing to the first entry in the collision list.
+ * Return an iterator pointing to the first entry with the given key.
  */
 struct cso_hash_iter cso_hash_find(struct cso_hash *hash, unsigned key);
 
+/**
+ * Return an iterator pointing to the next entry with the same key as the 
+ * given one, or a null iterator if there are no more.
+ */
+struct cso_hash_iter cso_hash_find_next(struct cso_hash_iter iter);
+
 /**
  * Returns true if a value with the given key exists in the hash
  */
@@ -112,7 +116,7 @@ struct cso_hash_iter cso_hash_iter_prev(struct cso_hash_iter iter);
 
 
 /**
- * Convenience routine to iterate over the collision list while doing a memory
+ * Convenience routine to iterate over the entries with the given key while doing a memory
  * comparison to see which entry in the list is a direct copy of our template
  * and returns that entry.
  */
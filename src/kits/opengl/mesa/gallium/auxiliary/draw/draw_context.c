@@ -428,3 +428,20 @@ void draw_do_flush( struct draw_context *draw, unsigned flags )
       draw->flushing = FALSE;
    }
 }
+
+
+const struct draw_statistics *
+draw_get_statistics( const struct draw_context *draw )
+{
+   return &draw->stats;
+}
+
+
+/**
+ * Time the middle ends?  This costs two timestamp reads per draw call.
+ */
+void
+draw_enable_timing( struct draw_context *draw, boolean enable )
+{
+   draw->timing = enable;
+}
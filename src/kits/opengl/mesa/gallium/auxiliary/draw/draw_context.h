@@ -178,5 +178,41 @@ boolean draw_need_pipeline(const struct draw_context *draw,
                            unsigned prim );
 
 
+/*******************************************************************************
+ * Statistics
+ */
+
+/** Middle ends, for draw_statistics::middle_ticks */
+enum draw_middle_end {
+   DRAW_MIDDLE_FETCH_EMIT,
+   DRAW_MIDDLE_FETCH_SHADE_EMIT,
+   DRAW_MIDDLE_GENERAL,
+   DRAW_MIDDLE_COUNT
+};
+
+/**
+ * Running counters kept by the draw module.  They are never reset;
+ * users take the difference between two snapshots.
+ */
+struct draw_statistics {
+   uint64_t vertices_fetched;
+   uint64_t vs_invocations;
+   uint64_t primitives_clipped;  /**< prims which needed actual clipping */
+   uint64_t primitives_culled;   /**< trivially rejected or face culled */
+
+   /** util_time_ticks() spent in each middle end, including whatever
+    * the backend did while the middle end was running.  Only counted
+    * when enabled with draw_enable_timing().
+    */
+   uint64_t middle_ticks[DRAW_MIDDLE_COUNT];
+   uint64_t middle_runs[DRAW_MIDDLE_COUNT];
+};
+
+const struct draw_statistics *
+draw_get_statistics(const struct draw_context *draw);
+
+void draw_enable_timing(struct draw_context *draw, boolean enable);
+
+
 
 #endif /* DRAW_CONTEXT_H */
@@ -391,9 +391,13 @@ clip_line( struct draw_stage *stage,
    }
    else if ((header->v[0]->clipmask &
              header->v[1]->clipmask) == 0) {
+      stage->draw->stats.primitives_clipped++;
       do_clip_line(stage, header, clipmask);
    }
-   /* else, totally clipped */
+   else {
+      /* totally clipped */
+      stage->draw->stats.primitives_culled++;
+   }
 }
 
 
@@ -412,8 +416,13 @@ clip_tri( struct draw_stage *stage,
    else if ((header->v[0]->clipmask & 
              header->v[1]->clipmask & 
              header->v[2]->clipmask) == 0) {
+      stage->draw->stats.primitives_clipped++;
       do_clip_tri(stage, header, clipmask);
    }
+   else {
+      /* totally clipped */
+      stage->draw->stats.primitives_culled++;
+   }
 }
 
 /* Update state.  Could further delay this until we hit the first
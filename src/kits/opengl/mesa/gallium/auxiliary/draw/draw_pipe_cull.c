@@ -80,8 +80,11 @@ static void cull_tri( struct draw_stage *stage,
       if ((winding & cull_stage(stage)->winding) == 0) {
          /* triangle is not culled, pass to next stage */
 	 stage->next->tri( stage->next, header );
+         return;
       }
    }
+
+   stage->draw->stats.primitives_culled++;
 }
 
 static void cull_first_tri( struct draw_stage *stage, 
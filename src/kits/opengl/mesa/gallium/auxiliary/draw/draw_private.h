@@ -47,6 +47,8 @@
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_scan.h"
 
+#include "draw_context.h"
+
 
 struct pipe_context;
 struct gallivm_prog;
@@ -226,6 +228,9 @@ struct draw_context
 
    unsigned reduced_prim;
 
+   struct draw_statistics stats;
+   boolean timing;  /**< time the middle ends? */
+
    void *driver_private;
 };
 
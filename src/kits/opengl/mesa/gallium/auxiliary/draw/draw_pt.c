@@ -37,6 +37,7 @@
 #include "tgsi/tgsi_dump.h"
 #include "util/u_math.h"
 #include "util/u_prim.h"
+#include "util/u_time.h"
 
 static unsigned trim( unsigned count, unsigned first, unsigned incr )
 {
@@ -61,6 +62,8 @@ draw_pt_arrays(struct draw_context *draw,
 {
    struct draw_pt_front_end *frontend = NULL;
    struct draw_pt_middle_end *middle = NULL;
+   enum draw_middle_end which;
+   uint64_t t0 = 0;
    unsigned opt = 0;
 
    /* Sanitize primitive length:
@@ -93,12 +96,18 @@ draw_pt_arrays(struct draw_context *draw,
       }
    }
       
-   if (opt == 0) 
+   if (opt == 0) {
       middle = draw->pt.middle.fetch_emit;
-   else if (opt == PT_SHADE && !draw->pt.no_fse)
+      which = DRAW_MIDDLE_FETCH_EMIT;
+   }
+   else if (opt == PT_SHADE && !draw->pt.no_fse) {
       middle = draw->pt.middle.fetch_shade_emit;
-   else
+      which = DRAW_MIDDLE_FETCH_SHADE_EMIT;
+   }
+   else {
       middle = draw->pt.middle.general;
+      which = DRAW_MIDDLE_GENERAL;
+   }
 
 
    /* Pick the right frontend
@@ -109,6 +118,9 @@ draw_pt_arrays(struct draw_context *draw,
       frontend = draw->pt.front.varray;
    }
 
+   if (draw->timing)
+      t0 = util_time_ticks();
+
    frontend->prepare( frontend, prim, middle, opt );
 
    frontend->run(frontend, 
@@ -118,6 +130,11 @@ draw_pt_arrays(struct draw_context *draw,
 
    frontend->finish( frontend );
 
+   if (draw->timing) {
+      draw->stats.middle_ticks[which] += util_time_ticks() - t0;
+      draw->stats.middle_runs[which]++;
+   }
+
    return TRUE;
 }
 
@@ -158,6 +158,8 @@ void draw_pt_fetch_run( struct pt_fetch *fetch,
 			count,
 			verts );
 
+   draw->stats.vertices_fetched += count;
+
    /* Edgeflags are hard to fit into a translate program, populate
     * them separately if required.  In the setup above they are
     * defaulted to one, so only need this if there is reason to change
@@ -194,6 +196,8 @@ void draw_pt_fetch_run_linear( struct pt_fetch *fetch,
                    count,
                    verts );
 
+   draw->stats.vertices_fetched += count;
+
    /* Edgeflags are hard to fit into a translate program, populate
     * them separately if required.  In the setup above they are
     * defaulted to one, so only need this if there is reason to change
@@ -258,6 +258,8 @@ static void fetch_emit_run( struct draw_pt_middle_end *middle,
 			      fetch_count,
 			      hw_verts );
 
+   draw->stats.vertices_fetched += fetch_count;
+
    if (0) {
       unsigned i;
       for (i = 0; i < fetch_count; i++) {
@@ -316,6 +318,8 @@ static void fetch_emit_run_linear( struct draw_pt_middle_end *middle,
                          count,
                          hw_verts );
 
+   draw->stats.vertices_fetched += count;
+
    if (0) {
       unsigned i;
       for (i = 0; i < count; i++) {
@@ -376,6 +380,8 @@ static boolean fetch_emit_run_linear_elts( struct draw_pt_middle_end *middle,
                          count,
                          hw_verts );
 
+   draw->stats.vertices_fetched += count;
+
    draw->render->unmap_vertices( draw->render, 0, (ushort)(count - 1) );
 
    /* XXX: Draw arrays path to avoid re-emitting index list again and
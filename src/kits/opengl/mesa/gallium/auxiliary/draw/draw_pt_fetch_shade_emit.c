@@ -255,6 +255,9 @@ static void fse_run_linear( struct draw_pt_middle_end *middle,
                             start, count,
                             hw_verts );
 
+   draw->stats.vertices_fetched += count;
+   draw->stats.vs_invocations += count;
+
 
    if (0) {
       unsigned i;
@@ -323,6 +326,9 @@ fse_run(struct draw_pt_middle_end *middle,
                           fetch_count,
                           hw_verts );
 
+   draw->stats.vertices_fetched += fetch_count;
+   draw->stats.vs_invocations += fetch_count;
+
 
    if (0) {
       unsigned i;
@@ -385,6 +391,9 @@ static boolean fse_run_linear_elts( struct draw_pt_middle_end *middle,
                             start, count,
                             hw_verts );
 
+   draw->stats.vertices_fetched += count;
+   draw->stats.vs_invocations += count;
+
 
    draw->render->draw( draw->render, 
                        draw_elts, 
@@ -154,6 +154,8 @@ static void fetch_pipeline_run( struct draw_pt_middle_end *middle,
 			 fetch_count,
 			 fpme->vertex_size,
 			 fpme->vertex_size);
+
+      draw->stats.vs_invocations += fetch_count;
    }
 
    if (draw_pt_post_vs_run( fpme->post_vs,
@@ -230,6 +232,8 @@ static void fetch_pipeline_linear_run( struct draw_pt_middle_end *middle,
 			 count,
 			 fpme->vertex_size,
 			 fpme->vertex_size);
+
+      draw->stats.vs_invocations += count;
    }
 
    if (draw_pt_post_vs_run( fpme->post_vs,
@@ -300,6 +304,8 @@ static boolean fetch_pipeline_linear_run_elts( struct draw_pt_middle_end *middle
 			 count,
 			 fpme->vertex_size,
 			 fpme->vertex_size);
+
+      draw->stats.vs_invocations += count;
    }
 
    if (draw_pt_post_vs_run( fpme->post_vs,
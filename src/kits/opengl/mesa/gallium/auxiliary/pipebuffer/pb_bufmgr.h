@@ -156,10 +156,13 @@ pb_slab_range_manager_create(struct pb_manager *provider,
  * Time-based buffer cache.
  *
  * This manager keeps a cache of destroyed buffers during a time interval. 
+ * The least recently destroyed buffers are freed early to keep the total
+ * size of the cached buffers under maxCacheSize, unless it is zero.
  */
 struct pb_manager *
 pb_cache_manager_create(struct pb_manager *provider, 
-                     	unsigned usecs); 
+                     	unsigned usecs,
+                        size_t maxCacheSize); 
 
 
 struct pb_fence_ops;
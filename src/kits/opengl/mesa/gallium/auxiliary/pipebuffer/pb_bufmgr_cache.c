@@ -51,6 +51,27 @@
 #define SUPER(__derived) (&(__derived)->base)
 
 
+/**
+ * Delayed buffers are kept in size classes, four per power of two, each
+ * with its own list.  Requests are rounded up to the size of their class,
+ * so any buffer in the class is big enough and less than twice as big, and
+ * reusing one is a matter of looking at the most recently freed buffers of
+ * the class.
+ */
+#define PB_CACHE_MIN_SIZE_LOG2   4   /**< smallest class, 16 bytes */
+#define PB_CACHE_MAX_SIZE_LOG2   30  /**< bigger buffers are not cached */
+#define PB_CACHE_STEPS_LOG2      2
+#define PB_CACHE_STEPS           (1 << PB_CACHE_STEPS_LOG2)
+#define PB_CACHE_NUM_BUCKETS \
+   ((PB_CACHE_MAX_SIZE_LOG2 - PB_CACHE_MIN_SIZE_LOG2 + 1) * PB_CACHE_STEPS)
+
+/**
+ * Buffers of a class may still be incompatible because of their alignment
+ * or usage.  Give up after looking at this many.
+ */
+#define PB_CACHE_MAX_PROBES      4
+
+
 struct pb_cache_manager;
 
 
@@ -67,7 +88,11 @@ struct pb_cache_buffer
    /** Caching time interval */
    struct util_time start, end;
 
+   /** In pb_cache_manager::delayed, oldest first */
    struct list_head head;
+
+   /** In pb_cache_manager::buckets, oldest first */
+   struct list_head bucket_head;
 };
 
 
@@ -82,6 +107,19 @@ struct pb_cache_manager
    
    struct list_head delayed;
    size_t numDelayed;
+
+   struct list_head buckets[PB_CACHE_NUM_BUCKETS];
+
+   /** Total size of the delayed buffers, and its limit (0 = none) */
+   size_t cacheSize;
+   size_t maxCacheSize;
+
+   /* Statistics, see PB_CACHE_STATS */
+   unsigned hits;
+   unsigned misses;
+   unsigned expired;
+   unsigned evicted;
+   size_t peakCacheSize;
 };
 
 
@@ -101,6 +139,72 @@ pb_cache_manager(struct pb_manager *mgr)
 }
 
 
+static INLINE unsigned
+pb_cache_log2(size_t size)
+{
+   unsigned log2 = 0;
+   
+   assert(size);
+   while(size >>= 1)
+      ++log2;
+   return log2;
+}
+
+
+/**
+ * Size class a request must be served from, and the size to allocate for
+ * it.  Returns PB_CACHE_NUM_BUCKETS if the size is not cached.
+ */
+static INLINE unsigned
+pb_cache_bucket_for_request(size_t size, size_t *class_size)
+{
+   unsigned log2, shift, step;
+
+   if(size <= ((size_t)1 << PB_CACHE_MIN_SIZE_LOG2)) {
+      *class_size = (size_t)1 << PB_CACHE_MIN_SIZE_LOG2;
+      return 0;
+   }
+
+   log2 = pb_cache_log2(size);
+   shift = log2 - PB_CACHE_STEPS_LOG2;
+   step = (unsigned)((size - ((size_t)1 << log2) + ((size_t)1 << shift) - 1) >> shift);
+   if(step == PB_CACHE_STEPS) {
+      ++log2;
+      ++shift;
+      step = 0;
+   }
+
+   if(log2 > PB_CACHE_MAX_SIZE_LOG2) {
+      *class_size = size;
+      return PB_CACHE_NUM_BUCKETS;
+   }
+
+   *class_size = ((size_t)1 << log2) + ((size_t)step << shift);
+   return (log2 - PB_CACHE_MIN_SIZE_LOG2) * PB_CACHE_STEPS + step;
+}
+
+
+/**
+ * Size class a buffer of the given size is kept in, or
+ * PB_CACHE_NUM_BUCKETS if it is not cached.
+ */
+static INLINE unsigned
+pb_cache_bucket_for_buffer(size_t size)
+{
+   unsigned log2;
+
+   if(size < ((size_t)1 << PB_CACHE_MIN_SIZE_LOG2))
+      return PB_CACHE_NUM_BUCKETS;
+
+   log2 = pb_cache_log2(size);
+   if(log2 > PB_CACHE_MAX_SIZE_LOG2)
+      return PB_CACHE_NUM_BUCKETS;
+
+   return (log2 - PB_CACHE_MIN_SIZE_LOG2) * PB_CACHE_STEPS +
+          (unsigned)((size - ((size_t)1 << log2)) >> (log2 - PB_CACHE_STEPS_LOG2));
+}
+
+
 /**
  * Actually destroy the buffer.
  */
@@ -110,8 +214,11 @@ _pb_cache_buffer_destroy(struct pb_cache_buffer *buf)
    struct pb_cache_manager *mgr = buf->mgr;
 
    LIST_DEL(&buf->head);
+   LIST_DEL(&buf->bucket_head);
    assert(mgr->numDelayed);
    --mgr->numDelayed;
+   assert(mgr->cacheSize >= buf->base.base.size);
+   mgr->cacheSize -= buf->base.base.size;
    assert(!pipe_is_referenced(&buf->base.base.reference));
    pb_reference(&buf->buffer, NULL);
    FREE(buf);
@@ -139,6 +246,7 @@ _pb_cache_buffer_list_check_free(struct pb_cache_manager *mgr)
 	 break;
 	 
       _pb_cache_buffer_destroy(buf);
+      ++mgr->expired;
 
       curr = next; 
       next = curr->next;
@@ -151,16 +259,39 @@ pb_cache_buffer_destroy(struct pb_buffer *_buf)
 {
    struct pb_cache_buffer *buf = pb_cache_buffer(_buf);   
    struct pb_cache_manager *mgr = buf->mgr;
+   size_t size = buf->base.base.size;
+   unsigned bucket;
 
    pipe_mutex_lock(mgr->mutex);
    assert(!pipe_is_referenced(&buf->base.base.reference));
    
    _pb_cache_buffer_list_check_free(mgr);
+
+   bucket = pb_cache_bucket_for_buffer(size);
+   if(bucket == PB_CACHE_NUM_BUCKETS ||
+      (mgr->maxCacheSize && size > mgr->maxCacheSize)) {
+      pipe_mutex_unlock(mgr->mutex);
+      pb_reference(&buf->buffer, NULL);
+      FREE(buf);
+      return;
+   }
+
+   /* Make room by evicting the least recently freed buffers */
+   while(mgr->maxCacheSize && mgr->cacheSize + size > mgr->maxCacheSize) {
+      assert(!LIST_IS_EMPTY(&mgr->delayed));
+      _pb_cache_buffer_destroy(LIST_ENTRY(struct pb_cache_buffer,
+                                          mgr->delayed.next, head));
+      ++mgr->evicted;
+   }
    
    util_time_get(&buf->start);
    util_time_add(&buf->start, mgr->usecs, &buf->end);
    LIST_ADDTAIL(&buf->head, &mgr->delayed);
+   LIST_ADDTAIL(&buf->bucket_head, &mgr->buckets[bucket]);
    ++mgr->numDelayed;
+   mgr->cacheSize += size;
+   if(mgr->cacheSize > mgr->peakCacheSize)
+      mgr->peakCacheSize = mgr->cacheSize;
    pipe_mutex_unlock(mgr->mutex);
 }
 
@@ -251,60 +382,57 @@ pb_cache_manager_create_buffer(struct pb_manager *_mgr,
 {
    struct pb_cache_manager *mgr = pb_cache_manager(_mgr);
    struct pb_cache_buffer *buf;
-   struct pb_cache_buffer *curr_buf;
-   struct list_head *curr, *next;
-   struct util_time now;
+   struct list_head *bucket, *curr;
+   size_t class_size;
+   unsigned probes;
+   unsigned i;
    
+   i = pb_cache_bucket_for_request(size, &class_size);
+
    pipe_mutex_lock(mgr->mutex);
 
-   buf = NULL;
-   curr = mgr->delayed.next;
-   next = curr->next;
-   
-   /* search in the expired buffers, freeing them in the process */
-   util_time_get(&now);
-   while(curr != &mgr->delayed) {
-      curr_buf = LIST_ENTRY(struct pb_cache_buffer, curr, head);
-      if(!buf && pb_cache_is_buffer_compat(curr_buf, size, desc))
-	 buf = curr_buf;
-      else if(util_time_timeout(&curr_buf->start, &curr_buf->end, &now))
-	 _pb_cache_buffer_destroy(curr_buf);
-      else
-         /* This buffer (and all hereafter) are still hot in cache */
-         break;
-      curr = next; 
-      next = curr->next;
-   }
+   _pb_cache_buffer_list_check_free(mgr);
 
-   /* keep searching in the hot buffers */
-   if(!buf) {
-      while(curr != &mgr->delayed) {
-         curr_buf = LIST_ENTRY(struct pb_cache_buffer, curr, head);
+   buf = NULL;
+   if(i < PB_CACHE_NUM_BUCKETS) {
+      /* the most recently freed buffers are the most likely to be hot */
+      bucket = &mgr->buckets[i];
+      curr = bucket->prev;
+      for(probes = 0; 
+          curr != bucket && probes < PB_CACHE_MAX_PROBES; 
+          ++probes, curr = curr->prev) {
+         struct pb_cache_buffer *curr_buf = 
+            LIST_ENTRY(struct pb_cache_buffer, curr, bucket_head);
          if(pb_cache_is_buffer_compat(curr_buf, size, desc)) {
             buf = curr_buf;
             break;
          }
-         /* no need to check the timeout here */
-         curr = next;
-         next = curr->next;
       }
    }
    
    if(buf) {
       LIST_DEL(&buf->head);
+      LIST_DEL(&buf->bucket_head);
+      --mgr->numDelayed;
+      mgr->cacheSize -= buf->base.base.size;
+      ++mgr->hits;
       pipe_mutex_unlock(mgr->mutex);
-      /* Increase refcount */
-      pb_reference((struct pb_buffer**)&buf, &buf->base);
+      /* The refcount dropped to zero, pb_reference would complain */
+      pipe_reference_init(&buf->base.base.reference, 1);
       return &buf->base;
    }
    
+   ++mgr->misses;
    pipe_mutex_unlock(mgr->mutex);
 
    buf = CALLOC_STRUCT(pb_cache_buffer);
    if(!buf)
       return NULL;
    
-   buf->buffer = mgr->provider->create_buffer(mgr->provider, size, desc);
+   /* Allocate the whole size class, so the buffer can be reused for any
+    * request of the class.
+    */
+   buf->buffer = mgr->provider->create_buffer(mgr->provider, class_size, desc);
    if(!buf->buffer) {
       FREE(buf);
       return NULL;
@@ -352,18 +480,30 @@ pb_cache_manager_flush(struct pb_manager *_mgr)
 
 
 static void
-pb_cache_manager_destroy(struct pb_manager *mgr)
+pb_cache_manager_destroy(struct pb_manager *_mgr)
 {
-   pb_cache_manager_flush(mgr);
+   struct pb_cache_manager *mgr = pb_cache_manager(_mgr);
+
+   if(debug_get_bool_option("PB_CACHE_STATS", FALSE)) {
+      debug_printf("pb_cache: %u hits, %u misses, %u expired, %u evicted\n",
+                   mgr->hits, mgr->misses, mgr->expired, mgr->evicted);
+      debug_printf("pb_cache: %lu bytes peak cache size\n",
+                   (unsigned long)mgr->peakCacheSize);
+   }
+
+   pb_cache_manager_flush(_mgr);
+   pipe_mutex_destroy(mgr->mutex);
    FREE(mgr);
 }
 
 
 struct pb_manager *
 pb_cache_manager_create(struct pb_manager *provider, 
-                     	unsigned usecs) 
+                     	unsigned usecs,
+                        size_t maxCacheSize) 
 {
    struct pb_cache_manager *mgr;
+   unsigned i;
 
    if(!provider)
       return NULL;
@@ -377,8 +517,11 @@ pb_cache_manager_create(struct pb_manager *provider,
    mgr->base.flush = pb_cache_manager_flush;
    mgr->provider = provider;
    mgr->usecs = usecs;
+   mgr->maxCacheSize = maxCacheSize;
    LIST_INITHEAD(&mgr->delayed);
    mgr->numDelayed = 0;
+   for(i = 0; i < PB_CACHE_NUM_BUCKETS; ++i)
+      LIST_INITHEAD(&mgr->buckets[i]);
    pipe_mutex_init(mgr->mutex);
       
    return &mgr->base;
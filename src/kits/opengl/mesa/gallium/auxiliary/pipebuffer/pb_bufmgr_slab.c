@@ -49,6 +49,29 @@
 #include "pb_bufmgr.h"
 
 
+/**
+ * Per-thread magazines need thread-specific data.
+ */
+#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_SOLARIS) || defined(PIPE_OS_HAIKU)
+#define PB_SLAB_MAGAZINES
+#endif
+
+/** Number of free buffers a magazine can hold */
+#define PB_SLAB_MAGAZINE_SIZE 32
+
+/** Number of buffers moved between a magazine and the slabs at once */
+#define PB_SLAB_MAGAZINE_BATCH (PB_SLAB_MAGAZINE_SIZE/2)
+
+/** Number of empty slabs kept around for reuse */
+#define PB_SLAB_MAX_EMPTY 2
+
+/** Time after which an unused empty slab is released, in usecs */
+#define PB_SLAB_EMPTY_TIMEOUT 1000000
+
+/** Number of live slab managers which can have per-thread magazines */
+#define PB_SLAB_THREAD_MAGAZINES 64
+
+
 struct pb_slab;
 
 
@@ -89,6 +112,9 @@ struct pb_slab
    struct pb_slab_buffer *buffers;
    struct pb_slab_manager *mgr;
    
+   /** When this slab became empty, in usecs, if it is on the empty list */
+   uint64_t emptyTime;
+   
    /** Buffer from the provider */
    struct pb_buffer *bo;
    
@@ -96,6 +122,47 @@ struct pb_slab
 };
 
 
+/**
+ * Per-thread cache of free buffers.
+ * 
+ * Allocations and frees are served from the magazine of the calling thread
+ * and only go to the slabs, under the manager mutex, to move a whole batch
+ * of buffers in or out. The magazine mutex is only contended when another
+ * thread drains the magazine in pb_slab_manager_reclaim().
+ */
+struct pb_slab_magazine
+{
+   /** In pb_slab_manager::magazines */
+   struct list_head head;
+   
+   pipe_mutex mutex;
+   
+   /** Whether the owning thread used this magazine since the last reclaim */
+   boolean used;
+   
+   unsigned count;
+   struct pb_slab_buffer *buffers[PB_SLAB_MAGAZINE_SIZE];
+};
+
+
+/**
+ * The magazines of one thread, indexed by pb_slab_manager::slot.
+ * 
+ * All managers share a single thread-specific data key, so that creating
+ * many of them (one per bucket of every range manager) can't exhaust the
+ * keys. A slot is reused by the next manager once its manager is
+ * destroyed; an entry is only valid while its generation matches the
+ * manager's, so entries left behind by a destroyed manager are replaced
+ * on the next lookup. The table is never freed, like the magazines of
+ * threads which exited.
+ */
+struct pb_slab_thread_magazines
+{
+   unsigned generation[PB_SLAB_THREAD_MAGAZINES];
+   struct pb_slab_magazine *mag[PB_SLAB_THREAD_MAGAZINES];
+};
+
+
 /**
  * It adds/removes slabs as needed in order to meet the allocation/destruction 
  * of individual buffers.
@@ -124,12 +191,34 @@ struct pb_slab_manager
    /** 
     * Partial slabs
     * 
-    * Full slabs are not stored in any list. Empty slabs are destroyed 
-    * immediatly.
+    * Full slabs are not stored in any list.
     */
    struct list_head slabs;
    
+   /**
+    * Empty slabs, least recently emptied first.
+    * 
+    * At most PB_SLAB_MAX_EMPTY of them are kept, for at most
+    * PB_SLAB_EMPTY_TIMEOUT, so that a workload which keeps allocating and
+    * freeing around a slab boundary does not go to the provider each time.
+    */
+   struct list_head emptySlabs;
+   unsigned numEmpty;
+   
    pipe_mutex mutex;
+   
+#ifdef PB_SLAB_MAGAZINES
+   boolean useMagazines;
+   
+   /** Index of this manager in pb_slab_thread_magazines */
+   unsigned slot;
+   /** Generation of the slot while this manager has it, never 0 */
+   unsigned generation;
+   
+   /** All magazines */
+   struct list_head magazines;
+   pipe_mutex magazinesMutex;
+#endif
 };
 
 
@@ -188,40 +277,369 @@ pb_slab_range_manager(struct pb_manager *mgr)
 }
 
 
+static enum pipe_error
+pb_slab_create(struct pb_slab_manager *mgr);
+
+
+static void
+pb_slab_destroy(struct pb_slab *slab)
+{
+   pb_reference(&slab->bo, NULL);
+   FREE(slab->buffers);
+   FREE(slab);
+}
+
+
 /**
- * Delete a buffer from the slab delayed list and put
- * it on the slab FREE list.
+ * Release the empty slabs which were not reused in time, and the least
+ * recently emptied ones above PB_SLAB_MAX_EMPTY.
+ * 
+ * Must be called with the manager mutex held.
  */
 static void
-pb_slab_buffer_destroy(struct pb_buffer *_buf)
+pb_slab_manager_release_empty(struct pb_slab_manager *mgr,
+                              boolean all)
 {
-   struct pb_slab_buffer *buf = pb_slab_buffer(_buf);
-   struct pb_slab *slab = buf->slab;
-   struct pb_slab_manager *mgr = slab->mgr;
-   struct list_head *list = &buf->head;
+   uint64_t now = util_time_micros();
+   struct list_head *curr, *next;
+   struct pb_slab *slab;
 
-   pipe_mutex_lock(mgr->mutex);
-   
-   assert(!pipe_is_referenced(&buf->base.base.reference));
-   
-   buf->mapCount = 0;
+   curr = mgr->emptySlabs.next;
+   next = curr->next;
+   while(curr != &mgr->emptySlabs) {
+      slab = LIST_ENTRY(struct pb_slab, curr, head);
+      
+      if(!all &&
+         mgr->numEmpty <= PB_SLAB_MAX_EMPTY &&
+         now - slab->emptyTime < PB_SLAB_EMPTY_TIMEOUT)
+         break;
+      
+      LIST_DEL(curr);
+      --mgr->numEmpty;
+      pb_slab_destroy(slab);
+      
+      curr = next;
+      next = curr->next;
+   }
+}
+
+
+/**
+ * Put a buffer back on the free list of its slab.
+ * 
+ * Must be called with the manager mutex held.
+ */
+static void
+pb_slab_buffer_put(struct pb_slab_manager *mgr,
+                   struct pb_slab_buffer *buf)
+{
+   struct pb_slab *slab = buf->slab;
 
-   LIST_DEL(list);
-   LIST_ADDTAIL(list, &slab->freeBuffers);
+   LIST_ADDTAIL(&buf->head, &slab->freeBuffers);
    slab->numFree++;
 
    if (slab->head.next == &slab->head)
       LIST_ADDTAIL(&slab->head, &mgr->slabs);
 
-   /* If the slab becomes totally empty, free it */
+   /* If the slab becomes totally empty, move it to the empty list */
    if (slab->numFree == slab->numBuffers) {
-      list = &slab->head;
+      LIST_DEL(&slab->head);
+      LIST_ADDTAIL(&slab->head, &mgr->emptySlabs);
+      slab->emptyTime = util_time_micros();
+      ++mgr->numEmpty;
+      
+      pb_slab_manager_release_empty(mgr, FALSE);
+   }
+}
+
+
+/**
+ * Take a buffer from the partial slabs, reusing an empty slab or creating 
+ * a new one when there are none.
+ * 
+ * Must be called with the manager mutex held.
+ */
+static struct pb_slab_buffer *
+pb_slab_buffer_get(struct pb_slab_manager *mgr)
+{
+   struct pb_slab *slab;
+   struct list_head *list;
+
+   if (LIST_IS_EMPTY(&mgr->slabs)) {
+      if (!LIST_IS_EMPTY(&mgr->emptySlabs)) {
+         /* The most recently emptied slab is the least likely to expire */
+         list = mgr->emptySlabs.prev;
+         LIST_DEL(list);
+         LIST_ADDTAIL(list, &mgr->slabs);
+         --mgr->numEmpty;
+      }
+      else {
+         (void) pb_slab_create(mgr);
+         if (LIST_IS_EMPTY(&mgr->slabs))
+            return NULL;
+      }
+   }
+   
+   /* Allocate the buffer from a partial (or just created) slab */
+   list = mgr->slabs.next;
+   slab = LIST_ENTRY(struct pb_slab, list, head);
+   
+   /* If totally full remove from the partial slab list */
+   if (--slab->numFree == 0)
       LIST_DELINIT(list);
-      pb_reference(&slab->bo, NULL);
-      FREE(slab->buffers);
-      FREE(slab);
+
+   list = slab->freeBuffers.next;
+   LIST_DELINIT(list);
+
+   return LIST_ENTRY(struct pb_slab_buffer, list, head);
+}
+
+
+#ifdef PB_SLAB_MAGAZINES
+
+/** pb_slab_thread_magazines of the current thread, shared by all managers */
+static pipe_tsd pb_slab_magazines_tsd;
+static boolean pb_slab_magazines_tsd_created = FALSE;
+
+/** Current generation of each slot, 0 while no manager has the slot */
+static unsigned pb_slab_slot_generation[PB_SLAB_THREAD_MAGAZINES];
+static unsigned pb_slab_last_generation = 0;
+pipe_static_mutex(pb_slab_slot_mutex);
+
+
+/**
+ * Give the manager a slot in the per-thread magazine tables.  Returns
+ * FALSE if all slots are taken, the manager then doesn't use magazines.
+ */
+static boolean
+pb_slab_slot_alloc(struct pb_slab_manager *mgr)
+{
+   unsigned i;
+
+   pipe_mutex_lock(pb_slab_slot_mutex);
+
+   /* The key is created here rather than on first use, which would race */
+   if (!pb_slab_magazines_tsd_created) {
+      pipe_tsd_init(&pb_slab_magazines_tsd);
+      pb_slab_magazines_tsd_created = TRUE;
+   }
+
+   for (i = 0; i < PB_SLAB_THREAD_MAGAZINES; ++i) {
+      if (!pb_slab_slot_generation[i])
+         break;
+   }
+
+   if (i == PB_SLAB_THREAD_MAGAZINES) {
+      pipe_mutex_unlock(pb_slab_slot_mutex);
+      return FALSE;
+   }
+
+   /* Generations are unique across slots, so that no thread's entry can
+    * match a later manager in the same slot.
+    */
+   if (++pb_slab_last_generation == 0)
+      ++pb_slab_last_generation;
+
+   pb_slab_slot_generation[i] = pb_slab_last_generation;
+   mgr->slot = i;
+   mgr->generation = pb_slab_last_generation;
+
+   pipe_mutex_unlock(pb_slab_slot_mutex);
+   return TRUE;
+}
+
+
+static void
+pb_slab_slot_free(struct pb_slab_manager *mgr)
+{
+   pipe_mutex_lock(pb_slab_slot_mutex);
+   pb_slab_slot_generation[mgr->slot] = 0;
+   pipe_mutex_unlock(pb_slab_slot_mutex);
+}
+
+
+/**
+ * The magazine of the calling thread, created on first use.
+ */
+static struct pb_slab_magazine *
+pb_slab_magazine_get(struct pb_slab_manager *mgr)
+{
+   struct pb_slab_thread_magazines *mags;
+   struct pb_slab_magazine *mag;
+
+   mags = (struct pb_slab_thread_magazines *)
+      pipe_tsd_get(&pb_slab_magazines_tsd);
+   if (!mags) {
+      mags = CALLOC_STRUCT(pb_slab_thread_magazines);
+      if (!mags)
+         return NULL;
+      pipe_tsd_set(&pb_slab_magazines_tsd, mags);
    }
 
+   /* Anything else in the slot belongs to a destroyed manager */
+   if (mags->generation[mgr->slot] == mgr->generation)
+      return mags->mag[mgr->slot];
+
+   mag = CALLOC_STRUCT(pb_slab_magazine);
+   if (!mag)
+      return NULL;
+
+   pipe_mutex_init(mag->mutex);
+
+   pipe_mutex_lock(mgr->magazinesMutex);
+   LIST_ADDTAIL(&mag->head, &mgr->magazines);
+   pipe_mutex_unlock(mgr->magazinesMutex);
+
+   mags->generation[mgr->slot] = mgr->generation;
+   mags->mag[mgr->slot] = mag;
+
+   return mag;
+}
+
+
+/**
+ * Return all buffers of a magazine to the slabs.
+ * 
+ * Must be called with the magazine mutex held.
+ */
+static void
+pb_slab_magazine_drain(struct pb_slab_manager *mgr,
+                       struct pb_slab_magazine *mag)
+{
+   if (!mag->count)
+      return;
+
+   pipe_mutex_lock(mgr->mutex);
+   while (mag->count)
+      pb_slab_buffer_put(mgr, mag->buffers[--mag->count]);
+   pipe_mutex_unlock(mgr->mutex);
+}
+
+
+static struct pb_slab_buffer *
+pb_slab_magazine_alloc(struct pb_slab_manager *mgr,
+                       struct pb_slab_magazine *mag)
+{
+   struct pb_slab_buffer *buf = NULL;
+
+   pipe_mutex_lock(mag->mutex);
+   
+   mag->used = TRUE;
+   
+   /* Refill half of the magazine at once */
+   if (!mag->count) {
+      pipe_mutex_lock(mgr->mutex);
+      while (mag->count < PB_SLAB_MAGAZINE_BATCH) {
+         buf = pb_slab_buffer_get(mgr);
+         if (!buf)
+            break;
+         mag->buffers[mag->count++] = buf;
+      }
+      pipe_mutex_unlock(mgr->mutex);
+   }
+   
+   buf = mag->count ? mag->buffers[--mag->count] : NULL;
+   
+   pipe_mutex_unlock(mag->mutex);
+   
+   return buf;
+}
+
+
+static void
+pb_slab_magazine_free(struct pb_slab_manager *mgr,
+                      struct pb_slab_magazine *mag,
+                      struct pb_slab_buffer *buf)
+{
+   unsigned i;
+
+   pipe_mutex_lock(mag->mutex);
+   
+   mag->used = TRUE;
+   
+   /* Return the least recently freed half of the magazine at once, the 
+    * most recently freed buffers are the most likely to be cached */
+   if (mag->count == PB_SLAB_MAGAZINE_SIZE) {
+      pipe_mutex_lock(mgr->mutex);
+      for (i = 0; i < PB_SLAB_MAGAZINE_BATCH; ++i)
+         pb_slab_buffer_put(mgr, mag->buffers[i]);
+      pipe_mutex_unlock(mgr->mutex);
+      
+      mag->count -= PB_SLAB_MAGAZINE_BATCH;
+      memmove(mag->buffers, 
+              mag->buffers + PB_SLAB_MAGAZINE_BATCH, 
+              mag->count * sizeof(*mag->buffers));
+   }
+   
+   mag->buffers[mag->count++] = buf;
+   
+   pipe_mutex_unlock(mag->mutex);
+}
+
+#endif /* PB_SLAB_MAGAZINES */
+
+
+/**
+ * Give back unused memory.
+ * 
+ * Magazines which were not used since the last call, e.g. because their 
+ * thread has gone away, are drained, and the empty slabs which timed out 
+ * are released.
+ */
+static void
+pb_slab_manager_reclaim(struct pb_slab_manager *mgr)
+{
+#ifdef PB_SLAB_MAGAZINES
+   struct list_head *curr;
+   struct pb_slab_magazine *mag;
+
+   pipe_mutex_lock(mgr->magazinesMutex);
+   for (curr = mgr->magazines.next; curr != &mgr->magazines; curr = curr->next) {
+      mag = LIST_ENTRY(struct pb_slab_magazine, curr, head);
+      pipe_mutex_lock(mag->mutex);
+      if (!mag->used)
+         pb_slab_magazine_drain(mgr, mag);
+      mag->used = FALSE;
+      pipe_mutex_unlock(mag->mutex);
+   }
+   pipe_mutex_unlock(mgr->magazinesMutex);
+#endif
+
+   pipe_mutex_lock(mgr->mutex);
+   pb_slab_manager_release_empty(mgr, FALSE);
+   pipe_mutex_unlock(mgr->mutex);
+}
+
+
+/**
+ * Put a buffer back in the magazine of the calling thread, or on the slab 
+ * FREE list.
+ */
+static void
+pb_slab_buffer_destroy(struct pb_buffer *_buf)
+{
+   struct pb_slab_buffer *buf = pb_slab_buffer(_buf);
+   struct pb_slab_manager *mgr = buf->slab->mgr;
+#ifdef PB_SLAB_MAGAZINES
+   struct pb_slab_magazine *mag;
+#endif
+
+   assert(!pipe_is_referenced(&buf->base.base.reference));
+   
+   buf->mapCount = 0;
+
+#ifdef PB_SLAB_MAGAZINES
+   if (mgr->useMagazines) {
+      mag = pb_slab_magazine_get(mgr);
+      if (mag) {
+         pb_slab_magazine_free(mgr, mag, buf);
+         return;
+      }
+   }
+#endif
+
+   pipe_mutex_lock(mgr->mutex);
+   pb_slab_buffer_put(mgr, buf);
    pipe_mutex_unlock(mgr->mutex);
 }
 
@@ -373,9 +791,10 @@ pb_slab_manager_create_buffer(struct pb_manager *_mgr,
                               const struct pb_desc *desc)
 {
    struct pb_slab_manager *mgr = pb_slab_manager(_mgr);
-   static struct pb_slab_buffer *buf;
-   struct pb_slab *slab;
-   struct list_head *list;
+   struct pb_slab_buffer *buf;
+#ifdef PB_SLAB_MAGAZINES
+   struct pb_slab_magazine *mag;
+#endif
 
    /* check size */
    assert(size <= mgr->bufSize);
@@ -394,30 +813,21 @@ pb_slab_manager_create_buffer(struct pb_manager *_mgr,
    if(!pb_check_usage(desc->usage, mgr->desc.usage))
       return NULL;
 
-   pipe_mutex_lock(mgr->mutex);
-   
-   /* Create a new slab, if we run out of partial slabs */
-   if (mgr->slabs.next == &mgr->slabs) {
-      (void) pb_slab_create(mgr);
-      if (mgr->slabs.next == &mgr->slabs) {
-	 pipe_mutex_unlock(mgr->mutex);
-	 return NULL;
-      }
+#ifdef PB_SLAB_MAGAZINES
+   mag = mgr->useMagazines ? pb_slab_magazine_get(mgr) : NULL;
+   if (mag) {
+      buf = pb_slab_magazine_alloc(mgr, mag);
+   }
+   else
+#endif
+   {
+      pipe_mutex_lock(mgr->mutex);
+      buf = pb_slab_buffer_get(mgr);
+      pipe_mutex_unlock(mgr->mutex);
    }
    
-   /* Allocate the buffer from a partial (or just created) slab */
-   list = mgr->slabs.next;
-   slab = LIST_ENTRY(struct pb_slab, list, head);
-   
-   /* If totally full remove from the partial slab list */
-   if (--slab->numFree == 0)
-      LIST_DELINIT(list);
-
-   list = slab->freeBuffers.next;
-   LIST_DELINIT(list);
-
-   pipe_mutex_unlock(mgr->mutex);
-   buf = LIST_ENTRY(struct pb_slab_buffer, list, head);
+   if (!buf)
+      return NULL;
    
    pipe_reference_init(&buf->base.base.reference, 1);
    buf->base.base.alignment = desc->alignment;
@@ -432,6 +842,8 @@ pb_slab_manager_flush(struct pb_manager *_mgr)
 {
    struct pb_slab_manager *mgr = pb_slab_manager(_mgr);
 
+   pb_slab_manager_reclaim(mgr);
+
    assert(mgr->provider->flush);
    if(mgr->provider->flush)
       mgr->provider->flush(mgr->provider);
@@ -442,8 +854,30 @@ static void
 pb_slab_manager_destroy(struct pb_manager *_mgr)
 {
    struct pb_slab_manager *mgr = pb_slab_manager(_mgr);
+#ifdef PB_SLAB_MAGAZINES
+   struct list_head *curr, *next;
+   struct pb_slab_magazine *mag;
+
+   curr = mgr->magazines.next;
+   next = curr->next;
+   while(curr != &mgr->magazines) {
+      mag = LIST_ENTRY(struct pb_slab_magazine, curr, head);
+      pb_slab_magazine_drain(mgr, mag);
+      pipe_mutex_destroy(mag->mutex);
+      FREE(mag);
+      curr = next;
+      next = curr->next;
+   }
+   
+   if (mgr->useMagazines)
+      pb_slab_slot_free(mgr);
+   pipe_mutex_destroy(mgr->magazinesMutex);
+#endif
+
+   pb_slab_manager_release_empty(mgr, TRUE);
 
    /* TODO: cleanup all allocated buffers */
+   pipe_mutex_destroy(mgr->mutex);
    FREE(mgr);
 }
 
@@ -470,9 +904,18 @@ pb_slab_manager_create(struct pb_manager *provider,
    mgr->desc = *desc;
 
    LIST_INITHEAD(&mgr->slabs);
+   LIST_INITHEAD(&mgr->emptySlabs);
    
    pipe_mutex_init(mgr->mutex);
 
+#ifdef PB_SLAB_MAGAZINES
+   mgr->useMagazines = debug_get_bool_option("PB_SLAB_MAGAZINES", TRUE);
+   if (mgr->useMagazines)
+      mgr->useMagazines = pb_slab_slot_alloc(mgr);
+   LIST_INITHEAD(&mgr->magazines);
+   pipe_mutex_init(mgr->magazinesMutex);
+#endif
+
    return &mgr->base;
 }
 
@@ -502,8 +945,11 @@ static void
 pb_slab_range_manager_flush(struct pb_manager *_mgr)
 {
    struct pb_slab_range_manager *mgr = pb_slab_range_manager(_mgr);
+   unsigned i;
 
-   /* Individual slabs don't hold any temporary buffers so no need to call them */
+   /* Not the bucket flush, which would flush the provider once per bucket */
+   for (i = 0; i < mgr->numBuckets; ++i)
+      pb_slab_manager_reclaim(pb_slab_manager(mgr->buckets[i]));
    
    assert(mgr->provider->flush);
    if(mgr->provider->flush)
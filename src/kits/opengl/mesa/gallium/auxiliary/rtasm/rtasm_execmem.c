@@ -34,70 +34,336 @@
 #include "util/u_debug.h"
 #include "pipe/p_thread.h"
 #include "util/u_memory.h"
+#include "util/u_double_list.h"
+#include "util/u_mm.h"
 
 #include "rtasm_execmem.h"
 
+
+/*
+ * Code is allocated from chunks of memory, which are doled out in pieces
+ * by means of the generic memory manager code.  More chunks are mapped as
+ * needed, and chunks which become unused are unmapped again, except for
+ * the last one.
+ *
+ * Where possible every chunk is mapped twice, from a shared memory object:
+ * once writable, where the code is generated, and once executable, from
+ * where it is run.  No page is ever both writable and executable, which
+ * hardened systems require.  When the double mapping fails, e.g. because
+ * the shared memory file system is mounted noexec, a single RWX mapping
+ * is used instead, and on the systems without mmap plain malloc'ed memory.
+ *
+ * Every allocation is preceded by a small header in the chunk, so freeing
+ * does not need to search for the block, and allocations can be grouped
+ * into arenas which are freed at once.
+ */
+
+
+#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_SOLARIS) || defined(PIPE_OS_HAIKU) 
+#define EXEC_MMAP
+#include <unistd.h>
+#include <sys/mman.h>
 #if defined(PIPE_OS_BSD)
 #define MAP_ANONYMOUS MAP_ANON
 #endif
+#endif
 
+#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_SOLARIS)
+#define EXEC_DOUBLE_MAP
+#include <fcntl.h>
+#include "util/u_string.h"
+#endif
 
-#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_SOLARIS) || defined(PIPE_OS_HAIKU) 
 
+#define EXEC_CHUNK_SIZE (1024*1024)
 
-/*
- * Allocate a large block of memory which can hold code then dole it out
- * in pieces by means of the generic memory manager code.
+/** 2^EXEC_ALIGN2 bytes alignment of the code */
+#define EXEC_ALIGN2 5
+#define EXEC_ALIGN (1 << EXEC_ALIGN2)
+
+#define EXEC_HEADER_SIZE EXEC_ALIGN
+
+
+struct exec_chunk
+{
+   struct list_head head;
+
+   struct mem_block *heap;
+
+   /** Writable view */
+   unsigned char *mem;
+
+   /** Executable view, same as mem when not double mapped */
+   unsigned char *code;
+
+   size_t size;
+   size_t used;
+};
+
+
+/**
+ * Precedes every allocation, in the writable view.
  */
+struct exec_header
+{
+   struct mem_block *block;
+   struct rtasm_exec_arena *arena;
+   struct exec_header *prev, *next;
+};
 
-#include <unistd.h>
-#include <sys/mman.h>
-#include "pipe/p_thread.h"
-#include "util/u_mm.h"
 
-#define EXEC_HEAP_SIZE (10*1024*1024)
+struct rtasm_exec_arena
+{
+   struct exec_header *blocks;
+};
+
 
 pipe_static_mutex(exec_mutex);
 
-static struct mem_block *exec_heap = NULL;
-static unsigned char *exec_mem = NULL;
+static struct list_head exec_chunks = { &exec_chunks, &exec_chunks };
+
+static struct rtasm_exec_stats exec_stats;
+
+
+static boolean
+map_chunk(struct exec_chunk *chunk)
+{
+#ifdef EXEC_DOUBLE_MAP
+   static unsigned count = 0;
+   char name[64];
+   int fd;
+
+   util_snprintf(name, sizeof(name), "/rtasm-%d-%u", (int) getpid(), count++);
+   fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd >= 0) {
+      shm_unlink(name);
+
+      if (ftruncate(fd, chunk->size) == 0) {
+         chunk->mem = (unsigned char *) mmap(0, chunk->size,
+                                             PROT_READ | PROT_WRITE,
+                                             MAP_SHARED, fd, 0);
+         chunk->code = (unsigned char *) mmap(0, chunk->size,
+                                              PROT_READ | PROT_EXEC,
+                                              MAP_SHARED, fd, 0);
+      }
+      else
+         chunk->mem = chunk->code = MAP_FAILED;
+
+      close(fd);
+
+      if (chunk->mem != MAP_FAILED && chunk->code != MAP_FAILED)
+         return TRUE;
+
+      if (chunk->mem != MAP_FAILED)
+         munmap(chunk->mem, chunk->size);
+      if (chunk->code != MAP_FAILED)
+         munmap(chunk->code, chunk->size);
+   }
+#endif
+
+#ifdef EXEC_MMAP
+   chunk->mem = (unsigned char *) mmap(0, chunk->size, 
+                                       PROT_EXEC | PROT_READ | PROT_WRITE, 
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (chunk->mem == MAP_FAILED)
+      return FALSE;
+#else
+   chunk->mem = MALLOC(chunk->size);
+   if (!chunk->mem)
+      return FALSE;
+#endif
+
+   chunk->code = chunk->mem;
+   return TRUE;
+}
 
 
 static void
-init_heap(void)
-{
-   if (!exec_heap)
-      exec_heap = u_mmInit( 0, EXEC_HEAP_SIZE );
-   
-   if (!exec_mem)
-      exec_mem = (unsigned char *) mmap(0, EXEC_HEAP_SIZE, 
-					PROT_EXEC | PROT_READ | PROT_WRITE, 
-					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+unmap_chunk(struct exec_chunk *chunk)
+{
+#ifdef EXEC_MMAP
+   if (chunk->code != chunk->mem)
+      munmap(chunk->code, chunk->size);
+   munmap(chunk->mem, chunk->size);
+#else
+   FREE(chunk->mem);
+#endif
 }
 
 
-void *
-rtasm_exec_malloc(size_t size)
+static struct exec_chunk *
+create_chunk(size_t size)
+{
+   struct exec_chunk *chunk;
+
+   chunk = CALLOC_STRUCT(exec_chunk);
+   if (!chunk)
+      return NULL;
+
+   chunk->size = (size + EXEC_CHUNK_SIZE - 1) & ~(EXEC_CHUNK_SIZE - 1);
+
+   chunk->heap = u_mmInit(0, chunk->size);
+   if (!chunk->heap) {
+      FREE(chunk);
+      return NULL;
+   }
+
+   if (!map_chunk(chunk)) {
+      debug_printf("rtasm: failed to map %u bytes of executable memory\n",
+                   (unsigned) chunk->size);
+      u_mmDestroy(chunk->heap);
+      FREE(chunk);
+      return NULL;
+   }
+
+   LIST_ADD(&chunk->head, &exec_chunks);
+
+   exec_stats.chunks++;
+   exec_stats.mapped += chunk->size;
+   if (chunk->code == chunk->mem)
+      exec_stats.rwx_chunks++;
+
+   return chunk;
+}
+
+
+static void
+destroy_chunk(struct exec_chunk *chunk)
 {
+   LIST_DEL(&chunk->head);
+
+   exec_stats.chunks--;
+   exec_stats.mapped -= chunk->size;
+   if (chunk->code == chunk->mem)
+      exec_stats.rwx_chunks--;
+
+   unmap_chunk(chunk);
+   u_mmDestroy(chunk->heap);
+   FREE(chunk);
+}
+
+
+/**
+ * Chunk containing addr in either view.
+ */
+static struct exec_chunk *
+find_chunk(const void *addr)
+{
+   const unsigned char *p = (const unsigned char *) addr;
+   struct list_head *curr;
+
+   for (curr = exec_chunks.next; curr != &exec_chunks; curr = curr->next) {
+      struct exec_chunk *chunk = LIST_ENTRY(struct exec_chunk, curr, head);
+
+      if ((p >= chunk->mem && p < chunk->mem + chunk->size) ||
+          (p >= chunk->code && p < chunk->code + chunk->size))
+         return chunk;
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Must be called with the exec mutex held.
+ */
+static void *
+exec_malloc(size_t size, struct rtasm_exec_arena *arena)
+{
+   struct exec_header *header;
    struct mem_block *block = NULL;
-   void *addr = NULL;
+   struct exec_chunk *chunk = NULL;
+   struct list_head *curr;
 
-   pipe_mutex_lock(exec_mutex);
+   assert(sizeof(struct exec_header) <= EXEC_HEADER_SIZE);
 
-   init_heap();
+   /* next multiple of the alignment, plus the header */
+   size = ((size + EXEC_ALIGN - 1) & ~(EXEC_ALIGN - 1)) + EXEC_HEADER_SIZE;
+
+   for (curr = exec_chunks.next; curr != &exec_chunks; curr = curr->next) {
+      chunk = LIST_ENTRY(struct exec_chunk, curr, head);
+      block = u_mmAllocMem(chunk->heap, size, EXEC_ALIGN2, 0);
+      if (block)
+         break;
+   }
 
-   if (exec_heap) {
-      size = (size + 31) & ~31;  /* next multiple of 32 bytes */
-      block = u_mmAllocMem( exec_heap, size, 5, 0 ); /* 5 -> 32-byte alignment */
+   if (!block) {
+      chunk = create_chunk(size);
+      if (chunk)
+         block = u_mmAllocMem(chunk->heap, size, EXEC_ALIGN2, 0);
    }
 
-   if (block)
-      addr = exec_mem + block->ofs;
-   else 
+   if (!block) {
       debug_printf("rtasm_exec_malloc failed\n");
-   
+      return NULL;
+   }
+
+   header = (struct exec_header *) (chunk->mem + block->ofs);
+   header->block = block;
+   header->arena = arena;
+   header->prev = NULL;
+   header->next = NULL;
+   if (arena) {
+      header->next = arena->blocks;
+      if (header->next)
+         header->next->prev = header;
+      arena->blocks = header;
+   }
+
+   chunk->used += size;
+
+   exec_stats.used += size;
+   if (exec_stats.used > exec_stats.peak_used)
+      exec_stats.peak_used = exec_stats.used;
+   exec_stats.allocs++;
+   exec_stats.total_allocs++;
+
+   return (unsigned char *) header + EXEC_HEADER_SIZE;
+}
+
+
+/**
+ * Must be called with the exec mutex held.
+ */
+static void
+exec_free(struct exec_chunk *chunk, struct exec_header *header)
+{
+   struct mem_block *block = header->block;
+   struct rtasm_exec_arena *arena = header->arena;
+
+   assert((unsigned char *) header == chunk->mem + block->ofs);
+
+   if (arena) {
+      if (header->prev)
+         header->prev->next = header->next;
+      else
+         arena->blocks = header->next;
+      if (header->next)
+         header->next->prev = header->prev;
+   }
+
+   chunk->used -= block->size;
+
+   exec_stats.used -= block->size;
+   exec_stats.allocs--;
+
+   u_mmFreeMem(block);
+
+   /* Keep the last chunk around, for the next shader */
+   if (!chunk->used && exec_chunks.next->next != &exec_chunks)
+      destroy_chunk(chunk);
+}
+
+
+void *
+rtasm_exec_malloc(size_t size)
+{
+   void *addr;
+
+   pipe_mutex_lock(exec_mutex);
+   addr = exec_malloc(size, NULL);
    pipe_mutex_unlock(exec_mutex);
-   
+
    return addr;
 }
 
@@ -105,37 +371,96 @@ rtasm_exec_malloc(size_t size)
 void 
 rtasm_exec_free(void *addr)
 {
+   struct exec_chunk *chunk;
+
+   if (!addr)
+      return;
+
    pipe_mutex_lock(exec_mutex);
 
-   if (exec_heap) {
-      struct mem_block *block = u_mmFindBlock(exec_heap, (unsigned char *)addr - exec_mem);
-   
-      if (block)
-	 u_mmFreeMem(block);
+   chunk = find_chunk(addr);
+   assert(chunk);
+   if (chunk) {
+      unsigned char *mem = (unsigned char *) addr;
+
+      if (mem < chunk->mem || mem >= chunk->mem + chunk->size)
+         mem = chunk->mem + (mem - chunk->code);
+
+      exec_free(chunk, (struct exec_header *) (mem - EXEC_HEADER_SIZE));
    }
 
    pipe_mutex_unlock(exec_mutex);
 }
 
 
-#else /* PIPE_OS_LINUX || PIPE_OS_BSD || PIPE_OS_SOLARIS || PIPE_OS_SOLARIS || PIPE_OS_HAIKU */
+void *
+rtasm_exec_code(void *addr)
+{
+   struct exec_chunk *chunk;
+   unsigned char *code = (unsigned char *) addr;
+
+   if (!addr)
+      return NULL;
+
+   pipe_mutex_lock(exec_mutex);
+
+   chunk = find_chunk(addr);
+   if (chunk && code >= chunk->mem && code < chunk->mem + chunk->size)
+      code = chunk->code + (code - chunk->mem);
+
+   pipe_mutex_unlock(exec_mutex);
+
+   return code;
+}
+
+
+struct rtasm_exec_arena *
+rtasm_exec_arena_create(void)
+{
+   return CALLOC_STRUCT(rtasm_exec_arena);
+}
 
-/*
- * Just use regular memory.
- */
 
 void *
-rtasm_exec_malloc(size_t size)
+rtasm_exec_arena_malloc(struct rtasm_exec_arena *arena, size_t size)
 {
-   return MALLOC( size );
+   void *addr;
+
+   pipe_mutex_lock(exec_mutex);
+   addr = exec_malloc(size, arena);
+   pipe_mutex_unlock(exec_mutex);
+
+   return addr;
 }
 
- 
-void 
-rtasm_exec_free(void *addr)
+
+void
+rtasm_exec_arena_destroy(struct rtasm_exec_arena *arena)
 {
-   FREE(addr);
+   if (!arena)
+      return;
+
+   pipe_mutex_lock(exec_mutex);
+
+   while (arena->blocks) {
+      struct exec_header *header = arena->blocks;
+      struct exec_chunk *chunk = find_chunk(header);
+
+      assert(chunk);
+      exec_free(chunk, header);
+   }
+
+   pipe_mutex_unlock(exec_mutex);
+
+   FREE(arena);
 }
 
 
-#endif /* PIPE_OS_LINUX || PIPE_OS_BSD || PIPE_OS_SOLARIS */
+void
+rtasm_exec_get_stats(struct rtasm_exec_stats *stats)
+{
+   pipe_mutex_lock(exec_mutex);
+   *stats = exec_stats;
+   stats->double_mapped = exec_stats.chunks && !exec_stats.rwx_chunks;
+   pipe_mutex_unlock(exec_mutex);
+}
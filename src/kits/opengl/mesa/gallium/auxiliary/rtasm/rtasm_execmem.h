@@ -34,12 +34,67 @@
 #include "pipe/p_compiler.h"
 
 
+/**
+ * Allocate memory for code.  The returned address is where the code is 
+ * written, rtasm_exec_code() gives the address it is run from.
+ */
 extern void *
 rtasm_exec_malloc( size_t size );
 
 
+/**
+ * Free memory from rtasm_exec_malloc() or rtasm_exec_arena_malloc(), by
+ * either address.
+ */
 extern void 
 rtasm_exec_free( void *addr );
 
 
+/**
+ * Executable address of the code written at addr.  The code must be 
+ * complete, it may not be writable from there.
+ */
+extern void *
+rtasm_exec_code( void *addr );
+
+
+/**
+ * A group of allocations which are freed at once, e.g. all the code of 
+ * a context or a cache.
+ */
+struct rtasm_exec_arena;
+
+
+extern struct rtasm_exec_arena *
+rtasm_exec_arena_create( void );
+
+
+extern void *
+rtasm_exec_arena_malloc( struct rtasm_exec_arena *arena, size_t size );
+
+
+/**
+ * Free the arena and everything still allocated from it.
+ */
+extern void
+rtasm_exec_arena_destroy( struct rtasm_exec_arena *arena );
+
+
+struct rtasm_exec_stats
+{
+   unsigned chunks;
+   unsigned rwx_chunks;       /**< chunks both writable and executable */
+   size_t mapped;             /**< bytes */
+   size_t used;               /**< bytes, including headers */
+   size_t peak_used;
+   unsigned allocs;           /**< live allocations */
+   unsigned long total_allocs;
+   boolean double_mapped;     /**< no chunk is writable and executable */
+};
+
+
+extern void
+rtasm_exec_get_stats( struct rtasm_exec_stats *stats );
+
+
 #endif
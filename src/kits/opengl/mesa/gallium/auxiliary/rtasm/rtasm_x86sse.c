@@ -1736,7 +1736,7 @@ void (*x86_get_func( struct x86_function *p ))(void)
    if (p->store == p->error_overflow)
       return (void (*)(void)) NULL;
    else
-      return (void (*)(void)) p->store;
+      return (void (*)(void)) rtasm_exec_code(p->store);
 }
 
 #else
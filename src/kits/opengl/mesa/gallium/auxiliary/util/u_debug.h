@@ -340,7 +340,10 @@ void
 debug_memory_end(unsigned long beginning);
 
 
-#if defined(PROFILE) && defined(PIPE_SUBSYSTEM_WINDOWS_DISPLAY)
+#if defined(PROFILE) && (defined(PIPE_SUBSYSTEM_WINDOWS_DISPLAY) || \
+    (defined(PIPE_CC_GCC) && (defined(PIPE_OS_LINUX) || \
+                              defined(PIPE_OS_BSD) || \
+                              defined(PIPE_OS_HAIKU))))
 
 void
 debug_profile_start(void);
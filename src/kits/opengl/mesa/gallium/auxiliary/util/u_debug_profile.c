@@ -29,6 +29,9 @@
  * @file
  * Poor-man profiling.
  * 
+ * There are two backends: one for MSVC's /Gh /GH hooks in the Windows
+ * display driver subsystem, and one for GCC's -finstrument-functions.
+ * 
  * @author José Fonseca <jrfonseca@tungstengraphics.com>
  * 
  * @sa http://blogs.msdn.com/joshpoley/archive/2008/03/12/poor-man-s-profiler.aspx
@@ -317,4 +320,584 @@ debug_profile_stop(void)
    free_table_entries = max_table_entries = 0;
 }
 
+#elif defined(PROFILE) && defined(PIPE_CC_GCC) && \
+      (defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_HAIKU))
+
+/*
+ * GCC backend.
+ *
+ * Code compiled with -finstrument-functions calls __cyg_profile_func_enter
+ * and __cyg_profile_func_exit around every function.  Every thread builds
+ * its own calling context tree from these, so the hooks never take a lock;
+ * the only shared write is the registration of a new thread.
+ *
+ * The time between two hooks is charged to the function on top of the
+ * stack, in cycles on x86 and in microseconds elsewhere.  With
+ * GALLIUM_PROFILE_SAMPLE=1 a SIGPROF timer counts samples instead, which
+ * distorts short functions less.
+ *
+ * Profiling starts at the first instrumented call if GALLIUM_PROFILE is
+ * set, or with debug_profile_start().  debug_profile_stop(), or process
+ * exit, writes GALLIUM_PROFILE_FILE (default "gallium.prof") either as
+ * folded stacks, one "thread;caller;...;callee count" line per context
+ * as flamegraph.pl reads them, or with GALLIUM_PROFILE_FORMAT=callgrind
+ * as callgrind data for kcachegrind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "util/u_debug.h" 
+#include "util/u_debug_symbol.h" 
+#include "util/u_hash_table.h" 
+#include "util/u_string.h" 
+
+
+/* Everything called from the hooks must not be instrumented itself. */
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+
+#define PROFILE_MAX_DEPTH 256
+#define PROFILE_CHUNK_NODES 4096
+#define SYMBOL_NAME_SIZE 256
+
+
+struct debug_profile_node
+{
+   uintptr_t function;
+   struct debug_profile_node *parent;
+   struct debug_profile_node *children;
+   struct debug_profile_node *sibling;
+   uint64_t calls;
+   uint64_t self;
+   uint64_t total;   /**< computed when dumping */
+};
+
+
+struct debug_profile_chunk
+{
+   struct debug_profile_node nodes[PROFILE_CHUNK_NODES];
+   struct debug_profile_chunk *next;
+};
+
+
+struct debug_profile_thread
+{
+   unsigned id;
+   unsigned generation;
+   volatile int busy;
+
+   struct debug_profile_node root;
+   struct debug_profile_node *current;
+   unsigned depth;
+   unsigned overflow;   /**< calls not entered in the tree */
+   uint64_t last;
+
+   struct debug_profile_chunk *chunks;
+   struct debug_profile_chunk *chunk;
+   unsigned used;
+
+   struct debug_profile_thread *next;
+};
+
+
+static volatile int enabled = 0;
+static volatile unsigned generation = 0;
+static int autostart_checked = 0;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+static struct debug_profile_thread * volatile threads = NULL;
+static unsigned num_threads = 0;
+
+static boolean sampling = FALSE;
+static boolean callgrind = FALSE;
+static const char *filename = "gallium.prof";
+
+
+static INLINE uint64_t NO_INSTRUMENT
+debug_profile_ticks(void)
+{
+#if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
+   uint32_t lo, hi;
+   __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+   return ((uint64_t) hi << 32) | lo;
+#else
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+static const char *
+debug_profile_unit(void)
+{
+   if (sampling)
+      return "Samples";
+#if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
+   return "Cycles";
+#else
+   return "Microseconds";
+#endif
+}
+
+
+static void NO_INSTRUMENT
+debug_profile_init(void)
+{
+   const char *option;
+
+   pthread_key_create(&thread_key, NULL);
+
+   /* Can't use debug_get_option() and friends, they are instrumented */
+   option = getenv("GALLIUM_PROFILE_FILE");
+   if (option)
+      filename = option;
+   option = getenv("GALLIUM_PROFILE_FORMAT");
+   callgrind = option && !strcmp(option, "callgrind");
+   option = getenv("GALLIUM_PROFILE_SAMPLE");
+   sampling = option && strcmp(option, "0") && strcmp(option, "n");
+}
+
+
+static void NO_INSTRUMENT
+debug_profile_reset_thread(struct debug_profile_thread *thread)
+{
+   memset(&thread->root, 0, sizeof thread->root);
+   thread->current = &thread->root;
+   thread->depth = 0;
+   thread->overflow = 0;
+   thread->chunk = thread->chunks;
+   thread->used = 0;
+   thread->last = debug_profile_ticks();
+   thread->generation = generation;
+}
+
+
+/**
+ * Get the calling thread's state, registering the thread on first use.
+ */
+static struct debug_profile_thread * NO_INSTRUMENT
+debug_profile_get_thread(void)
+{
+   struct debug_profile_thread *thread;
+
+   thread = (struct debug_profile_thread *) pthread_getspecific(thread_key);
+   if (!thread) {
+      thread = (struct debug_profile_thread *) calloc(1, sizeof *thread);
+      if (!thread)
+         return NULL;
+
+      thread->id = __sync_fetch_and_add(&num_threads, 1);
+      thread->generation = generation - 1;
+
+      /* Threads are never unregistered, their data is dumped later */
+      do {
+         thread->next = threads;
+      } while (!__sync_bool_compare_and_swap(&threads, thread->next, thread));
+
+      pthread_setspecific(thread_key, thread);
+   }
+
+   if (thread->generation != generation)
+      debug_profile_reset_thread(thread);
+
+   return thread;
+}
+
+
+static struct debug_profile_node * NO_INSTRUMENT
+debug_profile_alloc_node(struct debug_profile_thread *thread)
+{
+   if (!thread->chunk || thread->used == PROFILE_CHUNK_NODES) {
+      struct debug_profile_chunk *chunk;
+
+      chunk = thread->chunk ? thread->chunk->next : thread->chunks;
+      if (!chunk) {
+         chunk = (struct debug_profile_chunk *) malloc(sizeof *chunk);
+         if (!chunk)
+            return NULL;
+         chunk->next = NULL;
+         if (thread->chunk)
+            thread->chunk->next = chunk;
+         else
+            thread->chunks = chunk;
+      }
+
+      thread->chunk = chunk;
+      thread->used = 0;
+   }
+
+   return &thread->chunk->nodes[thread->used++];
+}
+
+
+/**
+ * Find or add the child node of parent for function.  The node found is
+ * moved to the front, as loops tend to call the same few functions.
+ */
+static struct debug_profile_node * NO_INSTRUMENT
+debug_profile_child(struct debug_profile_thread *thread,
+                    struct debug_profile_node *parent,
+                    uintptr_t function)
+{
+   struct debug_profile_node **link = &parent->children;
+   struct debug_profile_node *node;
+
+   while ((node = *link) != NULL) {
+      if (node->function == function) {
+         *link = node->sibling;
+         break;
+      }
+      link = &node->sibling;
+   }
+
+   if (!node) {
+      node = debug_profile_alloc_node(thread);
+      if (!node)
+         return NULL;
+      memset(node, 0, sizeof *node);
+      node->function = function;
+      node->parent = parent;
+   }
+
+   node->sibling = parent->children;
+   parent->children = node;
+   return node;
+}
+
+
+static INLINE void NO_INSTRUMENT
+debug_profile_charge(struct debug_profile_thread *thread)
+{
+   if (!sampling) {
+      uint64_t now = debug_profile_ticks();
+      thread->current->self += now - thread->last;
+      thread->last = now;
+   }
+}
+
+
+void NO_INSTRUMENT
+debug_profile_start(void);
+
+void NO_INSTRUMENT
+debug_profile_stop(void);
+
+
+void NO_INSTRUMENT
+__cyg_profile_func_enter(void *function, void *call_site)
+{
+   struct debug_profile_thread *thread;
+   struct debug_profile_node *node;
+
+   if (!enabled) {
+      if (autostart_checked ||
+          !__sync_bool_compare_and_swap(&autostart_checked, 0, 1))
+         return;
+      if (!getenv("GALLIUM_PROFILE"))
+         return;
+      debug_profile_start();
+      atexit(debug_profile_stop);
+   }
+
+   thread = debug_profile_get_thread();
+   if (!thread)
+      return;
+
+   thread->busy = 1;
+   __sync_synchronize();
+   if (enabled) {
+      node = NULL;
+      if (thread->depth < PROFILE_MAX_DEPTH) {
+         debug_profile_charge(thread);
+         node = debug_profile_child(thread, thread->current,
+                                    (uintptr_t) function);
+      }
+
+      if (node) {
+         node->calls++;
+         thread->current = node;
+         thread->depth++;
+      }
+      else {
+         thread->overflow++;
+      }
+   }
+   thread->busy = 0;
+}
+
+
+void NO_INSTRUMENT
+__cyg_profile_func_exit(void *function, void *call_site)
+{
+   struct debug_profile_thread *thread;
+
+   if (!enabled)
+      return;
+
+   thread = debug_profile_get_thread();
+   if (!thread)
+      return;
+
+   thread->busy = 1;
+   __sync_synchronize();
+   if (enabled) {
+      if (thread->overflow) {
+         thread->overflow--;
+      }
+      else if (thread->depth) {
+         /* Returns from functions entered before the start are ignored */
+         debug_profile_charge(thread);
+         thread->current = thread->current->parent;
+         thread->depth--;
+      }
+   }
+   thread->busy = 0;
+}
+
+
+#ifdef ITIMER_PROF
+static void NO_INSTRUMENT
+debug_profile_sample(int sig)
+{
+   struct debug_profile_thread *thread;
+
+   thread = (struct debug_profile_thread *) pthread_getspecific(thread_key);
+   if (enabled && thread && thread->generation == generation)
+      thread->current->self++;
+}
+
+
+static void NO_INSTRUMENT
+debug_profile_set_timer(unsigned usecs)
+{
+   struct itimerval timer;
+
+   if (usecs)
+      signal(SIGPROF, debug_profile_sample);
+
+   timer.it_interval.tv_sec = 0;
+   timer.it_interval.tv_usec = usecs;
+   timer.it_value = timer.it_interval;
+   setitimer(ITIMER_PROF, &timer, NULL);
+
+   if (!usecs)
+      signal(SIGPROF, SIG_IGN);
+}
+#endif
+
+
+/*
+ * Output.  Profiling is disabled at this point, so the helpers used here
+ * may be instrumented.
+ */
+
+static unsigned
+debug_profile_hash(void *key)
+{
+   uintptr_t function = (uintptr_t) key;
+   return (unsigned) (function ^ (function >> 12));
+}
+
+
+static int
+debug_profile_compare(void *key1, void *key2)
+{
+   return key1 != key2;
+}
+
+
+static const char *
+debug_profile_name(struct hash_table *names, uintptr_t function)
+{
+   char buf[SYMBOL_NAME_SIZE];
+   char *name;
+
+   name = (char *) hash_table_get(names, (void *) function);
+   if (name)
+      return name;
+
+   debug_symbol_name((const void *) function, buf, sizeof buf);
+   name = strdup(buf);
+   if (!name)
+      return "?";
+
+   hash_table_set(names, (void *) function, name);
+   return name;
+}
+
+
+static enum pipe_error
+debug_profile_free_name(void *key, void *value, void *data)
+{
+   free(value);
+   return PIPE_OK;
+}
+
+
+static uint64_t
+debug_profile_sum(struct debug_profile_node *node)
+{
+   struct debug_profile_node *child;
+
+   node->total = node->self;
+   for (child = node->children; child; child = child->sibling)
+      node->total += debug_profile_sum(child);
+
+   return node->total;
+}
+
+
+static void
+debug_profile_write_folded(FILE *file, struct hash_table *names,
+                           const struct debug_profile_thread *thread,
+                           const struct debug_profile_node *node,
+                           const char **stack, unsigned depth)
+{
+   const struct debug_profile_node *child;
+   unsigned i;
+
+   if (depth)
+      stack[depth - 1] = debug_profile_name(names, node->function);
+
+   if (node->self) {
+      fprintf(file, "thread %u", thread->id);
+      for (i = 0; i < depth; i++)
+         fprintf(file, ";%s", stack[i]);
+      fprintf(file, " %llu\n", (unsigned long long) node->self);
+   }
+
+   for (child = node->children; child; child = child->sibling)
+      debug_profile_write_folded(file, names, thread, child, stack, depth + 1);
+}
+
+
+static void
+debug_profile_write_callgrind(FILE *file, struct hash_table *names,
+                              const struct debug_profile_node *node)
+{
+   const struct debug_profile_node *child;
+
+   /* Callgrind sums up repeated fn blocks of the same function */
+   if (node->function) {
+      fprintf(file, "fn=%s\n", debug_profile_name(names, node->function));
+      fprintf(file, "0 %llu\n", (unsigned long long) node->self);
+      for (child = node->children; child; child = child->sibling) {
+         fprintf(file, "cfn=%s\n", debug_profile_name(names, child->function));
+         fprintf(file, "calls=%llu 0\n", (unsigned long long) child->calls);
+         fprintf(file, "0 %llu\n", (unsigned long long) child->total);
+      }
+      fprintf(file, "\n");
+   }
+
+   for (child = node->children; child; child = child->sibling)
+      debug_profile_write_callgrind(file, names, child);
+}
+
+
+static void
+debug_profile_dump(void)
+{
+   const char *stack[PROFILE_MAX_DEPTH];
+   struct debug_profile_thread *thread;
+   struct hash_table *names;
+   FILE *file;
+
+   file = fopen(filename, "w");
+   if (!file) {
+      debug_printf("%s: failed to open %s\n", __FUNCTION__, filename);
+      return;
+   }
+
+   names = hash_table_create(debug_profile_hash, debug_profile_compare);
+   if (!names) {
+      fclose(file);
+      return;
+   }
+
+   if (callgrind) {
+      fprintf(file, "version: 1\n");
+      fprintf(file, "creator: gallium u_debug_profile\n");
+      fprintf(file, "positions: line\n");
+      fprintf(file, "events: %s\n\n", debug_profile_unit());
+   }
+
+   for (thread = threads; thread; thread = thread->next) {
+      if (thread->generation != generation)
+         continue;
+
+      if (callgrind) {
+         debug_profile_sum(&thread->root);
+         debug_profile_write_callgrind(file, names, &thread->root);
+      }
+      else {
+         debug_profile_write_folded(file, names, thread, &thread->root,
+                                    stack, 0);
+      }
+   }
+
+   fclose(file);
+
+   hash_table_foreach(names, debug_profile_free_name, NULL);
+   hash_table_destroy(names);
+
+   debug_printf("%s: wrote %s (%s)\n", __FUNCTION__, filename,
+                debug_profile_unit());
+}
+
+
+void NO_INSTRUMENT
+debug_profile_start(void)
+{
+   pthread_once(&init_once, debug_profile_init);
+
+   if (enabled)
+      return;
+
+#ifdef ITIMER_PROF
+   if (sampling)
+      debug_profile_set_timer(1000);
+#else
+   sampling = FALSE;
+#endif
+
+   /* Threads throw away their old data when they see the new generation */
+   __sync_fetch_and_add(&generation, 1);
+   __sync_synchronize();
+   enabled = 1;
+}
+
+
+void NO_INSTRUMENT
+debug_profile_stop(void)
+{
+   struct debug_profile_thread *thread;
+
+   if (!enabled)
+      return;
+
+   enabled = 0;
+   __sync_synchronize();
+
+#ifdef ITIMER_PROF
+   if (sampling)
+      debug_profile_set_timer(0);
+#endif
+
+   /* Wait for hooks running in other threads */
+   for (thread = threads; thread; thread = thread->next) {
+      while (thread->busy)
+         sched_yield();
+   }
+
+   debug_profile_dump();
+}
+
 #endif /* PROFILE */
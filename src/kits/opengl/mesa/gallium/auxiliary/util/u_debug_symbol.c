@@ -32,10 +32,26 @@
  * @author Jose Fonseca <jfonseca@vmware.com>
  */
 
+/* for dladdr() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "pipe/p_compiler.h"
 
 #include "u_debug.h"
 #include "u_debug_symbol.h"
+#include "u_string.h"
+
+#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD)
+#include <string.h>
+#include <dlfcn.h>
+#endif
+
+#if defined(PIPE_OS_HAIKU)
+#include <string.h>
+#include <image.h>
+#endif
 
 #if defined(PIPE_SUBSYSTEM_WINDOWS_USER) && defined(PIPE_ARCH_X86)
    
@@ -238,13 +254,89 @@ debug_symbol_print_imagehlp(const void *addr)
 #endif
 
 
+#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD)
+static INLINE boolean
+debug_symbol_name_dladdr(const void *addr, char *buf, unsigned size)
+{
+   Dl_info info;
+   const char *module;
+
+   if(!dladdr(addr, &info) || !info.dli_fname)
+      return FALSE;
+
+   if(info.dli_sname) {
+      util_snprintf(buf, size, "%s", info.dli_sname);
+      return TRUE;
+   }
+
+   /* Static functions are not in the dynamic symbol table, give the
+    * module offset so that addr2line can resolve it. */
+   module = strrchr(info.dli_fname, '/');
+   module = module ? module + 1 : info.dli_fname;
+   util_snprintf(buf, size, "%s+0x%lx", module,
+                 (unsigned long)((const char *)addr - (const char *)info.dli_fbase));
+   return TRUE;
+}
+#endif
+
+
+#if defined(PIPE_OS_HAIKU)
+static INLINE boolean
+debug_symbol_name_image(const void *addr, char *buf, unsigned size)
+{
+   image_info info;
+   int32 cookie = 0;
+
+   while(get_next_image_info(0, &cookie, &info) == B_OK) {
+      const char *text = (const char *)info.text;
+      const char *module;
+
+      if((const char *)addr < text || (const char *)addr >= text + info.text_size)
+         continue;
+
+      /* Offsets are relative to the text segment, as addr2line expects
+       * for shared objects. */
+      module = strrchr(info.name, '/');
+      module = module ? module + 1 : info.name;
+      util_snprintf(buf, size, "%s+0x%lx", module,
+                    (unsigned long)((const char *)addr - text));
+      return TRUE;
+   }
+
+   return FALSE;
+}
+#endif
+
+
+/**
+ * Write the name of the function containing addr into buf, or the
+ * module and offset when the name is not known.
+ */
+void
+debug_symbol_name(const void *addr, char *buf, unsigned size)
+{
+#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD)
+   if(debug_symbol_name_dladdr(addr, buf, size))
+      return;
+#elif defined(PIPE_OS_HAIKU)
+   if(debug_symbol_name_image(addr, buf, size))
+      return;
+#endif
+
+   util_snprintf(buf, size, "%p", addr);
+}
+
+
 void
 debug_symbol_print(const void *addr)
 {
+   char buf[256];
+
 #if defined(PIPE_SUBSYSTEM_WINDOWS_USER) && defined(PIPE_ARCH_X86)
    if(debug_symbol_print_imagehlp(addr))
       return;
 #endif
-   
-   debug_printf("\t%p\n", addr);
+
+   debug_symbol_name(addr, buf, sizeof(buf));
+   debug_printf("\t%s\n", buf);
 }
@@ -42,6 +42,9 @@ extern "C" {
 #endif
 
 
+void
+debug_symbol_name(const void *addr, char *buf, unsigned size);
+
 void
 debug_symbol_print(const void *addr);
 
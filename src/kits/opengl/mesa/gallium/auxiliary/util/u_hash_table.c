@@ -29,10 +29,7 @@
  * @file
  * General purpose hash table implementation.
  * 
- * Just uses the cso_hash for now, but it might be better switch to a linear 
- * probing hash table implementation at some point -- as it is said they have 
- * better lookup and cache performance and it appears to be possible to write 
- * a lock-free implementation of such hash tables . 
+ * Just uses the cso_hash, which is a linear probing hash table, for now. 
  * 
  * @author José Fonseca <jrfonseca@tungstengraphics.com>
  */
@@ -111,7 +108,7 @@ hash_table_find_iter(struct hash_table *ht,
       item = (struct hash_table_item *)cso_hash_iter_data(iter);
       if (!ht->compare(item->key, key))
          break;
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    
    return iter;
@@ -131,7 +128,7 @@ hash_table_find_item(struct hash_table *ht,
       item = (struct hash_table_item *)cso_hash_iter_data(iter);
       if (!ht->compare(item->key, key))
          return item;
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    
    return NULL;
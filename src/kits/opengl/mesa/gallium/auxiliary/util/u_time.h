@@ -94,6 +94,23 @@ util_time_timeout(const struct util_time *start,
                   const struct util_time *end,
                   const struct util_time *curr);
 
+/**
+ * Cheap counter for timing short intervals, in unspecified units: the
+ * time stamp counter on x86, microseconds elsewhere.  Calibrate against
+ * util_time_micros() over a long interval to convert.
+ */
+static INLINE uint64_t
+util_time_ticks(void)
+{
+#if defined(PIPE_CC_GCC) && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
+   uint32_t lo, hi;
+   __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+   return ((uint64_t) hi << 32) | lo;
+#else
+   return util_time_micros();
+#endif
+}
+
 #if defined(PIPE_OS_LINUX) || defined(PIPE_OS_BSD) || defined(PIPE_OS_SOLARIS) || defined(PIPE_OS_HAIKU)
 #define util_time_sleep usleep
 #else
@@ -109,7 +109,7 @@ struct pipe_context {
    boolean (*get_query_result)(struct pipe_context *pipe, 
                                struct pipe_query *q,
                                boolean wait,
-                               uint64_t *result);
+                               union pipe_query_result *result);
    /*@}*/
 
    /**
@@ -211,6 +211,17 @@ struct pipe_context {
 			unsigned dstx, unsigned dsty,
 			unsigned width, unsigned height,
 			unsigned value);
+
+   /**
+    * Fill mipmap levels baseLevel+1..lastLevel of a texture face by
+    * filtering down from baseLevel.  Optional, may be NULL.
+    * \return FALSE if the texture's format/target isn't handled, in which
+    * case the caller must fall back to some other method.
+    */
+   boolean (*generate_mipmap)(struct pipe_context *pipe,
+                              struct pipe_texture *texture,
+                              unsigned face,
+                              unsigned baseLevel, unsigned lastLevel);
    /*@}*/
 
    /**
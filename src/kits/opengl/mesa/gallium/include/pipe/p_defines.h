@@ -261,7 +261,9 @@ enum pipe_transfer_usage {
 #define PIPE_QUERY_OCCLUSION_COUNTER     0
 #define PIPE_QUERY_PRIMITIVES_GENERATED  1
 #define PIPE_QUERY_PRIMITIVES_EMITTED    2
-#define PIPE_QUERY_TYPES                 3
+#define PIPE_QUERY_PIPELINE_STATISTICS   3  /**< see pipe_query_data_pipeline_statistics */
+#define PIPE_QUERY_TIME_ELAPSED          4  /**< nanoseconds */
+#define PIPE_QUERY_TYPES                 5
 
 
 /**
@@ -302,6 +304,10 @@ enum pipe_transfer_usage {
 #define PIPE_CAP_TEXTURE_MIRROR_CLAMP    24
 #define PIPE_CAP_TEXTURE_MIRROR_REPEAT   25
 #define PIPE_CAP_MAX_VERTEX_TEXTURE_UNITS 26
+#define PIPE_CAP_TIMER_QUERY             27
+/** Blend, sampler, depth/stencil/alpha, rasterizer and fragment shader
+ * objects may be bound and deleted by any context of the screen */
+#define PIPE_CAP_SHARED_STATE_OBJECTS    28
 
 
 /**
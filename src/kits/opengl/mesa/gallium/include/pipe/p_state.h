@@ -377,6 +377,34 @@ struct pipe_vertex_element
 };
 
 
+/**
+ * Result of a PIPE_QUERY_PIPELINE_STATISTICS query.
+ */
+struct pipe_query_data_pipeline_statistics
+{
+   uint64_t vertices_fetched;
+   uint64_t vs_invocations;
+   uint64_t primitives_clipped;    /**< primitives which needed clipping */
+   uint64_t primitives_culled;     /**< culled or trivially rejected */
+   uint64_t triangles_setup;
+   uint64_t quads_shaded;
+   uint64_t quads_early_z_killed;  /**< killed by depth before shading */
+   uint64_t quads_depth_killed;    /**< killed by depth after shading */
+   uint64_t quads_stencil_killed;  /**< killed by the stencil test */
+   uint64_t blend_ops;             /**< quads blended */
+};
+
+
+/**
+ * Storage for the result of any query type, see get_query_result().
+ */
+union pipe_query_result
+{
+   uint64_t u64;   /**< occlusion counter, time elapsed */
+   struct pipe_query_data_pipeline_statistics pipeline_statistics;
+};
+
+
 /* Reference counting helper functions */
 static INLINE void
 pipe_buffer_reference(struct pipe_buffer **ptr, struct pipe_buffer *buf)
@@ -76,6 +76,19 @@
 # define THREADS
 #endif
 
+/*
+ * On Linux/ELF with POSIX threads the current dispatch table and context
+ * live in initial-exec __thread variables, which makes every GL call a
+ * single %fs/%gs relative load instead of a pthread_getspecific() call.
+ * Define GLAPI_NO_TLS to get the pthread key based dispatch back.  Keep
+ * this in sync with x86/glapi_x86.S and x86-64/glapi_x86-64.S.
+ */
+#if defined(PTHREADS) && defined(__linux__) && defined(__ELF__) \
+    && defined(__GNUC__) && __GNUC__ >= 4 \
+    && !defined(GLX_USE_TLS) && !defined(GLAPI_NO_TLS)
+# define GLX_USE_TLS
+#endif
+
 #ifdef VMS
 #include <GL/vms_x_fix.h>
 #endif
@@ -362,7 +375,17 @@ extern __thread struct _glapi_table * _glapi_tls_Dispatch
 #define GET_DISPATCH() _glapi_tls_Dispatch
 
 #elif !defined(GL_CALL)
-# if defined(THREADS)
+# if defined(BEOS_THREADS) && defined(__HAIKU__)
+extern _glthread_TSD _gl_DispatchTSD;
+
+/* _glapi_Dispatch is only NULL once glapi went multithreaded, at which
+ * point _gl_DispatchTSD has its slot and tls_get() is a %fs load.
+ */
+#  define GET_DISPATCH() \
+   ((__builtin_expect( _glapi_Dispatch != NULL, 1 )) \
+       ? _glapi_Dispatch \
+       : (struct _glapi_table *) tls_get(_gl_DispatchTSD.key))
+# elif defined(THREADS)
 #  define GET_DISPATCH() \
    ((__builtin_expect( _glapi_Dispatch != NULL, 1 )) \
        ? _glapi_Dispatch : _glapi_get_dispatch())
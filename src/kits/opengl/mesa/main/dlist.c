@@ -779,12 +779,391 @@ _mesa_alloc_opcode(GLcontext *ctx,
       ctx->ListExt.Opcode[i].Execute = execute;
       ctx->ListExt.Opcode[i].Destroy = destroy;
       ctx->ListExt.Opcode[i].Print = print;
+      ctx->ListExt.Opcode[i].Merge = NULL;
       return i + OPCODE_EXT_0;
    }
    return -1;
 }
 
 
+/**
+ * Let the instructions of an extension opcode be combined when they
+ * are adjacent in a finished display list, see gl_list_instruction.
+ */
+void
+_mesa_set_opcode_merge(GLcontext *ctx, GLint opcode,
+                       GLuint (*merge) (GLcontext *, void *, void **, GLuint))
+{
+   const GLint i = opcode - (GLint) OPCODE_EXT_0;
+
+   if (i >= 0 && i < (GLint) ctx->ListExt.NumOpcodes)
+      ctx->ListExt.Opcode[i].Merge = merge;
+}
+
+
+
+/**********************************************************************/
+/*****                   Display list optimization                *****/
+/**********************************************************************/
+
+
+/** Longest run of state instructions which is folded */
+#define MAX_FOLD_RUN 32
+
+
+/**
+ * An instruction of the list being optimized.
+ */
+struct dlist_inst
+{
+   Node *n;
+   GLuint size;
+   GLboolean drop;
+};
+
+
+/**
+ * A state instruction seen in the current run.
+ */
+struct fold_entry
+{
+   GLuint opcode;
+   GLuint key0, key1;
+   GLuint inst;
+};
+
+
+/**
+ * Number of nodes of the instruction at n.
+ */
+static GLuint
+inst_size(const GLcontext *ctx, const Node *n)
+{
+   const GLint i = (GLint) n[0].opcode - (GLint) OPCODE_EXT_0;
+
+   if (i >= 0)
+      return ctx->ListExt.Opcode[i].Size;
+   return InstSize[n[0].opcode];
+}
+
+
+/**
+ * Is the instruction a state setter which is completely overridden by a
+ * later instruction with the same opcode and keys, with nothing between
+ * them but other such setters?  Enable and Disable share one opcode.
+ */
+static GLboolean
+fold_key(const Node *n, GLuint *opcode, GLuint *key0, GLuint *key1)
+{
+   *opcode = n[0].opcode;
+   *key0 = 0;
+   *key1 = 0;
+
+   switch (n[0].opcode) {
+   case OPCODE_ENABLE:
+   case OPCODE_DISABLE:
+      /* enabling color material copies the current color */
+      if (n[1].e == GL_COLOR_MATERIAL)
+         return GL_FALSE;
+      *opcode = OPCODE_ENABLE;
+      *key0 = n[1].e;
+      return GL_TRUE;
+   case OPCODE_ATTR_1F_NV:
+   case OPCODE_ATTR_2F_NV:
+   case OPCODE_ATTR_3F_NV:
+   case OPCODE_ATTR_4F_NV:
+      if (n[1].e == 0)
+         return GL_FALSE;
+      *opcode = OPCODE_ATTR_1F_NV;
+      *key0 = n[1].e;
+      return GL_TRUE;
+   case OPCODE_ATTR_1F_ARB:
+   case OPCODE_ATTR_2F_ARB:
+   case OPCODE_ATTR_3F_ARB:
+   case OPCODE_ATTR_4F_ARB:
+      if (n[1].e == 0)
+         return GL_FALSE;
+      *opcode = OPCODE_ATTR_1F_ARB;
+      *key0 = n[1].e;
+      return GL_TRUE;
+   case OPCODE_LIGHT:
+   case OPCODE_MATERIAL:
+   case OPCODE_TEXENV:
+   case OPCODE_TEXGEN:
+   case OPCODE_TEXPARAMETER:
+      *key0 = n[1].e;
+      *key1 = n[2].e;
+      return GL_TRUE;
+   case OPCODE_FOG:
+   case OPCODE_HINT:
+   case OPCODE_LIGHT_MODEL:
+   case OPCODE_POINT_PARAMETERS:
+   case OPCODE_POLYGON_MODE:
+   case OPCODE_STENCIL_FUNC_SEPARATE:
+   case OPCODE_STENCIL_MASK_SEPARATE:
+   case OPCODE_STENCIL_OP_SEPARATE:
+      *key0 = n[1].e;
+      return GL_TRUE;
+   case OPCODE_ALPHA_FUNC:
+   case OPCODE_BLEND_COLOR:
+   case OPCODE_BLEND_EQUATION:
+   case OPCODE_BLEND_EQUATION_SEPARATE:
+   case OPCODE_BLEND_FUNC_SEPARATE:
+   case OPCODE_CLEAR_ACCUM:
+   case OPCODE_CLEAR_COLOR:
+   case OPCODE_CLEAR_DEPTH:
+   case OPCODE_CLEAR_INDEX:
+   case OPCODE_CLEAR_STENCIL:
+   case OPCODE_COLOR_MASK:
+   case OPCODE_CULL_FACE:
+   case OPCODE_DEPTH_FUNC:
+   case OPCODE_DEPTH_MASK:
+   case OPCODE_DEPTH_RANGE:
+   case OPCODE_FRONT_FACE:
+   case OPCODE_INDEX_MASK:
+   case OPCODE_LINE_STIPPLE:
+   case OPCODE_LINE_WIDTH:
+   case OPCODE_LIST_BASE:
+   case OPCODE_LOGIC_OP:
+   case OPCODE_MATRIX_MODE:
+   case OPCODE_POINT_SIZE:
+   case OPCODE_POLYGON_OFFSET:
+   case OPCODE_PROVOKING_VERTEX:
+   case OPCODE_SCISSOR:
+   case OPCODE_SHADE_MODEL:
+   case OPCODE_STENCIL_FUNC:
+   case OPCODE_STENCIL_MASK:
+   case OPCODE_STENCIL_OP:
+   case OPCODE_VIEWPORT:
+      return GL_TRUE;
+   default:
+      return GL_FALSE;
+   }
+}
+
+
+/**
+ * Mark the instructions which can be dropped from the list:
+ *  - state setters which are overridden later in the same run of
+ *    state setters,
+ *  - PushMatrix immediately followed by PopMatrix.
+ * \return  number of dropped instructions
+ */
+static GLuint
+find_dropped_instructions(struct dlist_inst *insts, GLuint count)
+{
+   struct fold_entry run[MAX_FOLD_RUN];
+   GLuint run_len = 0, dropped = 0;
+   GLuint i, j;
+
+   for (i = 0; i < count; i++) {
+      const Node *n = insts[i].n;
+      GLuint opcode, key0, key1;
+
+      if (fold_key(n, &opcode, &key0, &key1)) {
+         for (j = 0; j < run_len; j++) {
+            if (run[j].opcode == opcode &&
+                run[j].key0 == key0 &&
+                run[j].key1 == key1) {
+               insts[run[j].inst].drop = GL_TRUE;
+               run[j].inst = i;
+               dropped++;
+               break;
+            }
+         }
+         if (j == run_len && run_len < MAX_FOLD_RUN) {
+            run[run_len].opcode = opcode;
+            run[run_len].key0 = key0;
+            run[run_len].key1 = key1;
+            run[run_len].inst = i;
+            run_len++;
+         }
+         continue;
+      }
+
+      run_len = 0;
+
+      if (n[0].opcode == OPCODE_POP_MATRIX) {
+         /* The last instruction of a run is never dropped, so the
+          * previous live instruction is directly before the pop.
+          */
+         j = i;
+         while (j > 0 && insts[j - 1].drop)
+            j--;
+         if (j > 0 && insts[j - 1].n[0].opcode == OPCODE_PUSH_MATRIX) {
+            insts[j - 1].drop = GL_TRUE;
+            insts[i].drop = GL_TRUE;
+            dropped += 2;
+         }
+      }
+   }
+
+   return dropped;
+}
+
+
+/**
+ * Number of adjacent instructions, starting at i, of an extension opcode
+ * with a Merge callback.  0 if the instruction can't be merged.
+ */
+static GLuint
+merge_run_length(const GLcontext *ctx, const struct dlist_inst *insts,
+                 GLuint i, GLuint count)
+{
+   const OpCode opcode = insts[i].n[0].opcode;
+   const GLint ext = (GLint) opcode - (GLint) OPCODE_EXT_0;
+   GLuint j;
+
+   if (ext < 0 || !ctx->ListExt.Opcode[ext].Merge)
+      return 0;
+
+   for (j = i + 1; j < count; j++) {
+      if (insts[j].drop || insts[j].n[0].opcode != opcode)
+         break;
+   }
+
+   return j - i;
+}
+
+
+/**
+ * Optimize a display list which was just finished: fold redundant state
+ * changes, drop empty PushMatrix/PopMatrix pairs and let extension
+ * opcodes merge adjacent instructions (e.g. vbo vertex lists into one
+ * buffer).  The result is stored in a single block, so replay doesn't
+ * chase any OPCODE_CONTINUE links either.
+ */
+static void
+optimize_list(GLcontext *ctx, struct gl_display_list *dlist)
+{
+   struct dlist_inst *insts;
+   void **src = NULL;
+   GLuint count = 0, max_run = 0, nodes = 0;
+   GLuint dropped, i, pos;
+   GLboolean continued = GL_FALSE;
+   Node *n, *head;
+
+   /* Count the instructions */
+   n = dlist->Head;
+   for (;;) {
+      if (n[0].opcode == OPCODE_CONTINUE) {
+         n = (Node *) n[1].next;
+         continued = GL_TRUE;
+         continue;
+      }
+      count++;
+      if (n[0].opcode == OPCODE_END_OF_LIST)
+         break;
+      n += inst_size(ctx, n);
+   }
+
+   insts = (struct dlist_inst *) _mesa_malloc(count * sizeof(*insts));
+   if (!insts)
+      return;
+
+   n = dlist->Head;
+   for (i = 0; i < count; i++) {
+      while (n[0].opcode == OPCODE_CONTINUE)
+         n = (Node *) n[1].next;
+      insts[i].n = n;
+      insts[i].size = inst_size(ctx, n);
+      insts[i].drop = GL_FALSE;
+      n += insts[i].size;
+   }
+
+   dropped = find_dropped_instructions(insts, count);
+
+   for (i = 0; i < count; i++) {
+      if (!insts[i].drop) {
+         const GLuint run = merge_run_length(ctx, insts, i, count);
+         if (run > max_run)
+            max_run = run;
+         nodes += insts[i].size;
+      }
+   }
+
+   if (!dropped && max_run < 2 && !continued) {
+      _mesa_free(insts);
+      return;
+   }
+
+   head = (Node *) _mesa_malloc(nodes * sizeof(Node));
+   if (max_run >= 2)
+      src = (void **) _mesa_malloc(max_run * sizeof(void *));
+   if (!head || (max_run >= 2 && !src)) {
+      _mesa_free(head);
+      _mesa_free(src);
+      _mesa_free(insts);
+      return;
+   }
+
+   /* Copy the live instructions, the new list owns their data now */
+   pos = 0;
+   i = 0;
+   while (i < count) {
+      const GLuint size = insts[i].size;
+      const GLuint run = insts[i].drop ? 0 :
+         merge_run_length(ctx, insts, i, count);
+      GLuint merged = 0, j;
+
+      if (insts[i].drop) {
+         i++;
+         continue;
+      }
+
+      if (run >= 2) {
+         const struct gl_list_instruction *ext =
+            &ctx->ListExt.Opcode[insts[i].n[0].opcode - OPCODE_EXT_0];
+
+         for (j = 0; j < run; j++)
+            src[j] = &insts[i + j].n[1];
+
+         head[pos].opcode = insts[i].n[0].opcode;
+         merged = ext->Merge(ctx, &head[pos + 1], src, run);
+
+         if (merged >= 2) {
+            for (j = 0; j < merged; j++)
+               ext->Destroy(ctx, src[j]);
+            pos += size;
+            i += merged;
+            continue;
+         }
+      }
+
+      _mesa_memcpy(&head[pos], insts[i].n, size * sizeof(Node));
+      pos += size;
+      i++;
+   }
+
+   assert(pos <= nodes);
+
+   /* Free the old blocks */
+   n = dlist->Head;
+   while (n) {
+      Node *block = n;
+      Node *next = NULL;
+
+      for (;;) {
+         if (n[0].opcode == OPCODE_CONTINUE) {
+            next = (Node *) n[1].next;
+            break;
+         }
+         if (n[0].opcode == OPCODE_END_OF_LIST)
+            break;
+         n += inst_size(ctx, n);
+      }
+
+      _mesa_free(block);
+      n = next;
+   }
+
+   dlist->Head = head;
+
+   _mesa_free(src);
+   _mesa_free(insts);
+}
+
+
 
 /**
  * Allocate display list instruction.  Returns Node ptr to where the opcode
@@ -6871,6 +7250,8 @@ _mesa_EndList(void)
 
    (void) ALLOC_INSTRUCTION(ctx, OPCODE_END_OF_LIST, 0);
 
+   optimize_list(ctx, ctx->ListState.CurrentList);
+
    /* Destroy old list, if any */
    destroy_list(ctx, ctx->ListState.CurrentList->Name);
 
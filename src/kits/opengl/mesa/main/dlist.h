@@ -75,6 +75,10 @@ extern GLint _mesa_alloc_opcode( GLcontext *ctx, GLuint sz,
                                  void (*destroy)( GLcontext *, void * ),
                                  void (*print)( GLcontext *, void * ) );
 
+extern void _mesa_set_opcode_merge( GLcontext *ctx, GLint opcode,
+                                    GLuint (*merge)( GLcontext *, void *,
+                                                     void **, GLuint ) );
+
 extern void _mesa_init_display_list( GLcontext * ctx );
 
 extern void _mesa_save_vtxfmt_init( GLvertexformat *vfmt );
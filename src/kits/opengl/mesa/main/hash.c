@@ -3,7 +3,8 @@
  * Generic hash table. 
  *
  * Used for display lists, texture objects, vertex/fragment programs,
- * buffer objects, etc.  The hash functions are thread-safe.
+ * buffer objects, etc.  The hash functions are thread-safe, and lookups
+ * don't take a lock.
  * 
  * \note key=0 is illegal.
  *
@@ -41,18 +42,64 @@
 #include "hash.h"
 
 
-#define TABLE_SIZE 1023  /**< Size of lookup table/array */
+/**
+ * Names below the size of the dense array are stored directly in it.
+ * glGen* hands out consecutive names, so that is where nearly all objects
+ * end up.  The dense array grows by doubling while it stays at least half
+ * full, up to DENSE_MAX_SIZE entries.  Other names go to an open addressed
+ * table with linear probing.
+ */
+#define DENSE_INITIAL_SIZE  256
+#define DENSE_MAX_SIZE      (1 << 20)
+
+#define OPEN_INITIAL_SIZE   64     /**< must be a power of two */
 
-#define HASH_FUNC(K)  ((K) % TABLE_SIZE)
+
+/**
+ * Readers don't take the table mutex.  Writers bump Seq to an odd value
+ * while they modify the table and back to an even one when done, and a
+ * reader retries if Seq changed under it.  Arrays replaced when growing
+ * are kept until the table is deleted, so a racing reader never touches
+ * freed memory; since they double in size this at most doubles the
+ * table's footprint.
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+/* x86 neither reorders loads with loads nor stores with stores */
+#define HASH_BARRIER()  __asm__ __volatile__("" : : : "memory")
+#elif defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define HASH_BARRIER()  __sync_synchronize()
+#elif defined(__GNUC__)
+#define HASH_BARRIER()  __asm__ __volatile__("" : : : "memory")
+#else
+#define HASH_BARRIER()
+#endif
 
 
 /**
- * An entry in the hash table.  
+ * An entry in the open addressed table.  Key 0 marks a free slot.
  */
 struct HashEntry {
    GLuint Key;             /**< the entry's key */
    void *Data;             /**< the entry's data */
-   struct HashEntry *Next; /**< pointer to next entry */
+};
+
+
+/**
+ * Open addressed table storage.  The size lives next to the entries so
+ * a reader always sees a matching pair.
+ */
+struct HashOpen {
+   GLuint Mask;                 /**< number of slots - 1 */
+   struct HashEntry Entry[1];   /**< Mask + 1 slots */
+};
+
+
+/**
+ * Dense array storage, indexed by key.
+ */
+struct HashDense {
+   GLuint Size;                 /**< number of slots, keys below this */
+   void *Data[1];               /**< Size slots */
 };
 
 
@@ -60,14 +107,278 @@ struct HashEntry {
  * The hash table data structure.  
  */
 struct _mesa_HashTable {
-   struct HashEntry *Table[TABLE_SIZE];  /**< the lookup table */
-   GLuint MaxKey;                        /**< highest key inserted so far */
-   _glthread_Mutex Mutex;                /**< mutual exclusion lock */
-   _glthread_Mutex WalkMutex;            /**< for _mesa_HashWalk() */
-   GLboolean InDeleteAll;                /**< Debug check */
+   struct HashDense * volatile Dense;  /**< direct lookup for small keys */
+   GLuint DenseCount;                  /**< used entries in Dense */
+   struct HashOpen * volatile Open;    /**< everything else */
+   GLuint OpenCount;                   /**< used entries in Open */
+   volatile GLuint Seq;                /**< odd while a writer is busy */
+   void **Retired;                     /**< replaced storage, see above */
+   GLuint NumRetired;
+   GLuint MaxKey;                      /**< highest key inserted so far */
+   _glthread_Mutex Mutex;              /**< mutual exclusion lock */
+   _glthread_Mutex WalkMutex;          /**< for _mesa_HashWalk() */
+   GLboolean InDeleteAll;              /**< Debug check */
 };
 
 
+static INLINE GLuint
+hash_func(GLuint key)
+{
+   key ^= key >> 16;
+   key *= 0x45d9f3b;
+   key ^= key >> 16;
+   return key;
+}
+
+
+static struct HashOpen *
+alloc_open(GLuint size)
+{
+   struct HashOpen *open = (struct HashOpen *)
+      _mesa_calloc(sizeof(struct HashOpen) +
+                   (size - 1) * sizeof(struct HashEntry));
+   if (open)
+      open->Mask = size - 1;
+   return open;
+}
+
+
+static struct HashDense *
+alloc_dense(GLuint size)
+{
+   struct HashDense *dense = (struct HashDense *)
+      _mesa_calloc(sizeof(struct HashDense) + (size - 1) * sizeof(void *));
+   if (dense)
+      dense->Size = size;
+   return dense;
+}
+
+
+/**
+ * Keep replaced storage around until the table is deleted.
+ */
+static void
+retire(struct _mesa_HashTable *table, void *storage)
+{
+   void **retired = (void **)
+      _mesa_realloc(table->Retired, table->NumRetired * sizeof(void *),
+                    (table->NumRetired + 1) * sizeof(void *));
+   if (!retired) {
+      /* leak rather than free memory a reader may be looking at */
+      return;
+   }
+   retired[table->NumRetired++] = storage;
+   table->Retired = retired;
+}
+
+
+static INLINE void
+begin_write(struct _mesa_HashTable *table)
+{
+   table->Seq++;
+   HASH_BARRIER();
+}
+
+
+static INLINE void
+end_write(struct _mesa_HashTable *table)
+{
+   HASH_BARRIER();
+   table->Seq++;
+}
+
+
+/**
+ * Find the slot holding key, or the free slot ending its probe sequence.
+ */
+static INLINE GLuint
+open_find(const struct HashOpen *open, GLuint key)
+{
+   GLuint pos = hash_func(key) & open->Mask;
+   GLuint n;
+
+   /* bounded, a racing reader may be looking at a table being rebuilt */
+   for (n = 0; n <= open->Mask; n++) {
+      if (open->Entry[pos].Key == key || open->Entry[pos].Key == 0)
+         break;
+      pos = (pos + 1) & open->Mask;
+   }
+   return pos;
+}
+
+
+/**
+ * Lookup without synchronization.  Caller holds the mutex or validates
+ * the result with the sequence number.
+ */
+static INLINE void *
+lookup_unlocked(const struct _mesa_HashTable *table, GLuint key)
+{
+   const struct HashDense *dense = table->Dense;
+   const struct HashOpen *open;
+   GLuint pos;
+
+   if (dense && key < dense->Size)
+      return dense->Data[key];
+
+   open = table->Open;
+   if (!open)
+      return NULL;
+
+   pos = open_find(open, key);
+   return open->Entry[pos].Key == key ? open->Entry[pos].Data : NULL;
+}
+
+
+/**
+ * Remove an open table entry, shifting the rest of its cluster back so
+ * that no tombstones are needed.
+ */
+static void
+open_remove(struct HashOpen *open, GLuint pos)
+{
+   const GLuint mask = open->Mask;
+   GLuint next = (pos + 1) & mask;
+
+   while (open->Entry[next].Key) {
+      const GLuint home = hash_func(open->Entry[next].Key) & mask;
+
+      /* move the entry back unless its home slot lies in (pos, next] */
+      if (pos <= next ? (home <= pos || home > next)
+                      : (home <= pos && home > next)) {
+         open->Entry[pos] = open->Entry[next];
+         pos = next;
+      }
+      next = (next + 1) & mask;
+   }
+
+   open->Entry[pos].Key = 0;
+   open->Entry[pos].Data = NULL;
+}
+
+
+static void
+open_insert(struct HashOpen *open, GLuint key, void *data)
+{
+   GLuint pos = open_find(open, key);
+   open->Entry[pos].Data = data;
+   open->Entry[pos].Key = key;
+}
+
+
+/**
+ * Rebuild the open table with the given size, dropping entries which the
+ * dense array now covers.
+ */
+static GLboolean
+open_resize(struct _mesa_HashTable *table, GLuint size)
+{
+   struct HashOpen *old = table->Open;
+   const GLuint denseSize = table->Dense ? table->Dense->Size : 0;
+   struct HashOpen *open = alloc_open(size);
+   GLuint i;
+
+   if (!open)
+      return GL_FALSE;
+
+   table->OpenCount = 0;
+   if (old) {
+      for (i = 0; i <= old->Mask; i++) {
+         const struct HashEntry *entry = &old->Entry[i];
+         if (entry->Key && entry->Key >= denseSize) {
+            open_insert(open, entry->Key, entry->Data);
+            table->OpenCount++;
+         }
+      }
+      retire(table, old);
+   }
+
+   table->Open = open;
+   return GL_TRUE;
+}
+
+
+/**
+ * Grow the dense array so it covers key, moving over the open table
+ * entries it now covers.
+ */
+static GLboolean
+dense_grow(struct _mesa_HashTable *table, GLuint key)
+{
+   struct HashDense *old = table->Dense;
+   struct HashOpen *open = table->Open;
+   struct HashDense *dense;
+   GLuint size = old ? old->Size : DENSE_INITIAL_SIZE;
+   GLuint moved = 0, i;
+
+   while (size <= key)
+      size *= 2;
+
+   dense = alloc_dense(size);
+   if (!dense)
+      return GL_FALSE;
+
+   if (old) {
+      memcpy(dense->Data, old->Data, old->Size * sizeof(void *));
+      retire(table, old);
+   }
+
+   if (open) {
+      for (i = 0; i <= open->Mask; i++) {
+         const GLuint k = open->Entry[i].Key;
+         if (k && k < size) {
+            dense->Data[k] = open->Entry[i].Data;
+            moved++;
+         }
+      }
+   }
+
+   table->Dense = dense;
+   table->DenseCount += moved;
+
+   /* rebuilding drops the moved entries from the open table */
+   if (moved && !open_resize(table, open->Mask + 1)) {
+      /* out of memory, remove them in place */
+      i = 0;
+      while (i <= open->Mask) {
+         if (open->Entry[i].Key && open->Entry[i].Key < size) {
+            open_remove(open, i);
+            table->OpenCount--;
+            i = 0;
+         }
+         else {
+            i++;
+         }
+      }
+   }
+
+   return GL_TRUE;
+}
+
+
+/**
+ * Decide whether key should go to the dense array, growing it if need be.
+ */
+static GLboolean
+use_dense(struct _mesa_HashTable *table, GLuint key)
+{
+   const struct HashDense *dense = table->Dense;
+
+   if (dense) {
+      if (key < dense->Size)
+         return GL_TRUE;
+      if (key >= DENSE_MAX_SIZE || key >= 2 * dense->Size ||
+          table->DenseCount < dense->Size / 2)
+         return GL_FALSE;
+   }
+   else if (key >= DENSE_INITIAL_SIZE) {
+      return GL_FALSE;
+   }
+
+   return dense_grow(table, key);
+}
+
+
 
 /**
  * Create a new hash table.
@@ -98,20 +409,19 @@ _mesa_NewHashTable(void)
 void
 _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 {
-   GLuint pos;
+   GLuint i;
    assert(table);
-   for (pos = 0; pos < TABLE_SIZE; pos++) {
-      struct HashEntry *entry = table->Table[pos];
-      while (entry) {
-	 struct HashEntry *next = entry->Next;
-         if (entry->Data) {
-            _mesa_problem(NULL,
-                          "In _mesa_DeleteHashTable, found non-freed data");
-         }
-	 _mesa_free(entry);
-	 entry = next;
-      }
+
+   if (table->DenseCount || table->OpenCount) {
+      _mesa_problem(NULL, "In _mesa_DeleteHashTable, found non-freed data");
    }
+
+   for (i = 0; i < table->NumRetired; i++)
+      _mesa_free(table->Retired[i]);
+   _mesa_free(table->Retired);
+   _mesa_free(table->Dense);
+   _mesa_free(table->Open);
+
    _glthread_DESTROY_MUTEX(table->Mutex);
    _glthread_DESTROY_MUTEX(table->WalkMutex);
    _mesa_free(table);
@@ -126,25 +436,26 @@ _mesa_DeleteHashTable(struct _mesa_HashTable *table)
  * \param key the key.
  * 
  * \return pointer to user's data or NULL if key not in table
+ *
+ * Doesn't take the table's lock, see the comment on HASH_BARRIER.
  */
 void *
 _mesa_HashLookup(const struct _mesa_HashTable *table, GLuint key)
 {
-   GLuint pos;
-   const struct HashEntry *entry;
+   void *data;
+   GLuint seq;
 
    assert(table);
    assert(key);
 
-   pos = HASH_FUNC(key);
-   entry = table->Table[pos];
-   while (entry) {
-      if (entry->Key == key) {
-	 return entry->Data;
-      }
-      entry = entry->Next;
-   }
-   return NULL;
+   do {
+      seq = table->Seq;
+      HASH_BARRIER();
+      data = lookup_unlocked(table, key);
+      HASH_BARRIER();
+   } while ((seq & 1) || seq != table->Seq);
+
+   return data;
 }
 
 
@@ -152,6 +463,7 @@ _mesa_HashLookup(const struct _mesa_HashTable *table, GLuint key)
 /**
  * Insert a key/pointer pair into the hash table.  
  * If an entry with this key already exists we'll replace the existing entry.
+ * Inserting NULL data is the same as removing the key.
  * 
  * \param table the hash table.
  * \param key the key (not zero).
@@ -160,42 +472,50 @@ _mesa_HashLookup(const struct _mesa_HashTable *table, GLuint key)
 void
 _mesa_HashInsert(struct _mesa_HashTable *table, GLuint key, void *data)
 {
-   /* search for existing entry with this key */
+   struct HashOpen *open;
    GLuint pos;
-   struct HashEntry *entry;
 
    assert(table);
    assert(key);
 
+   if (!data) {
+      _mesa_HashRemove(table, key);
+      return;
+   }
+
    _glthread_LOCK_MUTEX(table->Mutex);
+   begin_write(table);
 
    if (key > table->MaxKey)
       table->MaxKey = key;
 
-   pos = HASH_FUNC(key);
-
-   /* check if replacing an existing entry with same key */
-   for (entry = table->Table[pos]; entry; entry = entry->Next) {
-      if (entry->Key == key) {
-         /* replace entry's data */
-#if 0 /* not sure this check is always valid */
-         if (entry->Data) {
-            _mesa_problem(NULL, "Memory leak detected in _mesa_HashInsert");
+   if (use_dense(table, key)) {
+      struct HashDense *dense = table->Dense;
+      if (!dense->Data[key])
+         table->DenseCount++;
+      dense->Data[key] = data;
+   }
+   else {
+      open = table->Open;
+      if (!open || (table->OpenCount + 1) * 4 > (open->Mask + 1) * 3) {
+         if (!open_resize(table, open ? (open->Mask + 1) * 2
+                                      : OPEN_INITIAL_SIZE)) {
+            _mesa_problem(NULL, "Out of memory in _mesa_HashInsert");
+            end_write(table);
+            _glthread_UNLOCK_MUTEX(table->Mutex);
+            return;
          }
-#endif
-	 entry->Data = data;
-         _glthread_UNLOCK_MUTEX(table->Mutex);
-	 return;
+         open = table->Open;
       }
-   }
 
-   /* alloc and insert new table entry */
-   entry = MALLOC_STRUCT(HashEntry);
-   entry->Key = key;
-   entry->Data = data;
-   entry->Next = table->Table[pos];
-   table->Table[pos] = entry;
+      pos = open_find(open, key);
+      if (!open->Entry[pos].Key)
+         table->OpenCount++;
+      open->Entry[pos].Data = data;
+      open->Entry[pos].Key = key;
+   }
 
+   end_write(table);
    _glthread_UNLOCK_MUTEX(table->Mutex);
 }
 
@@ -213,8 +533,9 @@ _mesa_HashInsert(struct _mesa_HashTable *table, GLuint key, void *data)
 void
 _mesa_HashRemove(struct _mesa_HashTable *table, GLuint key)
 {
+   struct HashDense *dense;
+   struct HashOpen *open;
    GLuint pos;
-   struct HashEntry *entry, *prev;
 
    assert(table);
    assert(key);
@@ -227,27 +548,25 @@ _mesa_HashRemove(struct _mesa_HashTable *table, GLuint key)
    }
 
    _glthread_LOCK_MUTEX(table->Mutex);
-
-   pos = HASH_FUNC(key);
-   prev = NULL;
-   entry = table->Table[pos];
-   while (entry) {
-      if (entry->Key == key) {
-         /* found it! */
-         if (prev) {
-            prev->Next = entry->Next;
-         }
-         else {
-            table->Table[pos] = entry->Next;
-         }
-         _mesa_free(entry);
-         _glthread_UNLOCK_MUTEX(table->Mutex);
-	 return;
+   begin_write(table);
+
+   dense = table->Dense;
+   open = table->Open;
+   if (dense && key < dense->Size) {
+      if (dense->Data[key]) {
+         dense->Data[key] = NULL;
+         table->DenseCount--;
+      }
+   }
+   else if (open) {
+      pos = open_find(open, key);
+      if (open->Entry[pos].Key == key) {
+         open_remove(open, pos);
+         table->OpenCount--;
       }
-      prev = entry;
-      entry = entry->Next;
    }
 
+   end_write(table);
    _glthread_UNLOCK_MUTEX(table->Mutex);
 }
 
@@ -267,20 +586,35 @@ _mesa_HashDeleteAll(struct _mesa_HashTable *table,
                     void (*callback)(GLuint key, void *data, void *userData),
                     void *userData)
 {
-   GLuint pos;
+   struct HashDense *dense;
+   struct HashOpen *open;
+   GLuint i;
    ASSERT(table);
    ASSERT(callback);
    _glthread_LOCK_MUTEX(table->Mutex);
    table->InDeleteAll = GL_TRUE;
-   for (pos = 0; pos < TABLE_SIZE; pos++) {
-      struct HashEntry *entry, *next;
-      for (entry = table->Table[pos]; entry; entry = next) {
-         callback(entry->Key, entry->Data, userData);
-         next = entry->Next;
-         _mesa_free(entry);
+   dense = table->Dense;
+   open = table->Open;
+   if (dense) {
+      for (i = 1; i < dense->Size; i++) {
+         if (dense->Data[i])
+            callback(i, dense->Data[i], userData);
+      }
+   }
+   if (open) {
+      for (i = 0; i <= open->Mask; i++) {
+         if (open->Entry[i].Key)
+            callback(open->Entry[i].Key, open->Entry[i].Data, userData);
       }
-      table->Table[pos] = NULL;
    }
+   begin_write(table);
+   if (dense)
+      memset(dense->Data, 0, dense->Size * sizeof(void *));
+   if (open)
+      memset(open->Entry, 0, (open->Mask + 1) * sizeof(struct HashEntry));
+   table->DenseCount = 0;
+   table->OpenCount = 0;
+   end_write(table);
    table->InDeleteAll = GL_FALSE;
    _glthread_UNLOCK_MUTEX(table->Mutex);
 }
@@ -291,8 +625,8 @@ _mesa_HashDeleteAll(struct _mesa_HashTable *table,
  * Note: we use a separate mutex in this function to avoid a recursive
  * locking deadlock (in case the callback calls _mesa_HashRemove()) and to
  * prevent multiple threads/contexts from getting tangled up.
- * A lock-less version of this function could be used when the table will
- * not be modified.
+ * The keys are collected first since removing an entry may move others
+ * around in the open table.
  * \param table  the hash table to walk
  * \param callback  the callback function
  * \param userData  arbitrary pointer to pass along to the callback
@@ -305,26 +639,75 @@ _mesa_HashWalk(const struct _mesa_HashTable *table,
 {
    /* cast-away const */
    struct _mesa_HashTable *table2 = (struct _mesa_HashTable *) table;
-   GLuint pos;
+   GLuint *keys;
+   GLuint numKeys = 0, i;
    ASSERT(table);
    ASSERT(callback);
    _glthread_LOCK_MUTEX(table2->WalkMutex);
-   for (pos = 0; pos < TABLE_SIZE; pos++) {
-      struct HashEntry *entry, *next;
-      for (entry = table->Table[pos]; entry; entry = next) {
-         /* save 'next' pointer now in case the callback deletes the entry */
-         next = entry->Next;
-         callback(entry->Key, entry->Data, userData);
+
+   _glthread_LOCK_MUTEX(table2->Mutex);
+   keys = (GLuint *) _mesa_malloc((table->DenseCount + table->OpenCount + 1)
+                                  * sizeof(GLuint));
+   if (keys) {
+      const struct HashDense *dense = table->Dense;
+      const struct HashOpen *open = table->Open;
+      if (dense) {
+         for (i = 1; i < dense->Size; i++) {
+            if (dense->Data[i])
+               keys[numKeys++] = i;
+         }
+      }
+      if (open) {
+         for (i = 0; i <= open->Mask; i++) {
+            if (open->Entry[i].Key)
+               keys[numKeys++] = open->Entry[i].Key;
+         }
       }
    }
+   _glthread_UNLOCK_MUTEX(table2->Mutex);
+
+   for (i = 0; i < numKeys; i++) {
+      /* the callback may have removed later entries */
+      void *data = _mesa_HashLookup(table, keys[i]);
+      if (data)
+         callback(keys[i], data, userData);
+   }
+
+   _mesa_free(keys);
    _glthread_UNLOCK_MUTEX(table2->WalkMutex);
 }
 
 
+/**
+ * Return the first used key at or after the given dense array index or
+ * open table slot.  Dense keys come first.
+ */
+static GLuint
+next_key(const struct _mesa_HashTable *table, GLuint denseStart,
+         GLuint openStart)
+{
+   const struct HashDense *dense = table->Dense;
+   const struct HashOpen *open = table->Open;
+   GLuint i;
+
+   if (dense) {
+      for (i = denseStart; i < dense->Size; i++) {
+         if (dense->Data[i])
+            return i;
+      }
+   }
+   if (open) {
+      for (i = openStart; i <= open->Mask; i++) {
+         if (open->Entry[i].Key)
+            return open->Entry[i].Key;
+      }
+   }
+   return 0;
+}
+
+
 /**
  * Return the key of the "first" entry in the hash table.
- * While holding the lock, walks through all table positions until finding
- * the first entry of the first non-empty one.
  * 
  * \param table  the hash table
  * \return key for the "first" entry in the hash table.
@@ -332,17 +715,12 @@ _mesa_HashWalk(const struct _mesa_HashTable *table,
 GLuint
 _mesa_HashFirstEntry(struct _mesa_HashTable *table)
 {
-   GLuint pos;
+   GLuint key;
    assert(table);
    _glthread_LOCK_MUTEX(table->Mutex);
-   for (pos = 0; pos < TABLE_SIZE; pos++) {
-      if (table->Table[pos]) {
-         _glthread_UNLOCK_MUTEX(table->Mutex);
-         return table->Table[pos]->Key;
-      }
-   }
+   key = next_key(table, 1, 0);
    _glthread_UNLOCK_MUTEX(table->Mutex);
-   return 0;
+   return key;
 }
 
 
@@ -355,40 +733,29 @@ _mesa_HashFirstEntry(struct _mesa_HashTable *table)
 GLuint
 _mesa_HashNextEntry(const struct _mesa_HashTable *table, GLuint key)
 {
-   const struct HashEntry *entry;
+   const struct HashDense *dense = table->Dense;
+   const struct HashOpen *open = table->Open;
    GLuint pos;
 
    assert(table);
    assert(key);
 
-   /* Find the entry with given key */
-   pos = HASH_FUNC(key);
-   for (entry = table->Table[pos]; entry ; entry = entry->Next) {
-      if (entry->Key == key) {
-         break;
+   if (dense && key < dense->Size) {
+      if (!dense->Data[key]) {
+         /* the given key was not found, so we can't find the next entry */
+         return 0;
       }
+      return next_key(table, key + 1, 0);
    }
 
-   if (!entry) {
-      /* the given key was not found, so we can't find the next entry */
+   if (!open)
       return 0;
-   }
 
-   if (entry->Next) {
-      /* return next in linked list */
-      return entry->Next->Key;
-   }
-   else {
-      /* look for next non-empty table slot */
-      pos++;
-      while (pos < TABLE_SIZE) {
-         if (table->Table[pos]) {
-            return table->Table[pos]->Key;
-         }
-         pos++;
-      }
+   pos = open_find(open, key);
+   if (open->Entry[pos].Key != key)
       return 0;
-   }
+
+   return next_key(table, ~0u, pos + 1);
 }
 
 
@@ -400,13 +767,21 @@ _mesa_HashNextEntry(const struct _mesa_HashTable *table, GLuint key)
 void
 _mesa_HashPrint(const struct _mesa_HashTable *table)
 {
-   GLuint pos;
+   const struct HashDense *dense = table->Dense;
+   const struct HashOpen *open = table->Open;
+   GLuint i;
    assert(table);
-   for (pos = 0; pos < TABLE_SIZE; pos++) {
-      const struct HashEntry *entry = table->Table[pos];
-      while (entry) {
-	 _mesa_debug(NULL, "%u %p\n", entry->Key, entry->Data);
-	 entry = entry->Next;
+   if (dense) {
+      for (i = 1; i < dense->Size; i++) {
+         if (dense->Data[i])
+            _mesa_debug(NULL, "%u %p\n", i, dense->Data[i]);
+      }
+   }
+   if (open) {
+      for (i = 0; i <= open->Mask; i++) {
+         if (open->Entry[i].Key)
+            _mesa_debug(NULL, "%u %p\n", open->Entry[i].Key,
+                        open->Entry[i].Data);
       }
    }
 }
@@ -442,7 +817,7 @@ _mesa_HashFindFreeKeyBlock(struct _mesa_HashTable *table, GLuint numKeys)
       GLuint freeStart = 1;
       GLuint key;
       for (key = 1; key != maxKey; key++) {
-	 if (_mesa_HashLookup(table, key)) {
+	 if (lookup_unlocked(table, key)) {
 	    /* darn, this key is already in use */
 	    freeCount = 0;
 	    freeStart = key+1;
@@ -25,6 +25,161 @@
 #include "mm.h"
 
 
+/*
+ * Free blocks are kept in segregated free lists, TLSF style: the first
+ * level splits sizes by power of two, the second level splits each power
+ * of two range linearly in MM_SL_COUNT classes.  Two levels of bitmaps
+ * tell which lists are non-empty, so finding a free block of at least the
+ * requested size and coalescing freed blocks with their neighbours are
+ * constant time.
+ */
+
+#define MM_SL_LOG2 4
+#define MM_SL_COUNT (1 << MM_SL_LOG2)
+
+/** Enough first level classes for any 32 bit size */
+#define MM_FL_COUNT (32 - MM_SL_LOG2 + 1)
+
+
+/**
+ * The heap.  Users only see the head block, which is the sentinel of the
+ * list of all blocks in address order.
+ */
+struct mem_heap {
+   struct mem_block head;
+   unsigned fl_bitmap;
+   unsigned sl_bitmap[MM_FL_COUNT];
+   struct mem_block *free_lists[MM_FL_COUNT][MM_SL_COUNT];
+};
+
+
+static INLINE struct mem_heap *
+mem_heap(struct mem_block *heap)
+{
+   return (struct mem_heap *)heap;
+}
+
+
+/**
+ * Index of the most significant bit set.
+ */
+static INLINE unsigned
+mm_fls(unsigned x)
+{
+#if defined(__GNUC__)
+   return 31 - __builtin_clz(x);
+#else
+   unsigned i = 0;
+   while (x >>= 1)
+      i++;
+   return i;
+#endif
+}
+
+
+/**
+ * Free list class of a block of the given size.
+ */
+static INLINE void
+mapping_insert(unsigned size, unsigned *fl, unsigned *sl)
+{
+   if (size < MM_SL_COUNT) {
+      *fl = 0;
+      *sl = size;
+   }
+   else {
+      unsigned t = mm_fls(size);
+      *sl = (size >> (t - MM_SL_LOG2)) ^ MM_SL_COUNT;
+      *fl = t - MM_SL_LOG2 + 1;
+   }
+}
+
+
+/**
+ * First free list class whose blocks are all at least the given size.
+ */
+static INLINE void
+mapping_search(unsigned size, unsigned *fl, unsigned *sl)
+{
+   if (size >= MM_SL_COUNT) {
+      unsigned round = (1 << (mm_fls(size) - MM_SL_LOG2)) - 1;
+      if (size + round < size) {
+         *fl = MM_FL_COUNT;
+         *sl = 0;
+         return;
+      }
+      size += round;
+   }
+   mapping_insert(size, fl, sl);
+}
+
+
+static struct mem_block *
+find_suitable_block(struct mem_heap *heap, unsigned fl, unsigned sl)
+{
+   unsigned sl_map, fl_map;
+
+   if (fl >= MM_FL_COUNT)
+      return NULL;
+
+   sl_map = heap->sl_bitmap[fl] & (~0U << sl);
+   if (!sl_map) {
+      fl_map = fl + 1 < 32 ? heap->fl_bitmap & (~0U << (fl + 1)) : 0;
+      if (!fl_map)
+         return NULL;
+      fl = _mesa_ffs(fl_map) - 1;
+      sl_map = heap->sl_bitmap[fl];
+   }
+   sl = _mesa_ffs(sl_map) - 1;
+
+   return heap->free_lists[fl][sl];
+}
+
+
+static void
+insert_free_block(struct mem_heap *heap, struct mem_block *b)
+{
+   unsigned fl, sl;
+
+   mapping_insert(b->size, &fl, &sl);
+
+   b->prev_free = NULL;
+   b->next_free = heap->free_lists[fl][sl];
+   if (b->next_free)
+      b->next_free->prev_free = b;
+   heap->free_lists[fl][sl] = b;
+
+   heap->fl_bitmap |= 1 << fl;
+   heap->sl_bitmap[fl] |= 1 << sl;
+}
+
+
+static void
+remove_free_block(struct mem_heap *heap, struct mem_block *b)
+{
+   unsigned fl, sl;
+
+   mapping_insert(b->size, &fl, &sl);
+
+   if (b->next_free)
+      b->next_free->prev_free = b->prev_free;
+   if (b->prev_free)
+      b->prev_free->next_free = b->next_free;
+   else {
+      assert(heap->free_lists[fl][sl] == b);
+      heap->free_lists[fl][sl] = b->next_free;
+      if (!b->next_free) {
+         heap->sl_bitmap[fl] &= ~(1 << sl);
+         if (!heap->sl_bitmap[fl])
+            heap->fl_bitmap &= ~(1 << fl);
+      }
+   }
+
+   b->next_free = NULL;
+   b->prev_free = NULL;
+}
+
+
 void
 mmDumpMemInfo(const struct mem_block *heap)
 {
@@ -32,7 +187,9 @@ mmDumpMemInfo(const struct mem_block *heap)
    if (heap == 0) {
       fprintf(stderr, "  heap == 0\n");
    } else {
+      const struct mem_heap *h = (const struct mem_heap *)heap;
       const struct mem_block *p;
+      unsigned fl, sl;
 
       for(p = heap->next; p != heap; p = p->next) {
 	 fprintf(stderr, "  Offset:%08x, Size:%08x, %c%c\n",p->ofs,p->size,
@@ -42,10 +199,14 @@ mmDumpMemInfo(const struct mem_block *heap)
 
       fprintf(stderr, "\nFree list:\n");
 
-      for(p = heap->next_free; p != heap; p = p->next_free) {
-	 fprintf(stderr, " FREE Offset:%08x, Size:%08x, %c%c\n",p->ofs,p->size,
-		 p->free ? 'F':'.',
-		 p->reserved ? 'R':'.');
+      for(fl = 0; fl < MM_FL_COUNT; fl++) {
+         for(sl = 0; sl < MM_SL_COUNT; sl++) {
+            for(p = h->free_lists[fl][sl]; p; p = p->next_free) {
+               fprintf(stderr, " FREE Offset:%08x, Size:%08x, %c%c\n",p->ofs,p->size,
+                       p->free ? 'F':'.',
+                       p->reserved ? 'R':'.');
+            }
+         }
       }
 
    }
@@ -55,12 +216,13 @@ mmDumpMemInfo(const struct mem_block *heap)
 struct mem_block *
 mmInit(unsigned ofs, unsigned size)
 {
-   struct mem_block *heap, *block;
+   struct mem_heap *heap;
+   struct mem_block *block;
   
    if (!size) 
       return NULL;
 
-   heap = (struct mem_block *) _mesa_calloc(sizeof(struct mem_block));
+   heap = (struct mem_heap *) _mesa_calloc(sizeof(struct mem_heap));
    if (!heap) 
       return NULL;
    
@@ -70,125 +232,150 @@ mmInit(unsigned ofs, unsigned size)
       return NULL;
    }
 
-   heap->next = block;
-   heap->prev = block;
-   heap->next_free = block;
-   heap->prev_free = block;
+   heap->head.next = block;
+   heap->head.prev = block;
 
-   block->heap = heap;
-   block->next = heap;
-   block->prev = heap;
-   block->next_free = heap;
-   block->prev_free = heap;
+   block->heap = &heap->head;
+   block->next = &heap->head;
+   block->prev = &heap->head;
 
    block->ofs = ofs;
    block->size = size;
    block->free = 1;
 
-   return heap;
+   insert_free_block(heap, block);
+
+   return &heap->head;
 }
 
 
+/**
+ * Allocate [startofs, startofs + size) from the free block p, putting the
+ * remainders on either side back on the free lists.
+ */
 static struct mem_block *
 SliceBlock(struct mem_block *p, 
            unsigned startofs, unsigned size, 
            unsigned reserved, unsigned alignment)
 {
-   struct mem_block *newblock;
+   struct mem_heap *heap = mem_heap(p->heap);
+   struct mem_block *left = NULL, *right = NULL;
 
-   /* break left  [p, newblock, p->next], then p = newblock */
    if (startofs > p->ofs) {
-      newblock = (struct mem_block*) _mesa_calloc(sizeof(struct mem_block));
-      if (!newblock)
+      left = (struct mem_block *) _mesa_calloc(sizeof(struct mem_block));
+      if (!left)
+	 return NULL;
+   }
+   if (startofs + size < p->ofs + p->size) {
+      right = (struct mem_block *) _mesa_calloc(sizeof(struct mem_block));
+      if (!right) {
+         _mesa_free(left);
 	 return NULL;
-      newblock->ofs = startofs;
-      newblock->size = p->size - (startofs - p->ofs);
-      newblock->free = 1;
-      newblock->heap = p->heap;
-
-      newblock->next = p->next;
-      newblock->prev = p;
-      p->next->prev = newblock;
-      p->next = newblock;
-
-      newblock->next_free = p->next_free;
-      newblock->prev_free = p;
-      p->next_free->prev_free = newblock;
-      p->next_free = newblock;
-
-      p->size -= newblock->size;
-      p = newblock;
+      }
+   }
+
+   remove_free_block(heap, p);
+
+   /* break left  [p, newblock, p->next], then p = newblock */
+   if (left) {
+      left->ofs = startofs;
+      left->size = p->size - (startofs - p->ofs);
+      left->free = 1;
+      left->heap = p->heap;
+
+      left->next = p->next;
+      left->prev = p;
+      p->next->prev = left;
+      p->next = left;
+
+      p->size -= left->size;
+      insert_free_block(heap, p);
+      p = left;
    }
 
    /* break right, also [p, newblock, p->next] */
-   if (size < p->size) {
-      newblock = (struct mem_block*) _mesa_calloc(sizeof(struct mem_block));
-      if (!newblock)
-	 return NULL;
-      newblock->ofs = startofs + size;
-      newblock->size = p->size - size;
-      newblock->free = 1;
-      newblock->heap = p->heap;
-
-      newblock->next = p->next;
-      newblock->prev = p;
-      p->next->prev = newblock;
-      p->next = newblock;
-
-      newblock->next_free = p->next_free;
-      newblock->prev_free = p;
-      p->next_free->prev_free = newblock;
-      p->next_free = newblock;
+   if (right) {
+      right->ofs = startofs + size;
+      right->size = p->size - size;
+      right->free = 1;
+      right->heap = p->heap;
+
+      right->next = p->next;
+      right->prev = p;
+      p->next->prev = right;
+      p->next = right;
 	 
       p->size = size;
+      insert_free_block(heap, right);
    }
 
    /* p = middle block */
    p->free = 0;
-
-   /* Remove p from the free list: 
-    */
-   p->next_free->prev_free = p->prev_free;
-   p->prev_free->next_free = p->next_free;
-
-   p->next_free = 0;
-   p->prev_free = 0;
-
    p->reserved = reserved;
    return p;
 }
 
 
+/**
+ * Whether size bytes fit in the free block p with the given alignment,
+ * not before startSearch.
+ */
+static INLINE GLboolean
+BlockFits(const struct mem_block *p, unsigned size, unsigned mask,
+          unsigned startSearch, unsigned *startofs)
+{
+   *startofs = (p->ofs + mask) & ~mask;
+   if ( *startofs < startSearch ) {
+      *startofs = startSearch;
+   }
+   return *startofs + size <= p->ofs + p->size;
+}
+
+
 struct mem_block *
 mmAllocMem(struct mem_block *heap, unsigned size, unsigned align2, unsigned startSearch)
 {
+   struct mem_heap *h = mem_heap(heap);
    struct mem_block *p;
    const unsigned mask = (1 << align2)-1;
    unsigned startofs = 0;
-   unsigned endofs;
+   unsigned fl, sl, max_fl, max_sl;
 
    if (!heap || !size)
       return NULL;
 
-   for (p = heap->next_free; p != heap; p = p->next_free) {
-      assert(p->free);
-
-      startofs = (p->ofs + mask) & ~mask;
-      if ( startofs < startSearch ) {
-	 startofs = startSearch;
+   if (startSearch) {
+      for (p = heap->next; p != heap; p = p->next) {
+         if (p->free && BlockFits(p, size, mask, startSearch, &startofs))
+            return SliceBlock(p,startofs,size,0,mask+1);
       }
-      endofs = startofs+size;
-      if (endofs <= (p->ofs+p->size))
-	 break;
+      return NULL;
    }
 
-   if (p == heap) 
-      return NULL;
+   /* Good fit: any block big enough for the worst case alignment */
+   mapping_search(size + mask, &max_fl, &max_sl);
+   p = find_suitable_block(h, max_fl, max_sl);
+   if (p) {
+      assert(p->free);
+      BlockFits(p, size, mask, 0, &startofs);
+      return SliceBlock(p,startofs,size,0,mask+1);
+   }
 
-   assert(p->free);
-   p = SliceBlock(p,startofs,size,0,mask+1);
+   /* Otherwise only blocks in the classes between the requested size and
+    * the worst case may still fit with their actual alignment */
+   mapping_insert(size, &fl, &sl);
+   while (fl < max_fl || (fl == max_fl && sl < max_sl)) {
+      for (p = h->free_lists[fl][sl]; p; p = p->next_free) {
+         if (BlockFits(p, size, mask, 0, &startofs))
+            return SliceBlock(p,startofs,size,0,mask+1);
+      }
+      if (++sl == MM_SL_COUNT) {
+         sl = 0;
+         fl++;
+      }
+   }
 
-   return p;
+   return NULL;
 }
 
 
@@ -206,34 +393,12 @@ mmFindBlock(struct mem_block *heap, unsigned start)
 }
 
 
-static INLINE int
-Join2Blocks(struct mem_block *p)
-{
-   /* XXX there should be some assertions here */
-
-   /* NOTE: heap->free == 0 */
-
-   if (p->free && p->next->free) {
-      struct mem_block *q = p->next;
-
-      assert(p->ofs + p->size == q->ofs);
-      p->size += q->size;
-
-      p->next = q->next;
-      q->next->prev = p;
-
-      q->next_free->prev_free = q->prev_free; 
-      q->prev_free->next_free = q->next_free;
-     
-      _mesa_free(q);
-      return 1;
-   }
-   return 0;
-}
-
 int
 mmFreeMem(struct mem_block *b)
 {
+   struct mem_heap *heap;
+   struct mem_block *q;
+
    if (!b)
       return 0;
 
@@ -246,15 +411,32 @@ mmFreeMem(struct mem_block *b)
       return -1;
    }
 
+   heap = mem_heap(b->heap);
    b->free = 1;
-   b->next_free = b->heap->next_free;
-   b->prev_free = b->heap;
-   b->next_free->prev_free = b;
-   b->prev_free->next_free = b;
 
-   Join2Blocks(b);
-   if (b->prev != b->heap)
-      Join2Blocks(b->prev);
+   /* Coalesce with the neighbours.  NOTE: heap->free == 0 */
+   q = b->next;
+   if (q->free) {
+      assert(b->ofs + b->size == q->ofs);
+      remove_free_block(heap, q);
+      b->size += q->size;
+      b->next = q->next;
+      q->next->prev = b;
+      _mesa_free(q);
+   }
+
+   q = b->prev;
+   if (q->free) {
+      assert(q->ofs + q->size == b->ofs);
+      remove_free_block(heap, q);
+      q->size += b->size;
+      q->next = b->next;
+      b->next->prev = q;
+      _mesa_free(b);
+      b = q;
+   }
+
+   insert_free_block(heap, b);
 
    return 0;
 }
@@ -274,5 +456,5 @@ mmDestroy(struct mem_block *heap)
       p = next;
    }
 
-   _mesa_free(heap);
+   _mesa_free(mem_heap(heap));
 }
@@ -822,6 +822,12 @@ struct gl_list_instruction
    void (*Execute)( GLcontext *ctx, void *data );
    void (*Destroy)( GLcontext *ctx, void *data );
    void (*Print)( GLcontext *ctx, void *data );
+   /**
+    * Optional.  Called at glEndList with 'count' adjacent instructions
+    * of this opcode, may combine a leading run of them into 'dst'.
+    * Returns how many were combined; the list then destroys them.
+    */
+   GLuint (*Merge)( GLcontext *ctx, void *dst, void **src, GLuint count );
 };
 
 #define MAX_DLIST_EXT_OPCODES 16
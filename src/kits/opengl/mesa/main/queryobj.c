@@ -349,7 +349,7 @@ _mesa_GetQueryivARB(GLenum target, GLenum pname, GLint *params)
    switch (target) {
       case GL_SAMPLES_PASSED_ARB:
          if (!ctx->Extensions.ARB_occlusion_query) {
-            _mesa_error(ctx, GL_INVALID_ENUM, "glEndQueryARB(target)");
+            _mesa_error(ctx, GL_INVALID_ENUM, "glGetQueryivARB(target)");
             return;
          }
          q = ctx->Query.CurrentOcclusionObject;
@@ -357,7 +357,7 @@ _mesa_GetQueryivARB(GLenum target, GLenum pname, GLint *params)
 #if FEATURE_EXT_timer_query
       case GL_TIME_ELAPSED_EXT:
          if (!ctx->Extensions.EXT_timer_query) {
-            _mesa_error(ctx, GL_INVALID_ENUM, "glEndQueryARB(target)");
+            _mesa_error(ctx, GL_INVALID_ENUM, "glGetQueryivARB(target)");
             return;
          }
          q = ctx->Query.CurrentTimerObject;
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file threadpool.c
+ * Worker thread pool shared by tnl and swrast.
+ */
+
+#include "main/glheader.h"
+#include "main/imports.h"
+#include "main/threadpool.h"
+
+#include "pipe/p_thread.h"
+
+
+#ifdef PIPE_THREAD_HAVE_CONDVAR
+
+#include <unistd.h>
+
+
+struct mesa_threadpool_worker {
+   struct mesa_threadpool *pool;
+   GLuint index;
+   pipe_thread thread;
+};
+
+
+struct mesa_threadpool {
+   pipe_mutex mutex;
+   pipe_condvar work_cond;	/**< signalled when a job is posted */
+   pipe_condvar done_cond;	/**< signalled when a job is finished */
+   struct mesa_threadpool_worker *worker;
+   GLuint size;
+   GLboolean quit;
+
+   /* The current job, protected by mutex:
+    */
+   mesa_task_func func;
+   void *data;
+   GLuint nr_tasks;
+   GLuint next_task;		/**< next task to hand out */
+   GLuint pending;		/**< tasks not finished yet */
+   GLuint job;			/**< bumped for every job */
+};
+
+
+/**
+ * Run tasks of the current job until there are none left.  Called
+ * with the mutex held, returns with it held.
+ */
+static void
+run_pending_tasks( struct mesa_threadpool *pool, GLuint thread )
+{
+   while (pool->next_task < pool->nr_tasks) {
+      const GLuint task = pool->next_task++;
+
+      pipe_mutex_unlock(pool->mutex);
+      pool->func(pool->data, task, thread);
+      pipe_mutex_lock(pool->mutex);
+
+      if (--pool->pending == 0)
+	 pipe_condvar_signal(pool->done_cond);
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( worker_thread, param )
+{
+   struct mesa_threadpool_worker *worker =
+      (struct mesa_threadpool_worker *) param;
+   struct mesa_threadpool *pool = worker->pool;
+   GLuint job = 0;
+
+   pipe_mutex_lock(pool->mutex);
+
+   for (;;) {
+      unsigned short __tmp;
+
+      while (!pool->quit && pool->job == job)
+	 pipe_condvar_wait(pool->work_cond, pool->mutex);
+
+      if (pool->quit)
+	 break;
+
+      job = pool->job;
+
+      START_FAST_MATH(__tmp);
+      run_pending_tasks(pool, worker->index);
+      END_FAST_MATH(__tmp);
+   }
+
+   pipe_mutex_unlock(pool->mutex);
+   return NULL;
+}
+
+
+/**
+ * Pools are off unless env asks for them, "auto" uses one worker per
+ * extra CPU.
+ */
+static GLuint
+default_thread_count( const char *env )
+{
+   const char *value = _mesa_getenv(env);
+   long cpus = 1;
+
+   if (!value)
+      return 0;
+
+   if (_mesa_strcmp(value, "auto") != 0)
+      return _mesa_atoi(value);
+
+#ifdef _SC_NPROCESSORS_ONLN
+   cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+   return cpus > 1 ? (GLuint) cpus - 1 : 0;
+}
+
+
+/**
+ * Start a pool of up to max_threads workers, as many as the environment
+ * variable env asks for.  Returns NULL if it is unset or no worker could
+ * be started.
+ */
+struct mesa_threadpool *
+_mesa_create_threadpool( const char *env, GLuint max_threads )
+{
+   struct mesa_threadpool *pool;
+   GLuint nr_threads = default_thread_count(env);
+   GLuint i;
+
+   if (nr_threads > max_threads)
+      nr_threads = max_threads;
+   if (nr_threads == 0)
+      return NULL;
+
+   pool = CALLOC_STRUCT(mesa_threadpool);
+   if (!pool)
+      return NULL;
+
+   pool->worker = (struct mesa_threadpool_worker *)
+      CALLOC(nr_threads * sizeof(struct mesa_threadpool_worker));
+   if (!pool->worker) {
+      FREE(pool);
+      return NULL;
+   }
+
+   pipe_mutex_init(pool->mutex);
+   pipe_condvar_init(pool->work_cond);
+   pipe_condvar_init(pool->done_cond);
+
+   for (i = 0; i < nr_threads; i++) {
+      pool->worker[i].pool = pool;
+      pool->worker[i].index = i;
+      pool->worker[i].thread = pipe_thread_create(worker_thread,
+						  &pool->worker[i]);
+      if (!pool->worker[i].thread)
+	 break;
+   }
+
+   pool->size = i;
+
+   if (pool->size == 0) {
+      _mesa_destroy_threadpool(pool);
+      return NULL;
+   }
+
+   return pool;
+}
+
+
+void
+_mesa_destroy_threadpool( struct mesa_threadpool *pool )
+{
+   GLuint i;
+
+   if (!pool)
+      return;
+
+   pipe_mutex_lock(pool->mutex);
+   pool->quit = GL_TRUE;
+   pipe_condvar_broadcast(pool->work_cond);
+   pipe_mutex_unlock(pool->mutex);
+
+   for (i = 0; i < pool->size; i++)
+      pipe_thread_wait(pool->worker[i].thread);
+
+   pipe_condvar_destroy(pool->done_cond);
+   pipe_condvar_destroy(pool->work_cond);
+   pipe_mutex_destroy(pool->mutex);
+   FREE(pool->worker);
+   FREE(pool);
+}
+
+
+/**
+ * Number of workers; the calling thread of _mesa_threadpool_run() gets
+ * this as its thread index.
+ */
+GLuint
+_mesa_threadpool_size( const struct mesa_threadpool *pool )
+{
+   return pool ? pool->size : 0;
+}
+
+
+/**
+ * Call func for tasks [0, nr_tasks) on the workers and the calling
+ * thread.  Returns when all are done.  Only one job can run on a pool
+ * at a time.
+ */
+void
+_mesa_threadpool_run( struct mesa_threadpool *pool, GLuint nr_tasks,
+		      mesa_task_func func, void *data )
+{
+   GLuint i;
+
+   if (!pool || nr_tasks <= 1) {
+      for (i = 0; i < nr_tasks; i++)
+	 func(data, i, _mesa_threadpool_size(pool));
+      return;
+   }
+
+   pipe_mutex_lock(pool->mutex);
+
+   pool->func = func;
+   pool->data = data;
+   pool->nr_tasks = nr_tasks;
+   pool->next_task = 0;
+   pool->pending = nr_tasks;
+   pool->job++;
+   pipe_condvar_broadcast(pool->work_cond);
+
+   run_pending_tasks(pool, pool->size);
+
+   while (pool->pending)
+      pipe_condvar_wait(pool->done_cond, pool->mutex);
+
+   pool->func = NULL;
+   pool->data = NULL;
+   pool->nr_tasks = 0;
+   pool->next_task = 0;
+
+   pipe_mutex_unlock(pool->mutex);
+}
+
+
+#else /* !PIPE_THREAD_HAVE_CONDVAR */
+
+
+struct mesa_threadpool *
+_mesa_create_threadpool( const char *env, GLuint max_threads )
+{
+   (void) env;
+   (void) max_threads;
+   return NULL;
+}
+
+
+void
+_mesa_destroy_threadpool( struct mesa_threadpool *pool )
+{
+   (void) pool;
+}
+
+
+GLuint
+_mesa_threadpool_size( const struct mesa_threadpool *pool )
+{
+   (void) pool;
+   return 0;
+}
+
+
+void
+_mesa_threadpool_run( struct mesa_threadpool *pool, GLuint nr_tasks,
+		      mesa_task_func func, void *data )
+{
+   GLuint i;
+
+   (void) pool;
+   for (i = 0; i < nr_tasks; i++)
+      func(data, i, 0);
+}
+
+
+#endif
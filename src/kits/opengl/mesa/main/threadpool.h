@@ -0,0 +1,48 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file threadpool.h
+ * A small pool of worker threads which run the tasks of one job at a
+ * time together with the calling thread.
+ *
+ * Used by tnl to transform vertex chunks and by swrast to render screen
+ * bands.  Pools are opt-in: the environment variable given to
+ * _mesa_create_threadpool() sets the number of workers, "auto" uses the
+ * number of CPUs minus one.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "main/glheader.h"
+
+
+struct mesa_threadpool;
+
+
+/**
+ * Run task number task of a job.  thread is the index of the worker
+ * running it, or the pool size for the calling thread, for per-thread
+ * storage.
+ */
+typedef void (*mesa_task_func)( void *data, GLuint task, GLuint thread );
+
+
+extern struct mesa_threadpool *
+_mesa_create_threadpool( const char *env, GLuint max_threads );
+
+extern void
+_mesa_destroy_threadpool( struct mesa_threadpool *pool );
+
+extern GLuint
+_mesa_threadpool_size( const struct mesa_threadpool *pool );
+
+extern void
+_mesa_threadpool_run( struct mesa_threadpool *pool, GLuint nr_tasks,
+                      mesa_task_func func, void *data );
+
+
+#endif
@@ -38,6 +38,7 @@
  */
 #if defined(__GNUC__) && \
     ((defined(__i386__) && defined(USE_X86_ASM)) || \
+     (defined(__x86_64__) && defined(USE_X86_64_ASM)) || \
      (defined(__sparc__) && defined(USE_SPARC_ASM)))
 #define  RUN_DEBUG_BENCHMARK
 #endif
@@ -38,6 +38,8 @@ struct cache_item
    GLuint hash;
    void *key;
    struct gl_program *program;
+   void *data;                  /**< driver data derived from program */
+   gl_program_cache_data_func delete_data;
    struct cache_item *next;
 };
 
@@ -115,6 +117,8 @@ clear_cache(GLcontext *ctx, struct gl_program_cache *cache)
       for (c = cache->items[i]; c; c = next) {
 	 next = c->next;
 	 _mesa_free(c->key);
+         if (c->delete_data)
+            c->delete_data(ctx, c->data);
          _mesa_reference_program(ctx, &c->program, NULL);
 	 _mesa_free(c);
       }
@@ -153,13 +157,22 @@ _mesa_delete_program_cache(GLcontext *ctx, struct gl_program_cache *cache)
 }
 
 
-struct gl_program *
-_mesa_search_program_cache(struct gl_program_cache *cache,
-                           const void *key, GLuint keysize)
+/**
+ * Remove all entries from the cache.
+ */
+void
+_mesa_clear_program_cache(GLcontext *ctx, struct gl_program_cache *cache)
+{
+   clear_cache(ctx, cache);
+}
+
+
+static struct cache_item *
+search_cache(struct gl_program_cache *cache, const void *key, GLuint keysize)
 {
    if (cache->last && 
        memcmp(cache->last->key, key, keysize) == 0) {
-      return cache->last->program;
+      return cache->last;
    }
    else {
       const GLuint hash = hash_key(key, keysize);
@@ -168,7 +181,7 @@ _mesa_search_program_cache(struct gl_program_cache *cache,
       for (c = cache->items[hash % cache->size]; c; c = c->next) {
          if (c->hash == hash && memcmp(c->key, key, keysize) == 0) {
             cache->last = c;
-            return c->program;
+            return c;
          }
       }
 
@@ -177,11 +190,51 @@ _mesa_search_program_cache(struct gl_program_cache *cache,
 }
 
 
+struct gl_program *
+_mesa_search_program_cache(struct gl_program_cache *cache,
+                           const void *key, GLuint keysize)
+{
+   struct cache_item *c = search_cache(cache, key, keysize);
+   return c ? c->program : NULL;
+}
+
+
+/**
+ * Like _mesa_search_program_cache() but return the data which was
+ * stored with _mesa_program_cache_insert_data().
+ */
+void *
+_mesa_search_program_cache_data(struct gl_program_cache *cache,
+                                const void *key, GLuint keysize)
+{
+   struct cache_item *c = search_cache(cache, key, keysize);
+   return c ? c->data : NULL;
+}
+
+
 void
 _mesa_program_cache_insert(GLcontext *ctx,
                            struct gl_program_cache *cache,
                            const void *key, GLuint keysize,
                            struct gl_program *program)
+{
+   _mesa_program_cache_insert_data(ctx, cache, key, keysize, program,
+                                   NULL, NULL);
+}
+
+
+/**
+ * Insert program along with some data derived from it, such as
+ * generated code.  delete_data (if not NULL) is called to free the data
+ * when the entry is removed from the cache.
+ */
+void
+_mesa_program_cache_insert_data(GLcontext *ctx,
+                                struct gl_program_cache *cache,
+                                const void *key, GLuint keysize,
+                                struct gl_program *program,
+                                void *data,
+                                gl_program_cache_data_func delete_data)
 {
    const GLuint hash = hash_key(key, keysize);
    struct cache_item *c = CALLOC_STRUCT(cache_item);
@@ -192,6 +245,8 @@ _mesa_program_cache_insert(GLcontext *ctx,
    memcpy(c->key, key, keysize);
 
    c->program = program;  /* no refcount change */
+   c->data = data;
+   c->delete_data = delete_data;
 
    if (cache->n_items > cache->size * 1.5) {
       if (cache->size < 1000)
@@ -33,6 +33,9 @@
 /** Opaque type */
 struct gl_program_cache;
 
+/** Called to free the data stored with a cache entry */
+typedef void (*gl_program_cache_data_func)(GLcontext *ctx, void *data);
+
 
 extern struct gl_program_cache *
 _mesa_new_program_cache(void);
@@ -41,6 +44,10 @@ extern void
 _mesa_delete_program_cache(GLcontext *ctx, struct gl_program_cache *pc);
 
 
+extern void
+_mesa_clear_program_cache(GLcontext *ctx, struct gl_program_cache *cache);
+
+
 extern struct gl_program *
 _mesa_search_program_cache(struct gl_program_cache *cache,
                            const void *key, GLuint keysize);
@@ -52,4 +59,17 @@ _mesa_program_cache_insert(GLcontext *ctx,
                            struct gl_program *program);
 
 
+extern void *
+_mesa_search_program_cache_data(struct gl_program_cache *cache,
+                                const void *key, GLuint keysize);
+
+extern void
+_mesa_program_cache_insert_data(GLcontext *ctx,
+                                struct gl_program_cache *cache,
+                                const void *key, GLuint keysize,
+                                struct gl_program *program,
+                                void *data,
+                                gl_program_cache_data_func delete_data);
+
+
 #endif /* PROG_CACHE_H */
@@ -38,6 +38,7 @@
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_inlines.h"
+#include "util/u_debug.h"
 
 #include "st_context.h"
 #include "st_atom.h"
@@ -46,9 +47,60 @@
 #include "st_inlines.h"
 
 
+/**
+ * Get a constant buffer of the given size that the pipe isn't using,
+ * recycling one from the pool if possible.
+ */
+static struct pipe_buffer *
+get_constant_buffer(struct st_context *st, uint size)
+{
+   struct pipe_context *pipe = st->pipe;
+   struct pipe_buffer **pool = st->constants.pool;
+   uint i;
+
+   for (i = 0; i < ST_CONSTANT_POOL_SIZE; i++) {
+      struct pipe_buffer *buf = pool[i];
+
+      if (buf && buf->size == size &&
+          p_atomic_read(&buf->reference.count) == 1 &&
+          pipe->is_buffer_referenced(pipe, buf) == PIPE_UNREFERENCED) {
+         memmove(pool + i, pool + i + 1,
+                 (ST_CONSTANT_POOL_SIZE - i - 1) * sizeof(pool[0]));
+         pool[ST_CONSTANT_POOL_SIZE - 1] = NULL;
+         return buf;
+      }
+   }
+
+   return pipe_buffer_create(pipe->screen, 16,
+                             PIPE_BUFFER_USAGE_CONSTANT, size);
+}
+
+
+/**
+ * Move a buffer that is being replaced into the pool, taking over the
+ * caller's reference.  The oldest pooled buffer is dropped.
+ */
+static void
+release_constant_buffer(struct st_context *st, struct pipe_buffer **buf)
+{
+   struct pipe_buffer **pool = st->constants.pool;
+
+   pipe_buffer_reference(&pool[ST_CONSTANT_POOL_SIZE - 1], NULL);
+   memmove(pool + 1, pool, (ST_CONSTANT_POOL_SIZE - 1) * sizeof(pool[0]));
+   pool[0] = *buf;
+   *buf = NULL;
+}
+
+
 /**
  * Pass the given program parameters to the graphics pipe as a
  * constant buffer.
+ *
+ * A copy of what was last written to each constant buffer is kept, so
+ * that only the range of parameters which actually changed is written.
+ * The buffer is updated in place when the pipe isn't using it anymore,
+ * otherwise a new (or recycled) one is filled.
+ *
  * \param shader_type  either PIPE_SHADER_VERTEX or PIPE_SHADER_FRAGMENT
  */
 void st_upload_constants( struct st_context *st,
@@ -63,18 +115,13 @@ void st_upload_constants( struct st_context *st,
 
    /* update constants */
    if (params && params->NumParameters) {
-      const uint paramBytes = params->NumParameters * sizeof(GLfloat) * 4;
+      const uint numParams = params->NumParameters;
+      const uint paramBytes = numParams * sizeof(GLfloat) * 4;
+      GLfloat (*shadow)[4];
+      uint first, last;
 
       _mesa_load_state_parameters(st->ctx, params);
 
-      /* We always need to get a new buffer, to keep the drivers simple and
-       * avoid gratuitous rendering synchronization.
-       */
-      pipe_buffer_reference(&cbuf->buffer, NULL );
-      cbuf->buffer = pipe_buffer_create(pipe->screen, 16,
-                                        PIPE_BUFFER_USAGE_CONSTANT,
-					paramBytes );
-
       if (0) {
 	 debug_printf("%s(shader=%d, numParams=%d, stateFlags=0x%x)\n", 
                       __FUNCTION__, shader_type, params->NumParameters,
@@ -82,11 +129,65 @@ void st_upload_constants( struct st_context *st,
          _mesa_print_parameter_list(params);
       }
 
+      if (st->constants.shadow_size[shader_type] < numParams) {
+         _mesa_free(st->constants.shadow[shader_type]);
+         st->constants.shadow[shader_type] = _mesa_malloc(paramBytes);
+         st->constants.shadow_size[shader_type] =
+            st->constants.shadow[shader_type] ? numParams : 0;
+      }
+      shadow = st->constants.shadow[shader_type];
+
+      st->constants.bytes_total += paramBytes;
+
+      if (shadow && cbuf->buffer && cbuf->buffer->size == paramBytes) {
+         /* The shadow holds the buffer contents, find what changed */
+         for (first = 0; first < numParams; first++) {
+            if (memcmp(shadow[first], params->ParameterValues[first],
+                       4 * sizeof(GLfloat)) != 0)
+               break;
+         }
+
+         /* Nothing changed, the bound buffer is still good */
+         if (first == numParams)
+            return;
+
+         for (last = numParams - 1; last > first; last--) {
+            if (memcmp(shadow[last], params->ParameterValues[last],
+                       4 * sizeof(GLfloat)) != 0)
+               break;
+         }
+
+         /* We don't want to wait for rendering which still uses the
+          * buffer, write the whole thing to another one instead.
+          */
+         if (pipe->is_buffer_referenced(pipe, cbuf->buffer) !=
+             PIPE_UNREFERENCED) {
+            release_constant_buffer(st, &cbuf->buffer);
+            cbuf->buffer = get_constant_buffer(st, paramBytes);
+            first = 0;
+            last = numParams - 1;
+         }
+      }
+      else {
+         if (cbuf->buffer)
+            release_constant_buffer(st, &cbuf->buffer);
+         cbuf->buffer = get_constant_buffer(st, paramBytes);
+         first = 0;
+         last = numParams - 1;
+      }
+
       /* load Mesa constants into the constant buffer */
-      if (cbuf->buffer)
-         st_no_flush_pipe_buffer_write(st, cbuf->buffer,
-				       0, paramBytes,
-				       params->ParameterValues);
+      if (cbuf->buffer) {
+         const uint offset = first * sizeof(GLfloat) * 4;
+         const uint size = (last - first + 1) * sizeof(GLfloat) * 4;
+
+         st_no_flush_pipe_buffer_write(st, cbuf->buffer, offset, size,
+                                       params->ParameterValues[first]);
+         if (shadow)
+            memcpy(shadow[first], params->ParameterValues[first], size);
+
+         st->constants.bytes_uploaded += size;
+      }
 
       st->pipe->set_constant_buffer(st->pipe, shader_type, 0, cbuf);
    }
@@ -96,6 +197,31 @@ void st_upload_constants( struct st_context *st,
 }
 
 
+void st_destroy_constants( struct st_context *st )
+{
+   uint i;
+
+   if (debug_get_bool_option("ST_CONSTANT_STATS", FALSE)) {
+      debug_printf("st: constants: %llu bytes uploaded, %llu bytes without "
+                   "diffing\n",
+                   (unsigned long long) st->constants.bytes_uploaded,
+                   (unsigned long long) st->constants.bytes_total);
+   }
+
+   for (i = 0; i < Elements(st->state.constants); i++)
+      pipe_buffer_reference(&st->state.constants[i].buffer, NULL);
+
+   for (i = 0; i < PIPE_SHADER_TYPES; i++) {
+      _mesa_free(st->constants.shadow[i]);
+      st->constants.shadow[i] = NULL;
+      st->constants.shadow_size[i] = 0;
+   }
+
+   for (i = 0; i < ST_CONSTANT_POOL_SIZE; i++)
+      pipe_buffer_reference(&st->constants.pool[i], NULL);
+}
+
+
 /**
  * Vertex shader:
  */
@@ -34,5 +34,7 @@ void st_upload_constants( struct st_context *st,
                           struct gl_program_parameter_list *params,
                           unsigned id);
 
+void st_destroy_constants( struct st_context *st );
+
 
 #endif /* ST_ATOM_CONSTBUF_H */
@@ -45,9 +45,16 @@
 #include "pipe/p_context.h"
 #include "pipe/p_shader_tokens.h"
 
+#include "util/u_debug.h"
+#include "util/u_hash.h"
 #include "util/u_simple_shaders.h"
 
+#include "tgsi/tgsi_parse.h"
+
 #include "cso_cache/cso_context.h"
+#if FEATURE_feedback || FEATURE_drawpix
+#include "draw/draw_context.h"
+#endif
 
 #include "st_context.h"
 #include "st_atom.h"
@@ -56,32 +63,175 @@
 #include "st_mesa_to_tgsi.h"
 
 
+/** Default limit on the memory used by the variants of a vertex program */
+#define ST_VP_VARIANT_CACHE_SIZE (256 * 1024)
+
+
 /**
- * This represents a vertex program, especially translated to match
- * the inputs of a particular fragment shader.
+ * The way a vertex program's outputs are linked to the fragment program
+ * inputs.  Any fragment program needing the same linkage can share the
+ * translation.
  */
-struct translated_vertex_program
+struct st_vp_variant_key
 {
-   struct st_vertex_program *master;
-
-   /** The fragment shader "signature" this vertex shader is meant for: */
-   GLbitfield frag_inputs;
-
-   /** Compared against master vertex program's serialNo: */
-   GLuint serialNo;
-
    /** Maps VERT_RESULT_x to slot */
    GLuint output_to_slot[VERT_RESULT_MAX];
    ubyte output_to_semantic_name[VERT_RESULT_MAX];
    ubyte output_to_semantic_index[VERT_RESULT_MAX];
+};
 
-   /** Pointer to the translated vertex program */
-   struct st_vertex_program *vp;
 
-   struct translated_vertex_program *next;  /**< next in linked list */
+/**
+ * A vertex program translated for a particular linkage.
+ *
+ * Variants belong to their vertex program, not to a context, so every
+ * context sharing the program sees them go when it is deleted or its
+ * code changes.
+ */
+struct st_vp_variant
+{
+   struct st_vp_variant_key key;
+   unsigned hash;         /**< of key */
+
+   struct pipe_shader_state state;
+   void *driver_shader;
+
+   /** Approximate memory used, for the cache limit */
+   unsigned size;
+
+   /** Next in st_vertex_program::variants, most recently used first */
+   struct st_vp_variant *next;
 };
 
 
+/**
+ * Stop using a variant as the vertex program's current translation.
+ */
+static void
+unset_current_vp_variant(struct st_context *st,
+                         struct st_vertex_program *stvp)
+{
+   if (stvp->draw_shader) {
+#if FEATURE_feedback || FEATURE_drawpix
+      /* this would only have been allocated for the RasterPos path */
+      draw_delete_vertex_shader(st->draw, stvp->draw_shader);
+      stvp->draw_shader = NULL;
+#endif
+   }
+
+   stvp->state.tokens = NULL;
+   stvp->driver_shader = NULL;
+   stvp->variant = NULL;
+}
+
+
+/**
+ * Make a variant the vertex program's current translation.  The
+ * program's state and driver_shader point to the variant's, which
+ * remains their owner.
+ */
+static void
+set_current_vp_variant(struct st_context *st,
+                       struct st_vertex_program *stvp,
+                       struct st_vp_variant *variant)
+{
+   if (stvp->variant == variant)
+      return;
+
+   if (stvp->variant)
+      unset_current_vp_variant(st, stvp);
+
+   stvp->state = variant->state;
+   stvp->driver_shader = variant->driver_shader;
+   stvp->variant = variant;
+}
+
+
+/**
+ * Free a variant which was already unlinked from the program's list.
+ */
+static void
+destroy_vp_variant(struct st_context *st,
+                   struct st_vertex_program *stvp,
+                   struct st_vp_variant *variant)
+{
+   if (stvp->variant == variant)
+      unset_current_vp_variant(st, stvp);
+
+   stvp->variants_size -= variant->size;
+
+   if (variant->driver_shader)
+      cso_delete_vertex_shader(st->cso_context, variant->driver_shader);
+   _mesa_free((void *) variant->state.tokens);
+   _mesa_free(variant);
+}
+
+
+/**
+ * Evict least recently used variants until the program's variants fit
+ * the limit.  The variant in use is never evicted.
+ */
+static void
+evict_vp_variants(struct st_context *st, struct st_vertex_program *stvp)
+{
+   struct st_vp_variant **prev = &stvp->variants;
+   unsigned size = 0;
+
+   while (*prev && stvp->variants_size > st->vp_variants.max_size) {
+      struct st_vp_variant *variant = *prev;
+
+      size += variant->size;
+
+      if (size > st->vp_variants.max_size && variant != stvp->variant) {
+         *prev = variant->next;
+         size -= variant->size;
+         destroy_vp_variant(st, stvp, variant);
+         st->vp_variants.evictions++;
+      }
+      else {
+         prev = &variant->next;
+      }
+   }
+}
+
+
+/**
+ * Free all the variants of a vertex program, when it's deleted or its
+ * code changes.
+ */
+void
+st_release_vp_variants(struct st_context *st,
+                       struct st_vertex_program *stvp)
+{
+   while (stvp->variants) {
+      struct st_vp_variant *variant = stvp->variants;
+
+      stvp->variants = variant->next;
+      destroy_vp_variant(st, stvp, variant);
+   }
+}
+
+
+void
+st_init_vp_variants(struct st_context *st)
+{
+   st->vp_variants.max_size = debug_get_num_option("ST_SHADER_CACHE_SIZE",
+                                                   ST_VP_VARIANT_CACHE_SIZE);
+}
+
+
+void
+st_print_vp_variant_stats(struct st_context *st)
+{
+   if (debug_get_bool_option("ST_SHADER_CACHE_STATS", FALSE)) {
+      debug_printf("st: vertex program variants: %u hits, %u misses, "
+                   "%u evictions\n",
+                   st->vp_variants.hits, st->vp_variants.misses,
+                   st->vp_variants.evictions);
+   }
+}
+
+
 
 /**
  * Given a vertex program output attribute, return the corresponding
@@ -115,18 +265,143 @@ vp_out_to_fp_in(GLuint vertResult)
 }
 
 
+/**
+ * Compute how the outputs of stvp are linked to stfp's inputs.
+ */
+static void
+compute_vp_variant_key(struct st_vertex_program *stvp,
+                       struct st_fragment_program *stfp,
+                       struct st_vp_variant_key *key)
+{
+   static const GLuint UNUSED = ~0;
+   GLuint outAttr;
+   const GLbitfield outputsWritten = stvp->Base.Base.OutputsWritten;
+   GLuint numVpOuts = 0;
+   GLboolean emitPntSize = GL_FALSE, emitBFC0 = GL_FALSE, emitBFC1 = GL_FALSE;
+   GLbitfield usedGenerics = 0x0;
+   GLbitfield usedOutputSlots = 0x0;
+
+   /* Compute mapping of vertex program outputs to slots, which depends
+    * on the fragment program's input->slot mapping.
+    */
+   for (outAttr = 0; outAttr < VERT_RESULT_MAX; outAttr++) {
+      /* set defaults: */
+      key->output_to_slot[outAttr] = UNUSED;
+      key->output_to_semantic_name[outAttr] = TGSI_SEMANTIC_COUNT;
+      key->output_to_semantic_index[outAttr] = 99;
+
+      if (outAttr == VERT_RESULT_HPOS) {
+         /* always put xformed position into slot zero */
+         GLuint slot = 0;
+         key->output_to_slot[VERT_RESULT_HPOS] = slot;
+         key->output_to_semantic_name[outAttr] = TGSI_SEMANTIC_POSITION;
+         key->output_to_semantic_index[outAttr] = 0;
+         numVpOuts++;
+         usedOutputSlots |= (1 << slot);
+      }
+      else if (outputsWritten & (1 << outAttr)) {
+         /* see if the frag prog wants this vert output */
+         GLint fpInAttrib = vp_out_to_fp_in(outAttr);
+         if (fpInAttrib >= 0) {
+            GLuint fpInSlot = stfp->input_to_slot[fpInAttrib];
+            if (fpInSlot != ~0) {
+               /* match this vp output to the fp input */
+               GLuint vpOutSlot = stfp->input_map[fpInSlot];
+               key->output_to_slot[outAttr] = vpOutSlot;
+               key->output_to_semantic_name[outAttr] = stfp->input_semantic_name[fpInSlot];
+               key->output_to_semantic_index[outAttr] = stfp->input_semantic_index[fpInSlot];
+               numVpOuts++;
+               usedOutputSlots |= (1 << vpOutSlot);
+            }
+            else {
+#if 0 /*debug*/
+               printf("VP output %d not used by FP\n", outAttr);
+#endif
+            }
+         }
+         else if (outAttr == VERT_RESULT_PSIZ)
+            emitPntSize = GL_TRUE;
+         else if (outAttr == VERT_RESULT_BFC0)
+            emitBFC0 = GL_TRUE;
+         else if (outAttr == VERT_RESULT_BFC1)
+            emitBFC1 = GL_TRUE;
+      }
+#if 0 /*debug*/
+      printf("assign vp output_to_slot[%d] = %d\n", outAttr, 
+             key->output_to_slot[outAttr]);
+#endif
+   }
+
+   /* must do these last */
+   if (emitPntSize) {
+      GLuint slot = numVpOuts++;
+      key->output_to_slot[VERT_RESULT_PSIZ] = slot;
+      key->output_to_semantic_name[VERT_RESULT_PSIZ] = TGSI_SEMANTIC_PSIZE;
+      key->output_to_semantic_index[VERT_RESULT_PSIZ] = 0;
+      usedOutputSlots |= (1 << slot);
+   }
+   if (emitBFC0) {
+      GLuint slot = numVpOuts++;
+      key->output_to_slot[VERT_RESULT_BFC0] = slot;
+      key->output_to_semantic_name[VERT_RESULT_BFC0] = TGSI_SEMANTIC_COLOR;
+      key->output_to_semantic_index[VERT_RESULT_BFC0] = 0;
+      usedOutputSlots |= (1 << slot);
+   }
+   if (emitBFC1) {
+      GLuint slot = numVpOuts++;
+      key->output_to_slot[VERT_RESULT_BFC1] = slot;
+      key->output_to_semantic_name[VERT_RESULT_BFC1] = TGSI_SEMANTIC_COLOR;
+      key->output_to_semantic_index[VERT_RESULT_BFC1] = 1;
+      usedOutputSlots |= (1 << slot);
+   }
+
+   /* build usedGenerics mask */
+   usedGenerics = 0x0;
+   for (outAttr = 0; outAttr < VERT_RESULT_MAX; outAttr++) {
+      if (key->output_to_semantic_name[outAttr] == TGSI_SEMANTIC_GENERIC) {
+         usedGenerics |= (1 << key->output_to_semantic_index[outAttr]);
+      }
+   }
+
+   /* For each vertex program output that doesn't match up to a fragment
+    * program input, map the vertex program output to a free slot and
+    * free generic attribute.
+    */
+   for (outAttr = 0; outAttr < VERT_RESULT_MAX; outAttr++) {
+      if (outputsWritten & (1 << outAttr)) {
+         if (key->output_to_slot[outAttr] == UNUSED) {
+            GLint freeGeneric = _mesa_ffs(~usedGenerics) - 1;
+            GLint freeSlot = _mesa_ffs(~usedOutputSlots) - 1;
+            usedGenerics |= (1 << freeGeneric);
+            usedOutputSlots |= (1 << freeSlot);
+            key->output_to_slot[outAttr] = freeSlot;
+            key->output_to_semantic_name[outAttr] = TGSI_SEMANTIC_GENERIC;
+            key->output_to_semantic_index[outAttr] = freeGeneric;
+         }
+      }
+
+#if 0 /*debug*/
+      printf("vp output_to_slot[%d] = %d\n", outAttr, 
+             key->output_to_slot[outAttr]);
+#endif
+   }
+}
+
+
 /**
  * Find a translated vertex program that corresponds to stvp and
  * has outputs matched to stfp's inputs.
  * This performs vertex and fragment translation (to TGSI) when needed.
  */
-static struct translated_vertex_program *
+static struct st_vp_variant *
 find_translated_vp(struct st_context *st,
                    struct st_vertex_program *stvp,
                    struct st_fragment_program *stfp)
 {
    static const GLuint UNUSED = ~0;
-   struct translated_vertex_program *xvp;
+   struct st_vp_variant_key key;
+   struct st_vp_variant *variant, **prev;
+   unsigned hash;
    const GLbitfield fragInputsRead = stfp->Base.Base.InputsRead;
 
    /*
@@ -153,167 +428,61 @@ find_translated_vp(struct st_context *st,
    }
 
 
-   /* See if we've got a translated vertex program whose outputs match
-    * the fragment program's inputs.
-    * XXX This could be a hash lookup, using InputsRead as the key.
-    */
-   for (xvp = stfp->vertex_programs; xvp; xvp = xvp->next) {
-      if (xvp->master == stvp && xvp->frag_inputs == fragInputsRead) {
+   memset(&key, 0, sizeof key);
+   compute_vp_variant_key(stvp, stfp, &key);
+   hash = util_hash_crc32(&key, sizeof key);
+
+   for (prev = &stvp->variants; *prev; prev = &(*prev)->next) {
+      if ((*prev)->hash == hash &&
+          memcmp(&(*prev)->key, &key, sizeof key) == 0)
          break;
-      }
    }
 
-   /* No?  Allocate translated vp object now */
-   if (!xvp) {
-      xvp = ST_CALLOC_STRUCT(translated_vertex_program);
-      xvp->frag_inputs = fragInputsRead;
-      xvp->master = stvp;
-
-      xvp->next = stfp->vertex_programs;
-      stfp->vertex_programs = xvp;
+   variant = *prev;
+   if (variant) {
+      st->vp_variants.hits++;
+      *prev = variant->next;
    }
+   else {
+      st->vp_variants.misses++;
 
-   /* See if we need to translate vertex program to TGSI form */
-   if (xvp->serialNo != stvp->serialNo) {
-      GLuint outAttr;
-      const GLbitfield outputsWritten = stvp->Base.Base.OutputsWritten;
-      GLuint numVpOuts = 0;
-      GLboolean emitPntSize = GL_FALSE, emitBFC0 = GL_FALSE, emitBFC1 = GL_FALSE;
-      GLbitfield usedGenerics = 0x0;
-      GLbitfield usedOutputSlots = 0x0;
-
-      /* Compute mapping of vertex program outputs to slots, which depends
-       * on the fragment program's input->slot mapping.
-       */
-      for (outAttr = 0; outAttr < VERT_RESULT_MAX; outAttr++) {
-         /* set defaults: */
-         xvp->output_to_slot[outAttr] = UNUSED;
-         xvp->output_to_semantic_name[outAttr] = TGSI_SEMANTIC_COUNT;
-         xvp->output_to_semantic_index[outAttr] = 99;
-
-         if (outAttr == VERT_RESULT_HPOS) {
-            /* always put xformed position into slot zero */
-            GLuint slot = 0;
-            xvp->output_to_slot[VERT_RESULT_HPOS] = slot;
-            xvp->output_to_semantic_name[outAttr] = TGSI_SEMANTIC_POSITION;
-            xvp->output_to_semantic_index[outAttr] = 0;
-            numVpOuts++;
-            usedOutputSlots |= (1 << slot);
-         }
-         else if (outputsWritten & (1 << outAttr)) {
-            /* see if the frag prog wants this vert output */
-            GLint fpInAttrib = vp_out_to_fp_in(outAttr);
-            if (fpInAttrib >= 0) {
-               GLuint fpInSlot = stfp->input_to_slot[fpInAttrib];
-               if (fpInSlot != ~0) {
-                  /* match this vp output to the fp input */
-                  GLuint vpOutSlot = stfp->input_map[fpInSlot];
-                  xvp->output_to_slot[outAttr] = vpOutSlot;
-                  xvp->output_to_semantic_name[outAttr] = stfp->input_semantic_name[fpInSlot];
-                  xvp->output_to_semantic_index[outAttr] = stfp->input_semantic_index[fpInSlot];
-                  numVpOuts++;
-                  usedOutputSlots |= (1 << vpOutSlot);
-               }
-               else {
-#if 0 /*debug*/
-                  printf("VP output %d not used by FP\n", outAttr);
-#endif
-               }
-            }
-            else if (outAttr == VERT_RESULT_PSIZ)
-               emitPntSize = GL_TRUE;
-            else if (outAttr == VERT_RESULT_BFC0)
-               emitBFC0 = GL_TRUE;
-            else if (outAttr == VERT_RESULT_BFC1)
-               emitBFC1 = GL_TRUE;
-         }
-#if 0 /*debug*/
-         printf("assign vp output_to_slot[%d] = %d\n", outAttr, 
-                xvp->output_to_slot[outAttr]);
-#endif
-      }
+      variant = ST_CALLOC_STRUCT(st_vp_variant);
+      if (!variant)
+         return NULL;
 
-      /* must do these last */
-      if (emitPntSize) {
-         GLuint slot = numVpOuts++;
-         xvp->output_to_slot[VERT_RESULT_PSIZ] = slot;
-         xvp->output_to_semantic_name[VERT_RESULT_PSIZ] = TGSI_SEMANTIC_PSIZE;
-         xvp->output_to_semantic_index[VERT_RESULT_PSIZ] = 0;
-         usedOutputSlots |= (1 << slot);
-      }
-      if (emitBFC0) {
-         GLuint slot = numVpOuts++;
-         xvp->output_to_slot[VERT_RESULT_BFC0] = slot;
-         xvp->output_to_semantic_name[VERT_RESULT_BFC0] = TGSI_SEMANTIC_COLOR;
-         xvp->output_to_semantic_index[VERT_RESULT_BFC0] = 0;
-         usedOutputSlots |= (1 << slot);
-      }
-      if (emitBFC1) {
-         GLuint slot = numVpOuts++;
-         xvp->output_to_slot[VERT_RESULT_BFC1] = slot;
-         xvp->output_to_semantic_name[VERT_RESULT_BFC1] = TGSI_SEMANTIC_COLOR;
-         xvp->output_to_semantic_index[VERT_RESULT_BFC1] = 1;
-         usedOutputSlots |= (1 << slot);
-      }
+      variant->key = key;
+      variant->hash = hash;
 
-      /* build usedGenerics mask */
-      usedGenerics = 0x0;
-      for (outAttr = 0; outAttr < VERT_RESULT_MAX; outAttr++) {
-         if (xvp->output_to_semantic_name[outAttr] == TGSI_SEMANTIC_GENERIC) {
-            usedGenerics |= (1 << xvp->output_to_semantic_index[outAttr]);
-         }
-      }
+      assert(stvp->Base.Base.NumInstructions > 1);
 
-      /* For each vertex program output that doesn't match up to a fragment
-       * program input, map the vertex program output to a free slot and
-       * free generic attribute.
+      /* The translation replaces the program's current state, which
+       * belongs to another variant if there is one.
        */
-      for (outAttr = 0; outAttr < VERT_RESULT_MAX; outAttr++) {
-         if (outputsWritten & (1 << outAttr)) {
-            if (xvp->output_to_slot[outAttr] == UNUSED) {
-               GLint freeGeneric = _mesa_ffs(~usedGenerics) - 1;
-               GLint freeSlot = _mesa_ffs(~usedOutputSlots) - 1;
-               usedGenerics |= (1 << freeGeneric);
-               usedOutputSlots |= (1 << freeSlot);
-               xvp->output_to_slot[outAttr] = freeSlot;
-               xvp->output_to_semantic_name[outAttr] = TGSI_SEMANTIC_GENERIC;
-               xvp->output_to_semantic_index[outAttr] = freeGeneric;
-            }
-         }
-
-#if 0 /*debug*/
-         printf("vp output_to_slot[%d] = %d\n", outAttr, 
-                xvp->output_to_slot[outAttr]);
-#endif
-      }
-
-      assert(stvp->Base.Base.NumInstructions > 1);
+      if (stvp->variant)
+         unset_current_vp_variant(st, stvp);
 
-      st_translate_vertex_program(st, stvp, xvp->output_to_slot,
-                                  xvp->output_to_semantic_name,
-                                  xvp->output_to_semantic_index);
+      st_translate_vertex_program(st, stvp, key.output_to_slot,
+                                  key.output_to_semantic_name,
+                                  key.output_to_semantic_index);
 
-      xvp->vp = stvp;
+      /* the variant takes over the translation */
+      variant->state = stvp->state;
+      variant->driver_shader = stvp->driver_shader;
+      variant->size = sizeof *variant +
+         tgsi_num_tokens(variant->state.tokens) * sizeof(struct tgsi_token);
+      stvp->variant = variant;
 
-      /* translated VP is up to date now */
-      xvp->serialNo = stvp->serialNo;
+      stvp->variants_size += variant->size;
    }
 
-   return xvp;
-}
+   variant->next = stvp->variants;
+   stvp->variants = variant;
 
+   set_current_vp_variant(st, stvp, variant);
 
-void
-st_free_translated_vertex_programs(struct st_context *st,
-                                   struct translated_vertex_program *xvp)
-{
-   struct translated_vertex_program *next;
+   evict_vp_variants(st, stvp);
 
-   while (xvp) {
-      next = xvp->next;
-      _mesa_free(xvp);
-      xvp = next;
-   }
+   return variant;
 }
 
 
@@ -334,7 +503,7 @@ update_linkage( struct st_context *st )
 {
    struct st_vertex_program *stvp;
    struct st_fragment_program *stfp;
-   struct translated_vertex_program *xvp;
+   struct st_vp_variant *variant;
 
    /* find active shader and params -- Should be covered by
     * ST_NEW_VERTEX_PROGRAM
@@ -347,7 +516,9 @@ update_linkage( struct st_context *st )
    stfp = st_fragment_program(st->ctx->FragmentProgram._Current);
    assert(stfp->Base.Base.Target == GL_FRAGMENT_PROGRAM_ARB);
 
-   xvp = find_translated_vp(st, stvp, stfp);
+   variant = find_translated_vp(st, stvp, stfp);
+   if (!variant)
+      return;
 
    st_reference_vertprog(st, &st->vp, stvp);
    st_reference_fragprog(st, &st->fp, stfp);
@@ -363,7 +534,8 @@ update_linkage( struct st_context *st )
       cso_set_fragment_shader_handle(st->cso_context, stfp->driver_shader);
    }
 
-   st->vertex_result_to_slot = xvp->output_to_slot;
+   memcpy(st->vertex_result_to_slot, variant->key.output_to_slot,
+          sizeof st->vertex_result_to_slot);
 }
 
 
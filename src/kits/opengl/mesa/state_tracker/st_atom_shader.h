@@ -30,9 +30,17 @@
 #define ST_ATOM_SHADER_H
 
 
+struct st_vertex_program;
+
+extern void
+st_release_vp_variants(struct st_context *st,
+                       struct st_vertex_program *stvp);
+
+extern void
+st_init_vp_variants(struct st_context *st);
+
 extern void
-st_free_translated_vertex_programs(struct st_context *st,
-                                   struct translated_vertex_program *xvp);
+st_print_vp_variant_stats(struct st_context *st);
 
 
 #endif /* ST_ATOM_SHADER_H */
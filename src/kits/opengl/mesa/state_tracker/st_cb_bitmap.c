@@ -54,6 +54,8 @@
 #include "pipe/p_inlines.h"
 #include "util/u_tile.h"
 #include "util/u_draw_quad.h"
+#include "util/u_hash.h"
+#include "util/u_hash_table.h"
 #include "util/u_simple_shaders.h"
 #include "shader/prog_instruction.h"
 #include "cso_cache/cso_context.h"
@@ -104,6 +106,54 @@ struct bitmap_cache
 };
 
 
+/**
+ * The bitmap atlas keeps small bitmaps (typically font glyphs) resident
+ * in one texture across frames.  Glyphs are looked up by their contents
+ * so that a string drawn with glBitmap becomes a series of quads
+ * referencing the atlas, which are drawn with a single draw call when
+ * the batch is flushed.
+ */
+static GLboolean UseBitmapAtlas = GL_TRUE;
+
+
+#define BITMAP_ATLAS_WIDTH     512
+#define BITMAP_ATLAS_HEIGHT    512
+#define BITMAP_ATLAS_MAX_SIZE  64   /**< max glyph width/height */
+#define BITMAP_ATLAS_MAX_QUADS 256  /**< max glyphs per batch */
+
+struct bitmap_glyph
+{
+   GLsizei width, height;
+   unsigned hash;
+   /** Position of the glyph in the atlas texture */
+   GLint x, y;
+   /** Unpacked texels, width * height, as stored in the texture */
+   ubyte *texels;
+};
+
+struct bitmap_atlas
+{
+   struct pipe_texture *texture;
+
+   /** Glyphs in the atlas, keyed by their contents */
+   struct hash_table *glyphs;
+
+   /** Shelf packing: current shelf position and height */
+   GLint shelf_x, shelf_y, shelf_height;
+
+   /** Quads waiting to be drawn, all with the same color */
+   GLfloat color[4];
+   GLuint num_quads;
+   GLfloat vertices[BITMAP_ATLAS_MAX_QUADS][4][3][4];
+
+   /** Vertex buffer of the last batch, kept until the next one */
+   struct pipe_buffer *vbuf;
+
+   /** Statistics, see ST_BITMAP_STATS */
+   unsigned glyphs_drawn, glyphs_uploaded, batches, resets;
+};
+
+
 
 
 /**
@@ -440,20 +490,20 @@ setup_bitmap_vertex_data(struct st_context *st,
 
 
 /**
- * Render a glBitmap by drawing a textured quad
+ * Draw bitmap vertices (clip coords + color + texcoord, see
+ * setup_bitmap_vertex_data) from vbuf, sampling the bitmap texture pt.
  */
 static void
-draw_bitmap_quad(GLcontext *ctx, GLint x, GLint y, GLfloat z,
-                 GLsizei width, GLsizei height,
-                 struct pipe_texture *pt,
-                 const GLfloat *color)
+draw_bitmap_vertices(GLcontext *ctx,
+                     struct pipe_buffer *vbuf, GLuint offset,
+                     GLuint prim, GLuint num_verts,
+                     struct pipe_texture *pt,
+                     const GLfloat *color)
 {
    struct st_context *st = ctx->st;
    struct pipe_context *pipe = ctx->st->pipe;
    struct cso_context *cso = ctx->st->cso_context;
    struct st_fragment_program *stfp;
-   GLuint maxSize;
-   GLuint offset;
 
    stfp = combined_bitmap_fragment_program(ctx);
 
@@ -472,15 +522,6 @@ draw_bitmap_quad(GLcontext *ctx, GLint x, GLint y, GLfloat z,
       COPY_4V(ctx->Current.Attrib[VERT_ATTRIB_COLOR0], colorSave);
    }
 
-
-   /* limit checks */
-   /* XXX if the bitmap is larger than the max texture size, break
-    * it up into chunks.
-    */
-   maxSize = 1 << (pipe->screen->get_param(pipe->screen, PIPE_CAP_MAX_TEXTURE_2D_LEVELS) - 1);
-   assert(width <= (GLsizei)maxSize);
-   assert(height <= (GLsizei)maxSize);
-
    cso_save_rasterizer(cso);
    cso_save_samplers(cso);
    cso_save_sampler_textures(cso);
@@ -537,14 +578,10 @@ draw_bitmap_quad(GLcontext *ctx, GLint x, GLint y, GLfloat z,
       cso_set_viewport(cso, &vp);
    }
 
-   /* draw textured quad */
-   offset = setup_bitmap_vertex_data(st, x, y, width, height,
-                                     ctx->Current.RasterPos[2],
-                                     color);
-
-   util_draw_vertex_buffer(pipe, st->bitmap.vbuf, offset,
-                           PIPE_PRIM_TRIANGLE_FAN,
-                           4,  /* verts */
+   /* draw textured quads */
+   util_draw_vertex_buffer(pipe, vbuf, offset,
+                           prim,
+                           num_verts,
                            3); /* attribs/vert */
 
 
@@ -558,6 +595,36 @@ draw_bitmap_quad(GLcontext *ctx, GLint x, GLint y, GLfloat z,
 }
 
 
+/**
+ * Render a glBitmap by drawing a textured quad
+ */
+static void
+draw_bitmap_quad(GLcontext *ctx, GLint x, GLint y, GLfloat z,
+                 GLsizei width, GLsizei height,
+                 struct pipe_texture *pt,
+                 const GLfloat *color)
+{
+   struct st_context *st = ctx->st;
+   struct pipe_context *pipe = ctx->st->pipe;
+   GLuint maxSize;
+   GLuint offset;
+
+   /* limit checks */
+   /* XXX if the bitmap is larger than the max texture size, break
+    * it up into chunks.
+    */
+   maxSize = 1 << (pipe->screen->get_param(pipe->screen, PIPE_CAP_MAX_TEXTURE_2D_LEVELS) - 1);
+   assert(width <= (GLsizei)maxSize);
+   assert(height <= (GLsizei)maxSize);
+
+   offset = setup_bitmap_vertex_data(st, x, y, width, height, z, color);
+
+   draw_bitmap_vertices(ctx, st->bitmap.vbuf, offset,
+                        PIPE_PRIM_TRIANGLE_FAN, 4,
+                        pt, color);
+}
+
+
 static void
 reset_cache(struct st_context *st)
 {
@@ -615,8 +682,8 @@ create_cache_trans(struct st_context *st)
 /**
  * If there's anything in the bitmap cache, draw/flush it now.
  */
-void
-st_flush_bitmap_cache(struct st_context *st)
+static void
+flush_cache(struct st_context *st)
 {
    if (!st->bitmap.cache->empty) {
       struct bitmap_cache *cache = st->bitmap.cache;
@@ -660,6 +727,285 @@ st_flush_bitmap_cache(struct st_context *st)
    }
 }
 
+
+static unsigned
+glyph_hash(void *key)
+{
+   const struct bitmap_glyph *glyph = (const struct bitmap_glyph *) key;
+   return glyph->hash;
+}
+
+
+static int
+glyph_compare(void *key1, void *key2)
+{
+   const struct bitmap_glyph *a = (const struct bitmap_glyph *) key1;
+   const struct bitmap_glyph *b = (const struct bitmap_glyph *) key2;
+
+   if (a->width != b->width || a->height != b->height)
+      return 1;
+
+   return memcmp(a->texels, b->texels, a->width * a->height);
+}
+
+
+static enum pipe_error
+free_glyph(void *key, void *value, void *data)
+{
+   struct bitmap_glyph *glyph = (struct bitmap_glyph *) value;
+
+   _mesa_free(glyph->texels);
+   _mesa_free(glyph);
+   return PIPE_OK;
+}
+
+
+/**
+ * Draw the quads accumulated in the bitmap atlas batch.
+ */
+static void
+flush_atlas(struct st_context *st)
+{
+   struct bitmap_atlas *atlas = st->bitmap.atlas;
+   const GLuint num_quads = atlas->num_quads;
+
+   if (!num_quads)
+      return;
+
+   atlas->num_quads = 0;
+
+   if (st->ctx->DrawBuffer) {
+      struct pipe_screen *screen = st->pipe->screen;
+      const GLuint size = num_quads * sizeof(atlas->vertices[0]);
+
+      /* The previous batch's vertex buffer may still be in use, so
+       * don't overwrite it.
+       */
+      pipe_buffer_reference(&atlas->vbuf, NULL);
+      atlas->vbuf = pipe_buffer_create(screen, 32,
+                                       PIPE_BUFFER_USAGE_VERTEX, size);
+      if (!atlas->vbuf)
+         return;
+
+      st_no_flush_pipe_buffer_write(st, atlas->vbuf, 0, size,
+                                    atlas->vertices);
+
+      draw_bitmap_vertices(st->ctx, atlas->vbuf, 0,
+                           PIPE_PRIM_QUADS, num_quads * 4,
+                           atlas->texture, atlas->color);
+
+      atlas->batches++;
+   }
+}
+
+
+/**
+ * Throw away all the glyphs in the atlas.
+ */
+static void
+reset_atlas(struct st_context *st)
+{
+   struct bitmap_atlas *atlas = st->bitmap.atlas;
+
+   flush_atlas(st);
+
+   hash_table_foreach(atlas->glyphs, free_glyph, NULL);
+   hash_table_clear(atlas->glyphs);
+
+   atlas->shelf_x = 0;
+   atlas->shelf_y = 0;
+   atlas->shelf_height = 0;
+   atlas->resets++;
+}
+
+
+/**
+ * Find room for the glyph in the atlas and upload its texels.
+ * \return GL_FALSE if the atlas is full.
+ */
+static GLboolean
+place_glyph(struct st_context *st, struct bitmap_glyph *glyph)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+   struct bitmap_atlas *atlas = st->bitmap.atlas;
+   struct pipe_transfer *transfer;
+   ubyte *dest;
+   GLint row;
+
+   /* Glyphs are packed on shelves, with one texel of padding. */
+   if (atlas->shelf_x + glyph->width > BITMAP_ATLAS_WIDTH) {
+      atlas->shelf_x = 0;
+      atlas->shelf_y += atlas->shelf_height + 1;
+      atlas->shelf_height = 0;
+   }
+
+   if (atlas->shelf_y + glyph->height > BITMAP_ATLAS_HEIGHT)
+      return GL_FALSE;
+
+   glyph->x = atlas->shelf_x;
+   glyph->y = atlas->shelf_y;
+
+   atlas->shelf_x += glyph->width + 1;
+   atlas->shelf_height = MAX2(atlas->shelf_height, glyph->height);
+
+   transfer = st_cond_flush_get_tex_transfer(st, atlas->texture, 0, 0, 0,
+                                             PIPE_TRANSFER_WRITE,
+                                             glyph->x, glyph->y,
+                                             glyph->width, glyph->height);
+   if (!transfer)
+      return GL_FALSE;
+
+   dest = screen->transfer_map(screen, transfer);
+   if (dest) {
+      for (row = 0; row < glyph->height; row++) {
+         memcpy(dest + row * transfer->stride,
+                glyph->texels + row * glyph->width,
+                glyph->width);
+      }
+      screen->transfer_unmap(screen, transfer);
+   }
+   screen->tex_transfer_destroy(transfer);
+
+   atlas->glyphs_uploaded++;
+
+   return dest != NULL;
+}
+
+
+/**
+ * Try to draw this glBitmap from the bitmap atlas, uploading it there
+ * first if it's not resident yet.
+ * \return  GL_TRUE for success, GL_FALSE if bitmap is too large, etc.
+ */
+static GLboolean
+accum_glyph(struct st_context *st,
+            GLint x, GLint y, GLsizei width, GLsizei height,
+            const struct gl_pixelstore_attrib *unpack,
+            const GLubyte *bitmap)
+{
+   GLcontext *ctx = st->ctx;
+   struct bitmap_atlas *atlas = st->bitmap.atlas;
+   ubyte texels[BITMAP_ATLAS_MAX_SIZE * BITMAP_ATLAS_MAX_SIZE];
+   struct bitmap_glyph key, *glyph;
+   const struct gl_framebuffer *fb = ctx->DrawBuffer;
+   GLfloat x0, y0, x1, y1, s0, t0, s1, t1, z;
+   GLfloat (*v)[3][4];
+   GLuint i;
+
+   if (width > BITMAP_ATLAS_MAX_SIZE ||
+       height > BITMAP_ATLAS_MAX_SIZE)
+      return GL_FALSE; /* too big for the atlas */
+
+   if (!atlas->texture) {
+      atlas->texture = st_texture_create(st, PIPE_TEXTURE_2D,
+                                         st->bitmap.tex_format, 0,
+                                         BITMAP_ATLAS_WIDTH,
+                                         BITMAP_ATLAS_HEIGHT,
+                                         1, PIPE_TEXTURE_USAGE_SAMPLER);
+      if (!atlas->texture)
+         return GL_FALSE;
+   }
+
+   /* keep drawing order with the bitmap cache */
+   flush_cache(st);
+
+   /* PBO source... */
+   bitmap = _mesa_map_bitmap_pbo(ctx, unpack, bitmap);
+   if (!bitmap)
+      return GL_TRUE; /* error already recorded */
+
+   memset(texels, 0xff, width * height);
+   unpack_bitmap(st, 0, 0, width, height, unpack, bitmap, texels, width);
+
+   _mesa_unmap_bitmap_pbo(ctx, unpack);
+
+   key.width = width;
+   key.height = height;
+   key.texels = texels;
+   key.hash = util_hash_crc32(texels, width * height) ^
+              ((width << 16) | height);
+
+   glyph = (struct bitmap_glyph *) hash_table_get(atlas->glyphs, &key);
+   if (!glyph) {
+      glyph = ST_CALLOC_STRUCT(bitmap_glyph);
+      if (!glyph)
+         return GL_FALSE;
+      *glyph = key;
+      glyph->texels = _mesa_malloc(width * height);
+      if (!glyph->texels) {
+         _mesa_free(glyph);
+         return GL_FALSE;
+      }
+      memcpy(glyph->texels, texels, width * height);
+
+      if (!place_glyph(st, glyph)) {
+         /* atlas is full, start over */
+         reset_atlas(st);
+         if (!place_glyph(st, glyph) ||
+             hash_table_set(atlas->glyphs, glyph, glyph) != PIPE_OK) {
+            free_glyph(glyph, glyph, NULL);
+            return GL_FALSE;
+         }
+      }
+      else if (hash_table_set(atlas->glyphs, glyph, glyph) != PIPE_OK) {
+         free_glyph(glyph, glyph, NULL);
+         return GL_FALSE;
+      }
+   }
+
+   if (atlas->num_quads == BITMAP_ATLAS_MAX_QUADS ||
+       (atlas->num_quads &&
+        !TEST_EQ_4V(ctx->Current.RasterColor, atlas->color)))
+      flush_atlas(st);
+
+   if (!atlas->num_quads)
+      COPY_4FV(atlas->color, ctx->Current.RasterColor);
+
+   /* Positions are in clip coords, as in setup_bitmap_vertex_data().
+    * The glyph is stored upside down, like the bitmap cache.
+    */
+   x0 = (GLfloat) x / fb->Width * 2.0f - 1.0f;
+   y0 = (GLfloat) y / fb->Height * 2.0f - 1.0f;
+   x1 = (GLfloat) (x + width) / fb->Width * 2.0f - 1.0f;
+   y1 = (GLfloat) (y + height) / fb->Height * 2.0f - 1.0f;
+   s0 = (GLfloat) glyph->x / BITMAP_ATLAS_WIDTH;
+   t0 = (GLfloat) glyph->y / BITMAP_ATLAS_HEIGHT;
+   s1 = (GLfloat) (glyph->x + width) / BITMAP_ATLAS_WIDTH;
+   t1 = (GLfloat) (glyph->y + height) / BITMAP_ATLAS_HEIGHT;
+   z = ctx->Current.RasterPos[2];
+
+   v = atlas->vertices[atlas->num_quads++];
+
+   v[0][0][0] = x0;  v[0][0][1] = y0;  v[0][2][0] = s0;  v[0][2][1] = t0;
+   v[1][0][0] = x1;  v[1][0][1] = y0;  v[1][2][0] = s1;  v[1][2][1] = t0;
+   v[2][0][0] = x1;  v[2][0][1] = y1;  v[2][2][0] = s1;  v[2][2][1] = t1;
+   v[3][0][0] = x0;  v[3][0][1] = y1;  v[3][2][0] = s0;  v[3][2][1] = t1;
+
+   for (i = 0; i < 4; i++) {
+      v[i][0][2] = z;
+      v[i][0][3] = 1.0f;
+      COPY_4V(v[i][1], atlas->color);
+      v[i][2][2] = 0.0f; /*R*/
+      v[i][2][3] = 1.0f; /*Q*/
+   }
+
+   atlas->glyphs_drawn++;
+
+   return GL_TRUE; /* accumulated */
+}
+
+
+/**
+ * If there's anything in the bitmap cache or atlas batch, draw/flush
+ * it now.
+ */
+void
+st_flush_bitmap_cache(struct st_context *st)
+{
+   flush_atlas(st);
+   flush_cache(st);
+}
+
 /* Flush bitmap cache and release vertex buffer.
  */
 void
@@ -672,6 +1018,8 @@ st_flush_bitmap( struct st_context *st )
     */
    pipe_buffer_reference(&st->bitmap.vbuf, NULL);
    st->bitmap.vbuf_slot = 0;
+
+   pipe_buffer_reference(&st->bitmap.atlas->vbuf, NULL);
 }
 
 
@@ -692,6 +1040,9 @@ accum_bitmap(struct st_context *st,
        height > BITMAP_CACHE_HEIGHT)
       return GL_FALSE; /* too big to cache */
 
+   /* keep drawing order with the bitmap atlas */
+   flush_atlas(st);
+
    if (!cache->empty) {
       px = x - cache->xpos;  /* pos in buffer */
       py = y - cache->ypos;
@@ -764,9 +1115,15 @@ st_Bitmap(GLcontext *ctx, GLint x, GLint y, GLsizei width, GLsizei height,
                                                           semantic_indexes);
    }
 
+   if (UseBitmapAtlas && accum_glyph(st, x, y, width, height, unpack, bitmap))
+      return;
+
    if (UseBitmapCache && accum_bitmap(st, x, y, width, height, unpack, bitmap))
       return;
 
+   /* keep drawing order with the cached bitmaps */
+   st_flush_bitmap_cache(st);
+
    pt = make_bitmap_texture(ctx, width, height, unpack, bitmap);
    if (pt) {
       assert(pt->target == PIPE_TEXTURE_2D);
@@ -831,6 +1188,10 @@ st_init_bitmap(struct st_context *st)
    st->bitmap.cache = ST_CALLOC_STRUCT(bitmap_cache);
 
    reset_cache(st);
+
+   /* alloc bitmap atlas object, the texture is created on first use */
+   st->bitmap.atlas = ST_CALLOC_STRUCT(bitmap_atlas);
+   st->bitmap.atlas->glyphs = hash_table_create(glyph_hash, glyph_compare);
 }
 
 
@@ -841,8 +1202,23 @@ st_destroy_bitmap(struct st_context *st)
    struct pipe_context *pipe = st->pipe;
    struct pipe_screen *screen = pipe->screen;
    struct bitmap_cache *cache = st->bitmap.cache;
+   struct bitmap_atlas *atlas = st->bitmap.atlas;
+
+   if (atlas) {
+      if (debug_get_bool_option("ST_BITMAP_STATS", FALSE)) {
+         debug_printf("st: bitmap atlas: %u glyphs drawn in %u batches, "
+                      "%u uploaded, %u resets\n",
+                      atlas->glyphs_drawn, atlas->batches,
+                      atlas->glyphs_uploaded, atlas->resets);
+      }
 
-
+      hash_table_foreach(atlas->glyphs, free_glyph, NULL);
+      hash_table_destroy(atlas->glyphs);
+      pipe_buffer_reference(&atlas->vbuf, NULL);
+      pipe_texture_reference(&atlas->texture, NULL);
+      _mesa_free(atlas);
+      st->bitmap.atlas = NULL;
+   }
 
    if (st->bitmap.vs) {
       cso_delete_vertex_shader(st->cso_context, st->bitmap.vs);
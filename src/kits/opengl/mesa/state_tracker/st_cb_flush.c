@@ -39,6 +39,7 @@
 #include "st_cb_flush.h"
 #include "st_cb_clear.h"
 #include "st_cb_fbo.h"
+#include "st_glthread.h"
 #include "st_public.h"
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
@@ -91,6 +92,8 @@ display_front_buffer(struct st_context *st)
 void st_flush( struct st_context *st, uint pipeFlushFlags,
                struct pipe_fence_handle **fence )
 {
+   st_glthread_finish(st->glthread);
+
    FLUSH_CURRENT(st->ctx, 0);
 
    /* Release any vertex buffers that might potentially be accessed in
@@ -138,6 +138,8 @@ st_delete_program(GLcontext *ctx, struct gl_program *prog)
       {
          struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
 
+         st_release_vp_variants(st, stvp);
+
          if (stvp->driver_shader) {
             cso_delete_vertex_shader(st->cso_context, stvp->driver_shader);
             stvp->driver_shader = NULL;
@@ -177,7 +179,6 @@ st_delete_program(GLcontext *ctx, struct gl_program *prog)
             stfp->bitmap_program = NULL;
          }
 
-         st_free_translated_vertex_programs(st, stfp->vertex_programs);
       }
       break;
    default:
@@ -228,6 +229,8 @@ static void st_program_string_notify( GLcontext *ctx,
 
       stvp->serialNo++;
 
+      st_release_vp_variants(st, stvp);
+
       if (stvp->driver_shader) {
          cso_delete_vertex_shader(st->cso_context, stvp->driver_shader);
          stvp->driver_shader = NULL;
@@ -48,6 +48,7 @@ struct st_query_object
 {
    struct gl_query_object base;
    struct pipe_query *pq;
+   unsigned type;  /**< PIPE_QUERY_x of pq */
 };
 
 
@@ -96,17 +97,31 @@ st_BeginQuery(GLcontext *ctx, struct gl_query_object *q)
 {
    struct pipe_context *pipe = ctx->st->pipe;
    struct st_query_object *stq = st_query_object(q);
+   unsigned type;
 
    switch (q->Target) {
    case GL_SAMPLES_PASSED_ARB:
-      if (!stq->pq)
-	 stq->pq = pipe->create_query( pipe, PIPE_QUERY_OCCLUSION_COUNTER );
+      type = PIPE_QUERY_OCCLUSION_COUNTER;
+      break;
+   case GL_TIME_ELAPSED_EXT:
+      type = PIPE_QUERY_TIME_ELAPSED;
       break;
    default:
       assert(0);
       return;
    }
 
+   /* The same query object may be used with another target */
+   if (stq->pq && stq->type != type) {
+      pipe->destroy_query(pipe, stq->pq);
+      stq->pq = NULL;
+   }
+
+   if (!stq->pq) {
+      stq->pq = pipe->create_query( pipe, type );
+      stq->type = type;
+   }
+
    pipe->begin_query(pipe, stq->pq);
 }
 
@@ -126,6 +141,7 @@ st_WaitQuery(GLcontext *ctx, struct gl_query_object *q)
 {
    struct pipe_context *pipe = ctx->st->pipe;
    struct st_query_object *stq = st_query_object(q);
+   union pipe_query_result result;
 
    /* this function should only be called if we don't have a ready result */
    assert(!stq->base.Ready);
@@ -134,11 +150,12 @@ st_WaitQuery(GLcontext *ctx, struct gl_query_object *q)
 	  !pipe->get_query_result(pipe, 
 				  stq->pq,
 				  TRUE,
-				  &q->Result))
+				  &result))
    {
       /* nothing */
    }
 			    
+   q->Result = result.u64;
    q->Ready = GL_TRUE;
 }
 
@@ -148,12 +165,15 @@ st_CheckQuery(GLcontext *ctx, struct gl_query_object *q)
 {
    struct pipe_context *pipe = ctx->st->pipe;
    struct st_query_object *stq = st_query_object(q);
+   union pipe_query_result result;
 
    if (!q->Ready) {
       q->Ready = pipe->get_query_result(pipe, 
 					stq->pq,
 					FALSE,
-					&q->Result);
+					&result);
+      if (q->Ready)
+         q->Result = result.u64;
    }
 }
 
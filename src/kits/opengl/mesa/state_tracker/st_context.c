@@ -62,9 +62,12 @@
 #include "st_cb_strings.h"
 #include "st_cb_viewport.h"
 #include "st_atom.h"
+#include "st_atom_constbuf.h"
+#include "st_atom_shader.h"
 #include "st_draw.h"
 #include "st_extensions.h"
 #include "st_gen_mipmap.h"
+#include "st_glthread.h"
 #include "st_program.h"
 #include "pipe/p_context.h"
 #include "draw/draw_context.h"
@@ -134,6 +137,7 @@ st_create_context_priv( GLcontext *ctx, struct pipe_context *pipe )
    st->cso_context = cso_create_context(pipe);
 
    st_init_atoms( st );
+   st_init_vp_variants(st);
    st_init_bitmap(st);
    st_init_clear(st);
    st_init_draw( st );
@@ -171,6 +175,7 @@ struct st_context *st_create_context(struct pipe_context *pipe,
    GLcontext *ctx;
    GLcontext *shareCtx = share ? share->ctx : NULL;
    struct dd_function_table funcs;
+   struct st_context *st;
 
    memset(&funcs, 0, sizeof(funcs));
    st_init_driver_functions(&funcs);
@@ -183,7 +188,12 @@ struct st_context *st_create_context(struct pipe_context *pipe,
    if (debug_get_bool_option("MESA_MVP_DP4", FALSE))
       _mesa_set_mvp_with_dp4( ctx, GL_TRUE );
 
-   return st_create_context_priv(ctx, pipe);
+   st = st_create_context_priv(ctx, pipe);
+
+   if (st && debug_get_bool_option("MESA_GLTHREAD", FALSE))
+      st->glthread = st_glthread_create(st);
+
+   return st;
 }
 
 
@@ -191,6 +201,11 @@ static void st_destroy_context_priv( struct st_context *st )
 {
    uint i;
 
+   /* The variants belong to the programs, which are gone by now or
+    * still used by other contexts.
+    */
+   st_print_vp_variant_stats(st);
+
 #if FEATURE_feedback || FEATURE_drawpix
    draw_destroy(st->draw);
 #endif
@@ -213,11 +228,7 @@ static void st_destroy_context_priv( struct st_context *st )
       pipe_texture_reference(&st->state.sampler_texture[i], NULL);
    }
 
-   for (i = 0; i < Elements(st->state.constants); i++) {
-      if (st->state.constants[i].buffer) {
-         pipe_buffer_reference(&st->state.constants[i].buffer, NULL);
-      }
-   }
+   st_destroy_constants(st);
 
    if (st->default_texture) {
       st->ctx->Driver.DeleteTexture(st->ctx, st->default_texture);
@@ -235,6 +246,10 @@ void st_destroy_context( struct st_context *st )
    GLcontext *ctx = st->ctx;
    GLuint i;
 
+   /* let the worker thread drain before tearing anything down */
+   st_glthread_destroy(st->glthread);
+   st->glthread = NULL;
+
    /* need to unbind and destroy CSO objects before anything else */
    cso_release_all(st->cso_context);
 
@@ -268,6 +283,14 @@ st_make_current(struct st_context *st,
                 struct st_framebuffer *draw,
                 struct st_framebuffer *read)
 {
+   GET_CURRENT_CONTEXT(curCtx);
+
+   /* Commands recorded for the old context must run before it loses
+    * the current binding.
+    */
+   if (curCtx)
+      st_glthread_finish(curCtx->st->glthread);
+
    /* Call this periodically to detect when the user has begun using
     * GL rendering from multiple threads.
     */
@@ -288,6 +311,7 @@ st_make_current(struct st_context *st,
          _mesa_set_scissor(st->ctx, 0, 0, w, h);
 
       }
+      st_glthread_make_current(st->glthread);
       return GL_TRUE;
    }
    else {
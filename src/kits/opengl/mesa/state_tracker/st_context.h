@@ -43,6 +43,7 @@ struct cso_blend;
 struct gen_mipmap_state;
 struct blit_state;
 struct bitmap_cache;
+struct bitmap_atlas;
 
 
 /** XXX we'd like to get rid of these */
@@ -56,6 +57,9 @@ struct bitmap_cache;
 #define ST_NEW_VERTEX_PROGRAM          0x4
 #define ST_NEW_FRAMEBUFFER             0x8
 
+/** Number of replaced constant buffers kept for reuse */
+#define ST_CONSTANT_POOL_SIZE 4
+
 
 struct st_state_flags {
    GLuint mesa;
@@ -105,6 +109,16 @@ struct st_context
 
    struct {
       struct st_tracked_state tracked_state[PIPE_SHADER_TYPES];
+
+      /** Copy of what was written to state.constants[i].buffer */
+      GLfloat (*shadow[PIPE_SHADER_TYPES])[4];
+      GLuint shadow_size[PIPE_SHADER_TYPES];  /**< in vec4s */
+
+      /** Replaced constant buffers, for reuse */
+      struct pipe_buffer *pool[ST_CONSTANT_POOL_SIZE];
+
+      /** Statistics, see ST_CONSTANT_STATS */
+      uint64_t bytes_uploaded, bytes_total;
    } constants;
 
    /* XXX unused: */
@@ -122,7 +136,7 @@ struct st_context
    GLboolean missing_textures;
 
    /** Mapping from VERT_RESULT_x to post-transformed vertex slot */
-   const GLuint *vertex_result_to_slot;
+   GLuint vertex_result_to_slot[VERT_RESULT_MAX];
 
    struct st_vertex_program *vp;    /**< Currently bound vertex program */
    struct st_fragment_program *fp;  /**< Currently bound fragment program */
@@ -150,6 +164,7 @@ struct st_context
       struct pipe_buffer *vbuf;
       unsigned vbuf_slot;       /* next free slot in vbuf */
       struct bitmap_cache *cache;
+      struct bitmap_atlas *atlas;
    } bitmap;
 
    /** for glDraw/CopyPixels */
@@ -171,12 +186,21 @@ struct st_context
 
    void *passthrough_fs;  /**< simple pass-through frag shader */
 
+   /** Vertex program variants, see st_atom_shader.c */
+   struct {
+      unsigned max_size;   /**< per program, bytes */
+      unsigned hits, misses, evictions;
+   } vp_variants;
+
    struct gen_mipmap_state *gen_mipmap;
    struct blit_state *blit;
 
    struct cso_context *cso_context;
 
    int force_msaa;
+
+   /** Worker thread for threaded dispatch, or NULL */
+   struct st_glthread *glthread;
 };
 
 
@@ -36,6 +36,7 @@
 #include "main/viewport.h"
 #include "st_context.h"
 #include "st_cb_fbo.h"
+#include "st_glthread.h"
 #include "st_public.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_context.h"
@@ -134,6 +135,8 @@ void st_resize_framebuffer( struct st_framebuffer *stfb,
    if (stfb->Base.Width != width || stfb->Base.Height != height) {
       GET_CURRENT_CONTEXT(ctx);
       if (ctx) {
+         st_glthread_finish(ctx->st->glthread);
+
          if (stfb->InitWidth == 0 && stfb->InitHeight == 0) {
             /* didn't have a valid size until now */
             stfb->InitWidth = width;
@@ -166,6 +166,7 @@ st_generate_mipmap(GLcontext *ctx, GLenum target,
                    struct gl_texture_object *texObj)
 {
    struct st_context *st = ctx->st;
+   struct pipe_context *pipe = st->pipe;
    struct pipe_texture *pt = st_get_texobj_texture(texObj);
    const uint baseLevel = texObj->BaseLevel;
    uint lastLevel;
@@ -176,7 +177,15 @@ st_generate_mipmap(GLcontext *ctx, GLenum target,
 
    lastLevel = pt->last_level;
 
-   if (!st_render_mipmap(st, target, pt, baseLevel, lastLevel)) {
+   /* Let the driver do it natively if it can, else render the levels
+    * and as a last resort compute them on the CPU.
+    */
+   if (pipe->generate_mipmap &&
+       pipe->generate_mipmap(pipe, pt, _mesa_tex_target_to_face(target),
+                             baseLevel, lastLevel)) {
+      /* done */
+   }
+   else if (!st_render_mipmap(st, target, pt, baseLevel, lastLevel)) {
       fallback_generate_mipmap(ctx, target, texObj);
    }
 
@@ -0,0 +1,746 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * Threaded GL dispatch, see st_glthread.h.
+ *
+ * Commands are recorded into one of ST_GLTHREAD_BATCHES batches.  A full
+ * batch, glFlush and any synchronous call submit the batch to the worker,
+ * which replays each command through ctx->CurrentDispatch, so display
+ * list compilation and the vbo module's dispatch switching work as they
+ * do on a single thread.
+ *
+ * Synchronous calls run on the application thread once the worker is
+ * idle, through the real dispatch table.  Calls returning a value keep
+ * the marshalling table installed while they run: none of them calls
+ * back into the dispatch table.
+ */
+
+
+#include "main/imports.h"
+#include "main/context.h"
+#include "main/macros.h"
+#include "glapi/glapi.h"
+#include "glapi/dispatch.h"
+#include "pipe/p_thread.h"
+#include "st_context.h"
+#include "st_glthread.h"
+
+
+#define ST_GLTHREAD_BATCHES      4
+#define ST_GLTHREAD_BATCH_SIZE   (64 * 1024)   /* bytes */
+
+
+typedef void (*glthread_execute_func)(const struct _glapi_table *exec,
+                                      const void *cmd);
+
+
+/** Header of every recorded command, followed by its arguments */
+struct glthread_cmd
+{
+   glthread_execute_func execute;
+   GLuint size;                  /**< bytes, including the header */
+};
+
+
+struct glthread_batch
+{
+   GLuint used;                  /**< bytes */
+   uint64_t data[ST_GLTHREAD_BATCH_SIZE / sizeof(uint64_t)];
+};
+
+
+struct st_glthread
+{
+   GLcontext *ctx;
+
+   pipe_thread thread;
+   pipe_mutex mutex;
+   pipe_condvar work;            /**< signalled on submit and quit */
+   pipe_condvar done;            /**< signalled when a batch is replayed */
+
+   /* Counters, protected by the mutex.  Batch i is
+    * batches[i % ST_GLTHREAD_BATCHES].
+    */
+   unsigned submitted;
+   unsigned processed;
+   boolean started;              /**< the worker set up its glapi state */
+   boolean quit;
+
+   /** The batch being recorded, only touched by the application thread */
+   struct glthread_batch *batch;
+
+   struct glthread_batch batches[ST_GLTHREAD_BATCHES];
+};
+
+
+/** Application thread dispatch table, shared by all contexts */
+static struct _glapi_table *marshal_table = NULL;
+pipe_static_mutex(marshal_table_mutex);
+
+/** The st_glthread a worker thread replays, NULL on other threads */
+static pipe_tsd worker_tsd;
+
+
+/**
+ * Replay the commands of a batch.  Runs on the worker thread.
+ */
+static void
+glthread_execute_batch(GLcontext *ctx, struct glthread_batch *batch)
+{
+   GLuint pos = 0;
+
+   _glapi_set_dispatch(ctx->CurrentDispatch);
+
+   while (pos < batch->used) {
+      const struct glthread_cmd *cmd =
+         (const struct glthread_cmd *) ((const char *) batch->data + pos);
+
+      cmd->execute(ctx->CurrentDispatch, cmd);
+      pos += cmd->size;
+   }
+
+   batch->used = 0;
+}
+
+
+static PIPE_THREAD_ROUTINE(glthread_worker, param)
+{
+   struct st_glthread *glthread = (struct st_glthread *) param;
+
+   /* The application thread called this already, so glapi switches to
+    * per-thread context and dispatch pointers now.
+    */
+   _glapi_check_multithread();
+   _glapi_set_context(glthread->ctx);
+   pipe_tsd_set(&worker_tsd, glthread);
+
+   pipe_mutex_lock(glthread->mutex);
+   glthread->started = TRUE;
+   pipe_condvar_broadcast(glthread->done);
+
+   for (;;) {
+      struct glthread_batch *batch;
+
+      while (glthread->processed == glthread->submitted && !glthread->quit)
+         pipe_condvar_wait(glthread->work, glthread->mutex);
+
+      if (glthread->processed == glthread->submitted)
+         break;
+
+      batch = &glthread->batches[glthread->processed % ST_GLTHREAD_BATCHES];
+      pipe_mutex_unlock(glthread->mutex);
+
+      glthread_execute_batch(glthread->ctx, batch);
+
+      pipe_mutex_lock(glthread->mutex);
+      glthread->processed++;
+      pipe_condvar_broadcast(glthread->done);
+   }
+   pipe_mutex_unlock(glthread->mutex);
+
+   return NULL;
+}
+
+
+/**
+ * Hand the batch being recorded to the worker and wait for a free one.
+ */
+static void
+glthread_submit(struct st_glthread *glthread)
+{
+   if (glthread->batch->used == 0)
+      return;
+
+   pipe_mutex_lock(glthread->mutex);
+   glthread->submitted++;
+   pipe_condvar_signal(glthread->work);
+
+   while (glthread->submitted - glthread->processed >= ST_GLTHREAD_BATCHES)
+      pipe_condvar_wait(glthread->done, glthread->mutex);
+   pipe_mutex_unlock(glthread->mutex);
+
+   glthread->batch =
+      &glthread->batches[glthread->submitted % ST_GLTHREAD_BATCHES];
+}
+
+
+/**
+ * Wait until the worker has replayed every submitted batch.  The thread
+ * recording into glthread submits its batch first.  Does nothing on the
+ * worker itself, where everything before the current command was
+ * replayed already.
+ */
+void
+st_glthread_finish(struct st_glthread *glthread)
+{
+   GET_CURRENT_CONTEXT(ctx);
+
+   if (!glthread || pipe_tsd_get(&worker_tsd) == glthread)
+      return;
+
+   /* Only the recording thread may touch the batch being recorded;
+    * others, like a window thread resizing the framebuffer, just wait
+    * for the queue to drain.
+    */
+   if (ctx && ctx->st->glthread == glthread &&
+       _glapi_get_dispatch() == marshal_table)
+      glthread_submit(glthread);
+
+   pipe_mutex_lock(glthread->mutex);
+   while (glthread->processed != glthread->submitted)
+      pipe_condvar_wait(glthread->done, glthread->mutex);
+   pipe_mutex_unlock(glthread->mutex);
+}
+
+
+/**
+ * Reserve space for a command in the batch being recorded.
+ */
+static INLINE void *
+glthread_alloc(glthread_execute_func execute, GLuint size)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct st_glthread *glthread = ctx->st->glthread;
+   struct glthread_batch *batch = glthread->batch;
+   struct glthread_cmd *cmd;
+
+   size = (size + 7) & ~7;
+
+   if (batch->used + size > sizeof(batch->data)) {
+      glthread_submit(glthread);
+      batch = glthread->batch;
+   }
+
+   cmd = (struct glthread_cmd *) ((char *) batch->data + batch->used);
+   batch->used += size;
+
+   cmd->execute = execute;
+   cmd->size = size;
+
+   return cmd;
+}
+
+
+/*
+ * Synchronous calls.  Every entrypoint starts out as one of these.
+ */
+
+static const struct _glapi_table *
+glthread_sync(GLboolean switch_dispatch)
+{
+   GET_CURRENT_CONTEXT(ctx);
+
+   st_glthread_finish(ctx->st->glthread);
+
+   /* The call may dispatch GL calls itself (display list playback,
+    * vbo loopback) which must not be recorded behind it.
+    */
+   if (switch_dispatch)
+      _glapi_set_dispatch(ctx->CurrentDispatch);
+
+   return ctx->CurrentDispatch;
+}
+
+
+static void
+glthread_sync_done(void)
+{
+   GET_CURRENT_CONTEXT(ctx);
+
+   if (ctx && ctx->st->glthread)
+      _glapi_set_dispatch(marshal_table);
+}
+
+
+#define KEYWORD1 static
+#define KEYWORD1_ALT static
+#define KEYWORD2 GLAPIENTRY
+#define NAME(func)  sync_##func
+
+#define DISPATCH(func, args, msg)                                      \
+   const struct _glapi_table *exec = glthread_sync(GL_TRUE);           \
+   (exec->func) args;                                                   \
+   glthread_sync_done()
+
+#define RETURN_DISPATCH(func, args, msg)                               \
+   const struct _glapi_table *exec = glthread_sync(GL_FALSE);          \
+   return (exec->func) args
+
+#define DISPATCH_TABLE_NAME sync_table
+#define UNUSED_TABLE_NAME unused_sync_functions
+
+#define TABLE_ENTRY(name) (_glapi_proc) sync_##name
+
+static int
+sync_Unused(void)
+{
+   _mesa_warning(NULL, "User called no-op dispatch function "
+                 "(an unsupported extension function?)");
+   return 0;
+}
+
+#include "glapi/glapitemp.h"
+
+
+/*
+ * Recorded calls.  MARSHALn() defines a command with n arguments passed
+ * by value, MARSHALV() one taking a vector of n values.
+ */
+
+#define MARSHAL0(func)                                                  \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   (void) data;                                                         \
+   CALL_##func(exec, ());                                               \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(void)                                                    \
+{                                                                       \
+   (void) glthread_alloc(unmarshal_##func, sizeof(struct glthread_cmd)); \
+}
+
+#define MARSHAL1(func, T1)                                              \
+struct cmd_##func { struct glthread_cmd cmd; T1 a1; };                  \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   const struct cmd_##func *c = (const struct cmd_##func *) data;       \
+   CALL_##func(exec, (c->a1));                                          \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(T1 a1)                                                   \
+{                                                                       \
+   struct cmd_##func *c = (struct cmd_##func *)                         \
+      glthread_alloc(unmarshal_##func, sizeof(*c));                     \
+   c->a1 = a1;                                                          \
+}
+
+#define MARSHAL2(func, T1, T2)                                          \
+struct cmd_##func { struct glthread_cmd cmd; T1 a1; T2 a2; };           \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   const struct cmd_##func *c = (const struct cmd_##func *) data;       \
+   CALL_##func(exec, (c->a1, c->a2));                                   \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(T1 a1, T2 a2)                                            \
+{                                                                       \
+   struct cmd_##func *c = (struct cmd_##func *)                         \
+      glthread_alloc(unmarshal_##func, sizeof(*c));                     \
+   c->a1 = a1;                                                          \
+   c->a2 = a2;                                                          \
+}
+
+#define MARSHAL3(func, T1, T2, T3)                                      \
+struct cmd_##func { struct glthread_cmd cmd; T1 a1; T2 a2; T3 a3; };    \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   const struct cmd_##func *c = (const struct cmd_##func *) data;       \
+   CALL_##func(exec, (c->a1, c->a2, c->a3));                            \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(T1 a1, T2 a2, T3 a3)                                     \
+{                                                                       \
+   struct cmd_##func *c = (struct cmd_##func *)                         \
+      glthread_alloc(unmarshal_##func, sizeof(*c));                     \
+   c->a1 = a1;                                                          \
+   c->a2 = a2;                                                          \
+   c->a3 = a3;                                                          \
+}
+
+#define MARSHAL4(func, T1, T2, T3, T4)                                  \
+struct cmd_##func { struct glthread_cmd cmd; T1 a1; T2 a2; T3 a3; T4 a4; }; \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   const struct cmd_##func *c = (const struct cmd_##func *) data;       \
+   CALL_##func(exec, (c->a1, c->a2, c->a3, c->a4));                     \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(T1 a1, T2 a2, T3 a3, T4 a4)                              \
+{                                                                       \
+   struct cmd_##func *c = (struct cmd_##func *)                         \
+      glthread_alloc(unmarshal_##func, sizeof(*c));                     \
+   c->a1 = a1;                                                          \
+   c->a2 = a2;                                                          \
+   c->a3 = a3;                                                          \
+   c->a4 = a4;                                                          \
+}
+
+#define MARSHAL6(func, T)                                               \
+struct cmd_##func { struct glthread_cmd cmd; T a[6]; };                 \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   const struct cmd_##func *c = (const struct cmd_##func *) data;       \
+   CALL_##func(exec, (c->a[0], c->a[1], c->a[2], c->a[3], c->a[4], c->a[5])); \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(T a1, T a2, T a3, T a4, T a5, T a6)                      \
+{                                                                       \
+   struct cmd_##func *c = (struct cmd_##func *)                         \
+      glthread_alloc(unmarshal_##func, sizeof(*c));                     \
+   c->a[0] = a1;                                                        \
+   c->a[1] = a2;                                                        \
+   c->a[2] = a3;                                                        \
+   c->a[3] = a4;                                                        \
+   c->a[4] = a5;                                                        \
+   c->a[5] = a6;                                                        \
+}
+
+#define MARSHALV(func, T, n)                                            \
+struct cmd_##func { struct glthread_cmd cmd; T v[n]; };                 \
+static void                                                             \
+unmarshal_##func(const struct _glapi_table *exec, const void *data)     \
+{                                                                       \
+   const struct cmd_##func *c = (const struct cmd_##func *) data;       \
+   CALL_##func(exec, (c->v));                                           \
+}                                                                       \
+static void GLAPIENTRY                                                  \
+marshal_##func(const T *v)                                              \
+{                                                                       \
+   struct cmd_##func *c = (struct cmd_##func *)                         \
+      glthread_alloc(unmarshal_##func, sizeof(*c));                     \
+   memcpy(c->v, v, sizeof(c->v));                                       \
+}
+
+
+/* Immediate mode */
+MARSHAL1(Begin, GLenum)
+MARSHAL0(End)
+MARSHAL2(Vertex2f, GLfloat, GLfloat)
+MARSHAL3(Vertex3f, GLfloat, GLfloat, GLfloat)
+MARSHAL4(Vertex4f, GLfloat, GLfloat, GLfloat, GLfloat)
+MARSHAL2(Vertex2d, GLdouble, GLdouble)
+MARSHAL3(Vertex3d, GLdouble, GLdouble, GLdouble)
+MARSHAL2(Vertex2i, GLint, GLint)
+MARSHAL3(Vertex3i, GLint, GLint, GLint)
+MARSHALV(Vertex2fv, GLfloat, 2)
+MARSHALV(Vertex3fv, GLfloat, 3)
+MARSHALV(Vertex4fv, GLfloat, 4)
+MARSHALV(Vertex3dv, GLdouble, 3)
+MARSHAL3(Normal3f, GLfloat, GLfloat, GLfloat)
+MARSHAL3(Normal3d, GLdouble, GLdouble, GLdouble)
+MARSHALV(Normal3fv, GLfloat, 3)
+MARSHAL3(Color3f, GLfloat, GLfloat, GLfloat)
+MARSHAL4(Color4f, GLfloat, GLfloat, GLfloat, GLfloat)
+MARSHAL3(Color3ub, GLubyte, GLubyte, GLubyte)
+MARSHAL4(Color4ub, GLubyte, GLubyte, GLubyte, GLubyte)
+MARSHALV(Color3fv, GLfloat, 3)
+MARSHALV(Color4fv, GLfloat, 4)
+MARSHALV(Color3ubv, GLubyte, 3)
+MARSHALV(Color4ubv, GLubyte, 4)
+MARSHAL1(TexCoord1f, GLfloat)
+MARSHAL2(TexCoord2f, GLfloat, GLfloat)
+MARSHAL3(TexCoord3f, GLfloat, GLfloat, GLfloat)
+MARSHAL4(TexCoord4f, GLfloat, GLfloat, GLfloat, GLfloat)
+MARSHALV(TexCoord2fv, GLfloat, 2)
+MARSHAL3(MultiTexCoord2fARB, GLenum, GLfloat, GLfloat)
+MARSHAL3(Materialf, GLenum, GLenum, GLfloat)
+
+/* Matrices */
+MARSHAL1(MatrixMode, GLenum)
+MARSHAL0(LoadIdentity)
+MARSHAL0(PushMatrix)
+MARSHAL0(PopMatrix)
+MARSHAL3(Translatef, GLfloat, GLfloat, GLfloat)
+MARSHAL3(Translated, GLdouble, GLdouble, GLdouble)
+MARSHAL4(Rotatef, GLfloat, GLfloat, GLfloat, GLfloat)
+MARSHAL4(Rotated, GLdouble, GLdouble, GLdouble, GLdouble)
+MARSHAL3(Scalef, GLfloat, GLfloat, GLfloat)
+MARSHAL3(Scaled, GLdouble, GLdouble, GLdouble)
+MARSHALV(LoadMatrixf, GLfloat, 16)
+MARSHALV(LoadMatrixd, GLdouble, 16)
+MARSHALV(MultMatrixf, GLfloat, 16)
+MARSHALV(MultMatrixd, GLdouble, 16)
+MARSHAL6(Ortho, GLdouble)
+MARSHAL6(Frustum, GLdouble)
+
+/* State */
+MARSHAL1(Enable, GLenum)
+MARSHAL1(Disable, GLenum)
+MARSHAL1(EnableClientState, GLenum)
+MARSHAL1(DisableClientState, GLenum)
+MARSHAL1(ShadeModel, GLenum)
+MARSHAL2(BlendFunc, GLenum, GLenum)
+MARSHAL1(DepthFunc, GLenum)
+MARSHAL1(DepthMask, GLboolean)
+MARSHAL4(ColorMask, GLboolean, GLboolean, GLboolean, GLboolean)
+MARSHAL1(CullFace, GLenum)
+MARSHAL1(FrontFace, GLenum)
+MARSHAL2(PolygonMode, GLenum, GLenum)
+MARSHAL2(PolygonOffset, GLfloat, GLfloat)
+MARSHAL1(LineWidth, GLfloat)
+MARSHAL1(PointSize, GLfloat)
+MARSHAL2(AlphaFunc, GLenum, GLclampf)
+MARSHAL3(StencilFunc, GLenum, GLint, GLuint)
+MARSHAL3(StencilOp, GLenum, GLenum, GLenum)
+MARSHAL1(StencilMask, GLuint)
+MARSHAL2(Hint, GLenum, GLenum)
+MARSHAL3(Lightf, GLenum, GLenum, GLfloat)
+MARSHAL2(LightModelf, GLenum, GLfloat)
+MARSHAL2(LightModeli, GLenum, GLint)
+MARSHAL2(Fogf, GLenum, GLfloat)
+MARSHAL2(Fogi, GLenum, GLint)
+MARSHAL2(PixelStorei, GLenum, GLint)
+MARSHAL1(ActiveTextureARB, GLenum)
+MARSHAL1(ClientActiveTextureARB, GLenum)
+MARSHAL2(BindTexture, GLenum, GLuint)
+MARSHAL3(TexParameteri, GLenum, GLenum, GLint)
+MARSHAL3(TexParameterf, GLenum, GLenum, GLfloat)
+MARSHAL3(TexEnvi, GLenum, GLenum, GLint)
+MARSHAL3(TexEnvf, GLenum, GLenum, GLfloat)
+MARSHAL4(Viewport, GLint, GLint, GLsizei, GLsizei)
+MARSHAL4(Scissor, GLint, GLint, GLsizei, GLsizei)
+MARSHAL2(DepthRange, GLclampd, GLclampd)
+MARSHAL4(ClearColor, GLclampf, GLclampf, GLclampf, GLclampf)
+MARSHAL1(ClearDepth, GLclampd)
+MARSHAL1(ClearStencil, GLint)
+MARSHAL1(Clear, GLbitfield)
+
+/* Array pointers are only dereferenced by the (synchronous) draws */
+MARSHAL4(VertexPointer, GLint, GLenum, GLsizei, const GLvoid *)
+MARSHAL3(NormalPointer, GLenum, GLsizei, const GLvoid *)
+MARSHAL4(ColorPointer, GLint, GLenum, GLsizei, const GLvoid *)
+MARSHAL4(TexCoordPointer, GLint, GLenum, GLsizei, const GLvoid *)
+
+/* Display lists */
+MARSHAL2(NewList, GLuint, GLenum)
+MARSHAL0(EndList)
+MARSHAL1(CallList, GLuint)
+
+/* glFlush must get the commands executed in finite time */
+MARSHAL0(Flush)
+
+static void GLAPIENTRY
+marshal_flush(void)
+{
+   GET_CURRENT_CONTEXT(ctx);
+
+   marshal_Flush();
+   glthread_submit(ctx->st->glthread);
+}
+
+
+static void
+glthread_init_table(void)
+{
+   struct _glapi_table *table;
+   _glapi_proc *entry;
+   GLuint num_entries, i;
+
+   pipe_mutex_lock(marshal_table_mutex);
+
+   if (marshal_table) {
+      pipe_mutex_unlock(marshal_table_mutex);
+      return;
+   }
+
+   pipe_tsd_init(&worker_tsd);
+
+   num_entries = MAX2(_glapi_get_dispatch_table_size(),
+                      sizeof(struct _glapi_table) / sizeof(_glapi_proc));
+   table = (struct _glapi_table *) MALLOC(num_entries * sizeof(_glapi_proc));
+   if (!table) {
+      pipe_mutex_unlock(marshal_table_mutex);
+      return;
+   }
+
+   (void) unused_sync_functions;
+
+   entry = (_glapi_proc *) table;
+   for (i = 0; i < num_entries; i++) {
+      entry[i] = i < Elements(sync_table) ?
+         sync_table[i] : (_glapi_proc) sync_Unused;
+   }
+
+   SET_Begin(table, marshal_Begin);
+   SET_End(table, marshal_End);
+   SET_Vertex2f(table, marshal_Vertex2f);
+   SET_Vertex3f(table, marshal_Vertex3f);
+   SET_Vertex4f(table, marshal_Vertex4f);
+   SET_Vertex2d(table, marshal_Vertex2d);
+   SET_Vertex3d(table, marshal_Vertex3d);
+   SET_Vertex2i(table, marshal_Vertex2i);
+   SET_Vertex3i(table, marshal_Vertex3i);
+   SET_Vertex2fv(table, marshal_Vertex2fv);
+   SET_Vertex3fv(table, marshal_Vertex3fv);
+   SET_Vertex4fv(table, marshal_Vertex4fv);
+   SET_Vertex3dv(table, marshal_Vertex3dv);
+   SET_Normal3f(table, marshal_Normal3f);
+   SET_Normal3d(table, marshal_Normal3d);
+   SET_Normal3fv(table, marshal_Normal3fv);
+   SET_Color3f(table, marshal_Color3f);
+   SET_Color4f(table, marshal_Color4f);
+   SET_Color3ub(table, marshal_Color3ub);
+   SET_Color4ub(table, marshal_Color4ub);
+   SET_Color3fv(table, marshal_Color3fv);
+   SET_Color4fv(table, marshal_Color4fv);
+   SET_Color3ubv(table, marshal_Color3ubv);
+   SET_Color4ubv(table, marshal_Color4ubv);
+   SET_TexCoord1f(table, marshal_TexCoord1f);
+   SET_TexCoord2f(table, marshal_TexCoord2f);
+   SET_TexCoord3f(table, marshal_TexCoord3f);
+   SET_TexCoord4f(table, marshal_TexCoord4f);
+   SET_TexCoord2fv(table, marshal_TexCoord2fv);
+   SET_MultiTexCoord2fARB(table, marshal_MultiTexCoord2fARB);
+   SET_Materialf(table, marshal_Materialf);
+
+   SET_MatrixMode(table, marshal_MatrixMode);
+   SET_LoadIdentity(table, marshal_LoadIdentity);
+   SET_PushMatrix(table, marshal_PushMatrix);
+   SET_PopMatrix(table, marshal_PopMatrix);
+   SET_Translatef(table, marshal_Translatef);
+   SET_Translated(table, marshal_Translated);
+   SET_Rotatef(table, marshal_Rotatef);
+   SET_Rotated(table, marshal_Rotated);
+   SET_Scalef(table, marshal_Scalef);
+   SET_Scaled(table, marshal_Scaled);
+   SET_LoadMatrixf(table, marshal_LoadMatrixf);
+   SET_LoadMatrixd(table, marshal_LoadMatrixd);
+   SET_MultMatrixf(table, marshal_MultMatrixf);
+   SET_MultMatrixd(table, marshal_MultMatrixd);
+   SET_Ortho(table, marshal_Ortho);
+   SET_Frustum(table, marshal_Frustum);
+
+   SET_Enable(table, marshal_Enable);
+   SET_Disable(table, marshal_Disable);
+   SET_EnableClientState(table, marshal_EnableClientState);
+   SET_DisableClientState(table, marshal_DisableClientState);
+   SET_ShadeModel(table, marshal_ShadeModel);
+   SET_BlendFunc(table, marshal_BlendFunc);
+   SET_DepthFunc(table, marshal_DepthFunc);
+   SET_DepthMask(table, marshal_DepthMask);
+   SET_ColorMask(table, marshal_ColorMask);
+   SET_CullFace(table, marshal_CullFace);
+   SET_FrontFace(table, marshal_FrontFace);
+   SET_PolygonMode(table, marshal_PolygonMode);
+   SET_PolygonOffset(table, marshal_PolygonOffset);
+   SET_LineWidth(table, marshal_LineWidth);
+   SET_PointSize(table, marshal_PointSize);
+   SET_AlphaFunc(table, marshal_AlphaFunc);
+   SET_StencilFunc(table, marshal_StencilFunc);
+   SET_StencilOp(table, marshal_StencilOp);
+   SET_StencilMask(table, marshal_StencilMask);
+   SET_Hint(table, marshal_Hint);
+   SET_Lightf(table, marshal_Lightf);
+   SET_LightModelf(table, marshal_LightModelf);
+   SET_LightModeli(table, marshal_LightModeli);
+   SET_Fogf(table, marshal_Fogf);
+   SET_Fogi(table, marshal_Fogi);
+   SET_PixelStorei(table, marshal_PixelStorei);
+   SET_ActiveTextureARB(table, marshal_ActiveTextureARB);
+   SET_ClientActiveTextureARB(table, marshal_ClientActiveTextureARB);
+   SET_BindTexture(table, marshal_BindTexture);
+   SET_TexParameteri(table, marshal_TexParameteri);
+   SET_TexParameterf(table, marshal_TexParameterf);
+   SET_TexEnvi(table, marshal_TexEnvi);
+   SET_TexEnvf(table, marshal_TexEnvf);
+   SET_Viewport(table, marshal_Viewport);
+   SET_Scissor(table, marshal_Scissor);
+   SET_DepthRange(table, marshal_DepthRange);
+   SET_ClearColor(table, marshal_ClearColor);
+   SET_ClearDepth(table, marshal_ClearDepth);
+   SET_ClearStencil(table, marshal_ClearStencil);
+   SET_Clear(table, marshal_Clear);
+
+   SET_VertexPointer(table, marshal_VertexPointer);
+   SET_NormalPointer(table, marshal_NormalPointer);
+   SET_ColorPointer(table, marshal_ColorPointer);
+   SET_TexCoordPointer(table, marshal_TexCoordPointer);
+
+   SET_NewList(table, marshal_NewList);
+   SET_EndList(table, marshal_EndList);
+   SET_CallList(table, marshal_CallList);
+
+   SET_Flush(table, marshal_flush);
+
+   marshal_table = table;
+
+   pipe_mutex_unlock(marshal_table_mutex);
+}
+
+
+struct st_glthread *
+st_glthread_create(struct st_context *st)
+{
+   struct st_glthread *glthread;
+
+   glthread_init_table();
+   if (!marshal_table)
+      return NULL;
+
+   glthread = CALLOC_STRUCT(st_glthread);
+   if (!glthread)
+      return NULL;
+
+   glthread->ctx = st->ctx;
+   glthread->batch = &glthread->batches[0];
+
+   pipe_mutex_init(glthread->mutex);
+   pipe_condvar_init(glthread->work);
+   pipe_condvar_init(glthread->done);
+
+   /* Make sure the application thread is the one glapi knows first */
+   _glapi_check_multithread();
+
+   glthread->thread = pipe_thread_create(glthread_worker, glthread);
+   if (!glthread->thread) {
+      pipe_condvar_destroy(glthread->done);
+      pipe_condvar_destroy(glthread->work);
+      pipe_mutex_destroy(glthread->mutex);
+      FREE(glthread);
+      return NULL;
+   }
+
+   /* Until the worker has called _glapi_check_multithread() too, glapi
+    * may still use the global dispatch pointer, which installing the
+    * marshalling table would then hand to the worker as well.
+    */
+   pipe_mutex_lock(glthread->mutex);
+   while (!glthread->started)
+      pipe_condvar_wait(glthread->done, glthread->mutex);
+   pipe_mutex_unlock(glthread->mutex);
+
+   return glthread;
+}
+
+
+void
+st_glthread_destroy(struct st_glthread *glthread)
+{
+   if (!glthread)
+      return;
+
+   st_glthread_finish(glthread);
+
+   pipe_mutex_lock(glthread->mutex);
+   glthread->quit = TRUE;
+   pipe_condvar_signal(glthread->work);
+   pipe_mutex_unlock(glthread->mutex);
+
+   pipe_thread_wait(glthread->thread);
+
+   pipe_condvar_destroy(glthread->done);
+   pipe_condvar_destroy(glthread->work);
+   pipe_mutex_destroy(glthread->mutex);
+
+   FREE(glthread);
+}
+
+
+/**
+ * Called on the application thread once the context was made current.
+ */
+void
+st_glthread_make_current(struct st_glthread *glthread)
+{
+   if (glthread)
+      _glapi_set_dispatch(marshal_table);
+}
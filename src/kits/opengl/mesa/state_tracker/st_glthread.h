@@ -0,0 +1,39 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * @file
+ * Threaded GL dispatch.
+ *
+ * With MESA_GLTHREAD set, every context gets a worker thread.  While the
+ * context is current, the application thread's dispatch table marshals
+ * the common state, matrix and immediate mode calls into batches which
+ * the worker replays into the context's real dispatch table.  All other
+ * calls, and every call returning a value or reading client memory,
+ * wait for the worker to go idle and then run on the application thread.
+ */
+
+#ifndef ST_GLTHREAD_H
+#define ST_GLTHREAD_H
+
+
+struct st_context;
+struct st_glthread;
+
+
+struct st_glthread *
+st_glthread_create(struct st_context *st);
+
+void
+st_glthread_destroy(struct st_glthread *glthread);
+
+void
+st_glthread_finish(struct st_glthread *glthread);
+
+void
+st_glthread_make_current(struct st_glthread *glthread);
+
+
+#endif /* ST_GLTHREAD_H */
@@ -386,7 +386,6 @@ st_translate_fragment_program(struct st_context *st,
                               struct st_fragment_program *stfp,
                               const GLuint inputMapping[])
 {
-   struct pipe_context *pipe = st->pipe;
    struct tgsi_token *tokens;
    GLuint outputMapping[FRAG_RESULT_MAX];
    GLuint defaultInputMapping[FRAG_ATTRIB_MAX];
@@ -560,7 +559,7 @@ st_translate_fragment_program(struct st_context *st,
                     num_tokens * sizeof *tokens);
 
    stfp->state = fs; /* struct copy */
-   stfp->driver_shader = pipe->create_fs_state(pipe, &fs);
+   stfp->driver_shader = cso_create_fragment_shader(st->cso_context, &fs);
 
    if (0)
       _mesa_print_program(&stfp->Base.Base);
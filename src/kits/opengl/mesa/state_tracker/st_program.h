@@ -41,7 +41,7 @@
 
 struct cso_fragment_shader;
 struct cso_vertex_shader;
-struct translated_vertex_program;
+struct st_vp_variant;
 
 
 /**
@@ -66,11 +66,6 @@ struct st_fragment_program
 
    GLuint param_state;
 
-   /** List of vertex programs which have been translated such that their
-    * outputs match this fragment program's inputs.
-    */
-   struct translated_vertex_program *vertex_programs;
-
    /** Program prefixed with glBitmap prologue */
    struct st_fragment_program *bitmap_program;
    uint bitmap_sampler;
@@ -95,6 +90,13 @@ struct st_vertex_program
    struct pipe_shader_state state;
    void *driver_shader;
 
+   /** Translations for particular linkages, most recently used first */
+   struct st_vp_variant *variants;
+   unsigned variants_size;   /**< bytes */
+
+   /** The variant which state and driver_shader belong to, if any */
+   struct st_vp_variant *variant;
+
    /** For using our private draw module (glRasterPos) */
    struct draw_vertex_shader *draw_shader;
 
@@ -43,6 +43,7 @@
 #include "s_blend.h"
 #include "s_context.h"
 #include "s_span.h"
+#include "s_span_sse2.h"
 
 
 #if defined(USE_MMX_ASM)
@@ -911,6 +912,12 @@ _swrast_choose_blend_func(GLcontext *ctx, GLenum chanType)
          swrast->BlendFunc = _mesa_mmx_blend_min;
       }
       else
+#endif
+#if defined(USE_X86_64_ASM)
+      if (swrast->UseSSE2 && chanType == GL_UNSIGNED_BYTE) {
+         swrast->BlendFunc = _swrast_sse2_blend_min;
+      }
+      else
 #endif
          swrast->BlendFunc = blend_min;
    }
@@ -921,6 +928,12 @@ _swrast_choose_blend_func(GLcontext *ctx, GLenum chanType)
          swrast->BlendFunc = _mesa_mmx_blend_max;
       }
       else
+#endif
+#if defined(USE_X86_64_ASM)
+      if (swrast->UseSSE2 && chanType == GL_UNSIGNED_BYTE) {
+         swrast->BlendFunc = _swrast_sse2_blend_max;
+      }
+      else
 #endif
          swrast->BlendFunc = blend_max;
    }
@@ -934,6 +947,12 @@ _swrast_choose_blend_func(GLcontext *ctx, GLenum chanType)
          swrast->BlendFunc = _mesa_mmx_blend_transparency;
       }
       else
+#endif
+#if defined(USE_X86_64_ASM)
+      if (swrast->UseSSE2 && chanType == GL_UNSIGNED_BYTE) {
+         swrast->BlendFunc = _swrast_sse2_blend_transparency;
+      }
+      else
 #endif
       {
          if (chanType == GL_UNSIGNED_BYTE)
@@ -950,6 +969,12 @@ _swrast_choose_blend_func(GLcontext *ctx, GLenum chanType)
          swrast->BlendFunc = _mesa_mmx_blend_add;
       }
       else
+#endif
+#if defined(USE_X86_64_ASM)
+      if (swrast->UseSSE2 && chanType == GL_UNSIGNED_BYTE) {
+         swrast->BlendFunc = _swrast_sse2_blend_add;
+      }
+      else
 #endif
          swrast->BlendFunc = blend_add;
    }
@@ -963,6 +988,12 @@ _swrast_choose_blend_func(GLcontext *ctx, GLenum chanType)
          swrast->BlendFunc = _mesa_mmx_blend_modulate;
       }
       else
+#endif
+#if defined(USE_X86_64_ASM)
+      if (swrast->UseSSE2 && chanType == GL_UNSIGNED_BYTE) {
+         swrast->BlendFunc = _swrast_sse2_blend_modulate;
+      }
+      else
 #endif
          swrast->BlendFunc = blend_modulate;
    }
@@ -349,6 +349,8 @@ _swrast_validate_triangle( GLcontext *ctx,
    swrast->choose_triangle( ctx );
    ASSERT(swrast->Triangle);
 
+   _swrast_choose_tile_triangle( ctx );
+
    if (swrast->SpecularVertexAdd) {
       /* separate specular color, but no texture */
       swrast->SpecTriangle = swrast->Triangle;
@@ -709,6 +711,7 @@ _swrast_Line( GLcontext *ctx, const SWvertex *v0, const SWvertex *v1 )
       _swrast_print_vertex( ctx, v0 );
       _swrast_print_vertex( ctx, v1 );
    }
+   _swrast_flush_tiles( ctx );
    SWRAST_CONTEXT(ctx)->Line( ctx, v0, v1 );
 }
 
@@ -719,6 +722,7 @@ _swrast_Point( GLcontext *ctx, const SWvertex *v0 )
       _mesa_debug(ctx, "_swrast_Point\n");
       _swrast_print_vertex( ctx, v0 );
    }
+   _swrast_flush_tiles( ctx );
    SWRAST_CONTEXT(ctx)->Point( ctx, v0 );
 }
 
@@ -767,6 +771,30 @@ _swrast_allow_pixel_fog( GLcontext *ctx, GLboolean value )
 }
 
 
+/**
+ * Allocate span arrays for rasterizing.
+ */
+SWspanarrays *
+_swrast_new_span_arrays(void)
+{
+   SWspanarrays *arrays = MALLOC_STRUCT(sw_span_arrays);
+
+   if (!arrays)
+      return NULL;
+
+   arrays->ChanType = CHAN_TYPE;
+#if CHAN_TYPE == GL_UNSIGNED_BYTE
+   arrays->rgba = arrays->rgba8;
+#elif CHAN_TYPE == GL_UNSIGNED_SHORT
+   arrays->rgba = arrays->rgba16;
+#else
+   arrays->rgba = arrays->attribs[FRAG_ATTRIB_COL0];
+#endif
+
+   return arrays;
+}
+
+
 GLboolean
 _swrast_CreateContext( GLcontext *ctx )
 {
@@ -799,6 +827,11 @@ _swrast_CreateContext( GLcontext *ctx )
    swrast->AllowVertexFog = GL_TRUE;
    swrast->AllowPixelFog = GL_TRUE;
 
+#ifdef USE_X86_64_ASM
+   swrast->UseSSE2 = !_mesa_getenv("MESA_NO_ASM") &&
+                     !_mesa_getenv("MESA_NO_SSE");
+#endif
+
    /* Optimized Accum buffer */
    swrast->_IntegerAccumMode = GL_FALSE;
    swrast->_IntegerAccumScaler = 0.0;
@@ -806,19 +839,11 @@ _swrast_CreateContext( GLcontext *ctx )
    for (i = 0; i < MAX_TEXTURE_IMAGE_UNITS; i++)
       swrast->TextureSample[i] = NULL;
 
-   swrast->SpanArrays = MALLOC_STRUCT(sw_span_arrays);
+   swrast->SpanArrays = _swrast_new_span_arrays();
    if (!swrast->SpanArrays) {
       FREE(swrast);
       return GL_FALSE;
    }
-   swrast->SpanArrays->ChanType = CHAN_TYPE;
-#if CHAN_TYPE == GL_UNSIGNED_BYTE
-   swrast->SpanArrays->rgba = swrast->SpanArrays->rgba8;
-#elif CHAN_TYPE == GL_UNSIGNED_SHORT
-   swrast->SpanArrays->rgba = swrast->SpanArrays->rgba16;
-#else
-   swrast->SpanArrays->rgba = swrast->SpanArrays->attribs[FRAG_ATTRIB_COL0];
-#endif
 
    /* init point span buffer */
    swrast->PointSpan.primitive = GL_POINT;
@@ -836,6 +861,8 @@ _swrast_CreateContext( GLcontext *ctx )
 
    ctx->swrast_context = swrast;
 
+   _swrast_create_tiles(ctx);
+
    return GL_TRUE;
 }
 
@@ -848,6 +875,8 @@ _swrast_DestroyContext( GLcontext *ctx )
       _mesa_debug(ctx, "_swrast_DestroyContext\n");
    }
 
+   _swrast_destroy_tiles( ctx );
+
    FREE( swrast->SpanArrays );
    if (swrast->ZoomedArrays)
       FREE( swrast->ZoomedArrays );
@@ -869,6 +898,8 @@ void
 _swrast_flush( GLcontext *ctx )
 {
    SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   /* render buffered triangles */
+   _swrast_flush_tiles(ctx);
    /* flush any pending fragments from rendering points */
    if (swrast->PointSpan.end > 0) {
       if (ctx->Visual.rgbMode) {
@@ -905,6 +936,8 @@ void
 _swrast_render_finish( GLcontext *ctx )
 {
    SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   /* buffered triangles must be drawn before the driver finishes */
+   _swrast_flush_tiles(ctx);
    if (swrast->Driver.SpanRenderFinish)
       swrast->Driver.SpanRenderFinish( ctx );
 
@@ -47,6 +47,7 @@
 #include "shader/prog_execute.h"
 #include "swrast.h"
 #include "s_span.h"
+#include "s_tiles.h"
 
 
 typedef void (*texture_sample_func)(GLcontext *ctx,
@@ -124,6 +125,9 @@ typedef struct
    GLboolean AllowVertexFog;
    GLboolean AllowPixelFog;
 
+   /** Use the SSE2 span functions (x86-64 only), see s_span_sse2.c */
+   GLboolean UseSSE2;
+
    /** Derived values, invalidated on statechanges, updated from
     * _swrast_validate_derived():
     */
@@ -229,6 +233,9 @@ typedef struct
    /** State used during execution of fragment programs */
    struct gl_program_machine FragProgMachine;
 
+   /** Tile rendering worker threads, NULL if disabled, see s_tiles.c */
+   struct swrast_tiles *Tiles;
+
 } SWcontext;
 
 
@@ -238,6 +245,9 @@ _swrast_validate_derived( GLcontext *ctx );
 extern void
 _swrast_update_texture_samplers(GLcontext *ctx);
 
+extern SWspanarrays *
+_swrast_new_span_arrays(void);
+
 
 /** Return SWcontext for the given GLcontext */
 static INLINE SWcontext *
@@ -32,6 +32,7 @@
 #include "s_depth.h"
 #include "s_context.h"
 #include "s_span.h"
+#include "s_span_sse2.h"
 
 
 /**
@@ -46,6 +47,15 @@ depth_test_span16( GLcontext *ctx, GLuint n,
 {
    GLuint passed = 0;
 
+#ifdef USE_X86_64_ASM
+   if (SWRAST_CONTEXT(ctx)->UseSSE2 &&
+       _swrast_sse2_depth_func_supported(ctx->Depth.Func)) {
+      return _swrast_sse2_depth_test_span16(n, ctx->Depth.Func,
+                                            ctx->Depth.Mask,
+                                            zbuffer, z, mask);
+   }
+#endif
+
    /* switch cases ordered from most frequent to less frequent */
    switch (ctx->Depth.Func) {
       case GL_LESS:
@@ -275,6 +285,15 @@ depth_test_span32( GLcontext *ctx, GLuint n,
 {
    GLuint passed = 0;
 
+#ifdef USE_X86_64_ASM
+   if (SWRAST_CONTEXT(ctx)->UseSSE2 &&
+       _swrast_sse2_depth_func_supported(ctx->Depth.Func)) {
+      return _swrast_sse2_depth_test_span32(n, ctx->Depth.Func,
+                                            ctx->Depth.Mask,
+                                            zbuffer, z, mask);
+   }
+#endif
+
    /* switch cases ordered from most frequent to less frequent */
    switch (ctx->Depth.Func) {
       case GL_LESS:
@@ -184,10 +184,9 @@ init_machine(GLcontext *ctx, struct gl_program_machine *machine,
 static void
 run_program(GLcontext *ctx, SWspan *span, GLuint start, GLuint end)
 {
-   SWcontext *swrast = SWRAST_CONTEXT(ctx);
    const struct gl_fragment_program *program = ctx->FragmentProgram._Current;
    const GLbitfield outputsWritten = program->Base.OutputsWritten;
-   struct gl_program_machine *machine = &swrast->FragProgMachine;
+   struct gl_program_machine *machine = _swrast_fragprog_machine(ctx);
    GLuint i;
 
    for (i = start; i < end; i++) {
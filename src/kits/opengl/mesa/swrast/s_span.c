@@ -48,6 +48,7 @@
 #include "s_masking.h"
 #include "s_fragprog.h"
 #include "s_span.h"
+#include "s_span_sse2.h"
 #include "s_stencil.h"
 #include "s_texcombine.h"
 
@@ -242,6 +243,17 @@ interpolate_int_colors(GLcontext *ctx, SWspan *span)
                COPY_4UBV(rgba[i], color);
             }
          }
+#ifdef USE_X86_64_ASM
+         else if (SWRAST_CONTEXT(ctx)->UseSSE2) {
+            const GLfixed start[4] = {
+               span->red, span->green, span->blue, span->alpha
+            };
+            const GLint step[4] = {
+               span->redStep, span->greenStep, span->blueStep, span->alphaStep
+            };
+            _swrast_sse2_interpolate_rgba8(n, start, step, rgba);
+         }
+#endif
          else {
             GLfixed r = span->red;
             GLfixed g = span->green;
@@ -417,6 +429,14 @@ _swrast_span_interpolate_z( const GLcontext *ctx, SWspan *span )
 
    ASSERT(!(span->arrayMask & SPAN_Z));
 
+#ifdef USE_X86_64_ASM
+   if (((const SWcontext *) ctx->swrast_context)->UseSSE2) {
+      _swrast_sse2_interpolate_z(n, span->z, span->zStep,
+                                 ctx->DrawBuffer->Visual.depthBits <= 16,
+                                 span->array->z);
+   }
+   else
+#endif
    if (ctx->DrawBuffer->Visual.depthBits <= 16) {
       GLfixed zval = span->z;
       GLuint *z = span->array->z; 
@@ -584,11 +604,24 @@ interpolate_texcoords(GLcontext *ctx, SWspan *span)
          }
          else {
             GLuint i;
+#ifdef USE_X86_64_ASM
+            const GLboolean useSSE2 = SWRAST_CONTEXT(ctx)->UseSSE2;
+            const GLfloat start[4] = { s, t, r, q };
+            const GLfloat step[4] = { dsdx, dtdx, drdx, dqdx };
+#endif
             if (ctx->FragmentProgram._Current ||
                 ctx->ATIFragmentShader._Enabled) {
                /* do perspective correction but don't divide s, t, r by q */
                const GLfloat dwdx = span->attrStepX[FRAG_ATTRIB_WPOS][3];
                GLfloat w = span->attrStart[FRAG_ATTRIB_WPOS][3] + span->leftClip * dwdx;
+#ifdef USE_X86_64_ASM
+               if (useSSE2) {
+                  _swrast_sse2_interpolate_texcoords_w(span->end, start, step,
+                                                       w, dwdx,
+                                                       texcoord, lambda);
+               }
+               else
+#endif
                for (i = 0; i < span->end; i++) {
                   const GLfloat invW = 1.0F / w;
                   texcoord[i][0] = s * invW;
@@ -617,6 +650,12 @@ interpolate_texcoords(GLcontext *ctx, SWspan *span)
                   r += drdx;
                }
             }
+#ifdef USE_X86_64_ASM
+            else if (useSSE2) {
+               _swrast_sse2_interpolate_texcoords(span->end, start, step,
+                                                  texcoord, lambda);
+            }
+#endif
             else {
                for (i = 0; i < span->end; i++) {
                   const GLfloat invQ = (q == 0.0F) ? 1.0F : (1.0F / q);
@@ -1285,7 +1324,8 @@ _swrast_write_rgba_span( GLcontext *ctx, SWspan *span)
    void * const origRgba = span->array->rgba;
    const GLboolean shader = (ctx->FragmentProgram._Current
                              || ctx->ATIFragmentShader._Enabled);
-   const GLboolean shaderOrTexture = shader || ctx->Texture._EnabledCoordUnits;
+   const GLboolean shaderOrTexture = shader ||
+      (ctx->Texture._EnabledCoordUnits && !span->textured);
    struct gl_framebuffer *fb = ctx->DrawBuffer;
 
    /*
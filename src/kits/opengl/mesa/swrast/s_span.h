@@ -119,6 +119,9 @@ typedef struct sw_span
    /** 0 = front-facing span, 1 = back-facing span (for two-sided stencil) */
    GLuint facing;
 
+   /** The span's colors are already textured (see s_triangle.c) */
+   GLboolean textured;
+
    /**
     * This bitmask (of  \link SpanFlags SPAN_* flags\endlink) indicates
     * which of the attrStart/StepX/StepY variables are relevant.
@@ -171,7 +174,8 @@ do {						\
    (S).end = 0;					\
    (S).leftClip = 0;				\
    (S).facing = 0;				\
-   (S).array = SWRAST_CONTEXT(ctx)->SpanArrays;	\
+   (S).textured = GL_FALSE;			\
+   (S).array = _swrast_span_arrays(ctx);	\
 } while (0)
 
 
@@ -0,0 +1,589 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file s_span_sse2.c
+ * SSE2 versions of the hot per-fragment span functions, for x86-64.
+ *
+ * These give exactly the same results as the C code they replace: the
+ * integer interpolants are stepped with the same wrapping arithmetic,
+ * float interpolants are still accumulated one fragment at a time, and
+ * the 8-bit blend functions use the same DIV255() rounding.  Spans are
+ * processed four (or eight) fragments at a time; the last partial group
+ * goes through small padded buffers so that nothing past the end of the
+ * span arrays is touched.
+ */
+
+#ifdef USE_X86_64_ASM
+
+#include <emmintrin.h>
+
+#include "main/glheader.h"
+#include "main/colormac.h"
+#include "main/macros.h"
+
+#include "s_context.h"
+#include "s_span_sse2.h"
+
+
+/** Number of bits set in a four bit mask */
+static const GLubyte bit_count[16] = {
+   0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+
+
+static INLINE __m128i
+load_4ub(const GLubyte *p)
+{
+   GLint v;
+   memcpy(&v, p, sizeof(v));
+   return _mm_cvtsi32_si128(v);
+}
+
+
+static INLINE void
+store_4ub(GLubyte *p, __m128i v)
+{
+   const GLint i = _mm_cvtsi128_si32(v);
+   memcpy(p, &i, sizeof(i));
+}
+
+
+static INLINE __m128i
+select_si128(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+/* =============================================================
+ * Interpolation
+ */
+
+/**
+ * Fill zArray with n values starting at z, stepping by zStep.  If fixed
+ * the values are converted with FixedToInt(), else they're used as is.
+ */
+void
+_swrast_sse2_interpolate_z(GLuint n, GLuint z, GLint zStep, GLboolean fixed,
+                           GLuint zArray[])
+{
+   const __m128i shift = _mm_cvtsi32_si128(fixed ? FIXED_SHIFT : 0);
+   const __m128i step4 = _mm_set1_epi32(zStep * 4);
+   const __m128i step8 = _mm_set1_epi32(zStep * 8);
+   __m128i zv = _mm_setr_epi32(z, z + zStep, z + 2 * zStep, z + 3 * zStep);
+   __m128i zv4 = _mm_add_epi32(zv, step4);
+   GLuint i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      _mm_storeu_si128((__m128i *) (zArray + i), _mm_sra_epi32(zv, shift));
+      _mm_storeu_si128((__m128i *) (zArray + i + 4),
+                       _mm_sra_epi32(zv4, shift));
+      zv = _mm_add_epi32(zv, step8);
+      zv4 = _mm_add_epi32(zv4, step8);
+   }
+
+   if (i + 4 <= n) {
+      _mm_storeu_si128((__m128i *) (zArray + i), _mm_sra_epi32(zv, shift));
+      zv = zv4;
+      i += 4;
+   }
+
+   if (i < n) {
+      GLuint tmp[4];
+      _mm_storeu_si128((__m128i *) tmp, _mm_sra_epi32(zv, shift));
+      memcpy(zArray + i, tmp, (n - i) * sizeof(GLuint));
+   }
+}
+
+
+/** FixedToChan() of four fixed point values, truncated to GLubyte */
+#define FIXED_TO_UBYTE(v, comp)						\
+   _mm_slli_epi32(_mm_and_si128(_mm_srai_epi32(v, FIXED_SHIFT),		\
+                                byte_mask), (comp) * 8)
+
+
+/**
+ * Fill rgba with n colors interpolated from the fixed point start
+ * values, in RGBA order, like interpolate_int_colors() does.
+ */
+void
+_swrast_sse2_interpolate_rgba8(GLuint n, const GLfixed start[4],
+                               const GLint step[4], GLubyte rgba[][4])
+{
+   const __m128i byte_mask = _mm_set1_epi32(0xff);
+   const __m128i dr = _mm_set1_epi32(step[0] * 4);
+   const __m128i dg = _mm_set1_epi32(step[1] * 4);
+   const __m128i db = _mm_set1_epi32(step[2] * 4);
+   const __m128i da = _mm_set1_epi32(step[3] * 4);
+   __m128i r = _mm_setr_epi32(start[0], start[0] + step[0],
+                              start[0] + 2 * step[0], start[0] + 3 * step[0]);
+   __m128i g = _mm_setr_epi32(start[1], start[1] + step[1],
+                              start[1] + 2 * step[1], start[1] + 3 * step[1]);
+   __m128i b = _mm_setr_epi32(start[2], start[2] + step[2],
+                              start[2] + 2 * step[2], start[2] + 3 * step[2]);
+   __m128i a = _mm_setr_epi32(start[3], start[3] + step[3],
+                              start[3] + 2 * step[3], start[3] + 3 * step[3]);
+   __m128i pixels;
+   GLuint i;
+
+   for (i = 0; ; i += 4) {
+      pixels = _mm_or_si128(_mm_or_si128(FIXED_TO_UBYTE(r, RCOMP),
+                                         FIXED_TO_UBYTE(g, GCOMP)),
+                            _mm_or_si128(FIXED_TO_UBYTE(b, BCOMP),
+                                         FIXED_TO_UBYTE(a, ACOMP)));
+      if (i + 4 > n)
+         break;
+
+      _mm_storeu_si128((__m128i *) rgba[i], pixels);
+      r = _mm_add_epi32(r, dr);
+      g = _mm_add_epi32(g, dg);
+      b = _mm_add_epi32(b, db);
+      a = _mm_add_epi32(a, da);
+   }
+
+   if (i < n) {
+      GLubyte tmp[4][4];
+      _mm_storeu_si128((__m128i *) tmp, pixels);
+      memcpy(rgba[i], tmp, (n - i) * 4);
+   }
+}
+
+
+/**
+ * Store four texcoords, dividing s, t and r by q, as in the perspective
+ * path of interpolate_texcoords().
+ */
+static INLINE void
+store_texcoords_q(GLfloat texcoord[][4], GLfloat lambda[], GLuint count,
+                  const __m128 v[4])
+{
+   const __m128 one = _mm_set1_ps(1.0F);
+   const __m128 t01 = _mm_unpackhi_ps(v[0], v[1]);	/* r0 r1 q0 q1 */
+   const __m128 t23 = _mm_unpackhi_ps(v[2], v[3]);	/* r2 r3 q2 q3 */
+   const __m128 q = _mm_movehl_ps(t23, t01);
+   const __m128 zero_q = _mm_cmpeq_ps(q, _mm_setzero_ps());
+   __m128 invQ = _mm_div_ps(one, q);
+   const __m128i keep_q = _mm_setr_epi32(0, 0, 0, ~0);
+   __m128 tc[4];
+   GLuint j;
+
+   /* invQ = (q == 0.0F) ? 1.0F : (1.0F / q) */
+   invQ = _mm_or_ps(_mm_and_ps(zero_q, one), _mm_andnot_ps(zero_q, invQ));
+
+   tc[0] = _mm_mul_ps(v[0], _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(0,0,0,0)));
+   tc[1] = _mm_mul_ps(v[1], _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(1,1,1,1)));
+   tc[2] = _mm_mul_ps(v[2], _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(2,2,2,2)));
+   tc[3] = _mm_mul_ps(v[3], _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(3,3,3,3)));
+
+   for (j = 0; j < count; j++) {
+      /* texcoord[3] is q itself */
+      const __m128 k = _mm_castsi128_ps(keep_q);
+      _mm_storeu_ps(texcoord[j],
+                    _mm_or_ps(_mm_and_ps(k, v[j]), _mm_andnot_ps(k, tc[j])));
+      lambda[j] = 0.0F;
+   }
+}
+
+
+/**
+ * Interpolate n texcoords from start by step, dividing s, t and r by q.
+ * For the no-lambda, non-ortho case of interpolate_texcoords().
+ */
+void
+_swrast_sse2_interpolate_texcoords(GLuint n, const GLfloat start[4],
+                                   const GLfloat step[4],
+                                   GLfloat texcoord[][4], GLfloat lambda[])
+{
+   const __m128 d = _mm_loadu_ps(step);
+   __m128 v[4], tc = _mm_loadu_ps(start);
+   GLuint i, j;
+
+   for (i = 0; i < n; i += 4) {
+      for (j = 0; j < 4; j++) {
+         v[j] = tc;
+         tc = _mm_add_ps(tc, d);
+      }
+
+      store_texcoords_q(texcoord + i, lambda + i, MIN2(n - i, 4), v);
+   }
+}
+
+
+/**
+ * Interpolate n texcoords from start by step, multiplying them by 1/w,
+ * for fragment programs and ATI fragment shaders.
+ */
+void
+_swrast_sse2_interpolate_texcoords_w(GLuint n, const GLfloat start[4],
+                                     const GLfloat step[4],
+                                     GLfloat w, GLfloat dwdx,
+                                     GLfloat texcoord[][4], GLfloat lambda[])
+{
+   const __m128 d = _mm_loadu_ps(step);
+   const __m128 one = _mm_set1_ps(1.0F);
+   __m128 v = _mm_loadu_ps(start);
+   GLuint i, j;
+
+   for (i = 0; i < n; i += 4) {
+      const GLuint count = MIN2(n - i, 4);
+      GLfloat wv[4];
+      __m128 invW;
+
+      for (j = 0; j < 4; j++) {
+         wv[j] = w;
+         w += dwdx;
+      }
+      invW = _mm_div_ps(one, _mm_loadu_ps(wv));
+
+      for (j = 0; j < count; j++) {
+         const __m128 iw = _mm_shuffle_ps(invW, invW, _MM_SHUFFLE(0,0,0,0));
+         _mm_storeu_ps(texcoord[i + j], _mm_mul_ps(v, iw));
+         lambda[i + j] = 0.0F;
+         invW = _mm_shuffle_ps(invW, invW, _MM_SHUFFLE(0,3,2,1));
+         v = _mm_add_ps(v, d);
+      }
+   }
+}
+
+
+/* =============================================================
+ * Depth testing
+ */
+
+/**
+ * The depth functions done here, the rest stay with the C code.
+ */
+GLboolean
+_swrast_sse2_depth_func_supported(GLenum func)
+{
+   return (func == GL_LESS || func == GL_LEQUAL ||
+           func == GL_GREATER || func == GL_GEQUAL);
+}
+
+
+/**
+ * Compare signed (biased) z against zbuffer values with func.
+ */
+#define DEPTH_COMPARE(BITS, func, z, zb)				\
+   ((func) == GL_LESS ? _mm_cmplt_epi##BITS(z, zb) :			\
+    (func) == GL_LEQUAL ? _mm_xor_si128(_mm_cmpgt_epi##BITS(z, zb), ones) : \
+    (func) == GL_GREATER ? _mm_cmpgt_epi##BITS(z, zb) :			\
+    _mm_xor_si128(_mm_cmplt_epi##BITS(z, zb), ones))
+
+
+/**
+ * Depth test four fragments.  Returns the number which passed.
+ */
+static INLINE GLuint
+depth_test4_32(GLenum func, GLboolean write, GLuint zbuffer[],
+               const GLuint z[], GLubyte mask[])
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i ones = _mm_cmpeq_epi32(zero, zero);
+   const __m128i bias = _mm_set1_epi32(0x80000000);
+   const __m128i zv = _mm_loadu_si128((const __m128i *) z);
+   const __m128i zbv = _mm_loadu_si128((const __m128i *) zbuffer);
+   const __m128i m8 = load_4ub(mask);
+   const __m128i m32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(m8, zero), zero);
+   const __m128i live = _mm_xor_si128(_mm_cmpeq_epi32(m32, zero), ones);
+   __m128i pass, pass8;
+
+   pass = DEPTH_COMPARE(32, func, _mm_xor_si128(zv, bias),
+                        _mm_xor_si128(zbv, bias));
+   pass = _mm_and_si128(pass, live);
+
+   if (write)
+      _mm_storeu_si128((__m128i *) zbuffer, select_si128(pass, zv, zbv));
+
+   pass8 = _mm_packs_epi16(_mm_packs_epi32(pass, pass), zero);
+   store_4ub(mask, _mm_and_si128(m8, pass8));
+
+   return bit_count[_mm_movemask_ps(_mm_castsi128_ps(pass))];
+}
+
+
+/**
+ * Depth test eight fragments against a 16-bit buffer.  Returns the
+ * number which passed.
+ */
+static INLINE GLuint
+depth_test8_16(GLenum func, GLboolean write, GLushort zbuffer[],
+               const GLuint z[], GLubyte mask[])
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i ones = _mm_cmpeq_epi16(zero, zero);
+   const __m128i bias32 = _mm_set1_epi32(0x8000);
+   const __m128i bias16 = _mm_set1_epi16((short) 0x8000);
+   const __m128i zlo = _mm_loadu_si128((const __m128i *) z);
+   const __m128i zhi = _mm_loadu_si128((const __m128i *) (z + 4));
+   /* z values are 16 bits, so the biased values pack without saturating */
+   const __m128i zv = _mm_packs_epi32(_mm_sub_epi32(zlo, bias32),
+                                      _mm_sub_epi32(zhi, bias32));
+   const __m128i zbv = _mm_loadu_si128((const __m128i *) zbuffer);
+   const __m128i m8 = _mm_loadl_epi64((const __m128i *) mask);
+   const __m128i live = _mm_xor_si128(_mm_cmpeq_epi16(
+                                         _mm_unpacklo_epi8(m8, zero), zero),
+                                      ones);
+   __m128i pass, pass8;
+   GLuint bits;
+
+   pass = DEPTH_COMPARE(16, func, zv, _mm_xor_si128(zbv, bias16));
+   pass = _mm_and_si128(pass, live);
+
+   if (write)
+      _mm_storeu_si128((__m128i *) zbuffer,
+                       select_si128(pass, _mm_xor_si128(zv, bias16), zbv));
+
+   pass8 = _mm_packs_epi16(pass, zero);
+   _mm_storel_epi64((__m128i *) mask, _mm_and_si128(m8, pass8));
+
+   bits = _mm_movemask_epi8(pass8);
+   return bit_count[bits & 0xf] + bit_count[(bits >> 4) & 0xf];
+}
+
+
+GLuint
+_swrast_sse2_depth_test_span32(GLuint n, GLenum func, GLboolean write,
+                               GLuint zbuffer[], const GLuint z[],
+                               GLubyte mask[])
+{
+   GLuint passed = 0, i;
+
+   for (i = 0; i + 4 <= n; i += 4)
+      passed += depth_test4_32(func, write, zbuffer + i, z + i, mask + i);
+
+   if (i < n) {
+      const GLuint rest = n - i;
+      GLuint zb[4], zz[4];
+      GLubyte m[4] = { 0, 0, 0, 0 };
+
+      memset(zb, 0, sizeof(zb));
+      memset(zz, 0, sizeof(zz));
+      memcpy(zb, zbuffer + i, rest * sizeof(GLuint));
+      memcpy(zz, z + i, rest * sizeof(GLuint));
+      memcpy(m, mask + i, rest);
+      passed += depth_test4_32(func, write, zb, zz, m);
+      if (write)
+         memcpy(zbuffer + i, zb, rest * sizeof(GLuint));
+      memcpy(mask + i, m, rest);
+   }
+
+   return passed;
+}
+
+
+GLuint
+_swrast_sse2_depth_test_span16(GLuint n, GLenum func, GLboolean write,
+                               GLushort zbuffer[], const GLuint z[],
+                               GLubyte mask[])
+{
+   GLuint passed = 0, i;
+
+   for (i = 0; i + 8 <= n; i += 8)
+      passed += depth_test8_16(func, write, zbuffer + i, z + i, mask + i);
+
+   if (i < n) {
+      const GLuint rest = n - i;
+      GLushort zb[8];
+      GLuint zz[8];
+      GLubyte m[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+      memset(zb, 0, sizeof(zb));
+      memset(zz, 0, sizeof(zz));
+      memcpy(zb, zbuffer + i, rest * sizeof(GLushort));
+      memcpy(zz, z + i, rest * sizeof(GLuint));
+      memcpy(m, mask + i, rest);
+      passed += depth_test8_16(func, write, zb, zz, m);
+      if (write)
+         memcpy(zbuffer + i, zb, rest * sizeof(GLushort));
+      memcpy(mask + i, m, rest);
+   }
+
+   return passed;
+}
+
+
+/* =============================================================
+ * Blending, GL_UNSIGNED_BYTE only
+ */
+
+/**
+ * Blend four pixels with BLEND, keeping the source color of the pixels
+ * whose mask is zero.
+ */
+#define BLEND4(BLEND, s, d, m)						\
+do {									\
+   const __m128i zero = _mm_setzero_si128();				\
+   const __m128i sv = _mm_loadu_si128((const __m128i *) (s));		\
+   const __m128i dv = _mm_loadu_si128((const __m128i *) (d));		\
+   __m128i keep = _mm_unpacklo_epi8(load_4ub(m), zero);			\
+   keep = _mm_cmpeq_epi32(_mm_unpacklo_epi16(keep, zero), zero);	\
+   _mm_storeu_si128((__m128i *) (s),					\
+                    select_si128(keep, sv, BLEND(sv, dv)));		\
+} while (0)
+
+
+/**
+ * Blend n pixels with BLEND, four at a time.  The last few go through
+ * padded buffers.
+ */
+#define BLEND_LOOP(BLEND)						\
+do {									\
+   GLubyte (*rgba)[4] = (GLubyte (*)[4]) src;				\
+   const GLubyte (*dest)[4] = (const GLubyte (*)[4]) dst;		\
+   GLuint i;								\
+									\
+   ASSERT(chanType == GL_UNSIGNED_BYTE);				\
+   (void) ctx;								\
+									\
+   for (i = 0; i + 4 <= n; i += 4)					\
+      BLEND4(BLEND, rgba[i], dest[i], mask + i);			\
+									\
+   if (i < n) {								\
+      const GLuint rest = n - i;					\
+      GLubyte tmp_s[4][4], tmp_d[4][4], tmp_m[4];			\
+									\
+      memset(tmp_s, 0, sizeof(tmp_s));					\
+      memset(tmp_d, 0, sizeof(tmp_d));					\
+      memset(tmp_m, 0, sizeof(tmp_m));					\
+      memcpy(tmp_s, rgba[i], rest * 4);					\
+      memcpy(tmp_d, dest[i], rest * 4);					\
+      memcpy(tmp_m, mask + i, rest);					\
+      BLEND4(BLEND, tmp_s, tmp_d, tmp_m);				\
+      memcpy(rgba[i], tmp_s, rest * 4);					\
+   }									\
+} while (0)
+
+
+/**
+ * DIV255() of eight signed 32-bit products in lo and hi, packed back
+ * to 16 bits.
+ */
+static INLINE __m128i
+div255_epi32(__m128i lo, __m128i hi)
+{
+   const __m128i round = _mm_set1_epi32(256);
+
+   lo = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(lo, 8), lo), round);
+   hi = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(hi, 8), hi), round);
+   return _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+}
+
+
+/**
+ * (s - d) * t / 255 + d for two pixels of 16-bit channels, where t is
+ * the source alpha.
+ */
+static INLINE __m128i
+transparency_epi16(__m128i s, __m128i d)
+{
+   const __m128i t = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s,
+                                            _MM_SHUFFLE(ACOMP, ACOMP,
+                                                        ACOMP, ACOMP)),
+                                         _MM_SHUFFLE(ACOMP, ACOMP,
+                                                     ACOMP, ACOMP));
+   const __m128i diff = _mm_sub_epi16(s, d);
+   const __m128i lo = _mm_mullo_epi16(diff, t);
+   const __m128i hi = _mm_mulhi_epi16(diff, t);
+
+   return _mm_add_epi16(div255_epi32(_mm_unpacklo_epi16(lo, hi),
+                                     _mm_unpackhi_epi16(lo, hi)), d);
+}
+
+
+static INLINE __m128i
+blend_transparency4(__m128i s, __m128i d)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i lo = transparency_epi16(_mm_unpacklo_epi8(s, zero),
+                                         _mm_unpacklo_epi8(d, zero));
+   const __m128i hi = transparency_epi16(_mm_unpackhi_epi8(s, zero),
+                                         _mm_unpackhi_epi8(d, zero));
+   return _mm_packus_epi16(lo, hi);
+}
+
+
+/**
+ * DIV255(s * d) for eight 16-bit channels.  The products fit in 16
+ * bits unsigned and (257 * x + 256) >> 16 == (257 * (x + 1)) >> 16 for
+ * all of them.
+ */
+static INLINE __m128i
+modulate_epi16(__m128i s, __m128i d)
+{
+   const __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, d), _mm_set1_epi16(1));
+   return _mm_mulhi_epu16(x, _mm_set1_epi16(257));
+}
+
+
+static INLINE __m128i
+blend_modulate4(__m128i s, __m128i d)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i lo = modulate_epi16(_mm_unpacklo_epi8(s, zero),
+                                     _mm_unpacklo_epi8(d, zero));
+   const __m128i hi = modulate_epi16(_mm_unpackhi_epi8(s, zero),
+                                     _mm_unpackhi_epi8(d, zero));
+   return _mm_packus_epi16(lo, hi);
+}
+
+
+/**
+ * glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+ */
+void
+_swrast_sse2_blend_transparency(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                                GLvoid *src, const GLvoid *dst,
+                                GLenum chanType)
+{
+   BLEND_LOOP(blend_transparency4);
+}
+
+
+/**
+ * glBlendFunc(GL_ONE, GL_ONE)
+ */
+void
+_swrast_sse2_blend_add(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                       GLvoid *src, const GLvoid *dst, GLenum chanType)
+{
+   BLEND_LOOP(_mm_adds_epu8);
+}
+
+
+/**
+ * Source times destination color, see blend_modulate()
+ */
+void
+_swrast_sse2_blend_modulate(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                            GLvoid *src, const GLvoid *dst, GLenum chanType)
+{
+   BLEND_LOOP(blend_modulate4);
+}
+
+
+/**
+ * glBlendEquation(GL_MIN)
+ */
+void
+_swrast_sse2_blend_min(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                       GLvoid *src, const GLvoid *dst, GLenum chanType)
+{
+   BLEND_LOOP(_mm_min_epu8);
+}
+
+
+/**
+ * glBlendEquation(GL_MAX)
+ */
+void
+_swrast_sse2_blend_max(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                       GLvoid *src, const GLvoid *dst, GLenum chanType)
+{
+   BLEND_LOOP(_mm_max_epu8);
+}
+
+#endif /* USE_X86_64_ASM */
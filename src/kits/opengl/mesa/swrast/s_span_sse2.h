@@ -0,0 +1,71 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef S_SPAN_SSE2_H
+#define S_SPAN_SSE2_H
+
+#include "main/mtypes.h"
+#include "swrast.h"
+
+
+#ifdef USE_X86_64_ASM
+
+extern void
+_swrast_sse2_interpolate_z(GLuint n, GLuint z, GLint zStep, GLboolean fixed,
+                           GLuint zArray[]);
+
+extern void
+_swrast_sse2_interpolate_rgba8(GLuint n, const GLfixed start[4],
+                               const GLint step[4], GLubyte rgba[][4]);
+
+extern void
+_swrast_sse2_interpolate_texcoords(GLuint n, const GLfloat start[4],
+                                   const GLfloat step[4],
+                                   GLfloat texcoord[][4], GLfloat lambda[]);
+
+extern void
+_swrast_sse2_interpolate_texcoords_w(GLuint n, const GLfloat start[4],
+                                     const GLfloat step[4],
+                                     GLfloat w, GLfloat dwdx,
+                                     GLfloat texcoord[][4], GLfloat lambda[]);
+
+extern GLboolean
+_swrast_sse2_depth_func_supported(GLenum func);
+
+extern GLuint
+_swrast_sse2_depth_test_span16(GLuint n, GLenum func, GLboolean write,
+                               GLushort zbuffer[], const GLuint z[],
+                               GLubyte mask[]);
+
+extern GLuint
+_swrast_sse2_depth_test_span32(GLuint n, GLenum func, GLboolean write,
+                               GLuint zbuffer[], const GLuint z[],
+                               GLubyte mask[]);
+
+extern void
+_swrast_sse2_blend_transparency(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                                GLvoid *src, const GLvoid *dst,
+                                GLenum chanType);
+
+extern void
+_swrast_sse2_blend_add(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                       GLvoid *src, const GLvoid *dst, GLenum chanType);
+
+extern void
+_swrast_sse2_blend_modulate(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                            GLvoid *src, const GLvoid *dst, GLenum chanType);
+
+extern void
+_swrast_sse2_blend_min(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                       GLvoid *src, const GLvoid *dst, GLenum chanType);
+
+extern void
+_swrast_sse2_blend_max(GLcontext *ctx, GLuint n, const GLubyte mask[],
+                       GLvoid *src, const GLvoid *dst, GLenum chanType);
+
+#endif /* USE_X86_64_ASM */
+
+
+#endif /* S_SPAN_SSE2_H */
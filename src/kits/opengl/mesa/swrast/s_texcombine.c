@@ -47,9 +47,9 @@ typedef float (*float4_array)[4];
  * Return array of texels for given unit.
  */
 static INLINE float4_array
-get_texel_array(SWcontext *swrast, GLuint unit)
+get_texel_array(const GLfloat *texelBuffer, GLuint unit)
 {
-   return (float4_array) (swrast->TexelBuffer + unit * MAX_WIDTH * 4);
+   return (float4_array) (texelBuffer + unit * MAX_WIDTH * 4);
 }
 
 
@@ -78,7 +78,6 @@ texture_combine( GLcontext *ctx, GLuint unit, GLuint n,
                  const GLfloat *texelBuffer,
                  GLchan (*rgbaChan)[4] )
 {
-   SWcontext *swrast = SWRAST_CONTEXT(ctx);
    const struct gl_texture_unit *textureUnit = &(ctx->Texture.Unit[unit]);
    const struct gl_tex_env_combine_state *combine = textureUnit->_CurrentCombine;
    float4_array argRGB[MAX_COMBINER_TERMS];
@@ -117,7 +116,7 @@ texture_combine( GLcontext *ctx, GLuint unit, GLuint n,
 
       switch (srcRGB) {
          case GL_TEXTURE:
-            argRGB[term] = get_texel_array(swrast, unit);
+            argRGB[term] = get_texel_array(texelBuffer, unit);
             break;
          case GL_PRIMARY_COLOR:
             argRGB[term] = primary_rgba;
@@ -165,7 +164,7 @@ texture_combine( GLcontext *ctx, GLuint unit, GLuint n,
                ASSERT(srcUnit < ctx->Const.MaxTextureUnits);
                if (!ctx->Texture.Unit[srcUnit]._ReallyEnabled)
                   return;
-               argRGB[term] = get_texel_array(swrast, srcUnit);
+               argRGB[term] = get_texel_array(texelBuffer, srcUnit);
             }
       }
 
@@ -213,7 +212,7 @@ texture_combine( GLcontext *ctx, GLuint unit, GLuint n,
 
       switch (srcA) {
          case GL_TEXTURE:
-            argA[term] = get_texel_array(swrast, unit);
+            argA[term] = get_texel_array(texelBuffer, unit);
             break;
          case GL_PRIMARY_COLOR:
             argA[term] = primary_rgba;
@@ -255,7 +254,7 @@ texture_combine( GLcontext *ctx, GLuint unit, GLuint n,
                ASSERT(srcUnit < ctx->Const.MaxTextureUnits);
                if (!ctx->Texture.Unit[srcUnit]._ReallyEnabled)
                   return;
-               argA[term] = get_texel_array(swrast, srcUnit);
+               argA[term] = get_texel_array(texelBuffer, srcUnit);
             }
       }
 
@@ -560,6 +559,7 @@ void
 _swrast_texture_span( GLcontext *ctx, SWspan *span )
 {
    SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   GLfloat *texelBuffer = _swrast_texel_buffer(ctx);
    GLfloat primary_rgba[MAX_WIDTH][4];
    GLuint unit;
 
@@ -592,7 +592,7 @@ _swrast_texture_span( GLcontext *ctx, SWspan *span )
 
          const struct gl_texture_object *curObj = texUnit->_Current;
          GLfloat *lambda = span->array->lambda[unit];
-         float4_array texels = get_texel_array(swrast, unit);
+         float4_array texels = get_texel_array(texelBuffer, unit);
          GLuint i;
          GLfloat rotMatrix00 = ctx->Texture.Unit[unit].RotMatrix[0];
          GLfloat rotMatrix01 = ctx->Texture.Unit[unit].RotMatrix[1];
@@ -652,7 +652,7 @@ _swrast_texture_span( GLcontext *ctx, SWspan *span )
             span->array->attribs[FRAG_ATTRIB_TEX0 + unit];
          const struct gl_texture_object *curObj = texUnit->_Current;
          GLfloat *lambda = span->array->lambda[unit];
-         float4_array texels = get_texel_array(swrast, unit);
+         float4_array texels = get_texel_array(texelBuffer, unit);
 
          /* adjust texture lod (lambda) */
          if (span->arrayMask & SPAN_LAMBDA) {
@@ -703,7 +703,7 @@ _swrast_texture_span( GLcontext *ctx, SWspan *span )
       if (ctx->Texture.Unit[unit]._ReallyEnabled) {
          texture_combine( ctx, unit, span->end,
                           primary_rgba,
-                          swrast->TexelBuffer,
+                          texelBuffer,
                           span->array->rgba );
       }
    }
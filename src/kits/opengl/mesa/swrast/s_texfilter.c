@@ -23,6 +23,10 @@
  */
 
 
+#ifdef USE_X86_64_ASM
+#include <emmintrin.h>
+#endif
+
 #include "main/glheader.h"
 #include "main/context.h"
 #include "main/colormac.h"
@@ -1167,6 +1171,292 @@ sample_2d_linear_repeat(GLcontext *ctx,
 }
 
 
+/**
+ * For the 8-bit per component formats, return which byte of the 32-bit
+ * texel (bits 8*n..8*n+7) holds the R, G, B and A components.  Returns
+ * NULL for other formats.
+ */
+static const GLubyte *
+rgba8_components(const struct gl_texture_image *img)
+{
+   static const GLubyte rgba8888[4] = { 3, 2, 1, 0 };
+   static const GLubyte rgba8888_rev[4] = { 0, 1, 2, 3 };
+   static const GLubyte argb8888[4] = { 2, 1, 0, 3 };
+   static const GLubyte argb8888_rev[4] = { 1, 2, 3, 0 };
+
+   switch (img->TexFormat->MesaFormat) {
+   case MESA_FORMAT_RGBA8888:
+      return rgba8888;
+   case MESA_FORMAT_RGBA8888_REV:
+      return rgba8888_rev;
+   case MESA_FORMAT_ARGB8888:
+      return argb8888;
+   case MESA_FORMAT_ARGB8888_REV:
+      return argb8888_rev;
+#if CHAN_TYPE == GL_UNSIGNED_BYTE
+   case MESA_FORMAT_RGBA:
+      /* R, G, B, A bytes in memory */
+#ifdef MESA_BIG_ENDIAN
+      return rgba8888;
+#else
+      return rgba8888_rev;
+#endif
+#endif
+   default:
+      return NULL;
+   }
+}
+
+
+/**
+ * Whether linear filtering with this wrap mode only ever addresses
+ * texels inside the image.
+ */
+static INLINE GLboolean
+wrap_inside_image(GLenum wrapMode)
+{
+   return wrapMode == GL_REPEAT ||
+          wrapMode == GL_CLAMP_TO_EDGE ||
+          wrapMode == GL_MIRRORED_REPEAT ||
+          wrapMode == GL_MIRROR_CLAMP_TO_EDGE_EXT;
+}
+
+
+/**
+ * Whether mipmap levels tObj->BaseLevel through maxLevel can be sampled
+ * with the fixed point filters below: same 8-bit per component format,
+ * no border and S/T wrap modes which need no border color.
+ */
+static GLboolean
+use_rgba8_filter(const struct gl_texture_object *tObj, GLint maxLevel)
+{
+   const struct gl_texture_image *base = tObj->Image[0][tObj->BaseLevel];
+   GLint level;
+
+   if (!wrap_inside_image(tObj->WrapS) ||
+       !wrap_inside_image(tObj->WrapT) ||
+       !rgba8_components(base))
+      return GL_FALSE;
+
+   for (level = tObj->BaseLevel; level <= maxLevel; level++) {
+      const struct gl_texture_image *img = tObj->Image[0][level];
+      if (!img ||
+          img->Border ||
+          img->TexFormat->MesaFormat != base->TexFormat->MesaFormat)
+         return GL_FALSE;
+   }
+   return GL_TRUE;
+}
+
+
+/**
+ * As linear_texel_locations(), for the wrap modes accepted by
+ * wrap_inside_image() and with the weight in [0,256].
+ */
+static INLINE void
+linear_texel_locations_rgba8(GLenum wrapMode, GLint size, GLfloat s,
+                             GLint *i0, GLint *i1, GLint *weight)
+{
+   GLfloat u;
+   GLint pos;
+
+   switch (wrapMode) {
+   case GL_REPEAT:
+      u = s - (GLfloat) IFLOOR(s);
+      break;
+   case GL_CLAMP_TO_EDGE:
+      u = CLAMP(s, 0.0F, 1.0F);
+      break;
+   case GL_MIRRORED_REPEAT:
+      {
+         const GLint flr = IFLOOR(s);
+         if (flr & 1)
+            u = 1.0F - (s - (GLfloat) flr);
+         else
+            u = s - (GLfloat) flr;
+      }
+      break;
+   default:
+      ASSERT(wrapMode == GL_MIRROR_CLAMP_TO_EDGE_EXT);
+      u = MIN2(FABSF(s), 1.0F);
+   }
+
+   /* u * size - 0.5 rounded to 1/256, plus one so it isn't negative */
+   pos = (GLint) (u * (GLfloat) (size * 256) + 128.5F);
+   *weight = pos & 0xff;
+   *i0 = (pos >> 8) - 1;
+
+   /* also keeps NaN coordinates inside the image */
+   if (wrapMode == GL_REPEAT) {
+      if ((GLuint) *i0 >= (GLuint) size)
+         *i0 = *i0 < 0 ? size - 1 : 0;
+      *i1 = *i0 + 1 < size ? *i0 + 1 : 0;
+   }
+   else {
+      *i1 = CLAMP(*i0 + 1, 0, size - 1);
+      *i0 = CLAMP(*i0, 0, size - 1);
+   }
+}
+
+
+/**
+ * Scale of the results of lerp_rgba8_2d(): the weights have 8 fraction
+ * bits and one bit is dropped between the two passes.
+ */
+#define RGBA8_SCALE  (1.0F / (255.0F * 256.0F * 128.0F))
+
+
+/**
+ * Fixed point bilinear interpolation of the four 8-bit per component
+ * texels at (i0,j0), (i1,j0), (i0,j1) and (i1,j1).  a and b are the
+ * horizontal and vertical weights in [0,256].  The result is indexed
+ * by byte of the texel, unscaled (see RGBA8_SCALE).
+ */
+static INLINE void
+lerp_rgba8_2d(const struct gl_texture_image *img,
+              GLint i0, GLint i1, GLint j0, GLint j1, GLint a, GLint b,
+              GLfloat result[4])
+{
+   const GLuint *row0 = (const GLuint *) img->Data + j0 * img->RowStride;
+   const GLuint *row1 = (const GLuint *) img->Data + j1 * img->RowStride;
+#ifdef USE_X86_64_ASM
+   /* 16-bit lanes: texels (i0,j0) and (i0,j1), then (i1,j0) and (i1,j1) */
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i t0 = _mm_unpacklo_epi8(
+      _mm_unpacklo_epi32(_mm_cvtsi32_si128(row0[i0]),
+                         _mm_cvtsi32_si128(row1[i0])), zero);
+   const __m128i t1 = _mm_unpacklo_epi8(
+      _mm_unpacklo_epi32(_mm_cvtsi32_si128(row0[i1]),
+                         _mm_cvtsi32_si128(row1[i1])), zero);
+   __m128i rows;
+
+   /* horizontal pass, at most 255 * 256 so it fits unsigned words */
+   rows = _mm_add_epi16(_mm_mullo_epi16(t0, _mm_set1_epi16(256 - a)),
+                        _mm_mullo_epi16(t1, _mm_set1_epi16(a)));
+
+   /* vertical pass on signed word pairs (row 0, row 1) */
+   rows = _mm_srli_epi16(rows, 1);
+   rows = _mm_unpacklo_epi16(rows, _mm_srli_si128(rows, 8));
+   rows = _mm_madd_epi16(rows, _mm_set1_epi32((b << 16) | (256 - b)));
+
+   _mm_storeu_ps(result, _mm_cvtepi32_ps(rows));
+#else
+   const GLuint t00 = row0[i0], t10 = row0[i1];
+   const GLuint t01 = row1[i0], t11 = row1[i1];
+   GLuint k;
+
+   for (k = 0; k < 4; k++) {
+      const GLuint shift = 8 * k;
+      const GLint c0 = (((t00 >> shift) & 0xff) * (256 - a) +
+                        ((t10 >> shift) & 0xff) * a) >> 1;
+      const GLint c1 = (((t01 >> shift) & 0xff) * (256 - a) +
+                        ((t11 >> shift) & 0xff) * a) >> 1;
+      result[k] = (GLfloat) (c0 * (256 - b) + c1 * b);
+   }
+#endif
+}
+
+
+/**
+ * Bilinear sample of an image accepted by use_rgba8_filter().
+ */
+static INLINE void
+sample_2d_linear_rgba8(const struct gl_texture_object *tObj,
+                       const struct gl_texture_image *img,
+                       const GLfloat texcoord[4], GLfloat result[4])
+{
+   GLint i0, j0, i1, j1, a, b;
+
+   linear_texel_locations_rgba8(tObj->WrapS, img->Width2, texcoord[0],
+                                &i0, &i1, &a);
+   linear_texel_locations_rgba8(tObj->WrapT, img->Height2, texcoord[1],
+                                &j0, &j1, &b);
+
+   lerp_rgba8_2d(img, i0, i1, j0, j1, a, b, result);
+}
+
+
+/**
+ * Store a result of lerp_rgba8_2d() as an RGBA color.
+ */
+static INLINE void
+rgba8_to_rgba(const GLubyte comp[4], const GLfloat texel[4], GLfloat rgba[4])
+{
+   rgba[RCOMP] = texel[comp[0]] * RGBA8_SCALE;
+   rgba[GCOMP] = texel[comp[1]] * RGBA8_SCALE;
+   rgba[BCOMP] = texel[comp[2]] * RGBA8_SCALE;
+   rgba[ACOMP] = texel[comp[3]] * RGBA8_SCALE;
+}
+
+
+static void
+sample_linear_2d_rgba8(const struct gl_texture_object *tObj,
+                       const struct gl_texture_image *img,
+                       GLuint n, const GLfloat texcoords[][4],
+                       GLfloat rgba[][4])
+{
+   const GLubyte *comp = rgba8_components(img);
+   GLuint i;
+
+   for (i = 0; i < n; i++) {
+      GLfloat texel[4];
+      sample_2d_linear_rgba8(tObj, img, texcoords[i], texel);
+      rgba8_to_rgba(comp, texel, rgba[i]);
+   }
+}
+
+
+static void
+sample_2d_linear_mipmap_nearest_rgba8(const struct gl_texture_object *tObj,
+                                      GLuint n, const GLfloat texcoords[][4],
+                                      const GLfloat lambda[],
+                                      GLfloat rgba[][4])
+{
+   const GLubyte *comp =
+      rgba8_components(tObj->Image[0][tObj->BaseLevel]);
+   GLuint i;
+
+   for (i = 0; i < n; i++) {
+      const GLint level = nearest_mipmap_level(tObj, lambda[i]);
+      GLfloat texel[4];
+      sample_2d_linear_rgba8(tObj, tObj->Image[0][level], texcoords[i],
+                             texel);
+      rgba8_to_rgba(comp, texel, rgba[i]);
+   }
+}
+
+
+static void
+sample_2d_linear_mipmap_linear_rgba8(const struct gl_texture_object *tObj,
+                                     GLuint n, const GLfloat texcoords[][4],
+                                     const GLfloat lambda[],
+                                     GLfloat rgba[][4])
+{
+   const GLubyte *comp =
+      rgba8_components(tObj->Image[0][tObj->BaseLevel]);
+   GLuint i;
+
+   for (i = 0; i < n; i++) {
+      const GLint level = linear_mipmap_level(tObj, lambda[i]);
+      GLfloat texel[4];
+      if (level >= tObj->_MaxLevel) {
+         sample_2d_linear_rgba8(tObj, tObj->Image[0][tObj->_MaxLevel],
+                                texcoords[i], texel);
+      }
+      else {
+         const GLfloat f = FRAC(lambda[i]);
+         GLfloat t0[4], t1[4];
+         sample_2d_linear_rgba8(tObj, tObj->Image[0][level],
+                                texcoords[i], t0);
+         sample_2d_linear_rgba8(tObj, tObj->Image[0][level + 1],
+                                texcoords[i], t1);
+         lerp_rgba(texel, f, t0, t1);
+      }
+      rgba8_to_rgba(comp, texel, rgba[i]);
+   }
+}
+
+
 static void
 sample_2d_nearest_mipmap_nearest(GLcontext *ctx,
                                  const struct gl_texture_object *tObj,
@@ -1301,10 +1591,13 @@ sample_linear_2d(GLcontext *ctx,
    GLuint i;
    struct gl_texture_image *image = tObj->Image[0][tObj->BaseLevel];
    (void) lambda;
-   if (tObj->WrapS == GL_REPEAT &&
-       tObj->WrapT == GL_REPEAT &&
-       image->_IsPowerOfTwo &&
-       image->Border == 0) {
+   if (use_rgba8_filter(tObj, tObj->BaseLevel)) {
+      sample_linear_2d_rgba8(tObj, image, n, texcoords, rgba);
+   }
+   else if (tObj->WrapS == GL_REPEAT &&
+            tObj->WrapT == GL_REPEAT &&
+            image->_IsPowerOfTwo &&
+            image->Border == 0) {
       for (i = 0; i < n; i++) {
          sample_2d_linear_repeat(ctx, tObj, image, texcoords[i], rgba[i]);
       }
@@ -1456,15 +1749,22 @@ sample_lambda_2d(GLcontext *ctx,
                                           lambda + minStart, rgba + minStart);
          break;
       case GL_LINEAR_MIPMAP_NEAREST:
-         sample_2d_linear_mipmap_nearest(ctx, tObj, m, texcoords + minStart,
-                                         lambda + minStart, rgba + minStart);
+         if (use_rgba8_filter(tObj, tObj->_MaxLevel))
+            sample_2d_linear_mipmap_nearest_rgba8(tObj, m,
+                  texcoords + minStart, lambda + minStart, rgba + minStart);
+         else
+            sample_2d_linear_mipmap_nearest(ctx, tObj, m,
+                  texcoords + minStart, lambda + minStart, rgba + minStart);
          break;
       case GL_NEAREST_MIPMAP_LINEAR:
          sample_2d_nearest_mipmap_linear(ctx, tObj, m, texcoords + minStart,
                                          lambda + minStart, rgba + minStart);
          break;
       case GL_LINEAR_MIPMAP_LINEAR:
-         if (repeatNoBorderPOT)
+         if (use_rgba8_filter(tObj, tObj->_MaxLevel))
+            sample_2d_linear_mipmap_linear_rgba8(tObj, m,
+                  texcoords + minStart, lambda + minStart, rgba + minStart);
+         else if (repeatNoBorderPOT)
             sample_2d_linear_mipmap_linear_repeat(ctx, tObj, m,
                   texcoords + minStart, lambda + minStart, rgba + minStart);
          else
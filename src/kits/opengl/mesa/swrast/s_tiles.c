@@ -0,0 +1,428 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file s_tiles.c
+ * Binning of triangles into screen regions, which the worker thread
+ * pool renders.
+ */
+
+#include "main/glheader.h"
+#include "main/context.h"
+#include "main/imports.h"
+#include "main/macros.h"
+#include "main/threadpool.h"
+
+#include "pipe/p_thread.h"
+
+#include "s_blend.h"
+#include "s_context.h"
+#include "s_tiles.h"
+
+
+#define MAX_BINS  ((MAX_HEIGHT + SWRAST_TILE_ROWS - 1) / SWRAST_TILE_ROWS)
+
+
+/** Rendering storage of one thread */
+struct swrast_tile_thread {
+   struct swrast_tiles *tiles;
+   SWspanarrays *SpanArrays;
+   GLfloat *TexelBuffer;
+   struct gl_program_machine *FragProgMachine;
+   GLint RowMin, RowMax;	/**< rows of the band being rendered */
+};
+
+
+/** Triangles touching one band, in the order they were submitted */
+struct swrast_bin {
+   GLuint *tris;
+   GLuint count;
+   GLuint size;
+};
+
+
+struct swrast_tiles {
+   GLcontext *ctx;
+   struct mesa_threadpool *pool;
+
+   /** One per worker, then one for the calling thread */
+   struct swrast_tile_thread threads[SWRAST_MAX_THREADS + 1];
+
+   /** The triangle function chosen for the current state */
+   swrast_tri_func ChosenTriangle;
+
+   /* Buffered triangles, three vertices each:
+    */
+   swrast_tri_func Triangle;	/**< draws the buffered triangles */
+   SWvertex *verts;
+   GLuint nr_tris;
+   struct swrast_bin bin[MAX_BINS];
+   GLuint nr_bins;		/**< bins which may be non-empty */
+};
+
+
+/** The swrast_tile_thread of a thread while it renders tiles */
+static pipe_tsd thread_tsd;
+static GLboolean thread_tsd_created = GL_FALSE;
+pipe_static_mutex(thread_tsd_mutex);
+
+
+/**
+ * pipe_tsd_get() and pipe_tsd_set() create the key on first use, which
+ * isn't thread-safe, so create it up front.
+ */
+static void
+create_thread_tsd( void )
+{
+   pipe_mutex_lock(thread_tsd_mutex);
+   if (!thread_tsd_created) {
+      pipe_tsd_init(&thread_tsd);
+      thread_tsd_created = GL_TRUE;
+   }
+   pipe_mutex_unlock(thread_tsd_mutex);
+}
+
+
+/**
+ * The rendering storage of the calling thread, or NULL if it's not
+ * rendering tiles for ctx.
+ */
+static INLINE struct swrast_tile_thread *
+current_thread( GLcontext *ctx )
+{
+   struct swrast_tile_thread *thread;
+
+   if (!SWRAST_CONTEXT(ctx)->Tiles)
+      return NULL;
+
+   thread = (struct swrast_tile_thread *) pipe_tsd_get(&thread_tsd);
+   if (thread && thread->tiles != SWRAST_CONTEXT(ctx)->Tiles)
+      return NULL;
+
+   return thread;
+}
+
+
+/**
+ * Pool task: draw the triangles of bin b, clipped to its rows, with the
+ * storage of the given thread.
+ */
+static void
+render_bin( void *data, GLuint b, GLuint t )
+{
+   struct swrast_tiles *tiles = (struct swrast_tiles *) data;
+   struct swrast_tile_thread *thread = &tiles->threads[t];
+   const struct swrast_bin *bin = &tiles->bin[b];
+   GLcontext *ctx = tiles->ctx;
+   GLuint i;
+
+   if (!bin->count)
+      return;
+
+   thread->RowMin = b * SWRAST_TILE_ROWS;
+   thread->RowMax = thread->RowMin + SWRAST_TILE_ROWS;
+
+   pipe_tsd_set(&thread_tsd, thread);
+
+   for (i = 0; i < bin->count; i++) {
+      const SWvertex *v = tiles->verts + 3 * bin->tris[i];
+      tiles->Triangle(ctx, v, v + 1, v + 2);
+   }
+
+   pipe_tsd_set(&thread_tsd, NULL);
+}
+
+
+/**
+ * Allocate the rendering storage of a worker thread.
+ */
+static GLboolean
+init_worker_storage( GLcontext *ctx, struct swrast_tile_thread *thread )
+{
+   thread->SpanArrays = _swrast_new_span_arrays();
+   thread->TexelBuffer = (GLfloat *) MALLOC(ctx->Const.MaxTextureImageUnits *
+					    MAX_WIDTH * 4 * sizeof(GLfloat));
+   thread->FragProgMachine = CALLOC_STRUCT(gl_program_machine);
+
+   return thread->SpanArrays && thread->TexelBuffer &&
+      thread->FragProgMachine;
+}
+
+
+static void
+free_worker_storage( struct swrast_tile_thread *thread )
+{
+   if (thread->SpanArrays)
+      FREE(thread->SpanArrays);
+   if (thread->TexelBuffer)
+      FREE(thread->TexelBuffer);
+   if (thread->FragProgMachine)
+      FREE(thread->FragProgMachine);
+}
+
+
+/**
+ * Tile rendering is off unless MESA_SWRAST_THREADS asks for workers:
+ * they call the driver's span and renderbuffer functions, which don't
+ * have to be thread-safe.
+ */
+void
+_swrast_create_tiles( GLcontext *ctx )
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   struct swrast_tiles *tiles;
+   struct swrast_tile_thread *caller;
+   struct mesa_threadpool *pool;
+   GLuint nr_threads, i;
+
+   swrast->Tiles = NULL;
+
+   pool = _mesa_create_threadpool("MESA_SWRAST_THREADS", SWRAST_MAX_THREADS);
+   if (!pool)
+      return;
+
+   tiles = CALLOC_STRUCT(swrast_tiles);
+   if (!tiles) {
+      _mesa_destroy_threadpool(pool);
+      return;
+   }
+
+   create_thread_tsd();
+
+   tiles->ctx = ctx;
+   tiles->pool = pool;
+   swrast->Tiles = tiles;
+
+   nr_threads = _mesa_threadpool_size(pool);
+   for (i = 0; i < nr_threads; i++) {
+      tiles->threads[i].tiles = tiles;
+      if (!init_worker_storage(ctx, &tiles->threads[i])) {
+	 _swrast_destroy_tiles(ctx);
+	 return;
+      }
+   }
+
+   /* The calling thread renders with the context's own storage */
+   caller = &tiles->threads[nr_threads];
+   caller->tiles = tiles;
+   caller->SpanArrays = swrast->SpanArrays;
+   caller->TexelBuffer = swrast->TexelBuffer;
+   caller->FragProgMachine = &swrast->FragProgMachine;
+}
+
+
+void
+_swrast_destroy_tiles( GLcontext *ctx )
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   struct swrast_tiles *tiles = swrast->Tiles;
+   GLuint nr_threads, i;
+
+   if (!tiles)
+      return;
+
+   nr_threads = _mesa_threadpool_size(tiles->pool);
+   _mesa_destroy_threadpool(tiles->pool);
+   for (i = 0; i < nr_threads; i++)
+      free_worker_storage(&tiles->threads[i]);
+
+   for (i = 0; i < MAX_BINS; i++) {
+      if (tiles->bin[i].tris)
+	 FREE(tiles->bin[i].tris);
+   }
+   if (tiles->verts)
+      _mesa_align_free(tiles->verts);
+
+   FREE(tiles);
+   swrast->Tiles = NULL;
+}
+
+
+/**
+ * Append triangle tri to bin.
+ */
+static GLboolean
+bin_append( struct swrast_bin *bin, GLuint tri )
+{
+   if (bin->count == bin->size) {
+      const GLuint size = bin->size ? bin->size * 2 : 64;
+      GLuint *tris = (GLuint *) _mesa_realloc(bin->tris,
+					      bin->size * sizeof(GLuint),
+					      size * sizeof(GLuint));
+      if (!tris)
+	 return GL_FALSE;
+
+      bin->tris = tris;
+      bin->size = size;
+   }
+
+   bin->tris[bin->count++] = tri;
+   return GL_TRUE;
+}
+
+
+/**
+ * Called via swrast->Triangle: buffer the triangle and add it to the
+ * bins of all the bands it may touch.
+ */
+static void
+bin_triangle( GLcontext *ctx, const SWvertex *v0, const SWvertex *v1,
+	      const SWvertex *v2 )
+{
+   struct swrast_tiles *tiles = SWRAST_CONTEXT(ctx)->Tiles;
+   const GLint height = ctx->DrawBuffer->Height;
+   const GLfloat y0 = v0->attrib[FRAG_ATTRIB_WPOS][1];
+   const GLfloat y1 = v1->attrib[FRAG_ATTRIB_WPOS][1];
+   const GLfloat y2 = v2->attrib[FRAG_ATTRIB_WPOS][1];
+   const GLfloat ymin = MIN2(MIN2(y0, y1), y2);
+   const GLfloat ymax = MAX2(MAX2(y0, y1), y2);
+   GLint first, last, b;
+   GLuint tri;
+
+   if (tiles->nr_tris == SWRAST_TILE_MAX_TRIS ||
+       (tiles->nr_tris && tiles->Triangle != tiles->ChosenTriangle))
+      _swrast_flush_tiles(ctx);
+
+   if (!tiles->verts) {
+      tiles->verts = (SWvertex *)
+	 _mesa_align_malloc(3 * SWRAST_TILE_MAX_TRIS * sizeof(SWvertex), 16);
+      if (!tiles->verts) {
+	 tiles->ChosenTriangle(ctx, v0, v1, v2);
+	 return;
+      }
+   }
+
+   /* Nothing to draw above or below the buffer */
+   if (ymin >= (GLfloat) height || ymax < 0.0F)
+      return;
+
+   /* Conservative range of bands, the rasterizer does the exact
+    * clipping.  NaN coordinates get all the bands.
+    */
+   first = ymin > 0.0F ? (GLint) ymin / SWRAST_TILE_ROWS : 0;
+   last = ymax < (GLfloat) (height - 1) ?
+      ((GLint) ymax + 1) / SWRAST_TILE_ROWS :
+      (height - 1) / SWRAST_TILE_ROWS;
+
+   tri = tiles->nr_tris++;
+   tiles->Triangle = tiles->ChosenTriangle;
+   tiles->verts[3 * tri + 0] = *v0;
+   tiles->verts[3 * tri + 1] = *v1;
+   tiles->verts[3 * tri + 2] = *v2;
+
+   for (b = first; b <= last; b++) {
+      if (!bin_append(&tiles->bin[b], tri)) {
+	 /* Out of memory: render what's binned so far, then draw this
+	  * triangle the ordinary way.
+	  */
+	 while (b-- > first)
+	    tiles->bin[b].count--;
+	 tiles->nr_tris--;
+	 _swrast_flush_tiles(ctx);
+	 tiles->ChosenTriangle(ctx, v0, v1, v2);
+	 return;
+      }
+   }
+
+   if ((GLuint) last >= tiles->nr_bins)
+      tiles->nr_bins = last + 1;
+}
+
+
+/**
+ * Called after the triangle function was chosen: when tile rendering
+ * can be used, wrap it with the binning function.
+ */
+void
+_swrast_choose_tile_triangle( GLcontext *ctx )
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   struct swrast_tiles *tiles = swrast->Tiles;
+
+   if (!tiles)
+      return;
+
+   /* Feedback/select, antialiased triangles and occlusion queries
+    * aren't done per scanline, keep them serial.
+    */
+   if (ctx->RenderMode != GL_RENDER ||
+       ctx->Polygon.SmoothFlag ||
+       ctx->Query.CurrentOcclusionObject ||
+       ctx->DrawBuffer->Height <= SWRAST_TILE_ROWS)
+      return;
+
+   tiles->ChosenTriangle = swrast->Triangle;
+   swrast->Triangle = bin_triangle;
+}
+
+
+/**
+ * Render all buffered triangles, on the worker threads and the calling
+ * thread.  Returns when they're done.
+ */
+void
+_swrast_flush_tiles( GLcontext *ctx )
+{
+   struct swrast_tiles *tiles = SWRAST_CONTEXT(ctx)->Tiles;
+   GLuint i;
+
+   if (!tiles || tiles->nr_tris == 0)
+      return;
+
+   /* Choose the blend function now rather than in every worker */
+   if (ctx->Color.BlendEnabled)
+      _swrast_choose_blend_func(ctx, CHAN_TYPE);
+
+   _mesa_threadpool_run(tiles->pool, tiles->nr_bins, render_bin, tiles);
+
+   for (i = 0; i < tiles->nr_bins; i++)
+      tiles->bin[i].count = 0;
+   tiles->nr_bins = 0;
+   tiles->nr_tris = 0;
+}
+
+
+SWspanarrays *
+_swrast_span_arrays( GLcontext *ctx )
+{
+   const struct swrast_tile_thread *thread = current_thread(ctx);
+   return thread ? thread->SpanArrays : SWRAST_CONTEXT(ctx)->SpanArrays;
+}
+
+
+GLfloat *
+_swrast_texel_buffer( GLcontext *ctx )
+{
+   const struct swrast_tile_thread *thread = current_thread(ctx);
+   return thread ? thread->TexelBuffer : SWRAST_CONTEXT(ctx)->TexelBuffer;
+}
+
+
+struct gl_program_machine *
+_swrast_fragprog_machine( GLcontext *ctx )
+{
+   const struct swrast_tile_thread *thread = current_thread(ctx);
+   return thread ? thread->FragProgMachine
+      : &SWRAST_CONTEXT(ctx)->FragProgMachine;
+}
+
+
+/**
+ * The scanlines [*rowMin, *rowMax) the calling thread may render.
+ */
+void
+_swrast_tile_rows( GLcontext *ctx, GLint *rowMin, GLint *rowMax )
+{
+   const struct swrast_tile_thread *thread = current_thread(ctx);
+
+   if (thread) {
+      *rowMin = thread->RowMin;
+      *rowMax = thread->RowMax;
+   }
+   else {
+      *rowMin = 0;
+      *rowMax = MAX_HEIGHT;
+   }
+}
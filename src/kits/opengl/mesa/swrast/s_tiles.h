@@ -0,0 +1,80 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file s_tiles.h
+ * Tile-parallel triangle rasterization.
+ *
+ * Instead of being drawn right away, triangles are copied into a buffer
+ * and binned into horizontal bands of SWRAST_TILE_ROWS scanlines.  When
+ * the buffer is flushed the bands are handed out to a main/threadpool.c
+ * pool of worker threads and the calling thread.  Each renders the triangles of a band
+ * in the order they were submitted, restricted to the band's rows (see
+ * s_tritemp.h) and using its own span arrays.  Bands don't share any
+ * pixels, so the results are the same as when rendering serially.
+ *
+ * The buffer is flushed by _swrast_render_finish() and _swrast_flush(),
+ * before any point or line is drawn and whenever it fills up.
+ *
+ * Tile rendering is off by default, since the workers call the driver's
+ * span functions from other threads.  MESA_SWRAST_THREADS sets the
+ * number of workers, "auto" uses the number of CPUs minus one.
+ *
+ * Every band a triangle touches sets it up again and steps over all of
+ * its scanlines, only rendering those inside the band, so tall
+ * triangles cost more setup than with serial rendering.
+ */
+
+#ifndef S_TILES_H
+#define S_TILES_H
+
+#include "main/mtypes.h"
+#include "s_span.h"
+
+
+/** Max worker threads per context */
+#define SWRAST_MAX_THREADS    7
+
+/** Height of the screen regions triangles are binned into */
+#define SWRAST_TILE_ROWS      16
+
+/** Number of triangles buffered before they get rendered */
+#define SWRAST_TILE_MAX_TRIS  1024
+
+
+struct gl_program_machine;
+
+
+extern void
+_swrast_create_tiles( GLcontext *ctx );
+
+extern void
+_swrast_destroy_tiles( GLcontext *ctx );
+
+extern void
+_swrast_choose_tile_triangle( GLcontext *ctx );
+
+extern void
+_swrast_flush_tiles( GLcontext *ctx );
+
+
+/*
+ * Per-thread rendering storage: the worker's own when called from a
+ * tile worker, else the context's.
+ */
+extern SWspanarrays *
+_swrast_span_arrays( GLcontext *ctx );
+
+extern GLfloat *
+_swrast_texel_buffer( GLcontext *ctx );
+
+extern struct gl_program_machine *
+_swrast_fragprog_machine( GLcontext *ctx );
+
+extern void
+_swrast_tile_rows( GLcontext *ctx, GLint *rowMin, GLint *rowMax );
+
+
+#endif
@@ -266,7 +266,6 @@ affine_span(GLcontext *ctx, SWspan *span,
             struct affine_info *info)
 {
    GLchan sample[4];  /* the filtered texture sample */
-   const GLuint texEnableSave = ctx->Texture._EnabledCoordUnits;
 
    /* Instead of defining a function for each mode, a test is done
     * between the outer and inner loops. This is to reduce code size
@@ -396,8 +395,8 @@ affine_span(GLcontext *ctx, SWspan *span,
    GLuint i;
    GLchan *dest = span->array->rgba[0];
 
-   /* Disable tex units so they're not re-applied in swrast_write_rgba_span */
-   ctx->Texture._EnabledCoordUnits = 0x0;
+   /* Texturing is done here, not in swrast_write_rgba_span */
+   span->textured = GL_TRUE;
 
    span->intTex[0] -= FIXED_HALF;
    span->intTex[1] -= FIXED_HALF;
@@ -503,9 +502,6 @@ affine_span(GLcontext *ctx, SWspan *span,
 
    _swrast_write_rgba_span(ctx, span);
 
-   /* re-enable texture units */
-   ctx->Texture._EnabledCoordUnits = texEnableSave;
-
 #undef SPAN_NEAREST
 #undef SPAN_LINEAR
 }
@@ -664,8 +660,8 @@ fast_persp_span(GLcontext *ctx, SWspan *span,
    GLfloat tex_coord[3], tex_step[3];
    GLchan *dest = span->array->rgba[0];
 
-   const GLuint texEnableSave = ctx->Texture._EnabledCoordUnits;
-   ctx->Texture._EnabledCoordUnits = 0;
+   /* Texturing is done here, not in swrast_write_rgba_span */
+   span->textured = GL_TRUE;
 
    tex_coord[0] = span->attrStart[FRAG_ATTRIB_TEX0][0]  * (info->smask + 1);
    tex_step[0] = span->attrStepX[FRAG_ATTRIB_TEX0][0] * (info->smask + 1);
@@ -776,9 +772,6 @@ fast_persp_span(GLcontext *ctx, SWspan *span,
 
 #undef SPAN_NEAREST
 #undef SPAN_LINEAR
-
-   /* restore state */
-   ctx->Texture._EnabledCoordUnits = texEnableSave;
 }
 
 
@@ -139,6 +139,7 @@ static void NAME(GLcontext *ctx, const SWvertex *v0,
    GLfloat bf = SWRAST_CONTEXT(ctx)->_BackfaceSign;
    const GLint snapMask = ~((FIXED_ONE / (1 << SUB_PIXEL_BITS)) - 1); /* for x/y coord snapping */
    GLfixed vMin_fx, vMin_fy, vMid_fx, vMid_fy, vMax_fx, vMax_fy;
+   GLint rowMin, rowMax;  /* scanlines to render, see s_tiles.c */
 
    SWspan span;
 
@@ -147,6 +148,8 @@ static void NAME(GLcontext *ctx, const SWvertex *v0,
    INIT_SPAN(span, GL_POLYGON);
    span.y = 0; /* silence warnings */
 
+   _swrast_tile_rows(ctx, &rowMin, &rowMax);
+
 #ifdef INTERP_Z
    (void) fixedToDepthShift;
 #endif
@@ -843,8 +846,9 @@ static void NAME(GLcontext *ctx, const SWvertex *v0,
                /* This is where we actually generate fragments */
                /* XXX the test for span.y > 0 _shouldn't_ be needed but
                 * it fixes a problem on 64-bit Opterons (bug 4842).
+                * rowMin is never negative.
                 */
-               if (span.end > 0 && span.y >= 0) {
+               if (span.end > 0 && span.y >= rowMin && span.y < rowMax) {
                   const GLint len = span.end - 1;
                   (void) len;
 #ifdef INTERP_RGB
@@ -39,6 +39,7 @@
 #include "t_context.h"
 #include "t_pipeline.h"
 #include "t_vp_build.h"
+#include "t_threads.h"
 
 #include "vbo/vbo.h"
 
@@ -80,6 +81,8 @@ _tnl_CreateContext( GLcontext *ctx )
 
    tnl->nr_blocks = 0;
 
+   _tnl_create_threads( ctx );
+
    /* plug in the VBO drawing function */
    vbo_set_draw_func(ctx, _tnl_draw_prims);
 
@@ -95,6 +98,7 @@ _tnl_DestroyContext( GLcontext *ctx )
 {
    TNLcontext *tnl = TNL_CONTEXT(ctx);
 
+   _tnl_destroy_threads( ctx );
    _tnl_destroy_pipeline( ctx );
 
    FREE(tnl);
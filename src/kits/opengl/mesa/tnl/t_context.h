@@ -61,6 +61,8 @@
 
 #define MAX_PIPELINE_STAGES     30
 
+struct mesa_threadpool;
+
 /*
  * Note: The first attributes match the VERT_ATTRIB_* definitions
  * in mtypes.h.  However, the tnl module has additional attributes
@@ -537,6 +539,10 @@ typedef struct
    GLubyte *block[VERT_ATTRIB_MAX];
    GLuint nr_blocks;
 
+   /* Worker threads for the per-vertex stages, see t_threads.c:
+    */
+   struct mesa_threadpool *threads;
+
 } TNLcontext;
 
 
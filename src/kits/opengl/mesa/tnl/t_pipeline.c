@@ -153,6 +153,10 @@ void _tnl_run_pipeline( GLcontext *ctx )
 
    START_FAST_MATH(__tmp);
 
+   /* The per-vertex stages may split large VBs between the worker
+    * threads (see t_threads.c), but each stage is finished before the
+    * next one runs, so rendering still sees the vertices in order.
+    */
    for (i = 0; i < tnl->pipeline.nr_stages ; i++) {
       struct tnl_pipeline_stage *s = &tnl->pipeline.stages[i];
       if (!s->run( ctx, s ))
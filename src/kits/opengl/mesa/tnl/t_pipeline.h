@@ -71,4 +71,27 @@ extern void _tnl_RenderClippedPolygon( GLcontext *ctx,
 extern void _tnl_RenderClippedLine( GLcontext *ctx, GLuint ii, GLuint jj );
 
 
+/* Generated code for vertex programs, t_vb_program_sse.c:
+ */
+struct gl_program_cache;
+
+/** Per-program data, in gl_vertex_program::TnlData */
+struct tnl_vp_data {
+   GLuint serial;   /**< changes with every new program string */
+};
+
+static INLINE GLuint
+_tnl_program_serial( const struct gl_vertex_program *program )
+{
+   const struct tnl_vp_data *data =
+      (const struct tnl_vp_data *) program->TnlData;
+   return data ? data->serial : 0;
+}
+
+extern GLboolean _tnl_sse_run_vertex_program( GLcontext *ctx,
+					      struct gl_program_cache *cache,
+					      struct gl_vertex_program *program,
+					      GLvector4f *results );
+
+
 #endif
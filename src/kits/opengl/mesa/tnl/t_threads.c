@@ -0,0 +1,126 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file t_threads.c
+ * Splits the per-vertex pipeline stages into chunks for the worker
+ * thread pool.
+ */
+
+#include "main/glheader.h"
+#include "main/context.h"
+#include "main/imports.h"
+#include "main/threadpool.h"
+
+#include "t_context.h"
+#include "t_threads.h"
+
+
+struct tnl_chunk_job {
+   GLcontext *ctx;
+   tnl_chunk_func func;
+   void *data;
+   GLuint count;
+   GLuint nr_chunks;
+};
+
+
+/**
+ * Vertices [*start, *start + *count) make up the given chunk.  Chunks
+ * other than the first start at a multiple of four vertices.
+ */
+static void
+chunk_range( GLuint count, GLuint nr_chunks, GLuint chunk,
+	     GLuint *start, GLuint *n )
+{
+   const GLuint begin = chunk ? (count * chunk / nr_chunks) & ~3 : 0;
+   const GLuint end = chunk + 1 < nr_chunks ?
+      (count * (chunk + 1) / nr_chunks) & ~3 : count;
+
+   *start = begin;
+   *n = end - begin;
+}
+
+
+static void
+run_chunk( void *data, GLuint chunk, GLuint thread )
+{
+   const struct tnl_chunk_job *job = (const struct tnl_chunk_job *) data;
+   GLuint start, n;
+
+   (void) thread;
+
+   chunk_range(job->count, job->nr_chunks, chunk, &start, &n);
+   if (n)
+      job->func(job->ctx, job->data, chunk, start, n);
+}
+
+
+void
+_tnl_create_threads( GLcontext *ctx )
+{
+   TNL_CONTEXT(ctx)->threads =
+      _mesa_create_threadpool("MESA_TNL_THREADS", TNL_MAX_THREADS);
+}
+
+
+void
+_tnl_destroy_threads( GLcontext *ctx )
+{
+   TNLcontext *tnl = TNL_CONTEXT(ctx);
+
+   _mesa_destroy_threadpool(tnl->threads);
+   tnl->threads = NULL;
+}
+
+
+/**
+ * Number of chunks to split count vertices into; 1 means the stage
+ * should just run single threaded.
+ */
+GLuint
+_tnl_chunk_count( GLcontext *ctx, GLuint count )
+{
+   const struct mesa_threadpool *threads = TNL_CONTEXT(ctx)->threads;
+   const GLuint max_chunks = _mesa_threadpool_size(threads) + 1;
+   GLuint nr_chunks;
+
+   if (!threads)
+      return 1;
+
+   nr_chunks = count / TNL_MIN_CHUNK_SIZE;
+   if (nr_chunks > max_chunks)
+      nr_chunks = max_chunks;
+
+   return nr_chunks ? nr_chunks : 1;
+}
+
+
+/**
+ * Call func for each of nr_chunks chunks of count vertices, on the
+ * worker threads and the calling thread.  Returns when all are done.
+ */
+void
+_tnl_run_chunks( GLcontext *ctx, GLuint count, GLuint nr_chunks,
+		 tnl_chunk_func func, void *data )
+{
+   struct tnl_chunk_job job;
+
+   ASSERT(nr_chunks <= TNL_MAX_CHUNKS);
+
+   if (nr_chunks <= 1) {
+      func(ctx, data, 0, 0, count);
+      return;
+   }
+
+   job.ctx = ctx;
+   job.func = func;
+   job.data = data;
+   job.count = count;
+   job.nr_chunks = nr_chunks;
+
+   _mesa_threadpool_run(TNL_CONTEXT(ctx)->threads, nr_chunks,
+			run_chunk, &job);
+}
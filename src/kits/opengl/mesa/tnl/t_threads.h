@@ -0,0 +1,88 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file t_threads.h
+ * Worker threads for the per-vertex pipeline stages.
+ *
+ * Stages whose work on one vertex doesn't depend on any other vertex
+ * (transform, cliptest, normals, lighting) can split the vertex buffer
+ * into chunks which run on a small pool of worker threads and the
+ * calling thread.  _tnl_run_chunks() only returns once every chunk is
+ * done, so each stage still completes before the next one starts and
+ * rendering sees the vertices in order.
+ *
+ * The workers come from a main/threadpool.c pool, which is off unless
+ * MESA_TNL_THREADS sets the number of workers; "auto" uses the number
+ * of CPUs minus one.
+ */
+
+#ifndef _T_THREADS_H
+#define _T_THREADS_H
+
+#include "main/mtypes.h"
+#include "math/m_vector.h"
+
+
+/** Max worker threads per context; the caller runs one more chunk */
+#define TNL_MAX_THREADS      7
+#define TNL_MAX_CHUNKS       (TNL_MAX_THREADS + 1)
+
+/** Don't bother splitting the VB into chunks smaller than this */
+#define TNL_MIN_CHUNK_SIZE   256
+
+
+/**
+ * Process vertices [start, start + count) of the VB; chunk is the
+ * index of the chunk, for per-chunk results.
+ */
+typedef void (*tnl_chunk_func)( GLcontext *ctx, void *data, GLuint chunk,
+				GLuint start, GLuint count );
+
+
+extern void _tnl_create_threads( GLcontext *ctx );
+
+extern void _tnl_destroy_threads( GLcontext *ctx );
+
+extern GLuint _tnl_chunk_count( GLcontext *ctx, GLuint count );
+
+extern void _tnl_run_chunks( GLcontext *ctx, GLuint count, GLuint nr_chunks,
+			     tnl_chunk_func func, void *data );
+
+
+/**
+ * Make dst a view of count elements of src, starting at element start.
+ * The view shares src's storage and must not be freed.
+ */
+static INLINE void
+_tnl_vector4f_chunk( GLvector4f *dst, const GLvector4f *src,
+		     GLuint start, GLuint count )
+{
+   const GLuint offset = start * src->stride;
+
+   *dst = *src;
+   dst->data = (GLfloat (*)[4]) ((GLubyte *) src->data + offset);
+   dst->start = (GLfloat *) ((GLubyte *) src->start + offset);
+   dst->count = count;
+   dst->storage = NULL;
+}
+
+
+/**
+ * Update vec after its elements were written through chunk views, the
+ * first of which is chunk0: the math functions record the result size
+ * in the view they're given.
+ */
+static INLINE GLvector4f *
+_tnl_vector4f_join( GLvector4f *vec, const GLvector4f *chunk0, GLuint count )
+{
+   vec->size = chunk0->size;
+   vec->flags = chunk0->flags;
+   vec->count = count;
+   return vec;
+}
+
+
+#endif
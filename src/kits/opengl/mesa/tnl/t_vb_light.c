@@ -36,6 +36,7 @@
 
 #include "t_context.h"
 #include "t_pipeline.h"
+#include "t_threads.h"
 
 #define LIGHT_TWOSIDE       0x1
 #define LIGHT_MATERIAL      0x2
@@ -194,6 +195,82 @@ static void init_lighting_tables( void )
 }
 
 
+/**
+ * Lighting one chunk of the VB.  The light functions are handed copies
+ * of the VB and of the stage data, with views of the chunk's inputs and
+ * outputs in place of the full vectors.
+ */
+struct light_chunk_job {
+   struct tnl_pipeline_stage *stage;
+   light_func func;
+   GLvector4f *input;
+   GLvector4f *ColorPtr[2];
+   GLvector4f *SecondaryColorPtr[2];
+   GLvector4f *IndexPtr[2];
+};
+
+
+/* Map a pointer into the chunk's copy of the stage data back to the
+ * stage data itself.
+ */
+static GLvector4f *
+unchunk_ptr( GLvector4f *ptr, struct light_stage_data *chunk_store,
+	     struct light_stage_data *store )
+{
+   if ((GLubyte *) ptr >= (GLubyte *) chunk_store &&
+       (GLubyte *) ptr < (GLubyte *) (chunk_store + 1))
+      return (GLvector4f *) ((GLubyte *) store +
+			     ((GLubyte *) ptr - (GLubyte *) chunk_store));
+   return ptr;
+}
+
+
+static void light_chunk( GLcontext *ctx, void *data, GLuint chunk,
+			 GLuint start, GLuint count )
+{
+   struct light_chunk_job *job = (struct light_chunk_job *) data;
+   struct light_stage_data *store = LIGHT_STAGE_DATA(job->stage);
+   struct light_stage_data chunk_store;
+   struct tnl_pipeline_stage chunk_stage;
+   struct vertex_buffer VB;
+   GLvector4f input, normal;
+   GLuint i;
+
+   chunk_store = *store;
+   for (i = 0; i < 2; i++) {
+      _tnl_vector4f_chunk( &chunk_store.LitColor[i], &store->LitColor[i],
+			   start, count );
+      _tnl_vector4f_chunk( &chunk_store.LitSecondary[i],
+			   &store->LitSecondary[i], start, count );
+      _tnl_vector4f_chunk( &chunk_store.LitIndex[i], &store->LitIndex[i],
+			   start, count );
+   }
+
+   chunk_stage = *job->stage;
+   chunk_stage.privatePtr = &chunk_store;
+
+   VB = TNL_CONTEXT(ctx)->vb;
+   VB.Count = count;
+   _tnl_vector4f_chunk( &normal, VB.AttribPtr[_TNL_ATTRIB_NORMAL],
+			start, count );
+   VB.AttribPtr[_TNL_ATTRIB_NORMAL] = &normal;
+   _tnl_vector4f_chunk( &input, job->input, start, count );
+
+   job->func( ctx, &VB, &chunk_stage, &input );
+
+   /* Every chunk points the same outputs at its own views.
+    */
+   if (chunk == 0) {
+      for (i = 0; i < 2; i++) {
+	 job->ColorPtr[i] = unchunk_ptr(VB.ColorPtr[i], &chunk_store, store);
+	 job->SecondaryColorPtr[i] =
+	    unchunk_ptr(VB.SecondaryColorPtr[i], &chunk_store, store);
+	 job->IndexPtr[i] = unchunk_ptr(VB.IndexPtr[i], &chunk_store, store);
+      }
+   }
+}
+
+
 static GLboolean run_lighting( GLcontext *ctx, 
 			       struct tnl_pipeline_stage *stage )
 {
@@ -201,7 +278,7 @@ static GLboolean run_lighting( GLcontext *ctx,
    TNLcontext *tnl = TNL_CONTEXT(ctx);
    struct vertex_buffer *VB = &tnl->vb;
    GLvector4f *input = ctx->_NeedEyeCoords ? VB->EyePtr : VB->ObjPtr;
-   GLuint idx;
+   GLuint idx, nr_chunks;
 
    if (!ctx->Light.Enabled || ctx->VertexProgram._Current)
       return GL_TRUE;
@@ -243,8 +320,38 @@ static GLboolean run_lighting( GLcontext *ctx,
 
    /* The individual functions know about replaying side-effects
     * vs. full re-execution. 
+    *
+    * Without per-vertex materials, lighting a vertex only reads
+    * context state, so large VBs are lit in chunks on the worker
+    * threads.  Per-vertex materials update the context as they go and
+    * have to run in order.
     */
-   store->light_func_tab[idx]( ctx, VB, stage, input );
+   nr_chunks = _tnl_chunk_count( ctx, VB->Count );
+
+   if (nr_chunks > 1 && !(idx & LIGHT_MATERIAL)) {
+      struct light_chunk_job job;
+      GLuint i;
+
+      job.stage = stage;
+      job.func = store->light_func_tab[idx];
+      job.input = input;
+
+      /* The chunk views need the stride the light functions use.
+       */
+      store->LitColor[0].stride = 16;
+      store->LitColor[1].stride = 16;
+
+      _tnl_run_chunks( ctx, VB->Count, nr_chunks, light_chunk, &job );
+
+      for (i = 0; i < 2; i++) {
+	 VB->ColorPtr[i] = job.ColorPtr[i];
+	 VB->SecondaryColorPtr[i] = job.SecondaryColorPtr[i];
+	 VB->IndexPtr[i] = job.IndexPtr[i];
+      }
+   }
+   else {
+      store->light_func_tab[idx]( ctx, VB, stage, input );
+   }
 
    VB->AttribPtr[_TNL_ATTRIB_COLOR0] = VB->ColorPtr[0];
    VB->AttribPtr[_TNL_ATTRIB_COLOR1] = VB->SecondaryColorPtr[0];
@@ -37,6 +37,7 @@
 
 #include "t_context.h"
 #include "t_pipeline.h"
+#include "t_threads.h"
 
 
 struct normal_stage_data {
@@ -47,12 +48,41 @@ struct normal_stage_data {
 #define NORMAL_STAGE_DATA(stage) ((struct normal_stage_data *)stage->privatePtr)
 
 
+struct normal_chunk_job {
+   struct normal_stage_data *store;
+   GLvector4f *input;
+   const GLfloat *lengths;
+};
+
+
+static void
+normal_chunk(GLcontext *ctx, void *data, GLuint chunk,
+             GLuint start, GLuint count)
+{
+   struct normal_chunk_job *job = (struct normal_chunk_job *) data;
+   GLvector4f input, normal;
+
+   (void) chunk;
+
+   _tnl_vector4f_chunk(&input, job->input, start, count);
+   _tnl_vector4f_chunk(&normal, &job->store->normal, start, count);
+
+   job->store->NormalTransform( ctx->ModelviewMatrixStack.Top,
+                                ctx->_ModelViewInvScale,
+                                &input,
+                                job->lengths ? job->lengths + start : NULL,
+                                &normal );
+}
+
+
 static GLboolean
 run_normal_stage(GLcontext *ctx, struct tnl_pipeline_stage *stage)
 {
    struct normal_stage_data *store = NORMAL_STAGE_DATA(stage);
    struct vertex_buffer *VB = &TNL_CONTEXT(ctx)->vb;
    const GLfloat *lengths;
+   struct normal_chunk_job job;
+   GLuint count;
 
    if (!store->NormalTransform)
       return GL_TRUE;
@@ -65,11 +95,20 @@ run_normal_stage(GLcontext *ctx, struct tnl_pipeline_stage *stage)
    else
       lengths = VB->NormalLengthPtr;
 
-   store->NormalTransform( ctx->ModelviewMatrixStack.Top,
-			   ctx->_ModelViewInvScale,
-			   VB->AttribPtr[_TNL_ATTRIB_NORMAL],  /* input normals */
-			   lengths,
-			   &store->normal ); /* resulting normals */
+   /* The normal functions write 16 byte elements, which the chunk
+    * views need to know before the stride is fixed up below.
+    */
+   store->normal.stride = 4 * sizeof(GLfloat);
+
+   job.store = store;
+   job.input = VB->AttribPtr[_TNL_ATTRIB_NORMAL];  /* input normals */
+   job.lengths = lengths;
+
+   count = job.input->count;
+   _tnl_run_chunks( ctx, count, _tnl_chunk_count( ctx, count ),
+                    normal_chunk, &job );
+
+   store->normal.count = count;  /* resulting normals */
 
    if (VB->AttribPtr[_TNL_ATTRIB_NORMAL]->count > 1) {
       store->normal.stride = 4 * sizeof(GLfloat);
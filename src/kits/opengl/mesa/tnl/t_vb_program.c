@@ -36,6 +36,7 @@
 #include "main/context.h"
 #include "main/macros.h"
 #include "main/imports.h"
+#include "shader/prog_cache.h"
 #include "shader/prog_instruction.h"
 #include "shader/prog_statevars.h"
 #include "shader/prog_execute.h"
@@ -68,6 +69,9 @@ struct vp_stage_data {
    GLvector4f ndcCoords;              /**< normalized device coords */
    GLubyte *clipmask;                 /**< clip flags */
    GLubyte ormask, andmask;           /**< for clipping */
+
+   GLcontext *ctx;
+   struct gl_program_cache *code_cache; /**< generated code, may be NULL */
 };
 
 
@@ -196,6 +200,14 @@ vp_fetch_texel(GLcontext *ctx, const GLfloat texcoord[4], GLfloat lambda,
 }
 
 
+static GLboolean
+run_vp( GLcontext *ctx, struct tnl_pipeline_stage *stage );
+
+
+_glthread_DECLARE_STATIC_MUTEX(serial_mutex);
+static GLuint last_serial = 0;
+
+
 /**
  * Called via ctx->Driver.ProgramStringNotify() after a new vertex program
  * string has been parsed.
@@ -203,10 +215,40 @@ vp_fetch_texel(GLcontext *ctx, const GLfloat texcoord[4], GLfloat lambda,
 void
 _tnl_program_string(GLcontext *ctx, GLenum target, struct gl_program *program)
 {
-   /* No-op.
-    * If we had derived anything from the program that was private to this
-    * stage we'd recompute/validate it here.
+   TNLcontext *tnl = TNL_CONTEXT(ctx);
+   struct gl_vertex_program *vprog = (struct gl_vertex_program *) program;
+   struct tnl_vp_data *data;
+   GLuint i;
+
+   if (!tnl || target != GL_VERTEX_PROGRAM_ARB)
+      return;
+
+   /* Generated code is looked up by program and serial, so no context
+    * sharing the program can find code for the old program string.
     */
+   data = (struct tnl_vp_data *) vprog->TnlData;
+   if (!data) {
+      data = CALLOC_STRUCT(tnl_vp_data);
+      vprog->TnlData = data;
+   }
+   if (data) {
+      _glthread_LOCK_MUTEX(serial_mutex);
+      data->serial = ++last_serial;
+      _glthread_UNLOCK_MUTEX(serial_mutex);
+   }
+
+   /* Throw away this context's code for the old program string now,
+    * other contexts drop theirs when their cache is cleared.
+    */
+   for (i = 0; i < tnl->pipeline.nr_stages; i++) {
+      struct tnl_pipeline_stage *s = &tnl->pipeline.stages[i];
+
+      if (s->run == run_vp && s->privatePtr) {
+         struct vp_stage_data *store = VP_STAGE_DATA(s);
+         if (store->code_cache)
+            _mesa_clear_program_cache(ctx, store->code_cache);
+      }
+   }
 }
 
 
@@ -330,6 +372,12 @@ run_vp( GLcontext *ctx, struct tnl_pipeline_stage *stage )
       }
    }
 
+   /* Use generated code if the program could be compiled */
+   if (store->code_cache &&
+       _tnl_sse_run_vertex_program(ctx, store->code_cache, program,
+                                   store->results))
+      goto done;
+
    map_textures(ctx, program);
 
    for (i = 0; i < VB->Count; i++) {
@@ -397,6 +445,7 @@ run_vp( GLcontext *ctx, struct tnl_pipeline_stage *stage )
 
    unmap_textures(ctx, program);
 
+ done:
    /* Fixup fog and point size results if needed */
    if (program->IsNVProgram) {
       if (ctx->Fog.Enabled &&
@@ -507,6 +556,13 @@ init_vp(GLcontext *ctx, struct tnl_pipeline_stage *stage)
    _mesa_vector4f_alloc( &store->ndcCoords, 0, size, 32 );
    store->clipmask = (GLubyte *) ALIGN_MALLOC(sizeof(GLubyte)*size, 32 );
 
+   store->ctx = ctx;
+   store->code_cache = NULL;
+#ifdef USE_X86_64_ASM
+   if (!_mesa_getenv("MESA_NO_CODEGEN"))
+      store->code_cache = _mesa_new_program_cache();
+#endif
+
    return GL_TRUE;
 }
 
@@ -530,6 +586,9 @@ dtr(struct tnl_pipeline_stage *stage)
       _mesa_vector4f_free( &store->ndcCoords );
       ALIGN_FREE( store->clipmask );
 
+      if (store->code_cache)
+         _mesa_delete_program_cache(store->ctx, store->code_cache);
+
       FREE( store );
       stage->privatePtr = NULL;
    }
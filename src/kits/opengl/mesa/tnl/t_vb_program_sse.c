@@ -0,0 +1,1134 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/**
+ * \file t_vb_program_sse.c
+ * Generate SSE code for vertex programs on x86-64.
+ *
+ * The generated code runs four vertices at a time.  Registers are kept
+ * in a state block in "structure of arrays" form: each component of a
+ * register is one 16 byte vector holding that component for all four
+ * vertices, so every instruction maps onto plain packed float operations
+ * without any shuffling.  Operations which have no cheap SSE equivalent
+ * (EX2, LG2, POW, LIT, ...) call back into C helpers which do the same
+ * arithmetic as the interpreter in prog_execute.c.
+ *
+ * Programs using relative addressing, condition codes, branches or
+ * texture lookups aren't compiled; the caller falls back to the
+ * interpreter for those.  Compiled code is kept in a gl_program_cache
+ * keyed on the program, which is flushed whenever a program string
+ * changes.
+ */
+
+#include "main/glheader.h"
+#include "main/context.h"
+#include "main/imports.h"
+#include "main/macros.h"
+#include "shader/prog_cache.h"
+#include "shader/prog_instruction.h"
+#include "shader/prog_parameter.h"
+#include "shader/program.h"
+
+#include "t_context.h"
+#include "t_pipeline.h"
+
+
+#if defined(USE_X86_64_ASM) && defined(__x86_64__) && !defined(_WIN32)
+
+#include <stddef.h>
+
+
+/** One component of a register, for four vertices */
+#define VEC_SIZE (4 * sizeof(GLfloat))
+
+/** One register, for four vertices */
+#define REG_SIZE (4 * VEC_SIZE)
+
+/** Upper bound on the code generated for one instruction */
+#define MAX_INST_SIZE 512
+
+
+struct vp_sse_state {
+   GLfloat zero[4];
+   GLfloat one[4];
+   GLuint sign[4];
+   GLuint abs[4];
+   GLfloat scratch[3][4][4];	/**< helper arguments and result */
+   GLfloat inputs[VERT_ATTRIB_MAX][4][4];
+   GLfloat outputs[VERT_RESULT_MAX][4][4];
+   GLfloat temps[MAX_PROGRAM_TEMPS][4][4];
+   GLfloat params[1][4][4];	/**< really nr_params long */
+};
+
+#define STATE_OFFSET(field) ((GLuint) offsetof(struct vp_sse_state, field))
+
+#define SCRATCH_A   (STATE_OFFSET(scratch) + 0 * REG_SIZE)
+#define SCRATCH_B   (STATE_OFFSET(scratch) + 1 * REG_SIZE)
+#define SCRATCH_DST (STATE_OFFSET(scratch) + 2 * REG_SIZE)
+
+#define SET_POS_INFINITY(x)  ( *((GLuint *) (void *)&x) = 0x7F800000 )
+#define SET_NEG_INFINITY(x)  ( *((GLuint *) (void *)&x) = 0xFF800000 )
+
+
+/** A constant register, splatted from one of the parameter arrays */
+struct vp_sse_param {
+   GLuint file;
+   GLuint index;
+};
+
+
+struct vp_sse_program {
+   void (*func)( struct vp_sse_state *state );
+   GLubyte *store;		/**< executable memory holding func */
+   struct vp_sse_state *state;
+
+   struct vp_sse_param *params;
+   GLuint nr_params;
+};
+
+
+typedef void (*vp_sse_helper)( GLfloat dst[4][4], const GLfloat a[4][4],
+			       const GLfloat b[4][4] );
+
+
+struct vp_sse_compile {
+   const struct gl_vertex_program *program;
+   struct vp_sse_program *code;
+   GLubyte *csr;
+   GLuint src_offset[3];	/**< state offsets of the current sources */
+};
+
+
+/* SSE opcodes (second byte after 0x0f):
+ */
+#define SSE_MOVAPS_LOAD   0x28
+#define SSE_MOVAPS_STORE  0x29
+#define SSE_SQRTPS        0x51
+#define SSE_ANDPS         0x54
+#define SSE_XORPS         0x57
+#define SSE_ADDPS         0x58
+#define SSE_MULPS         0x59
+#define SSE_SUBPS         0x5c
+#define SSE_MINPS         0x5d
+#define SSE_DIVPS         0x5e
+#define SSE_MAXPS         0x5f
+#define SSE_CMPPS         0xc2
+
+/* cmpps predicates:
+ */
+#define CC_EQ   0
+#define CC_LT   1
+#define CC_LE   2
+#define CC_NEQ  4
+
+
+static void
+emit_1ub( struct vp_sse_compile *cp, GLubyte b )
+{
+   *cp->csr++ = b;
+}
+
+
+static void
+emit_1ui( struct vp_sse_compile *cp, GLuint ui )
+{
+   memcpy(cp->csr, &ui, sizeof(ui));
+   cp->csr += sizeof(ui);
+}
+
+
+static void
+emit_ptr( struct vp_sse_compile *cp, const void *ptr )
+{
+   memcpy(cp->csr, &ptr, sizeof(ptr));
+   cp->csr += sizeof(ptr);
+}
+
+
+/**
+ * op xmm, [rbx + offset].  The state block lives in rbx.
+ */
+static void
+sse_mem( struct vp_sse_compile *cp, GLubyte op, GLuint xmm, GLuint offset )
+{
+   emit_1ub(cp, 0x0f);
+   emit_1ub(cp, op);
+   emit_1ub(cp, 0x83 | (xmm << 3));
+   emit_1ui(cp, offset);
+}
+
+
+/**
+ * op dst, src
+ */
+static void
+sse_reg( struct vp_sse_compile *cp, GLubyte op, GLuint dst, GLuint src )
+{
+   emit_1ub(cp, 0x0f);
+   emit_1ub(cp, op);
+   emit_1ub(cp, 0xc0 | (dst << 3) | src);
+}
+
+
+static void
+sse_cmpps( struct vp_sse_compile *cp, GLuint dst, GLuint src, GLubyte cc )
+{
+   sse_reg(cp, SSE_CMPPS, dst, src);
+   emit_1ub(cp, cc);
+}
+
+
+/**
+ * Call func(rbx + dst, rbx + a, rbx + b).
+ */
+static void
+emit_call( struct vp_sse_compile *cp, vp_sse_helper func )
+{
+   emit_1ub(cp, 0x48);		/* lea rdi, [rbx + SCRATCH_DST] */
+   emit_1ub(cp, 0x8d);
+   emit_1ub(cp, 0xbb);
+   emit_1ui(cp, SCRATCH_DST);
+
+   emit_1ub(cp, 0x48);		/* lea rsi, [rbx + SCRATCH_A] */
+   emit_1ub(cp, 0x8d);
+   emit_1ub(cp, 0xb3);
+   emit_1ui(cp, SCRATCH_A);
+
+   emit_1ub(cp, 0x48);		/* lea rdx, [rbx + SCRATCH_B] */
+   emit_1ub(cp, 0x8d);
+   emit_1ub(cp, 0x93);
+   emit_1ui(cp, SCRATCH_B);
+
+   emit_1ub(cp, 0x48);		/* mov rax, func */
+   emit_1ub(cp, 0xb8);
+   emit_ptr(cp, (const void *) func);
+
+   emit_1ub(cp, 0xff);		/* call rax */
+   emit_1ub(cp, 0xd0);
+}
+
+
+/**
+ * Find or allocate the param slot for a constant register.
+ */
+static GLuint
+param_slot( struct vp_sse_compile *cp, GLuint file, GLuint index )
+{
+   struct vp_sse_program *code = cp->code;
+   GLuint i;
+
+   for (i = 0; i < code->nr_params; i++) {
+      if (code->params[i].file == file && code->params[i].index == index)
+	 return i;
+   }
+
+   code->params[i].file = file;
+   code->params[i].index = index;
+   code->nr_params++;
+   return i;
+}
+
+
+/**
+ * Work out where a source register lives in the state block.  Returns
+ * GL_FALSE for registers the generated code can't address.
+ */
+static GLboolean
+src_offset( struct vp_sse_compile *cp, const struct prog_src_register *src,
+	    GLuint *offset )
+{
+   const struct gl_program *prog = &cp->program->Base;
+   const GLint index = src->Index;
+
+   if (src->RelAddr || index < 0)
+      return GL_FALSE;
+
+   switch (src->File) {
+   case PROGRAM_TEMPORARY:
+      if (index >= MAX_PROGRAM_TEMPS)
+	 return GL_FALSE;
+      *offset = STATE_OFFSET(temps) + index * REG_SIZE;
+      return GL_TRUE;
+
+   case PROGRAM_INPUT:
+      if (index >= VERT_ATTRIB_MAX)
+	 return GL_FALSE;
+      *offset = STATE_OFFSET(inputs) + index * REG_SIZE;
+      return GL_TRUE;
+
+   case PROGRAM_OUTPUT:
+      if (index >= VERT_RESULT_MAX)
+	 return GL_FALSE;
+      *offset = STATE_OFFSET(outputs) + index * REG_SIZE;
+      return GL_TRUE;
+
+   case PROGRAM_LOCAL_PARAM:
+      if (index >= MAX_PROGRAM_LOCAL_PARAMS)
+	 return GL_FALSE;
+      break;
+
+   case PROGRAM_ENV_PARAM:
+      if (index >= MAX_PROGRAM_ENV_PARAMS)
+	 return GL_FALSE;
+      break;
+
+   case PROGRAM_STATE_VAR:
+   case PROGRAM_CONSTANT:
+   case PROGRAM_UNIFORM:
+   case PROGRAM_NAMED_PARAM:
+      if (index >= (GLint) prog->Parameters->NumParameters)
+	 return GL_FALSE;
+      break;
+
+   default:
+      return GL_FALSE;
+   }
+
+   *offset = STATE_OFFSET(params) +
+      param_slot(cp, src->File, index) * REG_SIZE;
+   return GL_TRUE;
+}
+
+
+/**
+ * Load channel chan of source arg into xmm, with swizzle, abs and negate
+ * applied the way fetch_vector4() does it.
+ */
+static void
+emit_fetch( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	    GLuint arg, GLuint chan, GLuint xmm )
+{
+   const struct prog_src_register *src = &inst->SrcReg[arg];
+   const GLuint swz = GET_SWZ(src->Swizzle, chan);
+   GLboolean negate;
+
+   if (swz == SWIZZLE_ZERO)
+      sse_reg(cp, SSE_XORPS, xmm, xmm);
+   else if (swz == SWIZZLE_ONE)
+      sse_mem(cp, SSE_MOVAPS_LOAD, xmm, STATE_OFFSET(one));
+   else
+      sse_mem(cp, SSE_MOVAPS_LOAD, xmm, cp->src_offset[arg] + swz * VEC_SIZE);
+
+   /* SWZ negates per channel and ignores abs */
+   if (inst->Opcode == OPCODE_SWZ) {
+      negate = (src->Negate >> chan) & 1;
+   }
+   else {
+      if (src->Abs)
+	 sse_mem(cp, SSE_ANDPS, xmm, STATE_OFFSET(abs));
+      negate = src->Negate != NEGATE_NONE;
+   }
+
+   if (negate)
+      sse_mem(cp, SSE_XORPS, xmm, STATE_OFFSET(sign));
+}
+
+
+/**
+ * Store the result, which is in xmm4..xmm7 or just in xmm4 if scalar.
+ */
+static void
+emit_store( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	    GLboolean scalar )
+{
+   const struct prog_dst_register *dst = &inst->DstReg;
+   GLuint offset, chan;
+
+   if (inst->SaturateMode == SATURATE_ZERO_ONE) {
+      for (chan = 0; chan < 4; chan++) {
+	 /* max/min with the constant as first operand, so that NaNs
+	  * pass through like they do with CLAMP()
+	  */
+	 if (scalar ? chan == 0 : (dst->WriteMask & (1 << chan)) != 0) {
+	    sse_mem(cp, SSE_MOVAPS_LOAD, 0, STATE_OFFSET(zero));
+	    sse_reg(cp, SSE_MAXPS, 0, 4 + chan);
+	    sse_mem(cp, SSE_MOVAPS_LOAD, 4 + chan, STATE_OFFSET(one));
+	    sse_reg(cp, SSE_MINPS, 4 + chan, 0);
+	 }
+      }
+   }
+
+   if (dst->File == PROGRAM_TEMPORARY)
+      offset = STATE_OFFSET(temps) + dst->Index * REG_SIZE;
+   else if (dst->File == PROGRAM_OUTPUT)
+      offset = STATE_OFFSET(outputs) + dst->Index * REG_SIZE;
+   else
+      return;			/* PROGRAM_WRITE_ONLY */
+
+   for (chan = 0; chan < 4; chan++) {
+      if (dst->WriteMask & (1 << chan))
+	 sse_mem(cp, SSE_MOVAPS_STORE, scalar ? 4 : 4 + chan,
+		 offset + chan * VEC_SIZE);
+   }
+}
+
+
+static void
+emit_binary( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	     GLubyte op )
+{
+   GLuint chan;
+
+   for (chan = 0; chan < 4; chan++) {
+      if (inst->DstReg.WriteMask & (1 << chan)) {
+	 emit_fetch(cp, inst, 0, chan, 4 + chan);
+	 emit_fetch(cp, inst, 1, chan, 0);
+	 sse_reg(cp, op, 4 + chan, 0);
+      }
+   }
+}
+
+
+/**
+ * Set-on-compare: 1.0 where (swap ? b : a) cc (swap ? a : b), else 0.0.
+ */
+static void
+emit_set( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	  GLubyte cc, GLboolean swap )
+{
+   GLuint chan;
+
+   for (chan = 0; chan < 4; chan++) {
+      if (inst->DstReg.WriteMask & (1 << chan)) {
+	 emit_fetch(cp, inst, swap, chan, 4 + chan);
+	 emit_fetch(cp, inst, !swap, chan, 0);
+	 sse_cmpps(cp, 4 + chan, 0, cc);
+	 sse_mem(cp, SSE_ANDPS, 4 + chan, STATE_OFFSET(one));
+      }
+   }
+}
+
+
+/**
+ * Dot product of the first n channels into xmm4.
+ */
+static void
+emit_dot( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	  GLuint n )
+{
+   GLuint chan;
+
+   emit_fetch(cp, inst, 0, 0, 4);
+   emit_fetch(cp, inst, 1, 0, 0);
+   sse_reg(cp, SSE_MULPS, 4, 0);
+
+   for (chan = 1; chan < n; chan++) {
+      emit_fetch(cp, inst, 0, chan, 1);
+      emit_fetch(cp, inst, 1, chan, 0);
+      sse_reg(cp, SSE_MULPS, 1, 0);
+      sse_reg(cp, SSE_ADDPS, 4, 1);
+   }
+}
+
+
+/**
+ * xmm = a[i] * b[j] - a[j] * b[i]
+ */
+static void
+emit_cross( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	    GLuint xmm, GLuint i, GLuint j )
+{
+   emit_fetch(cp, inst, 0, i, xmm);
+   emit_fetch(cp, inst, 1, j, 0);
+   sse_reg(cp, SSE_MULPS, xmm, 0);
+   emit_fetch(cp, inst, 0, j, 1);
+   emit_fetch(cp, inst, 1, i, 0);
+   sse_reg(cp, SSE_MULPS, 1, 0);
+   sse_reg(cp, SSE_SUBPS, xmm, 1);
+}
+
+
+/**
+ * 1 / sqrt(xmm4) into xmm4, going through xmm0.
+ */
+static void
+emit_rsq( struct vp_sse_compile *cp )
+{
+   sse_reg(cp, SSE_SQRTPS, 4, 4);
+   sse_mem(cp, SSE_MOVAPS_LOAD, 0, STATE_OFFSET(one));
+   sse_reg(cp, SSE_DIVPS, 0, 4);
+   sse_reg(cp, SSE_MOVAPS_LOAD, 4, 0);
+}
+
+
+static void
+emit_normalize( struct vp_sse_compile *cp,
+		const struct prog_instruction *inst, GLuint n )
+{
+   GLuint chan;
+
+   /* xmm3 = a.a, xmm1 = a.a != 0 ? 1 / sqrt(a.a) : 0
+    */
+   emit_fetch(cp, inst, 0, 0, 3);
+   sse_reg(cp, SSE_MULPS, 3, 3);
+   for (chan = 1; chan < n; chan++) {
+      emit_fetch(cp, inst, 0, chan, 1);
+      sse_reg(cp, SSE_MULPS, 1, 1);
+      sse_reg(cp, SSE_ADDPS, 3, 1);
+   }
+
+   sse_reg(cp, SSE_MOVAPS_LOAD, 2, 3);
+   sse_reg(cp, SSE_SQRTPS, 2, 2);
+   sse_mem(cp, SSE_MOVAPS_LOAD, 1, STATE_OFFSET(one));
+   sse_reg(cp, SSE_DIVPS, 1, 2);
+   sse_reg(cp, SSE_XORPS, 0, 0);
+   sse_cmpps(cp, 3, 0, CC_NEQ);
+   sse_reg(cp, SSE_ANDPS, 1, 3);
+
+   for (chan = 0; chan < 4; chan++) {
+      if (chan < n) {
+	 emit_fetch(cp, inst, 0, chan, 4 + chan);
+	 sse_reg(cp, SSE_MULPS, 4 + chan, 1);
+      }
+      else {
+	 sse_reg(cp, SSE_XORPS, 4 + chan, 4 + chan);
+      }
+   }
+}
+
+
+/* C helpers for the transcendental opcodes.  These match the
+ * interpreter in prog_execute.c, one vertex at a time.
+ */
+
+static void
+helper_ex2( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint i;
+
+   for (i = 0; i < 4; i++)
+      dst[0][i] = dst[1][i] = dst[2][i] = dst[3][i] =
+	 (GLfloat) _mesa_pow(2.0, a[0][i]);
+}
+
+
+static void
+helper_lg2( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint i;
+
+   for (i = 0; i < 4; i++) {
+      GLfloat val;
+
+      if (a[0][i] == 0.0F)
+	 val = 0.0F;
+      else
+	 val = log(a[0][i]) * 1.442695F;
+
+      dst[0][i] = dst[1][i] = dst[2][i] = dst[3][i] = val;
+   }
+}
+
+
+static void
+helper_pow( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint i;
+
+   for (i = 0; i < 4; i++)
+      dst[0][i] = dst[1][i] = dst[2][i] = dst[3][i] =
+	 (GLfloat) _mesa_pow(a[0][i], b[0][i]);
+}
+
+
+static void
+helper_lit( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   const GLfloat epsilon = 1.0F / 256.0F;
+   GLuint i;
+
+   for (i = 0; i < 4; i++) {
+      const GLfloat x = MAX2(a[0][i], 0.0F);
+      const GLfloat y = MAX2(a[1][i], 0.0F);
+      const GLfloat w = CLAMP(a[3][i], -(128.0F - epsilon),
+			      (128.0F - epsilon));
+
+      dst[0][i] = 1.0F;
+      dst[1][i] = x;
+      if (x > 0.0F) {
+	 if (y == 0.0 && w == 0.0)
+	    dst[2][i] = 1.0;
+	 else
+	    dst[2][i] = (GLfloat) _mesa_pow(y, w);
+      }
+      else {
+	 dst[2][i] = 0.0;
+      }
+      dst[3][i] = 1.0F;
+   }
+}
+
+
+static void
+helper_exp( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint i;
+
+   for (i = 0; i < 4; i++) {
+      const GLfloat t = a[0][i];
+      const GLfloat floor_t = FLOORF(t);
+
+      if (floor_t > FLT_MAX_EXP) {
+	 SET_POS_INFINITY(dst[0][i]);
+	 SET_POS_INFINITY(dst[2][i]);
+      }
+      else if (floor_t < FLT_MIN_EXP) {
+	 dst[0][i] = 0.0F;
+	 dst[2][i] = 0.0F;
+      }
+      else {
+	 dst[0][i] = LDEXPF(1.0, (int) floor_t);
+	 dst[2][i] = (GLfloat) _mesa_pow(2.0, t);
+      }
+      dst[1][i] = t - floor_t;
+      dst[3][i] = 1.0F;
+   }
+}
+
+
+static void
+helper_log( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint i;
+
+   for (i = 0; i < 4; i++) {
+      const GLfloat t = a[0][i];
+      const GLfloat abs_t = FABSF(t);
+
+      if (abs_t != 0.0F) {
+	 if (IS_INF_OR_NAN(abs_t)) {
+	    SET_POS_INFINITY(dst[0][i]);
+	    dst[1][i] = 1.0F;
+	    SET_POS_INFINITY(dst[2][i]);
+	 }
+	 else {
+	    int exponent;
+	    GLfloat mantissa = FREXPF(t, &exponent);
+	    dst[0][i] = (GLfloat) (exponent - 1);
+	    dst[1][i] = (GLfloat) (2.0 * mantissa);
+	    dst[2][i] = (log(t) * 1.442695F);
+	 }
+      }
+      else {
+	 SET_NEG_INFINITY(dst[0][i]);
+	 dst[1][i] = 1.0F;
+	 SET_NEG_INFINITY(dst[2][i]);
+      }
+      dst[3][i] = 1.0;
+   }
+}
+
+
+static void
+helper_flr( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint c, i;
+
+   for (c = 0; c < 4; c++)
+      for (i = 0; i < 4; i++)
+	 dst[c][i] = FLOORF(a[c][i]);
+}
+
+
+static void
+helper_frc( GLfloat dst[4][4], const GLfloat a[4][4], const GLfloat b[4][4] )
+{
+   GLuint c, i;
+
+   for (c = 0; c < 4; c++)
+      for (i = 0; i < 4; i++)
+	 dst[c][i] = a[c][i] - FLOORF(a[c][i]);
+}
+
+
+/**
+ * Copy the first nr_chans channels of each of the nr_args sources into
+ * the scratch registers, call func and load its result into xmm4..xmm7.
+ */
+static void
+emit_helper( struct vp_sse_compile *cp, const struct prog_instruction *inst,
+	     GLuint nr_args, GLuint nr_chans, vp_sse_helper func )
+{
+   GLuint arg, chan;
+
+   for (arg = 0; arg < nr_args; arg++) {
+      for (chan = 0; chan < nr_chans; chan++) {
+	 emit_fetch(cp, inst, arg, chan, 0);
+	 sse_mem(cp, SSE_MOVAPS_STORE, 0,
+		 SCRATCH_A + arg * REG_SIZE + chan * VEC_SIZE);
+      }
+   }
+
+   emit_call(cp, func);
+
+   for (chan = 0; chan < 4; chan++)
+      sse_mem(cp, SSE_MOVAPS_LOAD, 4 + chan, SCRATCH_DST + chan * VEC_SIZE);
+}
+
+
+/**
+ * Emit code for one instruction.  Returns GL_FALSE if the instruction
+ * can't be compiled.
+ */
+static GLboolean
+emit_instruction( struct vp_sse_compile *cp,
+		  const struct prog_instruction *inst )
+{
+   const GLuint nr_args = _mesa_num_inst_src_regs(inst->Opcode);
+   GLboolean scalar = GL_FALSE;
+   GLuint i;
+
+   if (inst->CondUpdate ||
+       inst->DstReg.CondMask != COND_TR ||
+       inst->DstReg.RelAddr)
+      return GL_FALSE;
+
+   if (_mesa_num_inst_dst_regs(inst->Opcode)) {
+      switch (inst->DstReg.File) {
+      case PROGRAM_TEMPORARY:
+	 if (inst->DstReg.Index >= MAX_PROGRAM_TEMPS)
+	    return GL_FALSE;
+	 break;
+      case PROGRAM_OUTPUT:
+	 if (inst->DstReg.Index >= VERT_RESULT_MAX)
+	    return GL_FALSE;
+	 break;
+      case PROGRAM_WRITE_ONLY:
+	 break;
+      default:
+	 return GL_FALSE;
+      }
+   }
+
+   for (i = 0; i < nr_args && i < 3; i++) {
+      if (!src_offset(cp, &inst->SrcReg[i], &cp->src_offset[i]))
+	 return GL_FALSE;
+   }
+
+   switch (inst->Opcode) {
+   case OPCODE_NOP:
+   case OPCODE_END:
+      return GL_TRUE;
+
+   case OPCODE_MOV:
+   case OPCODE_SWZ:
+      for (i = 0; i < 4; i++) {
+	 if (inst->DstReg.WriteMask & (1 << i))
+	    emit_fetch(cp, inst, 0, i, 4 + i);
+      }
+      break;
+
+   case OPCODE_ABS:
+      for (i = 0; i < 4; i++) {
+	 if (inst->DstReg.WriteMask & (1 << i)) {
+	    emit_fetch(cp, inst, 0, i, 4 + i);
+	    sse_mem(cp, SSE_ANDPS, 4 + i, STATE_OFFSET(abs));
+	 }
+      }
+      break;
+
+   case OPCODE_ADD:
+      emit_binary(cp, inst, SSE_ADDPS);
+      break;
+   case OPCODE_SUB:
+      emit_binary(cp, inst, SSE_SUBPS);
+      break;
+   case OPCODE_MUL:
+      emit_binary(cp, inst, SSE_MULPS);
+      break;
+   case OPCODE_MIN:
+      emit_binary(cp, inst, SSE_MINPS);
+      break;
+   case OPCODE_MAX:
+      emit_binary(cp, inst, SSE_MAXPS);
+      break;
+
+   case OPCODE_MAD:
+      for (i = 0; i < 4; i++) {
+	 if (inst->DstReg.WriteMask & (1 << i)) {
+	    emit_fetch(cp, inst, 0, i, 4 + i);
+	    emit_fetch(cp, inst, 1, i, 0);
+	    sse_reg(cp, SSE_MULPS, 4 + i, 0);
+	    emit_fetch(cp, inst, 2, i, 0);
+	    sse_reg(cp, SSE_ADDPS, 4 + i, 0);
+	 }
+      }
+      break;
+
+   case OPCODE_SEQ:
+      emit_set(cp, inst, CC_EQ, GL_FALSE);
+      break;
+   case OPCODE_SNE:
+      emit_set(cp, inst, CC_NEQ, GL_FALSE);
+      break;
+   case OPCODE_SLT:
+      emit_set(cp, inst, CC_LT, GL_FALSE);
+      break;
+   case OPCODE_SLE:
+      emit_set(cp, inst, CC_LE, GL_FALSE);
+      break;
+   case OPCODE_SGT:
+      emit_set(cp, inst, CC_LT, GL_TRUE);
+      break;
+   case OPCODE_SGE:
+      emit_set(cp, inst, CC_LE, GL_TRUE);
+      break;
+
+   case OPCODE_DP2:
+      emit_dot(cp, inst, 2);
+      scalar = GL_TRUE;
+      break;
+   case OPCODE_DP3:
+      emit_dot(cp, inst, 3);
+      scalar = GL_TRUE;
+      break;
+   case OPCODE_DP4:
+      emit_dot(cp, inst, 4);
+      scalar = GL_TRUE;
+      break;
+   case OPCODE_DPH:
+      emit_dot(cp, inst, 3);
+      emit_fetch(cp, inst, 1, 3, 0);
+      sse_reg(cp, SSE_ADDPS, 4, 0);
+      scalar = GL_TRUE;
+      break;
+
+   case OPCODE_RCP:
+      emit_fetch(cp, inst, 0, 0, 4);
+      sse_mem(cp, SSE_MOVAPS_LOAD, 0, STATE_OFFSET(one));
+      sse_reg(cp, SSE_DIVPS, 0, 4);
+      sse_reg(cp, SSE_MOVAPS_LOAD, 4, 0);
+      scalar = GL_TRUE;
+      break;
+
+   case OPCODE_RSQ:
+      emit_fetch(cp, inst, 0, 0, 4);
+      sse_mem(cp, SSE_ANDPS, 4, STATE_OFFSET(abs));
+      emit_rsq(cp);
+      scalar = GL_TRUE;
+      break;
+
+   case OPCODE_DST:
+      sse_mem(cp, SSE_MOVAPS_LOAD, 4, STATE_OFFSET(one));
+      emit_fetch(cp, inst, 0, 1, 5);
+      emit_fetch(cp, inst, 1, 1, 0);
+      sse_reg(cp, SSE_MULPS, 5, 0);
+      emit_fetch(cp, inst, 0, 2, 6);
+      emit_fetch(cp, inst, 1, 3, 7);
+      break;
+
+   case OPCODE_XPD:
+      emit_cross(cp, inst, 4, 1, 2);
+      emit_cross(cp, inst, 5, 2, 0);
+      emit_cross(cp, inst, 6, 0, 1);
+      sse_mem(cp, SSE_MOVAPS_LOAD, 7, STATE_OFFSET(one));
+      break;
+
+   case OPCODE_NRM3:
+      emit_normalize(cp, inst, 3);
+      break;
+   case OPCODE_NRM4:
+      emit_normalize(cp, inst, 4);
+      break;
+
+   case OPCODE_EX2:
+      emit_helper(cp, inst, 1, 1, helper_ex2);
+      break;
+   case OPCODE_LG2:
+      emit_helper(cp, inst, 1, 1, helper_lg2);
+      break;
+   case OPCODE_POW:
+      emit_helper(cp, inst, 2, 1, helper_pow);
+      break;
+   case OPCODE_LIT:
+      emit_helper(cp, inst, 1, 4, helper_lit);
+      break;
+   case OPCODE_EXP:
+      emit_helper(cp, inst, 1, 1, helper_exp);
+      break;
+   case OPCODE_LOG:
+      emit_helper(cp, inst, 1, 1, helper_log);
+      break;
+   case OPCODE_FLR:
+      emit_helper(cp, inst, 1, 4, helper_flr);
+      break;
+   case OPCODE_FRC:
+      emit_helper(cp, inst, 1, 4, helper_frc);
+      break;
+
+   default:
+      return GL_FALSE;
+   }
+
+   emit_store(cp, inst, scalar);
+   return GL_TRUE;
+}
+
+
+static void
+delete_code( GLcontext *ctx, void *data )
+{
+   struct vp_sse_program *code = (struct vp_sse_program *) data;
+
+   if (code->store)
+      _mesa_exec_free(code->store);
+   if (code->state)
+      ALIGN_FREE(code->state);
+   _mesa_free(code->params);
+   _mesa_free(code);
+}
+
+
+/**
+ * Compile program.  If it can't be compiled the returned code has a NULL
+ * func, which is cached just the same so we don't try again.
+ */
+static struct vp_sse_program *
+compile_program( GLcontext *ctx, const struct gl_vertex_program *program )
+{
+   const GLuint nr_insts = program->Base.NumInstructions;
+   struct vp_sse_compile cp;
+   struct vp_sse_program *code;
+   GLubyte *buffer = NULL;
+   GLuint i, size;
+
+   code = CALLOC_STRUCT(vp_sse_program);
+   if (!code)
+      return NULL;
+
+   if (program->IsNVProgram || program->Base.NumAddressRegs || nr_insts == 0)
+      return code;
+
+   /* Generate into a scratch buffer, then copy just what was used into
+    * executable memory.
+    */
+   code->params = (struct vp_sse_param *)
+      _mesa_malloc(3 * nr_insts * sizeof(struct vp_sse_param));
+   buffer = (GLubyte *) _mesa_malloc(nr_insts * MAX_INST_SIZE + 16);
+   if (!code->params || !buffer)
+      goto fail;
+
+   cp.program = program;
+   cp.code = code;
+   cp.csr = buffer;
+
+   emit_1ub(&cp, 0x53);		/* push rbx */
+   emit_1ub(&cp, 0x48);		/* mov rbx, rdi */
+   emit_1ub(&cp, 0x89);
+   emit_1ub(&cp, 0xfb);
+
+   for (i = 0; i < nr_insts; i++) {
+      const struct prog_instruction *inst = &program->Base.Instructions[i];
+      const GLubyte *start = cp.csr;
+
+      if (inst->Opcode == OPCODE_END)
+	 break;
+
+      if (!emit_instruction(&cp, inst))
+	 goto fail;
+
+      assert(cp.csr - start <= MAX_INST_SIZE);
+      (void) start;
+   }
+
+   emit_1ub(&cp, 0x5b);		/* pop rbx */
+   emit_1ub(&cp, 0xc3);		/* ret */
+
+   size = cp.csr - buffer;
+   code->store = (GLubyte *) _mesa_exec_malloc(size);
+   code->state = (struct vp_sse_state *)
+      ALIGN_MALLOC(STATE_OFFSET(params) + code->nr_params * REG_SIZE, 16);
+   if (!code->store || !code->state)
+      goto fail;
+
+   _mesa_memcpy(code->store, buffer, size);
+   _mesa_free(buffer);
+
+   _mesa_memset(code->state, 0, STATE_OFFSET(params));
+   for (i = 0; i < 4; i++) {
+      code->state->one[i] = 1.0F;
+      code->state->sign[i] = 0x80000000;
+      code->state->abs[i] = 0x7fffffff;
+   }
+
+   code->func = (void (*)( struct vp_sse_state * )) code->store;
+   return code;
+
+ fail:
+   if (code->store)
+      _mesa_exec_free(code->store);
+   if (code->state)
+      ALIGN_FREE(code->state);
+   _mesa_free(code->params);
+   _mesa_free(buffer);
+   code->store = NULL;
+   code->state = NULL;
+   code->params = NULL;
+   code->nr_params = 0;
+   return code;
+}
+
+
+static struct vp_sse_program *
+lookup_program( GLcontext *ctx, struct gl_program_cache *cache,
+		struct gl_vertex_program *program )
+{
+   struct {
+      struct gl_vertex_program *program;
+      GLuint serial;
+   } key;
+   struct vp_sse_program *code;
+   struct gl_program *ref = NULL;
+
+   /* The serial changes with the program string, also when another
+    * context sharing the program loads it.
+    */
+   _mesa_memset(&key, 0, sizeof(key));
+   key.program = program;
+   key.serial = _tnl_program_serial(program);
+
+   code = (struct vp_sse_program *)
+      _mesa_search_program_cache_data(cache, &key, sizeof(key));
+   if (code)
+      return code;
+
+   code = compile_program(ctx, program);
+   if (!code)
+      return NULL;
+
+   /* Hold a reference so the key can't be reused by another program.
+    */
+   _mesa_reference_program(ctx, &ref, &program->Base);
+   _mesa_program_cache_insert_data(ctx, cache, &key, sizeof(key),
+				   ref, code, delete_code);
+   return code;
+}
+
+
+/**
+ * Splat the current value of each constant register into the state.
+ */
+static void
+load_params( GLcontext *ctx, const struct gl_vertex_program *program,
+	     struct vp_sse_program *code )
+{
+   GLuint i, c;
+
+   for (i = 0; i < code->nr_params; i++) {
+      const GLuint index = code->params[i].index;
+      GLfloat (*reg)[4] = code->state->params[i];
+      const GLfloat *value;
+
+      switch (code->params[i].file) {
+      case PROGRAM_LOCAL_PARAM:
+	 value = program->Base.LocalParams[index];
+	 break;
+      case PROGRAM_ENV_PARAM:
+	 value = ctx->VertexProgram.Parameters[index];
+	 break;
+      default:
+	 value = program->Base.Parameters->ParameterValues[index];
+	 break;
+      }
+
+      for (c = 0; c < 4; c++)
+	 reg[c][0] = reg[c][1] = reg[c][2] = reg[c][3] = value[c];
+   }
+}
+
+
+/**
+ * Run the program for all vertices in the VB, writing the outputs to
+ * results.  Returns GL_FALSE if the program couldn't be compiled, in
+ * which case nothing has been done.
+ */
+GLboolean
+_tnl_sse_run_vertex_program( GLcontext *ctx, struct gl_program_cache *cache,
+			     struct gl_vertex_program *program,
+			     GLvector4f *results )
+{
+   struct vertex_buffer *VB = &TNL_CONTEXT(ctx)->vb;
+   const GLbitfield inputs = program->Base.InputsRead;
+   const GLbitfield outputs = program->Base.OutputsWritten;
+   struct vp_sse_program *code;
+   struct vp_sse_state *state;
+   GLuint i, n, attr, lane, c;
+
+   code = lookup_program(ctx, cache, program);
+   if (!code || !code->func)
+      return GL_FALSE;
+
+   state = code->state;
+   load_params(ctx, program, code);
+
+   for (i = 0; i < VB->Count; i += n) {
+      n = MIN2(VB->Count - i, 4);
+
+      /* Gather four vertices' inputs, repeating the first one if there
+       * are fewer than four left.
+       */
+      for (attr = 0; attr < VERT_ATTRIB_MAX; attr++) {
+	 if (inputs & (1 << attr)) {
+	    const GLvector4f *vec = VB->AttribPtr[attr];
+	    const GLubyte *ptr = (const GLubyte *) vec->data + i * vec->stride;
+	    GLfloat (*reg)[4] = state->inputs[attr];
+
+	    for (lane = 0; lane < 4; lane++) {
+	       const GLfloat *data = (const GLfloat *)
+		  (ptr + (lane < n ? lane : 0) * vec->stride);
+	       GLfloat v[4];
+
+	       COPY_CLEAN_4V(v, vec->size, data);
+	       reg[0][lane] = v[0];
+	       reg[1][lane] = v[1];
+	       reg[2][lane] = v[2];
+	       reg[3][lane] = v[3];
+	    }
+	 }
+      }
+
+      for (attr = 0; attr < VERT_RESULT_MAX; attr++) {
+	 if (outputs & (1 << attr)) {
+	    GLfloat (*reg)[4] = state->outputs[attr];
+
+	    for (lane = 0; lane < 4; lane++) {
+	       reg[0][lane] = reg[1][lane] = reg[2][lane] = 0.0F;
+	       reg[3][lane] = 1.0F;
+	    }
+	 }
+      }
+
+      code->func(state);
+
+      for (attr = 0; attr < VERT_RESULT_MAX; attr++) {
+	 if (outputs & (1 << attr)) {
+	    GLfloat (*reg)[4] = state->outputs[attr];
+	    GLfloat (*data)[4] = results[attr].data + i;
+
+	    for (lane = 0; lane < n; lane++)
+	       for (c = 0; c < 4; c++)
+		  data[lane][c] = reg[c][lane];
+	 }
+      }
+   }
+
+   return GL_TRUE;
+}
+
+
+#else
+
+
+GLboolean
+_tnl_sse_run_vertex_program( GLcontext *ctx, struct gl_program_cache *cache,
+			     struct gl_vertex_program *program,
+			     GLvector4f *results )
+{
+   /* Dummy version for when USE_X86_64_ASM not defined */
+   return GL_FALSE;
+}
+
+
+#endif
@@ -37,6 +37,7 @@
 
 #include "t_context.h"
 #include "t_pipeline.h"
+#include "t_threads.h"
 
 
 
@@ -119,42 +120,55 @@ static void (*(usercliptab[5]))( GLcontext *,
 
 
 
-static GLboolean run_vertex_stage( GLcontext *ctx,
-				   struct tnl_pipeline_stage *stage )
+/* Results for one chunk of the VB, written through views of the
+ * stage's vectors.
+ */
+struct vertex_chunk {
+   GLvector4f eye;
+   GLvector4f clip;
+   GLvector4f proj;
+   GLvector4f *ndc;
+   GLubyte ormask;
+   GLubyte andmask;
+};
+
+struct vertex_chunk_job {
+   struct vertex_stage_data *store;
+   GLvector4f *obj;
+   const GLmatrix *modelview;	/* NULL if eye coords aren't needed */
+   GLboolean ndc;
+   struct vertex_chunk chunk[TNL_MAX_CHUNKS];
+};
+
+
+static void transform_chunk( GLcontext *ctx, void *data, GLuint chunk,
+			     GLuint start, GLuint count )
 {
-   struct vertex_stage_data *store = (struct vertex_stage_data *)stage->privatePtr;
-   TNLcontext *tnl = TNL_CONTEXT(ctx);
-   struct vertex_buffer *VB = &tnl->vb;
+   struct vertex_chunk_job *job = (struct vertex_chunk_job *)data;
+   struct vertex_stage_data *store = job->store;
+   struct vertex_chunk *c = &job->chunk[chunk];
+   GLvector4f obj, *clip;
 
-   if (ctx->VertexProgram._Current) 
-      return GL_TRUE;
+   _tnl_vector4f_chunk( &obj, job->obj, start, count );
 
-   if (ctx->_NeedEyeCoords) {
-      /* Separate modelview transformation:
-       * Use combined ModelProject to avoid some depth artifacts
-       */
-      if (ctx->ModelviewMatrixStack.Top->type == MATRIX_IDENTITY)
-	 VB->EyePtr = VB->ObjPtr;
-      else
-	 VB->EyePtr = TransformRaw( &store->eye,
-				    ctx->ModelviewMatrixStack.Top,
-				    VB->ObjPtr);
+   if (job->modelview) {
+      _tnl_vector4f_chunk( &c->eye, &store->eye, start, count );
+      (void) TransformRaw( &c->eye, job->modelview, &obj );
    }
 
-   VB->ClipPtr = TransformRaw( &store->clip,
-			       &ctx->_ModelProjectMatrix,
-			       VB->ObjPtr );
+   _tnl_vector4f_chunk( &c->clip, &store->clip, start, count );
+   clip = TransformRaw( &c->clip, &ctx->_ModelProjectMatrix, &obj );
 
    /* Drivers expect this to be clean to element 4...
     */
-   switch (VB->ClipPtr->size) {
+   switch (clip->size) {
    case 1:			
       /* impossible */
    case 2:
-      _mesa_vector4f_clean_elem( VB->ClipPtr, VB->Count, 2 );
+      _mesa_vector4f_clean_elem( clip, count, 2 );
       /* fall-through */
    case 3:
-      _mesa_vector4f_clean_elem( VB->ClipPtr, VB->Count, 3 );
+      _mesa_vector4f_clean_elem( clip, count, 3 );
       /* fall-through */
    case 4:
       break;
@@ -164,24 +178,82 @@ static GLboolean run_vertex_stage( GLcontext *ctx,
    /* Cliptest and perspective divide.  Clip functions must clear
     * the clipmask.
     */
-   store->ormask = 0;
-   store->andmask = CLIP_FRUSTUM_BITS;
-
-   if (tnl->NeedNdcCoords) {
-      VB->NdcPtr =
-	 _mesa_clip_tab[VB->ClipPtr->size]( VB->ClipPtr,
-					    &store->proj,
-					    store->clipmask,
-					    &store->ormask,
-					    &store->andmask );
+   c->ormask = 0;
+   c->andmask = CLIP_FRUSTUM_BITS;
+
+   if (job->ndc) {
+      _tnl_vector4f_chunk( &c->proj, &store->proj, start, count );
+      c->ndc = _mesa_clip_tab[clip->size]( clip,
+					   &c->proj,
+					   store->clipmask + start,
+					   &c->ormask,
+					   &c->andmask );
    }
    else {
+      c->ndc = NULL;
+      _mesa_clip_np_tab[clip->size]( clip,
+				     NULL,
+				     store->clipmask + start,
+				     &c->ormask,
+				     &c->andmask );
+   }
+}
+
+
+static GLboolean run_vertex_stage( GLcontext *ctx,
+				   struct tnl_pipeline_stage *stage )
+{
+   struct vertex_stage_data *store = (struct vertex_stage_data *)stage->privatePtr;
+   TNLcontext *tnl = TNL_CONTEXT(ctx);
+   struct vertex_buffer *VB = &tnl->vb;
+   struct vertex_chunk_job job;
+   GLuint nr_chunks, i;
+
+   if (ctx->VertexProgram._Current) 
+      return GL_TRUE;
+
+   job.store = store;
+   job.obj = VB->ObjPtr;
+   job.modelview = NULL;
+   job.ndc = tnl->NeedNdcCoords;
+
+   if (ctx->_NeedEyeCoords) {
+      /* Separate modelview transformation:
+       * Use combined ModelProject to avoid some depth artifacts
+       */
+      if (ctx->ModelviewMatrixStack.Top->type == MATRIX_IDENTITY)
+	 VB->EyePtr = VB->ObjPtr;
+      else
+	 job.modelview = ctx->ModelviewMatrixStack.Top;
+   }
+
+   /* Transform, cliptest and divide are per-vertex, so large VBs are
+    * split up between the worker threads.
+    */
+   nr_chunks = _tnl_chunk_count( ctx, VB->Count );
+   _tnl_run_chunks( ctx, VB->Count, nr_chunks, transform_chunk, &job );
+
+   if (job.modelview)
+      VB->EyePtr = _tnl_vector4f_join( &store->eye, &job.chunk[0].eye,
+				       VB->ObjPtr->count );
+
+   VB->ClipPtr = _tnl_vector4f_join( &store->clip, &job.chunk[0].clip,
+				     VB->ObjPtr->count );
+
+   if (!job.ndc)
       VB->NdcPtr = NULL;
-      _mesa_clip_np_tab[VB->ClipPtr->size]( VB->ClipPtr,
-					    NULL,
-					    store->clipmask,
-					    &store->ormask,
-					    &store->andmask );
+   else if (job.chunk[0].ndc == &job.chunk[0].proj)
+      VB->NdcPtr = _tnl_vector4f_join( &store->proj, &job.chunk[0].proj,
+				       VB->ClipPtr->count );
+   else
+      VB->NdcPtr = VB->ClipPtr;
+
+   store->ormask = 0;
+   store->andmask = CLIP_FRUSTUM_BITS;
+
+   for (i = 0; i < nr_chunks; i++) {
+      store->ormask |= job.chunk[i].ormask;
+      store->andmask &= job.chunk[i].andmask;
    }
 
    if (store->andmask)
@@ -82,6 +82,16 @@ struct vbo_save_vertex_list {
 
    struct vbo_save_vertex_store *vertex_store;
    struct vbo_save_primitive_store *prim_store;
+
+   /* Lists merged at glEndList (see vbo_merge_vertex_lists) own their
+    * prims and draw them through an index buffer.  seq_prim are the
+    * original primitives, non-indexed, for loopback and for unfilled
+    * polygons, where converted strips would pick up edge flags.
+    */
+   struct gl_buffer_object *index_obj;
+   GLuint index_count;
+   struct _mesa_prim *seq_prim;
+   GLuint seq_prim_count;
 };
 
 /* These buffers should be a reasonable size to support upload to
@@ -97,6 +107,7 @@ struct vbo_save_vertex_list {
 #define VBO_SAVE_BUFFER_SIZE (8*1024) /* dwords */
 #define VBO_SAVE_PRIM_SIZE   128
 #define VBO_SAVE_PRIM_WEAK 0x40
+#define VBO_SAVE_MERGE_SIZE  (64*1024) /* vertices, indices are GLushort */
 
 #define VBO_SAVE_FALLBACK    0x10000000
 
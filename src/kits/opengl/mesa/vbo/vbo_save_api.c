@@ -286,6 +286,11 @@ static void _save_compile_vertex_list( GLcontext *ctx )
    node->vertex_store = save->vertex_store;
    node->prim_store = save->prim_store;
 
+   node->index_obj = NULL;
+   node->index_count = 0;
+   node->seq_prim = NULL;
+   node->seq_prim_count = 0;
+
    node->vertex_store->refcount++;
    node->prim_store->refcount++;
 
@@ -1120,6 +1125,269 @@ void vbo_save_EndCallList( GLcontext *ctx )
 }
 
 
+/* Can 'node' be merged into a list with the format of 'first'?  Only
+ * self-contained lists are, so no vertices need copying between them.
+ */
+static GLboolean vbo_can_merge_vertex_list( const struct vbo_save_vertex_list *first,
+                                            const struct vbo_save_vertex_list *node )
+{
+   GLuint i;
+
+   if (!node->prim_store ||
+       node->count == 0 ||
+       node->wrap_count != 0 ||
+       node->vertex_size != first->vertex_size ||
+       memcmp(node->attrsz, first->attrsz, sizeof(node->attrsz)) != 0)
+      return GL_FALSE;
+
+   for (i = 0 ; i < node->prim_count ; i++) 
+      if (!node->prim[i].begin || !node->prim[i].end)
+	 return GL_FALSE;
+
+   return GL_TRUE;
+}
+
+
+/* Vertices per primitive of the independent primitive types, 0 for
+ * the others.
+ */
+static GLuint vbo_prim_unit( GLenum mode )
+{
+   switch (mode) {
+   case GL_POINTS: return 1;
+   case GL_LINES: return 2;
+   case GL_TRIANGLES: return 3;
+   case GL_QUADS: return 4;
+   default: return 0;
+   }
+}
+
+
+/* Strips and fans become triangles, unless edge flags are per-vertex:
+ * independent triangles honour them, strips don't.
+ */
+static GLboolean vbo_convert_prim( const struct vbo_save_vertex_list *node,
+                                   const struct _mesa_prim *prim )
+{
+   return (!prim->weak &&
+	   !node->attrsz[VBO_ATTRIB_EDGEFLAG] &&
+	   (prim->mode == GL_TRIANGLE_STRIP ||
+	    prim->mode == GL_TRIANGLE_FAN));
+}
+
+
+static GLuint vbo_merged_index_count( const struct vbo_save_vertex_list *node,
+                                      const struct _mesa_prim *prim )
+{
+   if (vbo_convert_prim( node, prim ))
+      return prim->count < 3 ? 0 : (prim->count - 2) * 3;
+   else if (!prim->weak && vbo_prim_unit( prim->mode ))
+      return prim->count - prim->count % vbo_prim_unit( prim->mode );
+   else
+      return prim->count;
+}
+
+
+/* Write the indices of one primitive, relative to vertex 'base'.
+ * Triangles keep their winding and provoking (last) vertex.
+ */
+static GLuint vbo_emit_merged_indices( const struct vbo_save_vertex_list *node,
+                                       const struct _mesa_prim *prim,
+                                       GLuint base,
+                                       GLushort *elts )
+{
+   const GLuint nr = vbo_merged_index_count( node, prim );
+   const GLuint start = base + prim->start;
+   GLuint i;
+
+   if (!vbo_convert_prim( node, prim )) {
+      for (i = 0 ; i < nr ; i++)
+	 elts[i] = (GLushort) (start + i);
+   }
+   else if (prim->mode == GL_TRIANGLE_STRIP) {
+      for (i = 0 ; i + 2 < prim->count ; i++) {
+	 elts[i*3+0] = (GLushort) (start + i + (i & 1));
+	 elts[i*3+1] = (GLushort) (start + i + 1 - (i & 1));
+	 elts[i*3+2] = (GLushort) (start + i + 2);
+      }
+   }
+   else {
+      for (i = 0 ; i + 2 < prim->count ; i++) {
+	 elts[i*3+0] = (GLushort) start;
+	 elts[i*3+1] = (GLushort) (start + i + 1);
+	 elts[i*3+2] = (GLushort) (start + i + 2);
+      }
+   }
+
+   return nr;
+}
+
+
+/**
+ * Display list Merge callback: combine adjacent vertex lists with the
+ * same vertex format into one vertex buffer drawn with one index buffer.
+ * Complete triangle strips and fans are turned into triangles and runs
+ * of independent primitives of the same type are joined, so a typical
+ * mesh becomes a single indexed primitive.
+ */
+static GLuint vbo_merge_vertex_lists( GLcontext *ctx, void *dst,
+                                      void **src, GLuint count )
+{
+   struct vbo_save_vertex_list **lists = (struct vbo_save_vertex_list **) src;
+   struct vbo_save_vertex_list *node = (struct vbo_save_vertex_list *) dst;
+   const struct vbo_save_vertex_list *first = lists[0];
+   struct vbo_save_vertex_store *store = NULL;
+   struct gl_buffer_object *index_obj = NULL;
+   struct _mesa_prim *prim = NULL, *seq_prim = NULL;
+   GLfloat *vertices = NULL;
+   GLushort *elts = NULL;
+   GLuint nr_lists, nr_verts = 0, nr_prims = 0, nr_elts = 0;
+   GLuint nr_out = 0, base = 0, pos = 0;
+   GLuint i, j;
+
+   for (nr_lists = 0 ; nr_lists < count ; nr_lists++) {
+      const struct vbo_save_vertex_list *list = lists[nr_lists];
+
+      if (!vbo_can_merge_vertex_list( first, list ) ||
+	  nr_verts + list->count > VBO_SAVE_MERGE_SIZE)
+	 break;
+
+      nr_verts += list->count;
+      nr_prims += list->prim_count;
+      for (i = 0 ; i < list->prim_count ; i++)
+	 nr_elts += vbo_merged_index_count( list, &list->prim[i] );
+   }
+
+   if (nr_lists < 2 || nr_elts == 0)
+      return 0;
+
+   vertices = (GLfloat *) MALLOC( nr_verts * first->vertex_size * sizeof(GLfloat) );
+   elts = (GLushort *) MALLOC( nr_elts * sizeof(GLushort) );
+   prim = (struct _mesa_prim *) MALLOC( nr_prims * sizeof(struct _mesa_prim) );
+   seq_prim = (struct _mesa_prim *) MALLOC( nr_prims * sizeof(struct _mesa_prim) );
+   store = CALLOC_STRUCT(vbo_save_vertex_store);
+   if (!vertices || !elts || !prim || !seq_prim || !store)
+      goto fail;
+
+   for (i = 0 ; i < nr_lists ; i++) {
+      const struct vbo_save_vertex_list *list = lists[i];
+      const GLuint size = list->count * list->vertex_size * sizeof(GLfloat);
+      const char *buffer;
+
+      buffer = ctx->Driver.MapBuffer( ctx, GL_ARRAY_BUFFER_ARB, GL_READ_ONLY,
+				      list->vertex_store->bufferobj );
+      if (!buffer)
+	 goto fail;
+      memcpy( (char *) vertices + base * list->vertex_size * sizeof(GLfloat),
+	      buffer + list->buffer_offset, size );
+      ctx->Driver.UnmapBuffer( ctx, GL_ARRAY_BUFFER_ARB,
+			       list->vertex_store->bufferobj );
+
+      for (j = 0 ; j < list->prim_count ; j++) {
+	 const struct _mesa_prim *p = &list->prim[j];
+	 const GLboolean convert = vbo_convert_prim( list, p );
+	 const GLenum mode = convert ? GL_TRIANGLES : p->mode;
+	 const GLboolean joinable = !p->weak && vbo_prim_unit( mode );
+	 const GLuint nr = vbo_emit_merged_indices( list, p, base, elts + pos );
+
+	 if (nr_out > 0 && joinable &&
+	     !prim[nr_out-1].weak &&
+	     prim[nr_out-1].mode == mode) {
+	    prim[nr_out-1].count += nr;
+	 }
+	 else {
+	    prim[nr_out].mode = mode;
+	    prim[nr_out].indexed = 1;
+	    prim[nr_out].begin = 1;
+	    prim[nr_out].end = 1;
+	    prim[nr_out].weak = p->weak;
+	    prim[nr_out].pad = 0;
+	    prim[nr_out].start = pos;
+	    prim[nr_out].count = nr;
+	    nr_out++;
+	 }
+
+	 pos += nr;
+      }
+
+      base += list->count;
+   }
+
+   assert(pos == nr_elts);
+   assert(base == nr_verts);
+
+   /* The original primitives, relative to the merged vertex buffer */
+   base = 0;
+   nr_prims = 0;
+   for (i = 0 ; i < nr_lists ; i++) {
+      for (j = 0 ; j < lists[i]->prim_count ; j++) {
+	 seq_prim[nr_prims] = lists[i]->prim[j];
+	 seq_prim[nr_prims].start += base;
+	 nr_prims++;
+      }
+      base += lists[i]->count;
+   }
+
+   store->bufferobj = ctx->Driver.NewBufferObject( ctx, VBO_BUF_ID,
+						   GL_ARRAY_BUFFER_ARB );
+   index_obj = ctx->Driver.NewBufferObject( ctx, VBO_BUF_ID,
+					    GL_ELEMENT_ARRAY_BUFFER_ARB );
+   if (!store->bufferobj || !index_obj)
+      goto fail;
+
+   ctx->Driver.BufferData( ctx, GL_ARRAY_BUFFER_ARB,
+			   nr_verts * first->vertex_size * sizeof(GLfloat),
+			   vertices, GL_STATIC_DRAW_ARB, store->bufferobj );
+   ctx->Driver.BufferData( ctx, GL_ELEMENT_ARRAY_BUFFER_ARB,
+			   nr_elts * sizeof(GLushort),
+			   elts, GL_STATIC_DRAW_ARB, index_obj );
+   store->buffer = NULL;
+   store->used = nr_verts * first->vertex_size;
+   store->refcount = 1;
+
+   FREE( vertices );
+   FREE( elts );
+
+   _mesa_memcpy(node->attrsz, first->attrsz, sizeof(node->attrsz));
+   node->vertex_size = first->vertex_size;
+   node->buffer_offset = 0;
+   node->count = nr_verts;
+   node->wrap_count = 0;
+   node->dangling_attr_ref = GL_FALSE;
+   for (i = 0 ; i < nr_lists ; i++)
+      node->dangling_attr_ref |= lists[i]->dangling_attr_ref;
+   node->prim = prim;
+   node->prim_count = nr_out;
+   node->vertex_store = store;
+   node->prim_store = NULL;
+   node->index_obj = index_obj;
+   node->index_count = nr_elts;
+   node->seq_prim = seq_prim;
+   node->seq_prim_count = nr_prims;
+
+   /* The final vertex is the one of the last list */
+   node->current_size = lists[nr_lists-1]->current_size;
+   node->current_data = lists[nr_lists-1]->current_data;
+   lists[nr_lists-1]->current_data = NULL;
+
+   return nr_lists;
+
+ fail:
+   if (store) {
+      if (store->bufferobj)
+	 _mesa_reference_buffer_object(ctx, &store->bufferobj, NULL);
+      FREE( store );
+   }
+   if (index_obj)
+      _mesa_reference_buffer_object(ctx, &index_obj, NULL);
+   FREE( seq_prim );
+   FREE( prim );
+   FREE( elts );
+   FREE( vertices );
+   return 0;
+}
+
+
 static void vbo_destroy_vertex_list( GLcontext *ctx, void *data )
 {
    struct vbo_save_vertex_list *node = (struct vbo_save_vertex_list *)data;
@@ -1128,8 +1396,18 @@ static void vbo_destroy_vertex_list( GLcontext *ctx, void *data )
    if ( --node->vertex_store->refcount == 0 ) 
       free_vertex_store( ctx, node->vertex_store );
 
-   if ( --node->prim_store->refcount == 0 )
-      FREE( node->prim_store );
+   if (node->prim_store) {
+      if ( --node->prim_store->refcount == 0 )
+	 FREE( node->prim_store );
+   }
+   else {
+      /* merged list */
+      _mesa_reference_buffer_object(ctx, &node->index_obj, NULL);
+      FREE( node->prim );
+      FREE( node->seq_prim );
+   }
+
+   FREE( node->current_data );
 }
 
 
@@ -1139,16 +1417,18 @@ static void vbo_print_vertex_list( GLcontext *ctx, void *data )
    GLuint i;
    (void) ctx;
 
-   _mesa_printf("VBO-VERTEX-LIST, %u vertices %d primitives, %d vertsize\n",
+   _mesa_printf("VBO-VERTEX-LIST, %u vertices %d primitives, %d vertsize%s\n",
 		node->count,
 		node->prim_count,
-		node->vertex_size);
+		node->vertex_size,
+		node->index_obj ? ", merged" : "");
 
    for (i = 0 ; i < node->prim_count ; i++) {
       struct _mesa_prim *prim = &node->prim[i];
-      _mesa_printf("   prim %d: %s%s %d..%d %s %s\n",
+      _mesa_printf("   prim %d: %s%s%s %d..%d %s %s\n",
 		   i,
 		   _mesa_lookup_enum_by_nr(prim->mode),
+		   prim->indexed ? " (indexed)" : "",
 		   prim->weak ? " (weak)" : "",
 		   prim->start,
 		   prim->start + prim->count,
@@ -1192,6 +1472,8 @@ void vbo_save_api_init( struct vbo_save_context *save )
 			  vbo_save_playback_vertex_list,
 			  vbo_destroy_vertex_list,
 			  vbo_print_vertex_list );
+   _mesa_set_opcode_merge( ctx, save->opcode_vertex_list,
+			   vbo_merge_vertex_lists );
 
    ctx->Driver.NotifySaveBegin = vbo_save_NotifyBegin;
 
@@ -211,11 +211,12 @@ static void vbo_save_loopback_vertex_list( GLcontext *ctx,
 					      GL_READ_ONLY, /* ? */
 					       list->vertex_store->bufferobj);
 
+   /* Merged lists keep their original primitives for this */
    vbo_loopback_vertex_list( ctx,
 			     (const GLfloat *)(buffer + list->buffer_offset),
 			     list->attrsz,
-			     list->prim,
-			     list->prim_count,
+			     list->seq_prim ? list->seq_prim : list->prim,
+			     list->seq_prim ? list->seq_prim_count : list->prim_count,
 			     list->wrap_count,
 			     list->vertex_size);
 
@@ -274,13 +275,45 @@ void vbo_save_playback_vertex_list( GLcontext *ctx, void *data )
       if (ctx->NewState)
 	 _mesa_update_state( ctx );
 
-      vbo_context(ctx)->draw_prims( ctx, 
-				    save->inputs, 
-				    node->prim, 
-				    node->prim_count,
-				    NULL,
-				    0,	/* Node is a VBO, so this is ok */
-				    node->count - 1);
+      if (node->index_obj &&
+	  ctx->Polygon.FrontMode == GL_FILL &&
+	  ctx->Polygon.BackMode == GL_FILL) {
+	 struct _mesa_index_buffer ib;
+
+	 ib.count = node->index_count;
+	 ib.type = GL_UNSIGNED_SHORT;
+	 ib.obj = node->index_obj;
+	 ib.ptr = NULL;
+
+	 vbo_context(ctx)->draw_prims( ctx,
+				       save->inputs,
+				       node->prim,
+				       node->prim_count,
+				       &ib,
+				       0,
+				       node->count - 1);
+      }
+      else if (node->index_obj) {
+	 /* Unfilled: triangles made from strips would honour the
+	  * current edge flag, so draw the original primitives.
+	  */
+	 vbo_context(ctx)->draw_prims( ctx,
+				       save->inputs,
+				       node->seq_prim,
+				       node->seq_prim_count,
+				       NULL,
+				       0,
+				       node->count - 1);
+      }
+      else {
+	 vbo_context(ctx)->draw_prims( ctx, 
+				       save->inputs, 
+				       node->prim, 
+				       node->prim_count,
+				       NULL,
+				       0,	/* Node is a VBO, so this is ok */
+				       node->count - 1);
+      }
    }
 
    /* Copy to current?
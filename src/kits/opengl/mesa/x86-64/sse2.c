@@ -0,0 +1,554 @@
+/*
+ * Copyright 2009, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+/*
+ * SSE2 versions of the math/ transform, normal and cliptest functions
+ * for x86-64, written with compiler intrinsics.  Every vertex is handled
+ * as one xyzw register, so strided and odd sized input works the same as
+ * in the C versions.  Inputs of less than four components are loaded
+ * piecewise, since they may point into client arrays and must not be
+ * read past their end.
+ */
+
+#ifdef USE_X86_64_ASM
+
+#include <xmmintrin.h>
+
+#include "main/glheader.h"
+#include "main/macros.h"
+#include "math/m_xform.h"
+#include "x86-64.h"
+
+
+/* =============================================================
+ * Helpers
+ */
+
+static INLINE __m128
+load_2f(const GLfloat *f)
+{
+   return _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) f);
+}
+
+static INLINE __m128
+load_3f(const GLfloat *f)
+{
+   return _mm_movelh_ps(load_2f(f), _mm_load_ss(f + 2));
+}
+
+static INLINE __m128
+load_nf(const GLfloat *f, GLuint n)
+{
+   switch (n) {
+   case 1:
+      return _mm_load_ss(f);
+   case 2:
+      return load_2f(f);
+   case 3:
+      return load_3f(f);
+   default:
+      return _mm_loadu_ps(f);
+   }
+}
+
+static INLINE void
+store_nf(GLfloat *f, __m128 v, GLuint n)
+{
+   switch (n) {
+   case 1:
+      _mm_store_ss(f, v);
+      break;
+   case 2:
+      _mm_storel_pi((__m64 *) f, v);
+      break;
+   case 3:
+      _mm_storel_pi((__m64 *) f, v);
+      _mm_store_ss(f + 2, _mm_movehl_ps(v, v));
+      break;
+   default:
+      _mm_storeu_ps(f, v);
+      break;
+   }
+}
+
+/** x*x + y*y + z*z of the xyz lanes, in every lane */
+static INLINE __m128
+dot3(__m128 v)
+{
+   __m128 sq = _mm_mul_ps(v, v);
+   __m128 s = _mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1)));
+   s = _mm_add_ss(s, _mm_movehl_ps(sq, sq));
+   return _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+/** 1/sqrt(x): estimate plus one Newton-Raphson step */
+static INLINE __m128
+inv_sqrt(__m128 x)
+{
+   const __m128 half = _mm_set1_ps(0.5F);
+   const __m128 three = _mm_set1_ps(3.0F);
+   __m128 r = _mm_rsqrt_ps(x);
+   return _mm_mul_ps(_mm_mul_ps(half, r),
+                     _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(x, r), r)));
+}
+
+static const GLuint vec_size_flags[5] = {
+   0, VEC_SIZE_1, VEC_SIZE_2, VEC_SIZE_3, VEC_SIZE_4
+};
+
+
+/* =============================================================
+ * Point transformation
+ */
+
+/**
+ * Transform in_size component points by m, missing components being
+ * (0, 0, 0, 1), and keep out_size components of the result.  The
+ * matrix types only differ in which entries are known to be 0 or 1,
+ * so one kernel covers them all; in_size and out_size are constants
+ * in every caller.
+ */
+static INLINE void
+transform_points(GLvector4f *to_vec, const GLfloat m[16],
+                 const GLvector4f *from_vec, GLuint in_size, GLuint out_size)
+{
+   const GLuint stride = from_vec->stride;
+   const GLfloat *from = from_vec->start;
+   GLfloat (*to)[4] = (GLfloat (*)[4]) to_vec->start;
+   const GLuint count = from_vec->count;
+   const __m128 c0 = _mm_loadu_ps(m + 0);
+   const __m128 c1 = _mm_loadu_ps(m + 4);
+   const __m128 c2 = _mm_loadu_ps(m + 8);
+   const __m128 c3 = _mm_loadu_ps(m + 12);
+   GLuint i;
+
+   for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+      __m128 r = _mm_mul_ps(c0, _mm_set1_ps(from[0]));
+      if (in_size >= 2)
+         r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(from[1])));
+      if (in_size >= 3)
+         r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(from[2])));
+      if (in_size == 4)
+         r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(from[3])));
+      else
+         r = _mm_add_ps(r, c3);
+      store_nf(to[i], r, out_size);
+   }
+
+   to_vec->size = out_size;
+   to_vec->flags |= vec_size_flags[out_size];
+   to_vec->count = from_vec->count;
+}
+
+
+static INLINE void
+copy_points(GLvector4f *to_vec, const GLvector4f *from_vec, GLuint size)
+{
+   const GLuint stride = from_vec->stride;
+   const GLfloat *from = from_vec->start;
+   GLfloat (*to)[4] = (GLfloat (*)[4]) to_vec->start;
+   const GLuint count = from_vec->count;
+   GLuint i;
+
+   if (to_vec == from_vec)
+      return;
+
+   for (i = 0; i < count; i++, STRIDE_F(from, stride))
+      store_nf(to[i], load_nf(from, size), size);
+
+   to_vec->size = size;
+   to_vec->flags |= vec_size_flags[size];
+   to_vec->count = from_vec->count;
+}
+
+
+#define TRANSFORM(in_size, type, out_size)                              \
+static void _XFORMAPI                                                   \
+sse2_transform_points##in_size##_##type(GLvector4f *to_vec,             \
+                                        const GLfloat m[16],            \
+                                        const GLvector4f *from_vec)     \
+{                                                                       \
+   transform_points(to_vec, m, from_vec, in_size, out_size);            \
+}
+
+#define IDENTITY(in_size)                                               \
+static void _XFORMAPI                                                   \
+sse2_transform_points##in_size##_identity(GLvector4f *to_vec,           \
+                                          const GLfloat m[16],          \
+                                          const GLvector4f *from_vec)   \
+{                                                                       \
+   (void) m;                                                            \
+   copy_points(to_vec, from_vec, in_size);                              \
+}
+
+/* The output sizes match m_xform_tmp.h */
+TRANSFORM(1, general, 4)
+TRANSFORM(1, 2d, 2)
+TRANSFORM(1, 3d, 3)
+TRANSFORM(1, perspective, 4)
+IDENTITY(1)
+
+TRANSFORM(2, general, 4)
+TRANSFORM(2, 2d, 2)
+TRANSFORM(2, 3d, 3)
+TRANSFORM(2, perspective, 4)
+IDENTITY(2)
+
+TRANSFORM(3, general, 4)
+TRANSFORM(3, 2d, 3)
+TRANSFORM(3, 3d, 3)
+TRANSFORM(3, perspective, 4)
+IDENTITY(3)
+
+TRANSFORM(4, general, 4)
+TRANSFORM(4, 2d, 4)
+TRANSFORM(4, 3d, 4)
+TRANSFORM(4, perspective, 4)
+IDENTITY(4)
+
+/* The NO_ROT matrix types only scale and translate, the C versions do
+ * fewer operations than the full 4x4 kernel and stay installed.
+ */
+#define ASSIGN_XFORM_GROUP(sz)                                          \
+   _mesa_transform_tab[sz][MATRIX_GENERAL] =                            \
+      sse2_transform_points##sz##_general;                              \
+   _mesa_transform_tab[sz][MATRIX_IDENTITY] =                           \
+      sse2_transform_points##sz##_identity;                             \
+   _mesa_transform_tab[sz][MATRIX_PERSPECTIVE] =                        \
+      sse2_transform_points##sz##_perspective;                          \
+   _mesa_transform_tab[sz][MATRIX_2D] =                                 \
+      sse2_transform_points##sz##_2d;                                   \
+   _mesa_transform_tab[sz][MATRIX_3D] =                                 \
+      sse2_transform_points##sz##_3d;
+
+
+/* =============================================================
+ * Normal transformation
+ */
+
+/** Rows of the upper 3x3 of the inverse, scaled */
+static INLINE void
+normal_matrix(const GLmatrix *mat, GLfloat scale,
+              __m128 *r0, __m128 *r1, __m128 *r2)
+{
+   const GLfloat *m = mat->inv;
+
+   *r0 = _mm_setr_ps(m[0] * scale, m[4] * scale, m[8] * scale, 0.0F);
+   *r1 = _mm_setr_ps(m[1] * scale, m[5] * scale, m[9] * scale, 0.0F);
+   *r2 = _mm_setr_ps(m[2] * scale, m[6] * scale, m[10] * scale, 0.0F);
+}
+
+
+static INLINE __m128
+transform_normal(const GLfloat *from, __m128 r0, __m128 r1, __m128 r2)
+{
+   return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(from[0]), r0),
+                                _mm_mul_ps(_mm_set1_ps(from[1]), r1)),
+                     _mm_mul_ps(_mm_set1_ps(from[2]), r2));
+}
+
+
+/**
+ * Transform normals by the inverse matrix, optionally normalizing them
+ * or applying the precomputed lengths.
+ */
+static INLINE void
+transform_normals(const GLmatrix *mat, GLfloat scale, const GLvector4f *in,
+                  const GLfloat *lengths, GLvector4f *dest,
+                  GLboolean normalize)
+{
+   GLfloat (*out)[4] = (GLfloat (*)[4]) dest->start;
+   const GLfloat *from = in->start;
+   const GLuint stride = in->stride;
+   const GLuint count = in->count;
+   __m128 r0, r1, r2;
+   GLuint i;
+
+   if (!normalize) {
+      normal_matrix(mat, scale, &r0, &r1, &r2);
+      for (i = 0; i < count; i++, STRIDE_F(from, stride))
+         store_nf(out[i], transform_normal(from, r0, r1, r2), 3);
+   }
+   else if (lengths) {
+      normal_matrix(mat, scale, &r0, &r1, &r2);
+      for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+         const __m128 t = transform_normal(from, r0, r1, r2);
+         store_nf(out[i], _mm_mul_ps(t, _mm_set1_ps(lengths[i])), 3);
+      }
+   }
+   else {
+      const __m128 eps = _mm_set1_ps(1e-20F);
+      normal_matrix(mat, 1.0F, &r0, &r1, &r2);
+      for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+         const __m128 t = transform_normal(from, r0, r1, r2);
+         const __m128 len = dot3(t);
+         /* (near) zero length normals become zero */
+         const __m128 ok = _mm_cmpgt_ps(len, eps);
+         store_nf(out[i], _mm_and_ps(ok, _mm_mul_ps(t, inv_sqrt(len))), 3);
+      }
+   }
+
+   dest->count = in->count;
+}
+
+
+#define NORMALS(name, scale, normalize)                                 \
+static void _XFORMAPI                                                   \
+sse2_##name(const GLmatrix *mat, GLfloat scale_, const GLvector4f *in,  \
+            const GLfloat *lengths, GLvector4f *dest)                   \
+{                                                                       \
+   (void) scale_;                                                       \
+   transform_normals(mat, scale, in, lengths, dest, normalize);         \
+}
+
+/* As for the points, the C versions are faster for NO_ROT matrices */
+NORMALS(transform_normals, 1.0F, GL_FALSE)
+NORMALS(transform_rescale_normals, scale_, GL_FALSE)
+NORMALS(transform_normalize_normals, scale_, GL_TRUE)
+
+
+static void _XFORMAPI
+sse2_normalize_normals(const GLmatrix *mat, GLfloat scale,
+                       const GLvector4f *in, const GLfloat *lengths,
+                       GLvector4f *dest)
+{
+   GLfloat (*out)[4] = (GLfloat (*)[4]) dest->start;
+   const GLfloat *from = in->start;
+   const GLuint stride = in->stride;
+   const GLuint count = in->count;
+   GLuint i;
+
+   (void) mat;
+   (void) scale;
+
+   if (lengths) {
+      for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+         const __m128 v = load_3f(from);
+         store_nf(out[i], _mm_mul_ps(v, _mm_set1_ps(lengths[i])), 3);
+      }
+   }
+   else {
+      const __m128 zero = _mm_setzero_ps();
+      for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+         const __m128 v = load_3f(from);
+         const __m128 len = dot3(v);
+         /* zero length normals are passed through */
+         const __m128 ok = _mm_cmpgt_ps(len, zero);
+         const __m128 n = _mm_mul_ps(v, inv_sqrt(len));
+         store_nf(out[i], _mm_or_ps(_mm_and_ps(ok, n),
+                                    _mm_andnot_ps(ok, v)), 3);
+      }
+   }
+
+   dest->count = in->count;
+}
+
+
+static void _XFORMAPI
+sse2_rescale_normals(const GLmatrix *mat, GLfloat scale,
+                     const GLvector4f *in, const GLfloat *lengths,
+                     GLvector4f *dest)
+{
+   GLfloat (*out)[4] = (GLfloat (*)[4]) dest->start;
+   const GLfloat *from = in->start;
+   const GLuint stride = in->stride;
+   const GLuint count = in->count;
+   const __m128 s = _mm_set1_ps(scale);
+   GLuint i;
+
+   (void) mat;
+   (void) lengths;
+
+   for (i = 0; i < count; i++, STRIDE_F(from, stride))
+      store_nf(out[i], _mm_mul_ps(load_3f(from), s), 3);
+
+   dest->count = in->count;
+}
+
+
+/* =============================================================
+ * Clip testing
+ */
+
+/* Clip bits for the x, y and z lanes of a movemask, for the positive
+ * (right, top, far) and the negative (left, bottom, near) planes.
+ */
+static const GLubyte clip_pos_bits[8] = {
+   0,
+   CLIP_RIGHT_BIT,
+   CLIP_TOP_BIT,
+   CLIP_RIGHT_BIT | CLIP_TOP_BIT,
+   CLIP_FAR_BIT,
+   CLIP_RIGHT_BIT | CLIP_FAR_BIT,
+   CLIP_TOP_BIT | CLIP_FAR_BIT,
+   CLIP_RIGHT_BIT | CLIP_TOP_BIT | CLIP_FAR_BIT
+};
+
+static const GLubyte clip_neg_bits[8] = {
+   0,
+   CLIP_LEFT_BIT,
+   CLIP_BOTTOM_BIT,
+   CLIP_LEFT_BIT | CLIP_BOTTOM_BIT,
+   CLIP_NEAR_BIT,
+   CLIP_LEFT_BIT | CLIP_NEAR_BIT,
+   CLIP_BOTTOM_BIT | CLIP_NEAR_BIT,
+   CLIP_LEFT_BIT | CLIP_BOTTOM_BIT | CLIP_NEAR_BIT
+};
+
+
+static INLINE GLvector4f *
+cliptest_points4(GLvector4f *clip_vec, GLvector4f *proj_vec,
+                 GLubyte clipMask[], GLubyte *orMask, GLubyte *andMask,
+                 GLboolean project)
+{
+   const GLuint stride = clip_vec->stride;
+   const GLfloat *from = (GLfloat *) clip_vec->start;
+   const GLuint count = clip_vec->count;
+   GLfloat (*vProj)[4] = (GLfloat (*)[4]) proj_vec->start;
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 one = _mm_set1_ps(1.0F);
+   GLubyte tmpAndMask = *andMask;
+   GLubyte tmpOrMask = *orMask;
+   GLuint c = 0;
+   GLuint i;
+
+   for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+      const __m128 v = _mm_loadu_ps(from);
+      const __m128 w = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+      /* -c + w < 0 and c + w < 0 for c = x, y, z */
+      const int pos = _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(w, v), zero));
+      const int neg = _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(w, v), zero));
+      const GLubyte mask = clip_pos_bits[pos & 7] | clip_neg_bits[neg & 7];
+
+      clipMask[i] = mask;
+      if (mask) {
+         c++;
+         tmpAndMask &= mask;
+         tmpOrMask |= mask;
+         if (project)
+            _mm_storeu_ps(vProj[i], _mm_setr_ps(0.0F, 0.0F, 0.0F, 1.0F));
+      }
+      else if (project) {
+         const __m128 oow = _mm_div_ps(one, w);
+         /* xyz / w, 1 / w */
+         __m128 p = _mm_mul_ps(v, oow);
+         p = _mm_shuffle_ps(p, _mm_unpackhi_ps(p, oow), _MM_SHUFFLE(3, 0, 1, 0));
+         _mm_storeu_ps(vProj[i], p);
+      }
+   }
+
+   *orMask = tmpOrMask;
+   *andMask = (GLubyte) (c < count ? 0 : tmpAndMask);
+
+   if (!project)
+      return clip_vec;
+
+   proj_vec->flags |= VEC_SIZE_4;
+   proj_vec->size = 4;
+   proj_vec->count = clip_vec->count;
+   return proj_vec;
+}
+
+
+static GLvector4f * _XFORMAPI
+sse2_cliptest_points4(GLvector4f *clip_vec, GLvector4f *proj_vec,
+                      GLubyte clipMask[], GLubyte *orMask, GLubyte *andMask)
+{
+   return cliptest_points4(clip_vec, proj_vec, clipMask, orMask, andMask,
+                           GL_TRUE);
+}
+
+
+static GLvector4f * _XFORMAPI
+sse2_cliptest_np_points4(GLvector4f *clip_vec, GLvector4f *proj_vec,
+                         GLubyte clipMask[], GLubyte *orMask,
+                         GLubyte *andMask)
+{
+   return cliptest_points4(clip_vec, proj_vec, clipMask, orMask, andMask,
+                           GL_FALSE);
+}
+
+
+/**
+ * Cliptest already projected points against the unit cube.
+ */
+static INLINE GLvector4f *
+cliptest_projected(GLvector4f *clip_vec, GLubyte clipMask[],
+                   GLubyte *orMask, GLubyte *andMask, GLuint size)
+{
+   const GLuint stride = clip_vec->stride;
+   const GLfloat *from = (GLfloat *) clip_vec->start;
+   const GLuint count = clip_vec->count;
+   const __m128 one = _mm_set1_ps(1.0F);
+   const __m128 minus_one = _mm_set1_ps(-1.0F);
+   GLubyte tmpOrMask = *orMask;
+   GLubyte tmpAndMask = *andMask;
+   GLuint i;
+
+   for (i = 0; i < count; i++, STRIDE_F(from, stride)) {
+      const __m128 v = load_nf(from, size);
+      /* the unused lanes are zero and never outside */
+      const int pos = _mm_movemask_ps(_mm_cmpgt_ps(v, one));
+      const int neg = _mm_movemask_ps(_mm_cmplt_ps(v, minus_one));
+      const GLubyte mask = clip_pos_bits[pos & 7] | clip_neg_bits[neg & 7];
+
+      clipMask[i] = mask;
+      tmpOrMask |= mask;
+      tmpAndMask &= mask;
+   }
+
+   *orMask = tmpOrMask;
+   *andMask = tmpAndMask;
+   return clip_vec;
+}
+
+
+static GLvector4f * _XFORMAPI
+sse2_cliptest_points3(GLvector4f *clip_vec, GLvector4f *proj_vec,
+                      GLubyte clipMask[], GLubyte *orMask, GLubyte *andMask)
+{
+   (void) proj_vec;
+   return cliptest_projected(clip_vec, clipMask, orMask, andMask, 3);
+}
+
+
+static GLvector4f * _XFORMAPI
+sse2_cliptest_points2(GLvector4f *clip_vec, GLvector4f *proj_vec,
+                      GLubyte clipMask[], GLubyte *orMask, GLubyte *andMask)
+{
+   (void) proj_vec;
+   return cliptest_projected(clip_vec, clipMask, orMask, andMask, 2);
+}
+
+
+void
+_mesa_init_x86_64_sse2_transform(void)
+{
+   ASSIGN_XFORM_GROUP(1)
+   ASSIGN_XFORM_GROUP(2)
+   ASSIGN_XFORM_GROUP(3)
+   ASSIGN_XFORM_GROUP(4)
+
+   _mesa_normal_tab[NORM_TRANSFORM] =
+      sse2_transform_normals;
+   _mesa_normal_tab[NORM_TRANSFORM | NORM_RESCALE] =
+      sse2_transform_rescale_normals;
+   _mesa_normal_tab[NORM_TRANSFORM | NORM_NORMALIZE] =
+      sse2_transform_normalize_normals;
+   _mesa_normal_tab[NORM_RESCALE] =
+      sse2_rescale_normals;
+   _mesa_normal_tab[NORM_NORMALIZE] =
+      sse2_normalize_normals;
+
+   _mesa_clip_tab[4] = sse2_cliptest_points4;
+   _mesa_clip_tab[3] = sse2_cliptest_points3;
+   _mesa_clip_tab[2] = sse2_cliptest_points2;
+
+   _mesa_clip_np_tab[4] = sse2_cliptest_np_points4;
+   _mesa_clip_np_tab[3] = sse2_cliptest_points3;
+   _mesa_clip_np_tab[2] = sse2_cliptest_points2;
+}
+
+#endif /* USE_X86_64_ASM */
@@ -85,6 +85,7 @@ void _mesa_init_all_x86_64_transform_asm(void)
 {
 #ifdef USE_X86_64_ASM
    unsigned int regs[4];
+   GLboolean sse2 = GL_FALSE;
 
    if ( _mesa_getenv( "MESA_NO_ASM" ) ) {
      return;
@@ -92,6 +93,21 @@ void _mesa_init_all_x86_64_transform_asm(void)
 
    message("Initializing x86-64 optimizations\n");
 
+   /* SSE2 is part of x86-64, but MESA_NO_SSE still turns the intrinsic
+    * versions off for comparison.  They cover every size, the matrix and
+    * normal types other than the NO_ROT ones, and the clip functions;
+    * the asm routines below then take over the size 4 cases they handle.
+    */
+   regs[0] = 0x00000001;
+   regs[1] = 0x00000000;
+   regs[2] = 0x00000000;
+   regs[3] = 0x00000000;
+   _mesa_x86_64_cpuid(regs);
+   if ((regs[3] & (1U << 26)) && !_mesa_getenv( "MESA_NO_SSE" )) {
+      message("SSE2 detected\n");
+      _mesa_init_x86_64_sse2_transform();
+      sse2 = GL_TRUE;
+   }
 
    _mesa_transform_tab[4][MATRIX_GENERAL] =
       _mesa_x86_64_transform_points4_general;
@@ -105,7 +121,7 @@ void _mesa_init_all_x86_64_transform_asm(void)
    regs[2] = 0x00000000;
    regs[3] = 0x00000000;
    _mesa_x86_64_cpuid(regs);
-   if (regs[3] & (1U << 31)) {
+   if (!sse2 && (regs[3] & (1U << 31))) {
       message("3Dnow! detected\n");
       _mesa_transform_tab[4][MATRIX_3D_NO_ROT] =
 	  _mesa_3dnow_transform_points4_3d_no_rot;